@@ -0,0 +1,194 @@
+/**
+ * @file   arena.cpp
+ * @brief  the implementation file for Arena
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "arena.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include "heap_storage.h"
+#include "engine_stats.h"
+using namespace std;
+
+
+/**
+ * A HeapTable whose marshal the test can call directly
+ */
+class MarshalProbe : public HeapTable {
+public:
+    MarshalProbe(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+            : HeapTable(table_name, column_names, column_attributes) {}
+
+    const ValueDict *check(const ValueDict *row, ValueDict &converted) { return validate(row, converted); }
+
+    void encode(const ValueDict *row, Dbt &data) { marshal(row, 1, data); }
+};
+
+/**
+ * Testing function for Arena.
+ * Alignment, rewinding to marks and nested scopes, allocations bigger than a chunk, ArenaVector, and (with
+ * engine statistics) that validating and marshaling a row under an ArenaScope makes no heap allocation.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_arena() {
+    bool ok = true;
+    Arena arena(1024);
+    char *first = (char *) arena.allocate(3, 1);
+    double *aligned = arena.allocate_array<double>(4);
+    if ((uintptr_t) aligned % alignof(double) != 0 || (char *) aligned < first + 3) {
+        cout << "FAILED TEST: arena alignment" << endl;
+        ok = false;
+    }
+    Arena::Mark mark = arena.mark();
+    char *row = (char *) arena.allocate(100);
+    memset(row, 'x', 100);
+    char *big = (char *) arena.allocate(5000);  // more than a chunk
+    memset(big, 'y', 5000);
+    char *after_big = (char *) arena.allocate(10);
+    memset(after_big, 'z', 10);
+    size_t reserved = arena.bytes_reserved();
+    arena.rewind(mark);
+    if (arena.allocate(100) != row || arena.allocate(5000) != big || arena.bytes_reserved() != reserved) {
+        cout << "FAILED TEST: arena rewind does not reuse its chunks" << endl;
+        ok = false;
+    }
+    arena.reset();
+    if (arena.bytes_used() != 0 || arena.allocate(3, 1) != first) {
+        cout << "FAILED TEST: arena reset" << endl;
+        ok = false;
+    }
+
+    Arena huge(1024);
+    huge.allocate(Arena::RETAINED * 2);
+    huge.reset();
+    if (huge.bytes_reserved() > Arena::RETAINED) {
+        cout << "FAILED TEST: arena keeps " << huge.bytes_reserved() << " bytes after reset" << endl;
+        ok = false;
+    }
+
+    {
+        ArenaScope statement;
+        size_t before = Arena::scratch().bytes_used();
+        char *kept = (char *) statement.get_arena().allocate(16);
+        strcpy(kept, "statement");
+        for (int i = 0; i < 1000; i++) {
+            ArenaScope row_scope;
+            ArenaVector<int> values{ArenaAllocator<int>(row_scope.get_arena())};
+            for (int v = 0; v < 100; v++)
+                values.push_back(v);
+            if (values[99] != 99)
+                ok = false;
+        }
+        if (strcmp(kept, "statement") != 0 || Arena::scratch().bytes_used() != before + 16) {
+            cout << "FAILED TEST: nested arena scopes" << endl;
+            ok = false;
+        }
+    }
+
+    ColumnNames column_names = {"a", "b", "c"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT),
+                                          ColumnAttribute(ColumnAttribute::TEXT),
+                                          ColumnAttribute(ColumnAttribute::BIGINT)};
+    MarshalProbe table("_test_arena", column_names, column_attributes);
+    table.create();
+    ValueDict values;
+    values["a"] = Value(12);
+    values["b"] = Value("a value too long to fit in a std::string's own buffer");
+    values["c"] = Value(7);  // converted to a BIGINT
+    ValueDict converted;
+    const ValueDict *full_row = table.check(&values, converted);
+    if (full_row != &converted || converted["c"].data_type != ColumnAttribute::BIGINT) {
+        cout << "FAILED TEST: validate converting a value" << endl;
+        ok = false;
+    }
+    values["c"] = Value::bigint(7);
+    for (int i = 0; i < 3; i++) {
+        u_int64_t before = EngineStats::total(EngineStats::HEAP_ALLOCATIONS);
+        {
+            ArenaScope row_scope;
+            ValueDict unused;
+            full_row = table.check(&values, unused);
+            Dbt data;
+            table.encode(full_row, data);
+            if (full_row != &values || data.get_size() != VersionHeader::SIZE + 4 + 2 + values["b"].s.length() + 8) {
+                cout << "FAILED TEST: marshal in the arena" << endl;
+                ok = false;
+            }
+        }
+        u_int64_t allocations = EngineStats::total(EngineStats::HEAP_ALLOCATIONS) - before;
+        if (i > 0 && allocations != 0) {  // the first may grow the scratch arena
+            cout << "FAILED TEST: validate and marshal made " << allocations << " heap allocations" << endl;
+            ok = false;
+        }
+    }
+    table.drop();
+    return ok;
+}
+
+
+/*****************************************Arena*********************************************************************/
+
+Arena::Arena(size_t chunk_size) : chunk_size(chunk_size), current(0), used(0) {}
+
+Arena::~Arena() {
+    for (auto const &chunk: this->chunks)
+        delete[] chunk.bytes;
+}
+
+// the current chunk is full: continue in the first free chunk big enough, or a new one
+void *Arena::allocate_in_next_chunk(size_t size) {
+    size_t next = this->chunks.empty() ? 0 : this->current + 1;
+    size_t found = next;
+    while (found < this->chunks.size() && this->chunks[found].size < size)
+        found++;
+    if (found < this->chunks.size()) {
+        swap(this->chunks[next], this->chunks[found]);
+    } else {
+        Chunk chunk;
+        chunk.size = size > this->chunk_size ? size : this->chunk_size;
+        chunk.bytes = new char[chunk.size];  // aligned for any type
+        this->chunks.insert(this->chunks.begin() + next, chunk);
+    }
+    this->current = next;
+    this->used = size;
+    return this->chunks[next].bytes;
+}
+
+void Arena::rewind(const Mark &mark) {
+    size_t before = bytes_used();
+    this->current = mark.chunk;
+    this->used = mark.used;
+    STATS_COUNT(ARENA_BYTES, before - bytes_used());
+    (void) before;  // unused when the counters are compiled out
+    if (mark.chunk != 0 || mark.used != 0)
+        return;
+    // empty again: give back the chunks past RETAINED bytes (those left by an unusually big statement)
+    size_t kept = 0, c = 0;
+    while (c < this->chunks.size() && kept + this->chunks[c].size <= RETAINED)
+        kept += this->chunks[c++].size;
+    for (size_t extra = c; extra < this->chunks.size(); extra++)
+        delete[] this->chunks[extra].bytes;
+    this->chunks.resize(c);
+}
+
+size_t Arena::bytes_used() const {
+    if (this->chunks.empty())
+        return 0;
+    size_t bytes = this->used;
+    for (size_t c = 0; c < this->current; c++)
+        bytes += this->chunks[c].size;
+    return bytes;
+}
+
+size_t Arena::bytes_reserved() const {
+    size_t bytes = 0;
+    for (auto const &chunk: this->chunks)
+        bytes += chunk.size;
+    return bytes;
+}
+
+Arena &Arena::scratch() {
+    static thread_local Arena arena;
+    return arena;
+}
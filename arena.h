@@ -0,0 +1,146 @@
+/**
+ * @file   arena.h
+ * @brief  Bump allocators for the temporaries of a statement or a row, freed all at once
+ *
+ * The per-row paths (HeapTable::insert marshaling a row, project reading a page for one row) used to new and
+ * delete the same few buffers for every row. Instead they take them from the thread's scratch arena, which
+ * keeps its chunks between rows and statements, so once it has grown to a row's needs a row costs no malloc.
+ *
+ * Arena: hands out memory from chunks it keeps; rewinding to a mark frees everything allocated since
+ * ArenaScope: rewinds the calling thread's scratch arena when the scope ends (a statement, a row)
+ * ArenaAllocator: standard containers whose elements live in an arena
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @class Arena - a bump allocator: allocate is a pointer increment, and nothing is freed on its own
+ *
+ *      Memory comes from chunks of at least chunk_size bytes (bigger for a bigger allocation). Rewinding to a
+ *      mark makes everything allocated after it free again; the chunks are kept for the allocations that follow,
+ *      up to RETAINED bytes of them once the arena is rewound to empty. Objects placed in an arena are not
+ *      destroyed: put only trivially destructible things there (bytes, pointers, PODs), or containers using
+ *      ArenaAllocator that are destroyed before the rewind. An arena belongs to one thread.
+ */
+class Arena {
+public:
+    static const size_t DEFAULT_CHUNK_SIZE = 128 * 1024;
+    static const size_t RETAINED = 1024 * 1024;
+
+    // a point to rewind to
+    struct Mark {
+        size_t chunk;
+        size_t used;
+    };
+
+    explicit Arena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    virtual ~Arena();
+
+    Arena(const Arena &other) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    // size bytes aligned to align (a power of two, at most alignof(std::max_align_t))
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        size_t start = (this->used + align - 1) & ~(align - 1);
+        if (this->current < this->chunks.size() && start + size <= this->chunks[this->current].size) {
+            this->used = start + size;
+            return this->chunks[this->current].bytes + start;
+        }
+        return allocate_in_next_chunk(size);
+    }
+
+    template<typename T>
+    T *allocate_array(size_t n) {
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    virtual Mark mark() const { return Mark{this->current, this->used}; }
+
+    // free everything allocated since mark was taken
+    virtual void rewind(const Mark &mark);
+
+    // free everything
+    virtual void reset() { rewind(Mark{0, 0}); }
+
+    // bytes handed out and not yet rewound (counting alignment padding and the ends of chunks skipped)
+    virtual size_t bytes_used() const;
+
+    // bytes of chunks held
+    virtual size_t bytes_reserved() const;
+
+    // the calling thread's arena, for the temporaries of whatever it is executing
+    static Arena &scratch();
+
+protected:
+    struct Chunk {
+        char *bytes;
+        size_t size;
+    };
+
+    size_t chunk_size;
+    std::vector<Chunk> chunks;
+    size_t current;  // the chunk being filled (chunks after it are free)
+    size_t used;     // bytes of it handed out
+
+    virtual void *allocate_in_next_chunk(size_t size);
+};
+
+/**
+ * @class ArenaScope - whatever the scope allocates from the thread's scratch arena is freed when it ends.
+ *      Scopes nest: a row's scope inside a statement's frees the row's temporaries and keeps the statement's.
+ */
+class ArenaScope {
+public:
+    ArenaScope() : arena(Arena::scratch()), start(arena.mark()) {}
+
+    ~ArenaScope() { this->arena.rewind(this->start); }
+
+    ArenaScope(const ArenaScope &other) = delete;
+
+    ArenaScope &operator=(const ArenaScope &other) = delete;
+
+    Arena &get_arena() { return this->arena; }
+
+protected:
+    Arena &arena;
+    Arena::Mark start;
+};
+
+/**
+ * @class ArenaAllocator - an allocator for standard containers that takes its memory from an arena and
+ *      never gives it back (a container growing in an arena leaves its old buffers there until the rewind)
+ */
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena &arena) : arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return this->arena->template allocate_array<T>(n); }
+
+    void deallocate(T *, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return this->arena == other.arena; }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return this->arena != other.arena; }
+
+    Arena *arena;
+};
+
+// a vector whose elements live in an arena
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T> >;
+
+bool test_arena();
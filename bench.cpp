@@ -0,0 +1,913 @@
+/**
+ * @file   bench.cpp
+ * @brief  Microbenchmarks for the storage layer: SlottedPage, HeapFile, HeapTable and BTreeTable
+ *
+ * Usage: ./storage_bench [--json] [--rows N] [--threads N] [envdir]
+ *      envdir defaults to ./bench_data and is created if necessary; the benchmark's files are removed
+ *      afterwards. Output is one line per benchmark (TSV with a header, or JSON lines with --json).
+ *      The concurrent benchmarks run with 1, 2, 4, ... up to --threads threads (default 8), and the group commit
+ *      benchmark with as many committers.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "db_cxx.h"
+#include "SQLParser.h"
+#include "btree_table.h"
+#include "engine_stats.h"
+#include "expr_compiler.h"
+#include "heap_storage.h"
+#include "latency_recorder.h"
+#include "typed_table.h"
+#include "wal.h"
+using namespace std;
+
+DbEnv *_DB_ENV;
+
+typedef LatencyRecorder::Clock Clock;
+
+static const uint RECORD_SIZES[] = {16, 64, 256, 1024};
+static const uint FILL_PERCENTS[] = {25, 50, 100};
+
+// fill a page with records of one size up to a percentage of its capacity; returns the record ids
+static RecordIDs fill_page(SlottedPage &page, const Dbt &record, uint fill_percent) {
+    RecordIDs ids;
+    try {
+        while (true)
+            ids.push_back(page.add(&record));
+    } catch (DbBlockNoRoomError &e) {
+    }
+    size_t keep = ids.size() * fill_percent / 100;
+    for (size_t i = keep; i < ids.size(); i++)
+        page.del(ids[i]);
+    ids.resize(keep);
+    return ids;
+}
+
+/**
+ * SlottedPage add/get/put/del on in-memory pages, per record size; get and put at several fill levels
+ * @param reporter    where results go
+ * @param target_ops  roughly how many operations to time per benchmark
+ */
+static void bench_slotted_page(BenchmarkReporter &reporter, size_t target_ops) {
+    char block[DbBlock::BLOCK_SZ];
+    for (auto size: RECORD_SIZES) {
+        char *bytes = new char[size];
+        memset(bytes, 'x', size);
+        Dbt record(bytes, size);
+        string suffix = "/size=" + to_string(size);
+
+        LatencyRecorder add, del;
+        while (add.count() < target_ops) {
+            memset(block, 0, sizeof(block));
+            Dbt data(block, sizeof(block));
+            CompactSlottedPage page(data, 1, true);
+            RecordIDs ids;
+            while (true) {
+                Clock::time_point start = Clock::now();
+                try {
+                    ids.push_back(page.add(&record));
+                } catch (DbBlockNoRoomError &e) {
+                    break;
+                }
+                add.record(start);
+            }
+            for (auto id: ids) {
+                Clock::time_point start = Clock::now();
+                page.del(id);
+                del.record(start);
+            }
+        }
+        reporter.report("slotted_page.add" + suffix, add);
+        reporter.report("slotted_page.del" + suffix, del);
+
+        for (auto fill: FILL_PERCENTS) {
+            memset(block, 0, sizeof(block));
+            Dbt data(block, sizeof(block));
+            CompactSlottedPage page(data, 1, true);
+            RecordIDs ids = fill_page(page, record, fill);
+            if (ids.empty())
+                continue;
+            LatencyRecorder get, put;
+            while (get.count() < target_ops) {
+                for (auto id: ids) {
+                    Clock::time_point start = Clock::now();
+                    Dbt *got = page.get(id);
+                    get.record(start);
+                    delete got;
+                    start = Clock::now();
+                    page.put(id, record);
+                    put.record(start);
+                }
+            }
+            string fill_suffix = suffix + "/fill=" + to_string(fill);
+            reporter.report("slotted_page.get" + fill_suffix, get);
+            reporter.report("slotted_page.put" + fill_suffix, put);
+        }
+        delete[] bytes;
+    }
+}
+
+/**
+ * HeapFile get_new, then put and get over all the blocks it made
+ */
+static void bench_heap_file(BenchmarkReporter &reporter, size_t num_blocks) {
+    HeapFile file("_bench_heap_file");
+    file.create();
+    LatencyRecorder get_new, put, get;
+    for (size_t i = 0; i < num_blocks; i++) {
+        Clock::time_point start = Clock::now();
+        SlottedPage *page = file.get_new();
+        get_new.record(start);
+        delete page;
+    }
+    BlockIDs *block_ids = file.block_ids();
+    for (auto block_id: *block_ids) {
+        Clock::time_point start = Clock::now();
+        SlottedPage *page = file.get(block_id);
+        get.record(start);
+        start = Clock::now();
+        file.put(page);
+        put.record(start);
+        delete page;
+    }
+    delete block_ids;
+    file.drop();
+    reporter.report("heap_file.get_new", get_new);
+    reporter.report("heap_file.get", get);
+    reporter.report("heap_file.put", put);
+}
+
+/**
+ * HeapTable insert, full select, selective select (compiled WHERE), and project
+ */
+static void bench_heap_table(BenchmarkReporter &reporter, size_t num_rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_bench_heap_table", column_names, column_attributes);
+    table.create();
+
+    LatencyRecorder insert, select_all, select_where, project;
+    string padding(24, 'b');
+    for (size_t i = 0; i < num_rows; i++) {
+        ValueDict row;
+        row["a"] = Value((int32_t) i);
+        row["b"] = Value(padding + to_string(i % 100));
+        Clock::time_point start = Clock::now();
+        table.insert(&row);
+        insert.record(start);
+    }
+
+    Handles *handles = nullptr;
+    for (int i = 0; i < 5; i++) {
+        delete handles;
+        Clock::time_point start = Clock::now();
+        handles = table.select();
+        select_all.record(start);
+    }
+    for (int i = 0; i < 5; i++) {
+        ValueDict where;
+        where["a"] = Value((int32_t) (i * num_rows / 5));
+        Clock::time_point start = Clock::now();
+        Handles *matches = table.select(&where);
+        select_where.record(start);
+        delete matches;
+    }
+    for (auto const &handle: *handles) {
+        Clock::time_point start = Clock::now();
+        ValueDict *row = table.project(handle);
+        project.record(start);
+        delete row;
+    }
+    delete handles;
+    table.drop();
+
+    reporter.report("heap_table.insert", insert);
+    reporter.report("heap_table.select_all/rows=" + to_string(num_rows), select_all);
+    reporter.report("heap_table.select_where/rows=" + to_string(num_rows), select_where);
+    reporter.report("heap_table.project", project);
+}
+
+/**
+ * Full scans of one table with read-ahead off, then on. The read_ahead.select_all lines time each scan; the
+ * read_ahead.hits and read_ahead.wasted lines count the blocks that the scans with it on found read ahead and the
+ * blocks read ahead for nothing (one op per block). The difference only shows once the table is bigger than
+ * Berkeley DB's cache, when a block not read ahead is a wait for the disk.
+ * @param reporter  where results go
+ * @param num_rows  rows in the table
+ */
+static void bench_read_ahead(BenchmarkReporter &reporter, size_t num_rows) {
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable table("_bench_read_ahead", column_names, column_attributes);
+    table.create();
+    string padding(100, 'r');
+    for (size_t i = 0; i < num_rows; i++) {
+        ValueDict row;
+        row["a"] = Value((int32_t) i);
+        row["b"] = Value(padding + to_string(i));
+        table.insert(&row);
+    }
+    bool was_enabled = ReadAhead::enabled();
+    for (int on = 0; on < 2; on++) {
+        ReadAhead::set_enabled(on == 1);
+        u_int64_t hits = EngineStats::total(EngineStats::PREFETCH_HITS);
+        u_int64_t wasted = EngineStats::total(EngineStats::PREFETCH_WASTED);
+        LatencyRecorder select_all;
+        Clock::time_point begin = Clock::now();
+        for (int repeat = 0; repeat < 5; repeat++) {
+            Clock::time_point start = Clock::now();
+            delete table.select();
+            select_all.record(start);
+        }
+        double seconds = chrono::duration<double>(Clock::now() - begin).count();
+        string suffix = on ? "/prefetch=on" : "/prefetch=off";
+        reporter.report("read_ahead.select_all" + suffix, select_all, seconds);
+        if (!on)
+            continue;
+        hits = EngineStats::total(EngineStats::PREFETCH_HITS) - hits;
+        wasted = EngineStats::total(EngineStats::PREFETCH_WASTED) - wasted;
+        LatencyRecorder hit, waste;
+        for (u_int64_t i = 0; i < hits; i++)
+            hit.record_ns(0);
+        for (u_int64_t i = 0; i < wasted; i++)
+            waste.record_ns(0);
+        reporter.report("read_ahead.hits", hit, seconds);
+        reporter.report("read_ahead.wasted", waste, seconds);
+    }
+    ReadAhead::set_enabled(was_enabled);
+    table.drop();
+}
+
+/**
+ * The same rows, inserted in a scrambled key order, in a HeapTable and in a BTreeTable keyed on a: point lookups
+ * (select with a = k; one op per select), and a WHERE on a 1% range of a compiled as SQLExec does, which the
+ * heap filters with a full scan and the B+tree answers from the leaves the range covers.
+ * @param reporter  where results go
+ * @param num_rows  rows in each table
+ */
+static void bench_btree(BenchmarkReporter &reporter, size_t num_rows) {
+    const int HEAP_LOOKUPS = 20, BTREE_LOOKUPS = 2000, RANGES = 10;
+    ColumnNames column_names = {"a", "b"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+    HeapTable heap("_bench_btree_heap", column_names, column_attributes);
+    BTreeTable btree("_bench_btree", column_names, column_attributes, "a");
+    DbRelation *tables[] = {&heap, &btree};
+    const char *engines[] = {"heap", "btree"};
+    string padding(40, 'k');
+    for (int t = 0; t < 2; t++) {
+        tables[t]->create();
+        LatencyRecorder insert;
+        Clock::time_point begin = Clock::now();
+        for (size_t i = 0; i < num_rows; i++) {
+            ValueDict row;
+            row["a"] = Value((int32_t) (i * 7919 % num_rows));
+            row["b"] = Value(padding + to_string(i));
+            Clock::time_point start = Clock::now();
+            tables[t]->insert(&row);
+            insert.record(start);
+        }
+        reporter.report(string("btree.insert/engine=") + engines[t], insert,
+                        chrono::duration<double>(Clock::now() - begin).count());
+
+        LatencyRecorder lookup;
+        int lookups = t == 0 ? HEAP_LOOKUPS : BTREE_LOOKUPS;
+        begin = Clock::now();
+        for (int l = 0; l < lookups; l++) {
+            ValueDict where;
+            where["a"] = Value((int32_t) ((l * 104729L) % num_rows));
+            Clock::time_point start = Clock::now();
+            delete tables[t]->select(&where);
+            lookup.record(start);
+        }
+        reporter.report(string("btree.point_lookup/engine=") + engines[t] + "/rows=" + to_string(num_rows), lookup,
+                        chrono::duration<double>(Clock::now() - begin).count());
+
+        LatencyRecorder range;
+        size_t width = max((size_t) 1, num_rows / 100);
+        begin = Clock::now();
+        for (int r = 0; r < RANGES; r++) {
+            size_t low = r * (num_rows - width) / RANGES;
+            hsql::SQLParserResult *parsed = hsql::SQLParser::parseSQLString(
+                    "SELECT * FROM t WHERE a >= " + to_string(low) + " AND a < " + to_string(low + width));
+            const hsql::Expr *where = ((const hsql::SelectStatement *) parsed->getStatement(0))->whereClause;
+            Clock::time_point start = Clock::now();
+            CompiledPredicate *predicate = ExprCompiler::compile(where, column_names, column_attributes);
+            if (t == 0)
+                delete heap.select(predicate);
+            else
+                delete btree.select(ExprCompiler::column_range(where, column_names, column_attributes, 0), predicate);
+            range.record(start);
+            delete predicate;
+            delete parsed;
+        }
+        reporter.report(string("btree.range_1pct/engine=") + engines[t] + "/rows=" + to_string(num_rows), range,
+                        chrono::duration<double>(Clock::now() - begin).count());
+        tables[t]->drop();
+    }
+}
+
+/**
+ * The same table with each page size: insert rows one at a time, scan it a block at a time (copy_block and
+ * decode_block, as aggregation does; each row is charged an equal share of its block's time), and project
+ * every row by handle. Bigger pages mean fewer Berkeley DB records per scan, but project copies a whole page
+ * to read one row.
+ * @param reporter  where results go
+ * @param num_rows  rows inserted at each page size
+ */
+static void bench_page_sizes(BenchmarkReporter &reporter, size_t num_rows) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    string padding(200, 'b');
+
+    for (uint page_size = HeapFile::MIN_PAGE_SZ; page_size <= HeapFile::MAX_PAGE_SZ; page_size *= 2) {
+        HeapTable table("_bench_page_sizes", column_names, column_attributes, page_size);
+        table.create();
+        string suffix = "/page=" + to_string(page_size);
+
+        LatencyRecorder insert, scan, project;
+        for (size_t i = 0; i < num_rows; i++) {
+            ValueDict row;
+            row["a"] = Value((int32_t) i);
+            row["b"] = Value(padding + to_string(i % 100));
+            Clock::time_point start = Clock::now();
+            table.insert(&row);
+            insert.record(start);
+        }
+
+        vector<char> buffer(table.get_page_size());
+        Clock::time_point begin = Clock::now();
+        BlockIDs *block_ids = table.block_ids();
+        for (auto block_id: *block_ids) {
+            Clock::time_point start = Clock::now();
+            ValueDicts rows;
+            table.copy_block(block_id, buffer.data());
+            table.decode_block(buffer.data(), rows);
+            u_int64_t ns = (u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+            for (auto row: rows) {
+                scan.record_ns(ns / rows.size());
+                delete row;
+            }
+        }
+        delete block_ids;
+        double scan_seconds = chrono::duration<double>(Clock::now() - begin).count();
+
+        Handles *handles = table.select();
+        for (auto const &handle: *handles) {
+            Clock::time_point start = Clock::now();
+            ValueDict *row = table.project(handle);
+            project.record(start);
+            delete row;
+        }
+        delete handles;
+        table.drop();
+
+        reporter.report("page_size.insert" + suffix, insert);
+        reporter.report("page_size.scan" + suffix, scan, scan_seconds);
+        reporter.report("page_size.project" + suffix, project);
+    }
+}
+
+/**
+ * The same wide rows in a ROW and a PAX table: scan one INT column, one TEXT column, and whole rows, a block at a
+ * time (each value or row is charged an equal share of its block's time). PAX reads one minipage for a column;
+ * the slotted page has to step over every row's other fields.
+ * @param reporter  where results go
+ * @param num_rows  rows in each table
+ */
+static void bench_pax(BenchmarkReporter &reporter, size_t num_rows) {
+    const char *COLUMNS[] = {"a", "b", "c", "d", "e", "f"};
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    for (size_t c = 0; c < 6; c++) {
+        column_names.push_back(COLUMNS[c]);
+        column_attributes.push_back(ColumnAttribute(c % 2 == 0 ? ColumnAttribute::INT : ColumnAttribute::TEXT));
+    }
+    const HeapTable::PageLayout LAYOUTS[] = {HeapTable::ROW, HeapTable::PAX};
+
+    for (auto layout: LAYOUTS) {
+        HeapTable table("_bench_pax", column_names, column_attributes);
+        table.set_layout(layout);
+        table.create();
+        string suffix = layout == HeapTable::PAX ? "/layout=pax" : "/layout=row";
+        ValueDicts rows;
+        for (size_t i = 0; i < num_rows; i++) {
+            ValueDict *row = new ValueDict();
+            for (size_t c = 0; c < 6; c++)
+                (*row)[COLUMNS[c]] = c % 2 == 0 ? Value((int32_t) (i * c)) : Value(string(40, 'a' + c) + to_string(i));
+            rows.push_back(row);
+        }
+        delete table.insert_batch(&rows);
+        for (auto row: rows)
+            delete row;
+
+        vector<char> buffer(table.get_page_size());
+        BlockIDs *block_ids = table.block_ids();
+        LatencyRecorder int_scan, text_scan, row_scan;
+        double seconds[3] = {0, 0, 0};
+        for (int pass = 0; pass < 3; pass++) {
+            LatencyRecorder &recorder = pass == 0 ? int_scan : pass == 1 ? text_scan : row_scan;
+            Clock::time_point begin = Clock::now();
+            for (auto block_id: *block_ids) {
+                Clock::time_point start = Clock::now();
+                table.copy_block(block_id, buffer.data());
+                vector<Value> values;
+                ValueDicts decoded;
+                if (pass < 2)
+                    table.decode_column(buffer.data(), pass == 0 ? "a" : "b", values);
+                else
+                    table.decode_block(buffer.data(), decoded);
+                u_int64_t ns = (u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+                size_t count = pass < 2 ? values.size() : decoded.size();
+                for (size_t i = 0; i < count; i++)
+                    recorder.record_ns(ns / count);
+                for (auto row: decoded)
+                    delete row;
+            }
+            seconds[pass] = chrono::duration<double>(Clock::now() - begin).count();
+        }
+        delete block_ids;
+        table.drop();
+
+        reporter.report("pax.scan_int_column" + suffix, int_scan, seconds[0]);
+        reporter.report("pax.scan_text_column" + suffix, text_scan, seconds[1]);
+        reporter.report("pax.scan_rows" + suffix, row_scan, seconds[2]);
+    }
+}
+
+/**
+ * Compressible rows (an INT of 100 values, a TEXT of 8, an INT in long runs) in a ROW and a PAX table: the
+ * compression.blocks lines count each table's blocks (one op per block), then each WHERE (an equality on either
+ * column, one op per select) and a block-at-a-time scan of the INT column (rows/sec) are timed. PAX pages are sealed
+ * with encoded columns when they fill, so they hold more rows and test the WHERE on the encoded values.
+ * @param reporter  where results go
+ * @param num_rows  rows in each table
+ */
+static void bench_compression(BenchmarkReporter &reporter, size_t num_rows) {
+    const char *COLORS[] = {"red", "green", "blue", "yellow", "orange", "purple", "black", "white"};
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    column_names.push_back("c");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    const HeapTable::PageLayout LAYOUTS[] = {HeapTable::ROW, HeapTable::PAX};
+
+    for (auto layout: LAYOUTS) {
+        HeapTable table("_bench_compression", column_names, column_attributes);
+        table.set_layout(layout);
+        table.create();
+        string suffix = layout == HeapTable::PAX ? "/layout=pax" : "/layout=row";
+        ValueDicts rows;
+        for (size_t i = 0; i < num_rows; i++) {
+            ValueDict *row = new ValueDict();
+            (*row)["a"] = Value((int32_t) (i * 7 % 100));
+            (*row)["b"] = Value(string(COLORS[i % 8]) + " paint");
+            (*row)["c"] = Value((int32_t) (i / 1000));
+            rows.push_back(row);
+        }
+        delete table.insert_batch(&rows);
+        for (auto row: rows)
+            delete row;
+
+        BlockIDs *block_ids = table.block_ids();
+        LatencyRecorder blocks, select_int, select_text, scan;
+        for (size_t i = 0; i < block_ids->size(); i++)
+            blocks.record_ns(0);
+        double seconds[2] = {0, 0};
+        for (int s = 0; s < 2; s++) {
+            ValueDict where;
+            if (s == 0)
+                where["a"] = Value(42);
+            else
+                where["b"] = Value("blue paint");
+            Clock::time_point begin = Clock::now();
+            for (int repeat = 0; repeat < 5; repeat++) {
+                Clock::time_point start = Clock::now();
+                delete table.select(&where);
+                (s == 0 ? select_int : select_text).record_ns(
+                        (u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+            }
+            seconds[s] = chrono::duration<double>(Clock::now() - begin).count();
+        }
+        vector<char> buffer(table.get_page_size());
+        Clock::time_point begin = Clock::now();
+        for (auto block_id: *block_ids) {
+            Clock::time_point start = Clock::now();
+            table.copy_block(block_id, buffer.data());
+            vector<Value> values;
+            table.decode_column(buffer.data(), "a", values);
+            u_int64_t ns = (u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+            for (size_t i = 0; i < values.size(); i++)
+                scan.record_ns(ns / values.size());
+        }
+        double scan_seconds = chrono::duration<double>(Clock::now() - begin).count();
+        delete block_ids;
+        table.drop();
+
+        reporter.report("compression.blocks" + suffix, blocks);
+        reporter.report("compression.select_int" + suffix, select_int, seconds[0]);
+        reporter.report("compression.select_text" + suffix, select_text, seconds[1]);
+        reporter.report("compression.scan_int_column" + suffix, scan, scan_seconds);
+    }
+}
+
+/**
+ * A table with a column of each of INT, BIGINT, DOUBLE and TIMESTAMP holding the same numbers: an equality on
+ * each column (one op per select) is timed, so the lines show what a fixed-width type's codec costs next to INT's
+ * fused instruction, and types.insert times marshaling a row of them (one op per row).
+ * @param reporter  where results go
+ * @param num_rows  rows in the table
+ */
+static void bench_types(BenchmarkReporter &reporter, size_t num_rows) {
+    const char *NAMES[] = {"int", "bigint", "double", "timestamp"};
+    const ColumnAttribute::DataType TYPES[] = {ColumnAttribute::INT, ColumnAttribute::BIGINT, ColumnAttribute::DOUBLE,
+                                               ColumnAttribute::TIMESTAMP};
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    for (int c = 0; c < 4; c++) {
+        column_names.push_back(NAMES[c]);
+        column_attributes.push_back(ColumnAttribute(TYPES[c]));
+    }
+    HeapTable table("_bench_types", column_names, column_attributes);
+    table.create();
+    LatencyRecorder insert;
+    Clock::time_point begin = Clock::now();
+    for (size_t i = 0; i < num_rows; i++) {
+        int32_t n = (int32_t) (i * 7919 % 1000);
+        ValueDict row;
+        row["int"] = Value(n);
+        row["bigint"] = Value::bigint(n);
+        row["double"] = Value::real(n);
+        row["timestamp"] = Value::timestamp(n);
+        Clock::time_point start = Clock::now();
+        table.insert(&row);
+        insert.record_ns((u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    reporter.report("types.insert", insert, chrono::duration<double>(Clock::now() - begin).count());
+
+    for (int c = 0; c < 4; c++) {
+        ValueDict where;
+        // converted to the column's type once, when the WHERE is compiled (an INT is no TIMESTAMP, though)
+        where[NAMES[c]] = TYPES[c] == ColumnAttribute::TIMESTAMP ? Value::timestamp(42) : Value(42);
+        LatencyRecorder select;
+        begin = Clock::now();
+        for (int repeat = 0; repeat < 5; repeat++) {
+            Clock::time_point start = Clock::now();
+            delete table.select(&where);
+            select.record_ns((u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        reporter.report(string("types.select_") + NAMES[c], select,
+                        chrono::duration<double>(Clock::now() - begin).count());
+    }
+    table.drop();
+}
+
+/**
+ * The schema of bench_typed: an INT key, a BIGINT, a short TEXT and a DOUBLE
+ */
+struct BenchTypedSchema {
+    typedef TypedColumns<ColumnAttribute::INT, ColumnAttribute::BIGINT, ColumnAttribute::TEXT, ColumnAttribute::DOUBLE>
+            Columns;
+
+    static ColumnNames column_names() { return {"id", "big", "name", "price"}; }
+};
+
+/**
+ * The same rows inserted, scanned and projected through HeapTable's ValueDicts (path=generic) and through
+ * TypedTable's tuples (path=typed), one op per row, so the lines show what the lookups and checks of the generic
+ * interface cost. The scans read every visible row back (select and project for the generic path).
+ * @param reporter  where results go
+ * @param num_rows  rows in each table
+ */
+static void bench_typed(BenchmarkReporter &reporter, size_t num_rows) {
+    typedef TypedTable<BenchTypedSchema> Table;
+    for (int typed = 0; typed < 2; typed++) {
+        string path = typed ? "/path=typed" : "/path=generic";
+        Table table("_bench_typed");
+        table.create();
+        Handles handles;
+        LatencyRecorder insert;
+        Clock::time_point begin = Clock::now();
+        for (size_t i = 0; i < num_rows; i++) {
+            Table::Row row((int32_t) i, (int64_t) i * 1000, "name" + to_string(i % 1000), i / 4.0);
+            Clock::time_point start = Clock::now();
+            if (typed) {
+                handles.push_back(table.insert(row));
+            } else {
+                ValueDict values;
+                values["id"] = Value(get<0>(row));
+                values["big"] = Value::bigint(get<1>(row));
+                values["name"] = Value(get<2>(row));
+                values["price"] = Value::real(get<3>(row));
+                handles.push_back(table.insert(&values));
+            }
+            insert.record_ns((u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        reporter.report("typed.insert" + path, insert, chrono::duration<double>(Clock::now() - begin).count());
+
+        LatencyRecorder scan;
+        int64_t sum = 0;
+        begin = Clock::now();
+        for (int repeat = 0; repeat < 5; repeat++) {
+            Clock::time_point start = Clock::now();
+            if (typed) {
+                table.scan([&](Handle, const Table::Row &row) { sum += get<1>(row); });
+            } else {
+                Handles *all = table.select();
+                for (auto const &handle: *all) {
+                    ValueDict *row = table.project(handle);
+                    sum += (*row)["big"].l;
+                    delete row;
+                }
+                delete all;
+            }
+            scan.record_ns((u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        reporter.report("typed.scan" + path, scan, chrono::duration<double>(Clock::now() - begin).count());
+
+        LatencyRecorder project;
+        begin = Clock::now();
+        for (size_t i = 0; i < handles.size(); i += 7) {
+            Clock::time_point start = Clock::now();
+            if (typed) {
+                Table::Row row;
+                table.project(handles[i], row);
+                sum += get<0>(row);
+            } else {
+                ValueDict *row = table.project(handles[i]);
+                sum += (*row)["id"].n;
+                delete row;
+            }
+            project.record_ns((u_int64_t) chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+        }
+        reporter.report("typed.project" + path, project, chrono::duration<double>(Clock::now() - begin).count());
+        if (sum == 0)
+            cerr << "storage_bench: bench_typed read nothing" << endl;
+        table.drop();
+    }
+}
+
+/**
+ * Tables whose TEXT column holds values of different sizes: inline ones, then ones stored out of line. A filter
+ * on the INT column and projecting it only read the rows, so they should cost the same whatever the text;
+ * projecting the text follows its chain of overflow pages.
+ * @param reporter  where results go
+ * @param num_rows  rows in each table
+ */
+static void bench_overflow(BenchmarkReporter &reporter, size_t num_rows) {
+    const size_t TEXT_SIZES[] = {16, 512, 4096, 65536};
+    const int NUM_FILTERS = 20;
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    ColumnNames just_a(1, "a"), just_b(1, "b");
+
+    for (auto text_size: TEXT_SIZES) {
+        HeapTable table("_bench_overflow", column_names, column_attributes);
+        table.create();
+        string suffix = "/text=" + to_string(text_size);
+        LatencyRecorder insert, filter, project_a, project_b;
+        string text(text_size, 'b');
+        for (size_t i = 0; i < num_rows; i++) {
+            ValueDict row;
+            row["a"] = Value((int32_t) i);
+            row["b"] = Value(text);
+            Clock::time_point start = Clock::now();
+            table.insert(&row);
+            insert.record(start);
+        }
+
+        for (int f = 0; f < NUM_FILTERS; f++) {
+            ValueDict where;
+            where["a"] = Value((int32_t) ((f * 7919) % num_rows));
+            Clock::time_point start = Clock::now();
+            delete table.select(&where);
+            filter.record(start);
+        }
+
+        Handles *handles = table.select();
+        for (auto const &handle: *handles) {
+            Clock::time_point start = Clock::now();
+            ValueDict *row = table.project(handle, &just_a);
+            project_a.record(start);
+            delete row;
+        }
+        for (auto const &handle: *handles) {
+            Clock::time_point start = Clock::now();
+            ValueDict *row = table.project(handle, &just_b);
+            project_b.record(start);
+            delete row;
+        }
+        delete handles;
+        table.drop();
+
+        reporter.report("overflow.insert" + suffix, insert);
+        reporter.report("overflow.filter_int/rows=" + to_string(num_rows) + suffix, filter);
+        reporter.report("overflow.project_int" + suffix, project_a);
+        reporter.report("overflow.project_text" + suffix, project_b);
+    }
+}
+
+/**
+ * Stress the page latches: T threads inserting into one HeapTable (each its share of the rows), then T
+ * threads each scanning all of it (select, then project every row). The ops/sec, over wall-clock time,
+ * show how throughput scales with the number of threads.
+ * @param reporter     where results go
+ * @param num_rows     rows inserted at each thread count
+ * @param max_threads  the largest thread count to try
+ */
+static void bench_concurrency(BenchmarkReporter &reporter, size_t num_rows, uint max_threads) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    string padding(24, 'b');
+
+    for (uint num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        HeapTable table("_bench_concurrency", column_names, column_attributes);
+        table.create();
+        string suffix = "/threads=" + to_string(num_threads);
+
+        vector<LatencyRecorder> inserts(num_threads);
+        vector<thread> threads;
+        Clock::time_point begin = Clock::now();
+        for (uint t = 0; t < num_threads; t++) {
+            threads.push_back(thread([&, t]() {
+                for (size_t i = t; i < num_rows; i += num_threads) {
+                    ValueDict row;
+                    row["a"] = Value((int32_t) i);
+                    row["b"] = Value(padding + to_string(i % 100));
+                    Clock::time_point start = Clock::now();
+                    table.insert(&row);
+                    inserts[t].record(start);
+                }
+            }));
+        }
+        for (auto &worker: threads)
+            worker.join();
+        double insert_seconds = chrono::duration<double>(Clock::now() - begin).count();
+
+        vector<LatencyRecorder> projects(num_threads);
+        threads.clear();
+        begin = Clock::now();
+        for (uint t = 0; t < num_threads; t++) {
+            threads.push_back(thread([&, t]() {
+                Handles *handles = table.select();
+                for (auto const &handle: *handles) {
+                    Clock::time_point start = Clock::now();
+                    ValueDict *row = table.project(handle);
+                    projects[t].record(start);
+                    delete row;
+                }
+                delete handles;
+            }));
+        }
+        for (auto &worker: threads)
+            worker.join();
+        double scan_seconds = chrono::duration<double>(Clock::now() - begin).count();
+        table.drop();
+
+        LatencyRecorder insert, project;
+        for (uint t = 0; t < num_threads; t++) {
+            insert.merge(inserts[t]);
+            project.merge(projects[t]);
+        }
+        reporter.report("heap_table.concurrent_insert" + suffix, insert, insert_seconds);
+        reporter.report("heap_table.concurrent_scan" + suffix, project, scan_seconds);
+    }
+}
+
+/**
+ * Group commit: C threads each inserting their share of the rows into one table in durable mode, every
+ * insert committing (waiting for the log to reach disk) before it returns. The wal.commit lines give
+ * commits/sec; the wal.fsync lines count the log's fsyncs over the same time, so commit ops / fsync ops is
+ * the mean number of commits that shared an fsync (the group size).
+ * @param reporter        where results go
+ * @param num_commits     commits at each committer count
+ * @param max_committers  the largest committer count to try
+ * @param envdir          where the log goes
+ */
+static void bench_group_commit(BenchmarkReporter &reporter, size_t num_commits, uint max_committers,
+                               const string &envdir) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    string padding(24, 'b');
+    string log_path = envdir + "/_bench_group_commit.wal";
+
+    for (uint num_committers = 1; num_committers <= max_committers; num_committers *= 2) {
+        HeapTable table("_bench_group_commit", column_names, column_attributes);
+        table.create();
+        WriteAheadLog::open(log_path);
+        string suffix = "/committers=" + to_string(num_committers);
+
+        vector<LatencyRecorder> commits(num_committers);
+        vector<thread> threads;
+        Clock::time_point begin = Clock::now();
+        for (uint t = 0; t < num_committers; t++) {
+            threads.push_back(thread([&, t]() {
+                for (size_t i = t; i < num_commits; i += num_committers) {
+                    ValueDict row;
+                    row["a"] = Value((int32_t) i);
+                    row["b"] = Value(padding + to_string(i % 100));
+                    Clock::time_point start = Clock::now();
+                    table.insert(&row);
+                    commits[t].record(start);
+                }
+            }));
+        }
+        for (auto &worker: threads)
+            worker.join();
+        double seconds = chrono::duration<double>(Clock::now() - begin).count();
+        WalStats stats = WriteAheadLog::stats();
+        WriteAheadLog::close(false);
+        table.drop();
+        remove(log_path.c_str());
+
+        LatencyRecorder commit, fsync;
+        for (uint t = 0; t < num_committers; t++)
+            commit.merge(commits[t]);
+        for (u_int64_t i = 0; i < stats.flushes; i++)
+            fsync.record_ns((u_int64_t) (seconds * 1e9 / stats.flushes));
+        reporter.report("wal.commit" + suffix, commit, seconds);
+        reporter.report("wal.fsync" + suffix, fsync, seconds);
+    }
+}
+
+/**
+ * Main entry to the storage benchmarks
+ */
+int main(int argc, char *argv[]) {
+    bool json = false;
+    size_t num_rows = 20000;
+    uint max_threads = 8;
+    string envdir = "bench_data";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc)
+            num_rows = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            max_threads = (uint) strtoul(argv[++i], nullptr, 10);
+        else if (argv[i][0] == '-') {
+            cerr << "Usage: ./storage_bench [--json] [--rows N] [--threads N] [envdir]" << endl;
+            return EXIT_FAILURE;
+        } else
+            envdir = argv[i];
+    }
+    mkdir(envdir.c_str(), 0755);
+    DbEnv *env = new DbEnv(0U);
+    env->set_error_stream(&cerr);
+    try {
+        env->open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    } catch (DbException &e) {
+        cerr << "storage_bench: create db env error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    _DB_ENV = env;
+
+    BenchmarkReporter reporter(cout, json);
+    bench_slotted_page(reporter, 100000);
+    bench_heap_file(reporter, num_rows / 20);
+    bench_heap_table(reporter, num_rows);
+    bench_page_sizes(reporter, num_rows);
+    bench_read_ahead(reporter, num_rows);
+    bench_btree(reporter, num_rows);
+    bench_overflow(reporter, num_rows / 4);
+    bench_pax(reporter, num_rows);
+    bench_compression(reporter, num_rows);
+    bench_types(reporter, num_rows);
+    bench_typed(reporter, num_rows);
+    bench_concurrency(reporter, num_rows, max_threads);
+    bench_group_commit(reporter, num_rows / 10, max_threads, envdir);
+    env->close(0U);
+    delete env;
+    return EXIT_SUCCESS;
+}
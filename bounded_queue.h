@@ -0,0 +1,57 @@
+/**
+ * @file   bounded_queue.h
+ * @brief  Blocking producer/consumer queue shared by the engine's thread pools
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/**
+ * @class BoundedQueue - FIFO shared between threads; push waits while it is full, pop while it is empty
+ */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1), closed(false) {}
+
+    // false (and nothing queued) if the queue was closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->not_full.wait(lock, [this]() { return this->items.size() < this->capacity || this->closed; });
+        if (this->closed)
+            return false;
+        this->items.push_back(std::move(item));
+        this->not_empty.notify_one();
+        return true;
+    }
+
+    // false once the queue is closed and empty
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->not_empty.wait(lock, [this]() { return !this->items.empty() || this->closed; });
+        if (this->items.empty())
+            return false;
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        this->not_full.notify_one();
+        return true;
+    }
+
+    // no more pushes; pops drain what is left
+    void close() {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->closed = true;
+        this->not_full.notify_all();
+        this->not_empty.notify_all();
+    }
+
+protected:
+    std::mutex mutex;
+    std::condition_variable not_full, not_empty;
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+};
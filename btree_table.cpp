@@ -0,0 +1,1030 @@
+/**
+ * @file   btree_table.cpp
+ * @brief  the implementation file for BTreeNode, BTreeFile and BTreeTable
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "btree_table.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "column_codec.h"
+#include "engine_stats.h"
+#include "expr_compiler.h"
+#include "trace.h"
+using namespace std;
+
+typedef u_int16_t u16;
+typedef u_int32_t u32;
+
+
+/**
+ * Fill a table of key k, then check it against what the rows should be: point lookups, range scans in key order,
+ * select with a ValueDict, duplicate keys, deletes, updates of the key and of the other columns
+ * @param key_type  the key column's type
+ * @param reversed  insert the keys from the highest down (else in a scrambled order)
+ * @return true if testing succeeded, false otherwise
+ */
+static bool test_btree_keys(ColumnAttribute::DataType key_type, bool reversed) {
+    const int NUM_ROWS = 3000;
+    bool ok = true;
+    ColumnNames column_names = {"name", "k", "payload"};
+    ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::TEXT), ColumnAttribute(key_type),
+                                          ColumnAttribute(ColumnAttribute::INT)};
+    BTreeTable table("_test_btree", column_names, column_attributes, "k");
+    table.create();
+    // the key n in the key's type, and row i's key (even keys only)
+    auto key_value = [key_type](int n) {
+        return key_type == ColumnAttribute::TIMESTAMP ? Value::timestamp(n) : convert_value(Value(n), key_type);
+    };
+    auto key = [&key_value](int i) { return key_value(i * 2); };
+    auto make_row = [&](int i, ValueDict &row) {
+        row["name"] = Value(string(i % 100 == 7 ? 400 : 10, (char) ('a' + i % 26)) + to_string(i));
+        row["k"] = key(i);
+        row["payload"] = Value(i);
+    };
+    for (int n = 0; n < NUM_ROWS; n++) {
+        int i = reversed ? NUM_ROWS - 1 - n : (int) ((n * 7919L) % NUM_ROWS);
+        ValueDict row;
+        make_row(i, row);
+        table.insert(&row);
+    }
+    if (table.get_height() < 2) {
+        cout << "FAILED TEST: " << NUM_ROWS << " rows did not split the root" << endl;
+        ok = false;
+    }
+
+    Handles *handles = table.select();
+    for (size_t i = 0; i < handles->size() && ok; i++) {
+        ValueDict *row = table.project((*handles)[i]);
+        ValueDict want;
+        make_row((int) i, want);
+        if ((*row)["payload"].n != (int) i || (*row)["name"].s != want["name"].s) {
+            cout << "FAILED TEST: row " << i << " of a scan is out of key order" << endl;
+            ok = false;
+        }
+        delete row;
+    }
+    if (handles->size() != NUM_ROWS) {
+        cout << "FAILED TEST: scan found " << handles->size() << " rows" << endl;
+        ok = false;
+    }
+    delete handles;
+
+    for (int i: {0, 1, 1234, NUM_ROWS - 1}) {
+        Handle handle;
+        ColumnNames payload = {"payload"};
+        ValueDict *row = table.lookup(key(i), handle) ? table.project(handle, &payload) : nullptr;
+        if (row == nullptr || row->size() != 1 || (*row)["payload"].n != i) {
+            cout << "FAILED TEST: lookup of key " << i * 2 << endl;
+            ok = false;
+        }
+        delete row;
+    }
+    Handle missing;
+    if (table.lookup(key(NUM_ROWS), missing) || table.lookup(key_value(7), missing)) {
+        cout << "FAILED TEST: lookup found a key never inserted" << endl;
+        ok = false;
+    }
+
+    // keys 101 < k <= 201 are rows 51 to 100
+    ColumnRange range;
+    range.has_low = range.has_high = true;
+    range.low = key_value(101);
+    range.high = key_value(201);
+    range.low_inclusive = false;
+    handles = table.select(range);
+    for (size_t h = 0; h < handles->size(); h++) {
+        ValueDict *row = table.project((*handles)[h]);
+        if ((*row)["payload"].n != 51 + (int) h)
+            ok = false;
+        delete row;
+    }
+    if (handles->size() != 50 || !ok) {
+        cout << "FAILED TEST: range scan found " << handles->size() << " rows" << endl;
+        ok = false;
+    }
+    delete handles;
+
+    ValueDict where;
+    where["k"] = key(77);
+    where["payload"] = Value(77);
+    handles = table.select(&where);
+    size_t found = handles->size();
+    delete handles;
+    where["payload"] = Value(78);
+    handles = table.select(&where);
+    if (found != 1 || !handles->empty()) {
+        cout << "FAILED TEST: select(where) on the key" << endl;
+        ok = false;
+    }
+    delete handles;
+
+    try {
+        ValueDict row;
+        make_row(5, row);
+        table.insert(&row);
+        cout << "FAILED TEST: duplicate key accepted" << endl;
+        ok = false;
+    } catch (DbRelationError &e) {
+    }
+
+    // delete every third row through handles from one select: deletes keep the others' handles good
+    handles = table.select();
+    for (size_t i = 0; i < handles->size(); i += 3)
+        table.del((*handles)[i]);
+    delete handles;
+    // move row 1 to the odd key 1, and grow row 2's name
+    Handle handle;
+    ValueDict changes;
+    table.lookup(key(1), handle);
+    changes["k"] = key_value(1);
+    Handle moved = table.update(handle, &changes);
+    if (!table.lookup(key_value(1), handle) || handle != moved) {
+        cout << "FAILED TEST: update did not return the moved row's handle" << endl;
+        ok = false;
+    }
+    table.lookup(key(2), handle);
+    changes.clear();
+    changes["name"] = Value(string(500, 'z'));
+    table.update(handle, &changes);
+    // growing a run of neighbours overflows their leaf, which splits around each replaced row
+    for (int payload = 7; payload <= 40; payload++) {
+        if (payload % 3 != 0 && table.lookup(key(payload), handle)) {
+            changes.clear();
+            changes["name"] = Value(string(300, 'y'));
+            table.update(handle, &changes);
+        }
+    }
+    // moving a row onto a key already taken fails and leaves the row where it was
+    table.lookup(key(4), handle);
+    changes.clear();
+    changes["k"] = key(5);
+    try {
+        table.update(handle, &changes);
+        cout << "FAILED TEST: update to a duplicate key accepted" << endl;
+        ok = false;
+    } catch (DbRelationError &e) {
+        if (!table.lookup(key(4), handle)) {
+            cout << "FAILED TEST: failed update lost its row" << endl;
+            ok = false;
+        }
+    }
+    handles = table.select();
+    int expected = 0;
+    for (auto const &h: *handles) {
+        ValueDict *row = table.project(h);
+        int payload = (*row)["payload"].n;
+        if (expected == 0 && payload != 1)
+            ok = false;  // key 1 sorts before key 2
+        else if (expected > 0 && payload % 3 == 0)
+            ok = false;
+        if (payload == 2 && (*row)["name"].s != string(500, 'z'))
+            ok = false;
+        if (payload >= 7 && payload <= 40 && (*row)["name"].s != string(300, 'y'))
+            ok = false;
+        expected++;
+        delete row;
+    }
+    if (expected != NUM_ROWS - (NUM_ROWS + 2) / 3 || !ok) {
+        cout << "FAILED TEST: " << expected << " rows after deletes and updates" << endl;
+        ok = false;
+    }
+    delete handles;
+    table.drop();
+    return ok;
+}
+
+/**
+ * Testing function for BTreeTable.
+ * A table keyed on an INT inserted in a scrambled order, one keyed on a TIMESTAMP inserted backwards, and a
+ * table loaded in key order, whose leaves the rightmost-append split leaves full; the table reopened reads
+ * the same.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_btree_table() {
+    if (!test_btree_keys(ColumnAttribute::INT, false) || !test_btree_keys(ColumnAttribute::TIMESTAMP, true))
+        return false;
+
+    const int NUM_ROWS = 20000;
+    bool ok = true;
+    BTreeTable table("_test_btree_append", {"id", "v"},
+                     {ColumnAttribute(ColumnAttribute::BIGINT), ColumnAttribute(ColumnAttribute::INT)}, "id");
+    table.create();
+    for (int i = 0; i < NUM_ROWS; i++) {
+        ValueDict row;
+        row["id"] = Value::bigint(i);
+        row["v"] = Value(-i);
+        table.insert(&row);
+    }
+    table.close();
+    BTreeTable reopened("_test_btree_append", table.get_column_names(), table.get_column_attributes(), "id");
+    Handles *handles = reopened.select();
+    BlockIDs leaves;
+    for (auto const &handle: *handles)
+        if (leaves.empty() || leaves.back() != handle.first)
+            leaves.push_back(handle.first);
+    // rows of 12 bytes and their 4-byte slots: all but the last leaf full
+    size_t per_leaf = BTreeNode::capacity(DbBlock::BLOCK_SZ) / (8 + 12 + BTreeNode::SLOT_SIZE);
+    if (handles->size() != NUM_ROWS || leaves.size() != (NUM_ROWS + per_leaf - 1) / per_leaf) {
+        cout << "FAILED TEST: " << handles->size() << " rows loaded in key order took " << leaves.size()
+             << " leaves" << endl;
+        ok = false;
+    }
+    delete handles;
+    reopened.drop();
+    return ok;
+}
+
+
+/*****************************************B+tree Node***************************************************************/
+
+/**
+ * Constructor for BTreeNode
+ * @param block     the block's bytes, allocated with new char[] (the node frees them)
+ * @param block_id  the block's id
+ * @param key_codec the codec of the tree's key
+ * @param is_new    initialize it as an empty node
+ * @param kind      what kind of node a new one is
+ */
+BTreeNode::BTreeNode(Dbt &block, BlockID block_id, const CodecOps &key_codec, bool is_new, Kind kind)
+        : DbBlock(block, block_id, is_new), key_codec(key_codec) {
+    if (is_new) {
+        memset(block.get_data(), 0, block.get_size());
+        put_u32(0, MAGIC);
+        put_u16(4, (u16) kind);
+        put_u16(6, 0);
+        put_u32(8, 0);
+        put_u32(12, block.get_size());
+    }
+}
+
+BTreeNode::~BTreeNode() {
+    delete[] (char *) this->block.get_data();
+}
+
+bool BTreeNode::is_node() const {
+    return this->block.get_size() >= HEADER_SIZE && get_u32(0) == MAGIC;
+}
+
+// Insert data at its place in key order
+RecordID BTreeNode::add(const Dbt *data) {
+    RecordID record_id = lower_bound((const char *) data->get_data(), true);
+    if (!insert(record_id, (const char *) data->get_data(), (u16) data->get_size()))
+        throw DbBlockNoRoomError("not enough room for new entry");
+    return record_id;
+}
+
+// The entry at a position (its memory is the node's)
+Dbt *BTreeNode::get(RecordID record_id) {
+    if (record_id == 0 || record_id > get_count() || is_dead(record_id))
+        return nullptr;
+    return new Dbt(address(slot_offset(record_id)), entry_size(record_id));
+}
+
+void BTreeNode::put(RecordID record_id, const Dbt &data) {
+    check(record_id);
+    if (!replace(record_id, (const char *) data.get_data(), (u16) data.get_size()))
+        throw DbBlockNoRoomError("not enough room for enlarged entry");
+}
+
+void BTreeNode::del(RecordID record_id) {
+    check(record_id);
+    put_u16(slot(record_id) + 2, entry_size(record_id) | DEAD);
+}
+
+RecordIDs *BTreeNode::ids(void) {
+    RecordIDs *record_ids = new RecordIDs();
+    for (RecordID record_id = 1; record_id <= get_count(); record_id++)
+        if (!is_dead(record_id))
+            record_ids->push_back(record_id);
+    return record_ids;
+}
+
+// Binary search of the slots, dead ones included (their keys keep their place in the order)
+RecordID BTreeNode::lower_bound(const char *key, bool after) const {
+    RecordID low = 1, high = (RecordID) (get_count() + 1);
+    while (low < high) {
+        RecordID middle = (RecordID) (low + (high - low) / 2);
+        int cmp = this->key_codec.compare(this->key(middle), key);
+        if (cmp < 0 || (after && cmp == 0))
+            low = (RecordID) (middle + 1);
+        else
+            high = middle;
+    }
+    return low;
+}
+
+BlockID BTreeNode::find_child(const char *key) const {
+    return child((RecordID) (lower_bound(key, true) - 1));
+}
+
+BlockID BTreeNode::child(RecordID record_id) const {
+    if (record_id == 0)
+        return get_link();
+    BlockID child;
+    memcpy(&child, this->key(record_id) + this->key_codec.size, sizeof(child));
+    return child;
+}
+
+/**
+ * Put an entry at a position, moving the slots from there on up one
+ * @param record_id the position (1 to get_count() + 1)
+ * @param data      the entry
+ * @param size      its bytes
+ * @return false if the node hasn't room for it and its slot
+ */
+bool BTreeNode::insert(RecordID record_id, const char *data, u16 size) {
+    if (size + SLOT_SIZE > free_space())
+        return false;
+    u32 free_end = get_u32(12) - size;
+    memcpy(address(free_end), data, size);
+    u16 count = get_count();
+    memmove(address(slot(record_id + 1)), address(slot(record_id)), SLOT_SIZE * (count + 1 - record_id));
+    put_u16(slot(record_id), (u16) free_end);
+    put_u16(slot(record_id) + 2, size);
+    put_u16(6, (u16) (count + 1));
+    put_u32(12, free_end);
+    return true;
+}
+
+// Overwrite an entry no larger than the old one in place; else write it in the free space
+bool BTreeNode::replace(RecordID record_id, const char *data, u16 size) {
+    if (size <= entry_size(record_id)) {
+        memcpy(address(slot_offset(record_id)), data, size);
+    } else {
+        if (size > free_space())
+            return false;
+        u32 free_end = get_u32(12) - size;
+        memcpy(address(free_end), data, size);
+        put_u16(slot(record_id), (u16) free_end);
+        put_u32(12, free_end);
+    }
+    put_u16(slot(record_id) + 2, size);
+    return true;
+}
+
+// Rewrite the node with only its live entries, packed against the end of the block (if it has anything else)
+void BTreeNode::compact() {
+    uint used = 0;
+    bool dead = false;
+    for (RecordID record_id = 1; record_id <= get_count(); record_id++) {
+        used += entry_size(record_id);
+        dead = dead || is_dead(record_id);
+    }
+    if (!dead && used == this->block.get_size() - get_u32(12))
+        return;  // no dead rows, and no old copies of replaced ones
+    vector<string> entries;
+    get_entries(entries);
+    set_entries(entries);
+}
+
+void BTreeNode::get_entries(vector<string> &entries) const {
+    for (RecordID record_id = 1; record_id <= get_count(); record_id++)
+        if (!is_dead(record_id))
+            entries.push_back(string(entry(record_id), entry_size(record_id)));
+}
+
+void BTreeNode::set_entries(const vector<string> &entries) {
+    put_u16(6, 0);
+    put_u32(12, this->block.get_size());
+    for (auto const &entry: entries)
+        if (!insert((RecordID) (get_count() + 1), entry.data(), (u16) entry.size()))
+            throw DbBlockNoRoomError("entries don't fit in a node");
+}
+
+void BTreeNode::check(RecordID record_id) const {
+    if (record_id == 0 || record_id > get_count())
+        throw DbRelationError("no such record");
+}
+
+// The header and slots are unaligned in general (the offsets are of any page size), so go through memcpy
+u16 BTreeNode::get_u16(uint offset) const {
+    u16 n;
+    memcpy(&n, address(offset), sizeof(n));
+    return n;
+}
+
+void BTreeNode::put_u16(uint offset, u16 n) {
+    memcpy(address(offset), &n, sizeof(n));
+}
+
+u32 BTreeNode::get_u32(uint offset) const {
+    u32 n;
+    memcpy(&n, address(offset), sizeof(n));
+    return n;
+}
+
+void BTreeNode::put_u32(uint offset, u32 n) {
+    memcpy(address(offset), &n, sizeof(n));
+}
+
+
+/*****************************************B+tree File***************************************************************/
+
+/**
+ * Constructor for BTreeFile
+ * @param name      the file's name (the Berkeley DB file is name.db)
+ * @param key_codec the codec of the tree's key
+ * @param page_size the size of the blocks, if the file is created
+ */
+BTreeFile::BTreeFile(string name, const CodecOps &key_codec, uint page_size)
+        : HeapFile(name, page_size), key_codec(key_codec) {
+}
+
+// Create the file with the meta block and an empty root leaf
+void BTreeFile::create(void) {
+    db_open(DB_CREATE | DB_EXCL);
+    char *meta = new char[this->page_size];
+    memset(meta, 0, this->page_size);
+    memcpy(meta, &META_MAGIC, sizeof(META_MAGIC));
+    append(meta);
+    delete[] meta;
+    BTreeNode *root = get_new_node(BTreeNode::LEAF);
+    set_root(root->get_block_id(), 1);
+    delete root;
+}
+
+// Read a node (a copy: the node owns its memory)
+BTreeNode *BTreeFile::get_node(BlockID block_id) {
+    TRACE_SPAN("BTreeFile::get_node", "storage");
+    this->read_ahead.on_read(block_id);
+    Dbt key(&block_id, sizeof(block_id));
+    char *block = new char[this->page_size];
+    Dbt data(block, this->page_size);
+    data.set_ulen(this->page_size);
+    data.set_flags(DB_DBT_USERMEM);
+    {
+        TRACE_SPAN("Db::get", "bdb");
+        this->db.get(nullptr, &key, &data, 0);
+    }
+    BTreeNode *node = new BTreeNode(data, block_id, this->key_codec);
+    if (!node->is_node()) {
+        delete node;
+        throw DbRelationError("block " + to_string(block_id) + " of " + this->name + " is not a B+tree node");
+    }
+    return node;
+}
+
+// A new node takes the next block id: writers hold the tree's exclusive latch, so nobody else is appending
+BTreeNode *BTreeFile::get_new_node(BTreeNode::Kind kind) {
+    char *block = new char[this->page_size];
+    Dbt data(block, this->page_size);
+    BTreeNode *node = new BTreeNode(data, this->allocated + 1, this->key_codec, true, kind);
+    append(block);
+    return node;
+}
+
+// The root and height, from the meta block
+void BTreeFile::get_root(BlockID &root, u32 &height) {
+    vector<char> meta(this->page_size);
+    read_meta(meta.data());
+    memcpy(&root, meta.data() + sizeof(u32), sizeof(root));
+    memcpy(&height, meta.data() + 2 * sizeof(u32), sizeof(height));
+}
+
+void BTreeFile::set_root(BlockID root, u32 height) {
+    vector<char> meta(this->page_size);
+    read_meta(meta.data());
+    memcpy(meta.data() + sizeof(u32), &root, sizeof(root));
+    memcpy(meta.data() + 2 * sizeof(u32), &height, sizeof(height));
+    BlockID block_id = META_BLOCK;
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(meta.data(), this->page_size);
+    TRACE_SPAN("Db::put", "bdb");
+    this->db.put(nullptr, &key, &data, 0);
+}
+
+// Read the meta block (not through ReadAhead: it is not part of any scan)
+void BTreeFile::read_meta(char *meta) {
+    BlockID block_id = META_BLOCK;
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(meta, this->page_size);
+    data.set_ulen(this->page_size);
+    data.set_flags(DB_DBT_USERMEM);
+    {
+        TRACE_SPAN("Db::get", "bdb");
+        this->db.get(nullptr, &key, &data, 0);
+    }
+    u32 magic;
+    memcpy(&magic, meta, sizeof(magic));
+    if (magic != META_MAGIC)
+        throw DbRelationError(this->name + " is not a B+tree file");
+}
+
+// Writers hold the tree's exclusive latch, so blocks are appended one at a time
+BlockID BTreeFile::append(char *bytes) {
+    STATS_COUNT(PAGES_ALLOCATED, 1);
+    BlockID block_id = ++this->allocated;
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(bytes, this->page_size);
+    {
+        TRACE_SPAN("Db::put", "bdb");
+        this->db.put(nullptr, &key, &data, 0);
+    }
+    this->last = block_id;
+    return block_id;
+}
+
+
+/*****************************************B+tree Table**************************************************************/
+
+const Identifier BTreeTable::PRIMARY = "PRIMARY";
+
+/**
+ * Constructor for BTreeTable
+ * @param table_name        the table (its file is table_name.db)
+ * @param column_names      its columns
+ * @param column_attributes their types
+ * @param key_column        the column the rows are ordered and looked up by
+ * @param page_size         the size of the blocks, if the table is created
+ */
+BTreeTable::BTreeTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                       Identifier key_column, uint page_size)
+        : DbRelation(table_name, column_names, column_attributes),
+          key_ordinal((u16) (find(column_names.begin(), column_names.end(), key_column) - column_names.begin())),
+          codecs(),
+          file(table_name, codec_ops(key_ordinal < column_attributes.size()
+                                     ? column_attributes[key_ordinal].get_data_type() : ColumnAttribute::INT),
+               page_size) {
+    if (this->key_ordinal >= column_names.size())
+        throw DbRelationError("unknown key column " + key_column);
+    for (auto const &column_attribute: this->column_attributes)
+        this->codecs.push_back(&codec_ops(column_attribute.get_data_type()));
+    if (!this->codecs[this->key_ordinal]->is_fixed())
+        throw DbRelationError("key column " + key_column + " must be of a fixed-width type");
+}
+
+void BTreeTable::create() {
+    this->file.create();
+}
+
+// Create the table if it does not exist yet
+void BTreeTable::create_if_not_exists() {
+    try {
+        this->open();
+    } catch (DbException &e) {
+        create();
+    }
+}
+
+void BTreeTable::drop() {
+    this->file.drop();
+}
+
+void BTreeTable::open() {
+    if (!this->file.is_open())
+        this->file.open();
+}
+
+void BTreeTable::close() {
+    this->file.close();
+}
+
+/**
+ * Insert a row at its key's place
+ * @param row the row (every column)
+ * @return its handle (good until the next insert)
+ * @throws DbRelationError if a row with its key is already in the table
+ */
+Handle BTreeTable::insert(const ValueDict *row) {
+    TRACE_SPAN("BTreeTable::insert", "storage");
+    this->open();
+    string entry = marshal(row);
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, true);
+    return insert_entry(entry);
+}
+
+/**
+ * Change some columns of a row: in place unless the row's key changes or it outgrows its leaf. A new key is
+ * inserted before the old one is deleted, and a row that outgrows its leaf is replaced as the leaf splits, so
+ * if the update fails the old row is still there.
+ * @param handle     the row
+ * @param new_values the columns to change
+ * @return           the row's handle afterwards (handle itself unless the row moved)
+ */
+Handle BTreeTable::update(const Handle handle, const ValueDict *new_values) {
+    TRACE_SPAN("BTreeTable::update", "storage");
+    this->open();
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, true);
+    BTreeNode *leaf = this->file.get_node(handle.first);
+    Handle updated = handle;
+    try {
+        if (!leaf->is_leaf() || handle.second == 0 || handle.second > leaf->get_count()
+            || leaf->is_dead(handle.second))
+            throw DbRelationError("no such record");
+        ValueDict *row = unmarshal(leaf->entry(handle.second));
+        for (auto const &value: *new_values)
+            (*row)[value.first] = value.second;
+        string entry;
+        try {
+            entry = marshal(row);
+        } catch (...) {
+            delete row;
+            throw;
+        }
+        delete row;
+        const CodecOps &key_codec = *this->codecs[this->key_ordinal];
+        bool same_key = key_codec.compare(leaf->key(handle.second), entry.data()) == 0;
+        if (same_key && leaf->replace(handle.second, entry.data(), (u16) entry.size())) {
+            this->file.put(leaf);
+        } else if (same_key) {
+            updated = insert_entry(entry, true);
+        } else {
+            string old_key(leaf->key(handle.second), key_codec.size);
+            updated = insert_entry(entry);  // throws (changing nothing) if the new key is taken
+            delete leaf;
+            leaf = nullptr;
+            // the insert may have moved the old row (compacting or splitting its leaf): find it by its key
+            leaf = find_leaf(old_key.data());
+            RecordID position = leaf->lower_bound(old_key.data());
+            while (position <= leaf->get_count() && leaf->is_dead(position))
+                position++;
+            if (position > leaf->get_count() || key_codec.compare(leaf->key(position), old_key.data()) != 0)
+                throw DbRelationError("no such record");
+            leaf->del(position);
+            this->file.put(leaf);
+        }
+    } catch (...) {
+        delete leaf;
+        throw;
+    }
+    delete leaf;
+    return updated;
+}
+
+// Mark a row deleted (the leaf's other rows keep their positions)
+void BTreeTable::del(const Handle handle) {
+    TRACE_SPAN("BTreeTable::del", "storage");
+    this->open();
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, true);
+    BTreeNode *leaf = this->file.get_node(handle.first);
+    if (!leaf->is_leaf() || handle.second == 0 || handle.second > leaf->get_count() || leaf->is_dead(handle.second)) {
+        delete leaf;
+        throw DbRelationError("no such record");
+    }
+    leaf->del(handle.second);
+    this->file.put(leaf);
+    delete leaf;
+}
+
+Handles *BTreeTable::select() {
+    return select(ColumnRange());
+}
+
+/**
+ * The rows matching a conjunction of column = value equalities; one on the key reads just that key's leaf
+ * @param where the equalities
+ * @return their handles, in key order (freed by caller)
+ */
+Handles *BTreeTable::select(const ValueDict *where) {
+    ColumnRange range;
+    ValueDict::const_iterator key = where->find(get_key_column());
+    if (key != where->end()) {
+        range.has_low = range.has_high = true;
+        range.low = range.high = convert_value(key->second, this->codecs[this->key_ordinal]->data_type);
+    }
+    CompiledPredicate *predicate = ExprCompiler::compile(where, this->column_names, this->column_attributes);
+    Handles *handles;
+    try {
+        handles = select(range, predicate);
+    } catch (...) {
+        delete predicate;
+        throw;
+    }
+    delete predicate;
+    return handles;
+}
+
+/**
+ * Walk the leaves from the range's low bound (or the first leaf) along their links to its high bound (or the
+ * last leaf)
+ * @param range     the key's range
+ * @param predicate what else a row must satisfy (nullptr for nothing)
+ * @return the handles of the rows, in key order (freed by caller)
+ */
+Handles *BTreeTable::select(const ColumnRange &range, const CompiledPredicate *predicate) {
+    TRACE_SPAN("BTreeTable::select", "storage");
+    this->open();
+    const CodecOps &key_codec = *this->codecs[this->key_ordinal];
+    string low = range.has_low ? key_of(range.low) : "";
+    string high = range.has_high ? key_of(range.high) : "";
+    Handles *handles = new Handles();
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, false);
+    BTreeNode *leaf = find_leaf(range.has_low ? low.data() : nullptr);
+    RecordID record_id = range.has_low ? leaf->lower_bound(low.data(), !range.low_inclusive) : 1;
+    bool done = false;
+    while (true) {
+        for (; record_id <= leaf->get_count(); record_id++) {
+            if (range.has_high) {
+                int cmp = key_codec.compare(leaf->key(record_id), high.data());
+                if (cmp > 0 || (cmp == 0 && !range.high_inclusive)) {
+                    done = true;
+                    break;
+                }
+            }
+            if (leaf->is_dead(record_id))
+                continue;
+            if (predicate != nullptr && !predicate->evaluate(leaf->entry(record_id) + key_codec.size))
+                continue;
+            handles->push_back(Handle(leaf->get_block_id(), record_id));
+        }
+        BlockID next = leaf->get_link();
+        delete leaf;
+        if (done || next == 0)
+            break;
+        leaf = this->file.get_node(next);
+        record_id = 1;
+    }
+    return handles;
+}
+
+/**
+ * Find a row by its key, reading one node per level of the tree
+ * @param key    a value of the key column's type (or one that converts to it)
+ * @param handle set to the row's handle if there is one
+ * @return whether there is a row with the key
+ */
+bool BTreeTable::lookup(const Value &key, Handle &handle) {
+    TRACE_SPAN("BTreeTable::lookup", "storage");
+    this->open();
+    string key_bytes = key_of(key);
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, false);
+    BTreeNode *leaf = find_leaf(key_bytes.data());
+    RecordID record_id = leaf->lower_bound(key_bytes.data());
+    bool found = record_id <= leaf->get_count() && !leaf->is_dead(record_id)
+                 && this->codecs[this->key_ordinal]->compare(leaf->key(record_id), key_bytes.data()) == 0;
+    if (found)
+        handle = Handle(leaf->get_block_id(), record_id);
+    delete leaf;
+    return found;
+}
+
+ValueDict *BTreeTable::project(Handle handle) {
+    return project(handle, nullptr);
+}
+
+/**
+ * The values of some columns of a row
+ * @param handle       the row
+ * @param column_names the columns (all of them if nullptr or empty)
+ * @return the values (freed by caller)
+ */
+ValueDict *BTreeTable::project(Handle handle, const ColumnNames *column_names) {
+    TRACE_SPAN("BTreeTable::project", "storage");
+    this->open();
+    if (column_names != nullptr && column_names->empty())
+        column_names = nullptr;
+    if (column_names != nullptr)
+        for (auto const &column_name: *column_names)
+            if (find(this->column_names.begin(), this->column_names.end(), column_name) == this->column_names.end())
+                throw DbRelationError("unknown column " + column_name);
+    BTreeNode *leaf;
+    {
+        PageLatch latch(this->file, BTreeFile::META_BLOCK, false);
+        leaf = this->file.get_node(handle.first);
+    }
+    ValueDict *row = nullptr;
+    if (leaf->is_leaf() && handle.second != 0 && handle.second <= leaf->get_count() && !leaf->is_dead(handle.second))
+        row = unmarshal(leaf->entry(handle.second), column_names);
+    delete leaf;
+    if (row == nullptr)
+        throw DbRelationError("no such record");
+    return row;
+}
+
+u32 BTreeTable::get_height() {
+    this->open();
+    PageLatch latch(this->file, BTreeFile::META_BLOCK, false);
+    BlockID root;
+    u32 height;
+    this->file.get_root(root, height);
+    return height;
+}
+
+void BTreeTable::set_page_size(uint page_size) {
+    if (!HeapFile::valid_page_size(page_size))
+        throw DbRelationError("page size must be a power of two from " + to_string(HeapFile::MIN_PAGE_SZ) + " to "
+                              + to_string(HeapFile::MAX_PAGE_SZ));
+    this->file.set_page_size(page_size);
+}
+
+/**
+ * A row as a leaf entry: the key, then every column as HeapTable marshals it (TEXT always inline)
+ * @param row the row (every column, in its type or one that converts to it)
+ * @return the entry
+ * @throws DbRelationError if a column is missing or of the wrong type, or the entry is too large for a leaf
+ */
+string BTreeTable::marshal(const ValueDict *row) {
+    string entry;
+    size_t num_columns = this->column_names.size();
+    vector<Value> values(num_columns);
+    for (size_t c = 0; c < num_columns; c++) {
+        ValueDict::const_iterator column = row->find(this->column_names[c]);
+        if (column == row->end())
+            throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+        values[c] = column->second;
+        if (values[c].data_type != this->codecs[c]->data_type) {
+            try {
+                values[c] = convert_value(values[c], this->codecs[c]->data_type);
+            } catch (DbRelationError &e) {
+                throw DbRelationError("wrong type of value for column " + this->column_names[c] + ": " + e.what());
+            }
+        }
+    }
+    entry = key_of(values[this->key_ordinal]);
+    for (size_t c = 0; c < num_columns; c++) {
+        const CodecOps &codec = *this->codecs[c];
+        if (codec.is_fixed()) {
+            char field[sizeof(int64_t)];
+            codec.marshal(values[c], field);
+            entry.append(field, codec.size);
+        } else {
+            if (values[c].s.length() > this->file.max_entry_size())
+                throw DbRelationError("row too large for a B+tree leaf");
+            u16 size = (u16) values[c].s.length();
+            entry.append((const char *) &size, sizeof(size));
+            entry.append(values[c].s);
+        }
+    }
+    if (entry.size() > this->file.max_entry_size())
+        throw DbRelationError("row too large for a B+tree leaf");
+    return entry;
+}
+
+/**
+ * Decode a leaf entry
+ * @param entry        the entry (the key, then the row)
+ * @param column_names the columns to decode (all of them if nullptr)
+ * @return the values (freed by caller)
+ */
+ValueDict *BTreeTable::unmarshal(const char *entry, const ColumnNames *column_names) {
+    ValueDict *row = new ValueDict();
+    const char *field = entry + this->codecs[this->key_ordinal]->size;
+    for (size_t c = 0; c < this->column_names.size(); c++) {
+        const CodecOps &codec = *this->codecs[c];
+        bool wanted = column_names == nullptr
+                      || find(column_names->begin(), column_names->end(), this->column_names[c]) != column_names->end();
+        if (codec.is_fixed()) {
+            if (wanted)
+                (*row)[this->column_names[c]] = codec.unmarshal(field);
+            field += codec.size;
+        } else {
+            u16 size;
+            memcpy(&size, field, sizeof(size));
+            if (wanted)
+                (*row)[this->column_names[c]] = Value(string(field + sizeof(size), size));
+            field += sizeof(size) + size;
+        }
+    }
+    return row;
+}
+
+string BTreeTable::key_of(const Value &value) {
+    const CodecOps &codec = *this->codecs[this->key_ordinal];
+    char key[sizeof(int64_t)];
+    codec.marshal(value.data_type == codec.data_type ? value : convert_value(value, codec.data_type), key);
+    return string(key, codec.size);
+}
+
+/**
+ * Descend from the root to the leaf a key belongs in (the caller holds the tree's latch)
+ * @param key  the key in marshal format, or nullptr for the first leaf
+ * @param path if given, filled with the internal nodes passed on the way (root first; freed by caller)
+ * @return the leaf (freed by caller)
+ */
+BTreeNode *BTreeTable::find_leaf(const char *key, vector<BTreeNode *> *path) {
+    BlockID root;
+    u32 height;
+    this->file.get_root(root, height);
+    BTreeNode *node = this->file.get_node(root);
+    while (!node->is_leaf()) {
+        BlockID child = key == nullptr ? node->get_link() : node->find_child(key);
+        if (path != nullptr)
+            path->push_back(node);
+        else
+            delete node;
+        node = this->file.get_node(child);
+    }
+    return node;
+}
+
+/**
+ * Add an entry to its leaf, splitting the leaf if it is full: in half by bytes, or, for a key past every other
+ * in the last leaf (a load in key order), leaving the old leaf full and starting the new one with the entry
+ * @param entry   the entry (key, then row)
+ * @param replace whether an entry with the same key gives way to it (nothing is written until it is in place)
+ * @return its handle
+ * @throws DbRelationError if its key is already in the tree (and not replace)
+ */
+Handle BTreeTable::insert_entry(const string &entry, bool replace) {
+    vector<BTreeNode *> path;
+    BTreeNode *leaf = nullptr, *right = nullptr;
+    Handle handle;
+    try {
+        leaf = find_leaf(entry.data(), &path);
+        leaf->compact();
+        RecordID record_id = leaf->lower_bound(entry.data());
+        if (record_id <= leaf->get_count()
+            && this->codecs[this->key_ordinal]->compare(leaf->key(record_id), entry.data()) == 0) {
+            if (!replace)
+                throw DbRelationError("duplicate key in " + this->table_name);
+            leaf->del(record_id);  // only in memory until the leaf is put with the new entry
+            leaf->compact();
+        }
+        if (leaf->insert(record_id, entry.data(), (u16) entry.size())) {
+            this->file.put(leaf);
+            handle = Handle(leaf->get_block_id(), record_id);
+        } else {
+            vector<string> entries;
+            leaf->get_entries(entries);
+            entries.insert(entries.begin() + (record_id - 1), entry);
+            bool appending = leaf->get_link() == 0 && record_id == entries.size();
+            size_t split = entries.size() - 1;
+            if (!appending) {
+                size_t total = 0, left = 0;
+                for (auto const &e: entries)
+                    total += e.size() + BTreeNode::SLOT_SIZE;
+                for (split = 0; split < entries.size() - 1 && left < total / 2; split++)
+                    left += entries[split].size() + BTreeNode::SLOT_SIZE;
+                split = max(split, (size_t) 1);
+            }
+            right = this->file.get_new_node(BTreeNode::LEAF);
+            right->set_entries(vector<string>(entries.begin() + split, entries.end()));
+            right->set_link(leaf->get_link());
+            leaf->set_entries(vector<string>(entries.begin(), entries.begin() + split));
+            leaf->set_link(right->get_block_id());
+            this->file.put(right);
+            this->file.put(leaf);
+            if ((size_t) record_id - 1 < split)
+                handle = Handle(leaf->get_block_id(), record_id);
+            else
+                handle = Handle(right->get_block_id(), (RecordID) (record_id - split));
+            string separator(right->key(1), this->codecs[this->key_ordinal]->size);
+            insert_child(path, (int) path.size() - 1, leaf->get_block_id(), separator, right->get_block_id(),
+                         appending);
+        }
+    } catch (...) {
+        for (auto node: path)
+            delete node;
+        delete leaf;
+        delete right;
+        throw;
+    }
+    for (auto node: path)
+        delete node;
+    delete leaf;
+    delete right;
+    return handle;
+}
+
+/**
+ * Add a split child to its parent, splitting the parent in turn if it is full (its middle key moves up), up to
+ * a new root if the root splits
+ * @param path      the internal nodes from the root down to the parent
+ * @param level     the parent's index in path (-1: the node that split was the root)
+ * @param left      the node that split
+ * @param key       the first key of the new node
+ * @param right     the new node, just after left
+ * @param appending the split was an append past the end of the tree: leave this level's nodes full too
+ */
+void BTreeTable::insert_child(vector<BTreeNode *> &path, int level, BlockID left, const string &key,
+                              BlockID right, bool appending) {
+    if (level < 0) {
+        BlockID root;
+        u32 height;
+        this->file.get_root(root, height);
+        BTreeNode *new_root = this->file.get_new_node(BTreeNode::INTERNAL);
+        new_root->set_link(left);
+        string entry = key + string((const char *) &right, sizeof(right));
+        new_root->insert(1, entry.data(), (u16) entry.size());
+        this->file.put(new_root);
+        this->file.set_root(new_root->get_block_id(), height + 1);
+        delete new_root;
+        return;
+    }
+    BTreeNode *parent = path[level];
+    RecordID record_id = parent->lower_bound(key.data(), true);
+    string entry = key + string((const char *) &right, sizeof(right));
+    if (parent->insert(record_id, entry.data(), (u16) entry.size())) {
+        this->file.put(parent);
+        return;
+    }
+    vector<string> entries;
+    parent->get_entries(entries);
+    entries.insert(entries.begin() + (record_id - 1), entry);
+    appending = appending && record_id == entries.size();
+    size_t middle = appending ? entries.size() - 1 : entries.size() / 2;
+    BTreeNode *sibling = this->file.get_new_node(BTreeNode::INTERNAL);
+    size_t key_size = this->codecs[this->key_ordinal]->size;
+    BlockID middle_child;
+    memcpy(&middle_child, entries[middle].data() + key_size, sizeof(middle_child));
+    sibling->set_link(middle_child);
+    sibling->set_entries(vector<string>(entries.begin() + middle + 1, entries.end()));
+    string up = entries[middle].substr(0, key_size);
+    parent->set_entries(vector<string>(entries.begin(), entries.begin() + middle));
+    this->file.put(sibling);
+    this->file.put(parent);
+    BlockID sibling_id = sibling->get_block_id();
+    delete sibling;
+    insert_child(path, level - 1, parent->get_block_id(), up, sibling_id, appending);
+}
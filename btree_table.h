@@ -0,0 +1,296 @@
+/**
+ * @file   btree_table.h
+ * @brief  Clustered B+tree storage engine: a table's rows kept in primary-key order in a B+tree of blocks
+ *
+ * A HeapTable puts rows wherever there is room, so finding one by key needs a scan (or an index that points at
+ * it), and a range of keys is spread over the whole file. A BTreeTable keeps its rows in the leaves of a B+tree
+ * ordered by one fixed-width column, its key: a point lookup reads one block per level, and a range scan reads
+ * only the leaves the range covers, in key order, following each leaf's link to the next.
+ *
+ *      CREATE TABLE readings (at TIMESTAMP, sensor INT, value DOUBLE) WITH (engine = btree, key = at)
+ *
+ * BTreeNode: a block of the tree, a leaf (rows) or an internal node (keys and children)
+ * BTreeFile: the tree's blocks, in a Berkeley DB RecNo file like a HeapFile's, with the root in block 1
+ * BTreeTable: the DbRelation
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "heap_storage.h"
+
+struct ColumnRange;
+
+/**
+ * @class BTreeNode - a block of a B+tree: a header, then slots in key order growing up, then the entries they
+ *      point to growing down from the end of the block
+ *
+ *      Every entry starts with its key (in marshal format). A leaf's entry is the key then the row; an internal
+ *      node's is the key then the child holding the keys from it up to the next entry's. The header's link is a
+ *      leaf's next leaf (0 for the last) or an internal node's leftmost child (the keys below its first entry).
+ *      Deleting marks a leaf's slot DEAD instead of removing it, so the positions of the other rows (their
+ *      handles' record ids) stay put; the next insert into the leaf compacts it.
+ *      Positions are record ids: 1 to get_count().
+ */
+class BTreeNode : public DbBlock {
+public:
+    enum Kind {
+        LEAF = 1,
+        INTERNAL = 2
+    };
+
+    static const u_int32_t MAGIC = 0xB7EE0DE5;  // not PaxPage's, so HeapFile reads the block as a slotted page
+    static const uint HEADER_SIZE = 16;        // magic, kind, count, link, free_end
+    static const uint SLOT_SIZE = 4;           // offset, size
+    static const u_int16_t DEAD = 0x8000;      // in a slot's size: the row was deleted
+
+    /**
+     * @param block      the block's bytes, allocated with new char[] (the node frees them)
+     * @param block_id   its id
+     * @param key_codec  the key's codec (a fixed-width type)
+     * @param is_new     initialize an empty node of kind
+     */
+    BTreeNode(Dbt &block, BlockID block_id, const CodecOps &key_codec, bool is_new = false, Kind kind = LEAF);
+
+    virtual ~BTreeNode();
+
+    BTreeNode(const BTreeNode &other) = delete;
+
+    BTreeNode &operator=(const BTreeNode &other) = delete;
+
+    // add an entry at its place in key order (after any equal keys)
+    virtual RecordID add(const Dbt *data);
+
+    virtual Dbt *get(RecordID record_id);
+
+    // replace an entry (its key must not change the order)
+    virtual void put(RecordID record_id, const Dbt &data);
+
+    // a leaf's: mark the row deleted
+    virtual void del(RecordID record_id);
+
+    virtual RecordIDs *ids(void);
+
+    virtual bool is_leaf() const { return get_u16(4) == LEAF; }
+
+    // whether the block is a B+tree node at all
+    virtual bool is_node() const;
+
+    // slots, dead ones included
+    virtual RecordID get_count() const { return get_u16(6); }
+
+    virtual BlockID get_link() const { return get_u32(8); }
+
+    virtual void set_link(BlockID link) { put_u32(8, link); }
+
+    virtual const char *key(RecordID record_id) const { return address(slot_offset(record_id)); }
+
+    virtual const char *entry(RecordID record_id) const { return key(record_id); }
+
+    virtual u_int16_t entry_size(RecordID record_id) const { return get_u16(slot(record_id) + 2) & ~DEAD; }
+
+    virtual bool is_dead(RecordID record_id) const { return (get_u16(slot(record_id) + 2) & DEAD) != 0; }
+
+    // the first position whose key is >= key (> key if after), or get_count() + 1 if there is none
+    virtual RecordID lower_bound(const char *key, bool after = false) const;
+
+    // an internal node's child for a key: the one of the last entry whose key is <= key, else the link
+    virtual BlockID find_child(const char *key) const;
+
+    // an internal node's child at a position (0: the link)
+    virtual BlockID child(RecordID record_id) const;
+
+    // insert an entry at a position; false if there is no room
+    virtual bool insert(RecordID record_id, const char *data, u_int16_t size);
+
+    // replace an entry in place; false if there is no room for its new size
+    virtual bool replace(RecordID record_id, const char *data, u_int16_t size);
+
+    // remove the dead slots (moving the positions after them)
+    virtual void compact();
+
+    // the live entries, in order
+    virtual void get_entries(std::vector<std::string> &entries) const;
+
+    // make the node hold just these entries, in this order (they must fit)
+    virtual void set_entries(const std::vector<std::string> &entries);
+
+    // bytes for entries and their slots
+    virtual uint free_space() const { return get_u32(12) - HEADER_SIZE - SLOT_SIZE * get_count(); }
+
+    // the bytes entries and slots of an empty node of the size take
+    static uint capacity(uint page_size) { return page_size - HEADER_SIZE; }
+
+protected:
+    const CodecOps &key_codec;
+
+    virtual uint slot(RecordID record_id) const { return HEADER_SIZE + SLOT_SIZE * (record_id - 1); }
+
+    virtual u_int16_t slot_offset(RecordID record_id) const { return get_u16(slot(record_id)); }
+
+    virtual void check(RecordID record_id) const;
+
+    virtual u_int16_t get_u16(uint offset) const;
+
+    virtual void put_u16(uint offset, u_int16_t n);
+
+    virtual u_int32_t get_u32(uint offset) const;
+
+    virtual void put_u32(uint offset, u_int32_t n);
+
+    virtual char *address(uint offset) const { return (char *) this->block.get_data() + offset; }
+};
+
+/**
+ * @class BTreeFile - the blocks of a B+tree: block 1 records the root and the tree's height, the others are
+ *      BTreeNodes
+ *
+ *      Reads go through get_node, which tells the file's ReadAhead, so a range scan's walk along the leaves (which
+ *      a load in key order allocates one after another) is read ahead like a heap scan. Not logged in durable
+ *      mode: nodes are written with put, and the file is synced at checkpoints like any other.
+ */
+class BTreeFile : public HeapFile {
+public:
+    static const BlockID META_BLOCK = 1;
+    static const u_int32_t META_MAGIC = 0xB7EE0001;
+
+    BTreeFile(std::string name, const CodecOps &key_codec, uint page_size = DbBlock::BLOCK_SZ);
+
+    virtual ~BTreeFile() {}
+
+    // the meta block, and an empty leaf as the root
+    virtual void create(void);
+
+    // a copy of a node (freed by caller)
+    virtual BTreeNode *get_node(BlockID block_id);
+
+    // a new empty node, written out (freed by caller)
+    virtual BTreeNode *get_new_node(BTreeNode::Kind kind);
+
+    virtual void get_root(BlockID &root, u_int32_t &height);
+
+    virtual void set_root(BlockID root, u_int32_t height);
+
+    // the largest leaf entry, so a leaf that splits always has room for each half
+    virtual uint max_entry_size() const { return BTreeNode::capacity(this->page_size) / 4 - BTreeNode::SLOT_SIZE; }
+
+protected:
+    const CodecOps &key_codec;
+
+    // write out a new block with these bytes (a page_size buffer) and return its id
+    virtual BlockID append(char *bytes);
+
+    // read block 1 into meta (a page_size buffer)
+    virtual void read_meta(char *meta);
+};
+
+/**
+ * @class BTreeTable - Clustered B+tree storage engine (implementation of DbRelation)
+ *
+ *      Rows are kept in leaves in the order of the key column, which must be of a fixed-width type; the key is
+ *      unique, so inserting a row with a key already in the table throws. A handle is a leaf and a position in
+ *      it: insert may move rows (a leaf compacts or splits), so handles are good until the next insert, or an
+ *      update that changes a row's key or makes it grow out of its leaf; del and other updates keep them.
+ *      Each row is stored whole in its leaf, in HeapTable's column format (so CompiledPredicates evaluate it in
+ *      place), with no version header: changes are made in place, seen by every reader at once, and there is no
+ *      out-of-line TEXT, so a row may take at most BTreeFile::max_entry_size() bytes. Leaves that deletes empty
+ *      are left in the tree. One shared/exclusive latch covers the whole tree (the meta block's PageLatch):
+ *      readers run side by side, and a writer has the tree to itself.
+ */
+class BTreeTable : public DbRelation {
+public:
+    static const Identifier PRIMARY;  // the name of the _indices row that records a table's key
+
+    /**
+     * @param key_column  the key (a column of a fixed-width type)
+     * @throws            DbRelationError if there is no such column, or its type is TEXT
+     */
+    BTreeTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+               Identifier key_column, uint page_size = DbBlock::BLOCK_SZ);
+
+    virtual ~BTreeTable() {}
+
+    BTreeTable(const BTreeTable &other) = delete;
+
+    BTreeTable &operator=(const BTreeTable &other) = delete;
+
+    virtual void create();
+
+    virtual void create_if_not_exists();
+
+    virtual void drop();
+
+    virtual void open();
+
+    virtual void close();
+
+    // throws DbRelationError if the key is already in the table
+    virtual Handle insert(const ValueDict *row);
+
+    virtual Handle update(const Handle handle, const ValueDict *new_values);
+
+    virtual void del(const Handle handle);
+
+    // every row, in key order
+    virtual Handles *select();
+
+    // an equality on the key is a point lookup; the rest of where filters
+    virtual Handles *select(const ValueDict *where);
+
+    /**
+     * The rows whose keys are in a range, in key order.
+     * @param range      the key column's range (see ExprCompiler::column_range)
+     * @param predicate  what else a row must satisfy (nullptr for nothing)
+     * @return           their handles (freed by caller)
+     */
+    virtual Handles *select(const ColumnRange &range, const CompiledPredicate *predicate = nullptr);
+
+    // the handle of the row with a key: false if there is none
+    virtual bool lookup(const Value &key, Handle &handle);
+
+    virtual ValueDict *project(Handle handle);
+
+    virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
+
+    virtual const Identifier &get_key_column() const { return column_names[key_ordinal]; }
+
+    virtual u_int16_t get_key_ordinal() const { return key_ordinal; }
+
+    // levels from the root to the leaves (1: the root is a leaf)
+    virtual u_int32_t get_height();
+
+    /**
+     * Choose the page size for create() (an existing table keeps the size it was created with).
+     * @throws DbRelationError if it is not a power of two from HeapFile::MIN_PAGE_SZ to HeapFile::MAX_PAGE_SZ
+     */
+    virtual void set_page_size(uint page_size);
+
+protected:
+    u_int16_t key_ordinal;
+    std::vector<const CodecOps *> codecs;  // each column's
+    BTreeFile file;
+
+    // a row in leaf format: the key, then the columns (converted to their types)
+    virtual std::string marshal(const ValueDict *row);
+
+    // column_names: the columns to decode (all of them if nullptr)
+    virtual ValueDict *unmarshal(const char *entry, const ColumnNames *column_names = nullptr);
+
+    // the key of a value of the key column, in marshal format
+    virtual std::string key_of(const Value &value);
+
+    // the leaf a key belongs in, with the internal nodes above it (root first) if path is given
+    virtual BTreeNode *find_leaf(const char *key, std::vector<BTreeNode *> *path = nullptr);
+
+    // add a leaf entry under the tree's exclusive latch, splitting what has to split; with replace, it takes the
+    // place of the entry with its key
+    virtual Handle insert_entry(const std::string &entry, bool replace = false);
+
+    // add (key, right) to path[level], the parent of left, after left split into left and right
+    virtual void insert_child(std::vector<BTreeNode *> &path, int level, BlockID left, const std::string &key,
+                              BlockID right, bool appending);
+};
+
+bool test_btree_table();
@@ -0,0 +1,432 @@
+/**
+ * @file   bulk_loader.cpp
+ * @brief  the implementation file for BulkLoader
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "bulk_loader.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include "heap_storage.h"
+#include "schema_tables.h"
+#include "sql_exec.h"
+#include "sql_script.h"
+#include "trace.h"
+using namespace std;
+using namespace hsql;
+
+
+/**
+ * A chunk of the script on its way to a worker; the worker fulfils result, which the loading thread
+ * waits on in script order.
+ */
+struct ChunkTask {
+    vector<string> statements;
+    vector<size_t> lines;
+    promise<ParsedChunk *> result;
+};
+
+// a stream buffer that fails after its first few statements, as a read error would
+class FailingScript : public streambuf {
+public:
+    FailingScript() : script(string(20, ' ') + "CREATE TABLE _bulk_loader_failing (a INT);\n") {
+        setg(&this->script[0], &this->script[0], &this->script[0] + this->script.size());
+    }
+
+protected:
+    virtual int_type underflow() {
+        throw runtime_error("read error");
+    }
+
+    string script;
+};
+
+/**
+ * Testing function for BulkLoader.
+ * Loads a script of CREATE TABLE and many INSERTs (with a bad statement in the middle) on several workers
+ * in small chunks, then checks every row arrived, in script order. Then loads a CREATE TABLE ... WITH (...)
+ * with a BIGINT column and a row that fails inside a batch, and a script whose stream fails part way
+ * (load throws, having joined its threads).
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_bulk_loader() {
+    const int num_rows = 5000;
+    stringstream script;
+    script << "CREATE TABLE _bulk_loader_test (a INT, b TEXT);\n";
+    for (int i = 0; i < num_rows; i++) {
+        script << "INSERT INTO _bulk_loader_test VALUES (" << i << ", 'row " << i << "');\n";
+        if (i == num_rows / 2)
+            script << "INSERT INTO _bulk_loader_test VALUES (oops;\n";
+    }
+    BulkLoader loader(4, 100, 700);
+    stringstream log;
+    LoadSummary summary = loader.load(script, log);
+    bool ok = true;
+    if (summary.rows != (size_t) num_rows || summary.failed != 1 || summary.statements != (size_t) num_rows + 2
+        || log.str().find("line " + to_string(num_rows / 2 + 3)) == string::npos) {
+        cout << "FAILED TEST: loaded " << summary.rows << " rows from " << summary.statements << " statements, "
+             << summary.failed << " failed: " << log.str() << endl;
+        ok = false;
+    }
+    try {
+        DbRelation &table = SQLExec::get_tables().get_table("_bulk_loader_test");
+        Handles *handles = table.select();
+        int expected = 0;
+        for (auto const &handle: *handles) {
+            ValueDict *row = table.project(handle);
+            if ((*row)["a"].n != expected || (*row)["b"].s != "row " + to_string(expected)) {
+                cout << "FAILED TEST: row " << expected << " out of order" << endl;
+                ok = false;
+                delete row;
+                break;
+            }
+            delete row;
+            expected++;
+        }
+        if (expected != num_rows && ok) {
+            cout << "FAILED TEST: read back " << expected << " rows" << endl;
+            ok = false;
+        }
+        delete handles;
+        SQLParserResult *drop = SQLParser::parseSQLString("DROP TABLE _bulk_loader_test");
+        delete SQLExec::execute(drop->getStatement(0));
+        delete drop;
+    } catch (exception &e) {
+        cout << "FAILED TEST: " << e.what() << endl;
+        ok = false;
+    }
+
+    // CREATE TABLE with the shell's WITH clause and a type the parser doesn't know; a row that fails part way
+    // through a batch costs only itself
+    stringstream typed;
+    typed << "CREATE TABLE _bulk_loader_typed (a INT, big BIGINT) WITH (page_size = 8192);\n";
+    for (int i = 0; i < 100; i++)
+        typed << "INSERT INTO _bulk_loader_typed VALUES (" << (i == 40 ? "'forty'" : to_string(i)) << ", "
+              << i * 10000000000LL << ");\n";
+    log.str("");
+    summary = loader.load(typed, log);
+    if (summary.rows != 99 || summary.failed != 1 || log.str().find("line 42:") == string::npos) {
+        cout << "FAILED TEST: typed load of " << summary.rows << " rows, " << summary.failed << " failed: "
+             << log.str() << endl;
+        ok = false;
+    }
+    try {
+        DbRelation &table = SQLExec::get_tables().get_table("_bulk_loader_typed");
+        HeapTable *heap = dynamic_cast<HeapTable *>(&table);
+        Handles *handles = table.select();
+        size_t count = handles->size();
+        ValueDict *last = count > 0 ? table.project(handles->back()) : nullptr;
+        if (count != 99 || heap == nullptr || heap->get_page_size() != 8192 || last == nullptr
+            || (*last)["big"].l != 99 * 10000000000LL) {
+            cout << "FAILED TEST: typed load left " << count << " rows" << endl;
+            ok = false;
+        }
+        delete last;
+        delete handles;
+        SQLParserResult *drop = SQLParser::parseSQLString("DROP TABLE _bulk_loader_typed");
+        delete SQLExec::execute(drop->getStatement(0));
+        delete drop;
+    } catch (exception &e) {
+        cout << "FAILED TEST: " << e.what() << endl;
+        ok = false;
+    }
+
+    FailingScript failing_buffer;
+    istream failing(&failing_buffer);
+    failing.exceptions(ios::badbit);
+    try {
+        BulkLoader(2, 1, 10).load(failing, log);
+        cout << "FAILED TEST: load of a failing stream did not throw" << endl;
+        ok = false;
+    } catch (runtime_error &e) {
+    }
+    try {
+        SQLParserResult *drop = SQLParser::parseSQLString("DROP TABLE _bulk_loader_failing");
+        delete SQLExec::execute(drop->getStatement(0));
+        delete drop;
+    } catch (exception &e) {
+    }
+    return ok;
+}
+
+
+/*****************************************BulkLoader****************************************************************/
+
+BulkLoader::BulkLoader(uint num_threads, size_t chunk_statements, size_t batch_rows)
+        : num_threads(num_threads), chunk_statements(chunk_statements ? chunk_statements : 1),
+          batch_rows(batch_rows ? batch_rows : 1) {
+    if (this->num_threads == 0) {
+        uint hardware = thread::hardware_concurrency();
+        this->num_threads = hardware > 1 ? hardware - 1 : 1;
+    }
+}
+
+ParsedChunk *BulkLoader::parse_chunk(const vector<string> &given, const vector<size_t> &lines) {
+    TRACE_SPAN("BulkLoader::parse_chunk", "parse");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    ParsedChunk *chunk = new ParsedChunk();
+    // CREATE TABLE ... WITH (...) and unknown column types are rewritten for the parser, as the shell does
+    vector<string> statements = given;
+    vector<LoadItem> creates(statements.size());
+    for (size_t i = 0; i < statements.size(); i++) {
+        string create;
+        creates[i].split_create = SQLExec::split_create(statements[i], create, creates[i].options,
+                                                        creates[i].column_types);
+        if (creates[i].split_create)
+            statements[i] = create;
+    }
+    auto add = [chunk, &creates](const SQLStatement *statement, size_t i, size_t line) {
+        LoadItem item;
+        item.statement = statement;
+        item.line = line;
+        item.has_values = false;
+        item.split_create = creates[i].split_create;
+        item.options = creates[i].options;
+        item.column_types = creates[i].column_types;
+        if (statement->type() == kStmtInsert) {
+            const InsertStatement *insert = (const InsertStatement *) statement;
+            if (insert->type == InsertStatement::kInsertValues) {
+                try {
+                    for (auto const &expr: *insert->values)
+                        item.values.push_back(SQLExec::literal(expr));
+                    item.has_values = true;
+                } catch (exception &e) {
+                    item.statement = nullptr;
+                    item.error = e.what();
+                }
+            }
+        }
+        chunk->items.push_back(item);
+    };
+
+    // usually the whole chunk parses at once; if not, parse statement by statement to find the bad ones
+    string text;
+    for (auto const &statement: statements)
+        text += statement + ";\n";
+    SQLParserResult *result = SQLParser::parseSQLString(text);
+    if (result->isValid() && result->size() == statements.size()) {
+        chunk->parsed.push_back(result);
+        for (size_t i = 0; i < statements.size(); i++)
+            add(result->getStatement(i), i, lines[i]);
+    } else {
+        delete result;
+        for (size_t i = 0; i < statements.size(); i++) {
+            SQLParserResult *single = SQLParser::parseSQLString(statements[i]);
+            if (single->isValid() && single->size() == 1) {
+                chunk->parsed.push_back(single);
+                add(single->getStatement(0), i, lines[i]);
+            } else {
+                delete single;
+                LoadItem item;
+                item.statement = nullptr;
+                item.line = lines[i];
+                item.has_values = false;
+                item.split_create = false;
+                item.error = "invalid SQL: " + given[i].substr(0, 80);
+                chunk->items.push_back(item);
+            }
+        }
+    }
+    chunk->parse_seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return chunk;
+}
+
+LoadSummary BulkLoader::load(istream &in, ostream &log) {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    LoadSummary summary;
+    BoundedQueue<ChunkTask *> work(this->num_threads * 2);
+    BoundedQueue<future<ParsedChunk *> > ordered(this->num_threads * 4);
+
+    // whatever goes wrong below, the queues are closed and the threads joined before load returns or throws
+    vector<thread> workers;
+    thread reader;
+    exception_ptr reader_error;
+    auto stop_threads = [&]() {
+        work.close();
+        ordered.close();
+        if (reader.joinable())
+            reader.join();
+        for (auto &worker: workers)
+            if (worker.joinable())
+                worker.join();
+    };
+    Identifier batch_table;
+    ValueDicts batch;
+    vector<size_t> batch_lines;  // where each row's INSERT is in the script
+    ParsedChunk *chunk = nullptr;
+    future<ParsedChunk *> next;
+    try {
+        for (uint i = 0; i < this->num_threads; i++) {
+            workers.push_back(thread([&work]() {
+                ChunkTask *task;
+                while (work.pop(task)) {
+                    try {
+                        task->result.set_value(parse_chunk(task->statements, task->lines));
+                    } catch (...) {
+                        task->result.set_exception(current_exception());
+                    }
+                    delete task;
+                }
+            }));
+        }
+
+        // the reader queues each chunk's future (for the order) before handing the chunk to the workers
+        // (it stops early if the queues are closed under it, when this thread gives up)
+        reader = thread([this, &in, &work, &ordered, &reader_error]() {
+            ChunkTask *task = new ChunkTask();
+            auto submit = [&]() {
+                if (!ordered.push(task->result.get_future()) || !work.push(task))
+                    return false;
+                task = new ChunkTask();
+                return true;
+            };
+            try {
+                SQLScriptReader script(in);
+                string statement;
+                bool open = true;
+                while (open && script.next(statement)) {
+                    task->statements.push_back(statement);
+                    task->lines.push_back(script.get_line());
+                    if (task->statements.size() >= this->chunk_statements)
+                        open = submit();
+                }
+                if (open && !task->statements.empty())
+                    submit();
+            } catch (...) {
+                reader_error = current_exception();
+            }
+            delete task;
+            work.close();
+            ordered.close();
+        });
+
+        // this thread: rows go to insert_batch a table at a time, anything else runs through SQLExec in order
+        auto flush = [&]() {
+            if (batch.empty())
+                return;
+            TRACE_SPAN("BulkLoader::insert_batch", "storage");
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            DbRelation *relation = nullptr;
+            size_t next = 0;  // the first row not yet inserted or failed
+            try {
+                relation = &SQLExec::get_tables().get_table(batch_table);
+                HeapTable *table = dynamic_cast<HeapTable *>(relation);
+                if (table != nullptr) {
+                    size_t stored = 0;
+                    try {
+                        delete table->insert_batch(&batch, &stored);
+                    } catch (exception &e) {
+                        // the rows before the one that failed are in the table; the rest go in one at a time
+                        log << "line " << batch_lines[min(stored, batch.size() - 1)] << ": " << e.what() << endl;
+                        if (stored < batch.size()) {
+                            summary.failed++;
+                            next = 1;
+                        }
+                    }
+                    summary.rows += stored;
+                    next += stored;
+                }
+            } catch (exception &e) {
+                log << "line " << batch_lines[0] << ": " << batch.size() << " rows into " << batch_table
+                    << " from here failed: " << e.what() << endl;
+                summary.failed += batch.size();
+                next = batch.size();
+            }
+            for (; next < batch.size(); next++) {  // a B+tree table puts each row at its key's place
+                try {
+                    relation->insert(batch[next]);
+                    summary.rows++;
+                } catch (exception &e) {
+                    log << "line " << batch_lines[next] << ": " << e.what() << endl;
+                    summary.failed++;
+                }
+            }
+            summary.insert_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            for (auto row: batch)
+                delete row;
+            batch.clear();
+            batch_lines.clear();
+        };
+
+        while (ordered.pop(next)) {
+            chunk = nullptr;
+            try {
+                chunk = next.get();
+            } catch (exception &e) {
+                log << "parsing failed: " << e.what() << endl;
+                summary.failed++;
+                continue;
+            }
+            summary.parse_seconds += chunk->parse_seconds;
+            for (auto const &item: chunk->items) {
+                summary.statements++;
+                if (item.statement == nullptr) {
+                    log << "line " << item.line << ": " << item.error << endl;
+                    summary.failed++;
+                    continue;
+                }
+                if (item.has_values) {
+                    const InsertStatement *insert = (const InsertStatement *) item.statement;
+                    if (batch_table != insert->tableName)
+                        flush();
+                    try {
+                        ColumnNames column_names;
+                        if (insert->columns != nullptr) {
+                            for (auto const &column_name: *insert->columns)
+                                column_names.push_back(column_name);
+                        } else {
+                            column_names = SQLExec::get_tables().get_table(insert->tableName).get_column_names();
+                        }
+                        if (column_names.size() != item.values.size())
+                            throw SQLExecError("wrong number of values");
+                        ValueDict *row = new ValueDict();
+                        for (size_t i = 0; i < column_names.size(); i++)
+                            (*row)[column_names[i]] = item.values[i];
+                        batch_table = insert->tableName;
+                        batch.push_back(row);
+                        batch_lines.push_back(item.line);
+                    } catch (exception &e) {
+                        log << "line " << item.line << ": " << e.what() << endl;
+                        summary.failed++;
+                    }
+                    if (batch.size() >= this->batch_rows)
+                        flush();
+                    continue;
+                }
+                flush();
+                try {
+                    if (item.split_create)
+                        delete SQLExec::create((const CreateStatement *) item.statement, item.options,
+                                               item.column_types);
+                    else
+                        delete SQLExec::execute(item.statement);
+                } catch (exception &e) {
+                    log << "line " << item.line << ": " << e.what() << endl;
+                    summary.failed++;
+                }
+            }
+            delete chunk;
+            chunk = nullptr;
+        }
+        flush();
+    } catch (...) {
+        stop_threads();
+        delete chunk;
+        for (auto row: batch)
+            delete row;
+        while (ordered.pop(next)) {  // chunks parsed for nothing (or never, if their task was dropped)
+            try {
+                delete next.get();
+            } catch (...) {
+            }
+        }
+        throw;
+    }
+
+    stop_threads();
+    if (reader_error)
+        rethrow_exception(reader_error);
+    summary.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return summary;
+}
@@ -0,0 +1,109 @@
+/**
+ * @file   bulk_loader.h
+ * @brief  Loading large SQL scripts (dumps of INSERTs) with parsing spread over a thread pool
+ *
+ * A reader thread splits the script into chunks of statements. Worker threads parse the chunks and turn
+ * each INSERT's literals into Values. The calling thread takes the parsed chunks back in script order
+ * and feeds the rows to HeapTable::insert_batch (a B+tree table's one at a time), running any other statement
+ * (CREATE TABLE, ...) in place. CREATE TABLE goes through SQLExec::split_create first, as in the shell, so a dump
+ * may use WITH (...) and the column types the parser doesn't know.
+ * Every queue between them is bounded, so parsing and storage overlap without the script piling up in memory.
+ *
+ * BulkLoader: the pipeline
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SQLParser.h"
+#include "storage_engine.h"
+#include "bounded_queue.h"
+#include "sql_exec.h"
+
+/**
+ * @class LoadItem - one statement of a parsed chunk
+ */
+struct LoadItem {
+    const hsql::SQLStatement *statement;  // nullptr if it didn't parse
+    size_t line;                          // where it starts in the script
+    bool has_values;                      // an INSERT ... VALUES whose literals are in values
+    std::vector<Value> values;
+    std::string error;                    // why it didn't parse
+    bool split_create;                    // a CREATE TABLE that SQLExec::split_create rewrote
+    TableOptions options;                 // its WITH (...) options
+    ColumnTypes column_types;             // and the types of the columns the parser was given as INT
+};
+
+/**
+ * @class ParsedChunk - the statements of one chunk, and the parses that own them
+ */
+struct ParsedChunk {
+    std::vector<hsql::SQLParserResult *> parsed;
+    std::vector<LoadItem> items;
+    double parse_seconds;
+
+    ParsedChunk() : parse_seconds(0) {}
+
+    ~ParsedChunk() {
+        for (auto result: parsed)
+            delete result;
+    }
+
+    ParsedChunk(const ParsedChunk &other) = delete;
+
+    ParsedChunk &operator=(const ParsedChunk &other) = delete;
+};
+
+/**
+ * @class LoadSummary - what a load did
+ */
+struct LoadSummary {
+    size_t statements = 0;
+    size_t rows = 0;      // rows inserted
+    size_t failed = 0;    // statements that didn't parse or failed to execute
+    double seconds = 0;
+    double parse_seconds = 0;  // summed over the workers
+    double insert_seconds = 0;
+};
+
+/**
+ * @class BulkLoader - runs a script through the parse/insert pipeline
+ */
+class BulkLoader {
+public:
+    static const size_t DEFAULT_CHUNK_STATEMENTS = 1000;
+    static const size_t DEFAULT_BATCH_ROWS = 5000;
+
+    /**
+     * @param num_threads       parsing workers (0 for one fewer than the hardware threads)
+     * @param chunk_statements  statements handed to a worker at a time
+     * @param batch_rows        rows per HeapTable::insert_batch
+     */
+    explicit BulkLoader(uint num_threads = 0, size_t chunk_statements = DEFAULT_CHUNK_STATEMENTS,
+                        size_t batch_rows = DEFAULT_BATCH_ROWS);
+
+    virtual ~BulkLoader() {}
+
+    /**
+     * Load a script. Must be called from the thread that owns the catalog (SQLExec).
+     * @param in    the script
+     * @param log   where statements that fail are reported, with their line numbers
+     */
+    virtual LoadSummary load(std::istream &in, std::ostream &log);
+
+    virtual uint get_num_threads() const { return num_threads; }
+
+protected:
+    uint num_threads;
+    size_t chunk_statements;
+    size_t batch_rows;
+
+    // worker side: parse a chunk and convert its INSERT literals
+    static ParsedChunk *parse_chunk(const std::vector<std::string> &statements, const std::vector<size_t> &lines);
+};
+
+bool test_bulk_loader();
@@ -0,0 +1,461 @@
+/**
+ * @file   column_codec.cpp
+ * @brief  the implementation file for the CodecOps table and Value conversions
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "column_codec.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <strings.h>
+#include "SQLParser.h"
+#include "expr_compiler.h"
+#include "heap_storage.h"
+using namespace std;
+using namespace hsql;
+
+
+typedef u_int64_t u64;
+
+static const int64_t MICROS_PER_DAY = 86400LL * 1000000;
+
+/**
+ * Testing function for the column types: codecs, conversions, and a table of every type in both page layouts.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_column_types() {
+    // each fixed codec round-trips and orders its values
+    const Value samples[][2] = {
+            {Value(-7),                          Value(12)},
+            {Value::bigint(-5000000000LL),       Value::bigint(5000000000LL)},
+            {Value::real(-0.25),                 Value::real(3.5)},
+            {Value::boolean(false),              Value::boolean(true)},
+            {Value::date(-1),                    Value::date(18413)},
+            {Value::timestamp(-1),               Value::timestamp(1590932700123456LL)}};
+    for (auto const &pair: samples) {
+        const CodecOps &codec = codec_ops(pair[0].data_type);
+        char low[8], high[8];
+        codec.marshal(pair[0], low);
+        codec.marshal(pair[1], high);
+        if (codec.data_type != pair[0].data_type || compare_values(codec.unmarshal(high), pair[1]) != 0
+            || codec.compare(low, high) >= 0 || codec.compare(high, low) <= 0 || codec.compare(low, low) != 0) {
+            cout << "FAILED TEST: " << codec.name << " codec" << endl;
+            return false;
+        }
+    }
+    struct Conversion {
+        Value from;
+        ColumnAttribute::DataType to;
+        const char *expected;  // as value_to_string prints it, or nullptr if the conversion must fail
+    } conversions[] = {
+            {Value(42),                      ColumnAttribute::BIGINT,    "42"},
+            {Value(3),                       ColumnAttribute::DOUBLE,    "3"},
+            {Value::real(2.5),               ColumnAttribute::DOUBLE,    "2.5"},
+            {Value(1),                       ColumnAttribute::BOOLEAN,   "true"},
+            {Value(2),                       ColumnAttribute::BOOLEAN,   nullptr},
+            {Value("FALSE"),                 ColumnAttribute::BOOLEAN,   "false"},
+            {Value("2020-05-31"),            ColumnAttribute::DATE,      "2020-05-31"},
+            {Value("1969-12-31"),            ColumnAttribute::DATE,      "1969-12-31"},
+            {Value("2020-02-30"),            ColumnAttribute::DATE,      nullptr},
+            {Value("2020-05-31 13:45:00"),   ColumnAttribute::TIMESTAMP, "2020-05-31 13:45:00"},
+            {Value("1969-12-31T23:59:59.5"), ColumnAttribute::TIMESTAMP, "1969-12-31 23:59:59.500000"},
+            {Value("2020-05-31"),            ColumnAttribute::TIMESTAMP, "2020-05-31 00:00:00"},
+            {Value::bigint(1LL << 40),       ColumnAttribute::INT,       nullptr},
+            {Value("12"),                    ColumnAttribute::INT,       nullptr},
+            {Value(12),                      ColumnAttribute::TEXT,      nullptr}};
+    for (auto const &c: conversions) {
+        string actual;
+        try {
+            Value converted = convert_value(c.from, c.to);
+            actual = converted.data_type == c.to ? value_to_string(converted) : "wrong type";
+        } catch (DbRelationError &e) {
+            actual = "error";
+        }
+        if (actual != (c.expected == nullptr ? "error" : c.expected)) {
+            cout << "FAILED TEST: converting " << value_to_string(c.from) << " to " << codec_ops(c.to).name
+                 << " gave " << actual << endl;
+            return false;
+        }
+    }
+
+    // a table with a column of each type, in both layouts
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    const ColumnAttribute::DataType types[] = {ColumnAttribute::INT, ColumnAttribute::BIGINT, ColumnAttribute::DOUBLE,
+                                               ColumnAttribute::BOOLEAN, ColumnAttribute::DATE,
+                                               ColumnAttribute::TIMESTAMP, ColumnAttribute::TEXT};
+    const char *names[] = {"i", "l", "d", "b", "dt", "ts", "t"};
+    for (size_t c = 0; c < sizeof(types) / sizeof(types[0]); c++) {
+        column_names.push_back(names[c]);
+        column_attributes.push_back(ColumnAttribute(types[c]));
+    }
+    const int num_rows = 500;
+    for (int layout = 0; layout < 2; layout++) {
+        HeapTable table(layout == 0 ? "_test_column_types_row" : "_test_column_types_pax", column_names,
+                        column_attributes);
+        table.set_layout(layout == 0 ? HeapTable::ROW : HeapTable::PAX);
+        table.create();
+        bool ok = true;
+        for (int i = 0; i < num_rows; i++) {
+            ValueDict row;
+            row["i"] = Value(i);
+            row["l"] = Value::bigint((int64_t) i * 10000000000LL);
+            row["d"] = Value::real(i / 4.0);
+            row["b"] = Value::boolean(i % 3 == 0);
+            row["dt"] = Value("2020-01-01");                    // converted by insert
+            row["ts"] = Value::timestamp((int64_t) i * MICROS_PER_DAY / 24);
+            row["t"] = Value("row " + to_string(i));
+            if (i % 2 == 1)
+                row["l"] = Value(i);                            // an INT for a BIGINT column is converted too
+            table.insert(&row);
+        }
+        Handles *handles = table.select();
+        ok = handles->size() == (size_t) num_rows;
+        for (auto const &handle: *handles) {
+            ValueDict *row = table.project(handle);
+            int i = (*row)["i"].n;
+            if ((*row)["l"].data_type != ColumnAttribute::BIGINT
+                || (*row)["l"].l != (i % 2 == 1 ? i : (int64_t) i * 10000000000LL)
+                || (*row)["d"].d != i / 4.0 || ((*row)["b"].n != 0) != (i % 3 == 0)
+                || value_to_string((*row)["dt"]) != "2020-01-01"
+                || (*row)["ts"].l != (int64_t) i * MICROS_PER_DAY / 24 || (*row)["t"].s != "row " + to_string(i))
+                ok = false;
+            delete row;
+        }
+        delete handles;
+        if (!ok) {
+            cout << "FAILED TEST: column types round trip (layout " << layout << ")" << endl;
+            table.drop();
+            return false;
+        }
+        struct Case {
+            const char *where;
+            size_t expected;
+        } cases[] = {
+                {"d < 10",                                40},
+                {"d >= 124.5",                            2},
+                {"b = 1",                                 167},
+                {"b = 'true' AND i < 10",                 4},
+                {"ts < '1970-01-02'",                     24},
+                {"ts >= '1970-01-21 12:00:00' AND i < 499", 7},
+                {"dt = '2020-01-01' AND i > 489",         10},
+                {"l > 4000000000000",                     49},
+                {"l = 7",                                 1},
+                {"d = d AND ts <> ts",                    0}};
+        for (auto const &c: cases) {
+            SQLParserResult *parsed = SQLParser::parseSQLString(string("SELECT * FROM t WHERE ") + c.where);
+            size_t actual = (size_t) -1;
+            if (parsed->isValid() && parsed->size() == 1) {
+                const SelectStatement *select = (const SelectStatement *) parsed->getStatement(0);
+                CompiledPredicate *predicate = ExprCompiler::compile(select->whereClause, column_names,
+                                                                     column_attributes);
+                handles = table.select(predicate);
+                actual = handles->size();
+                delete handles;
+                delete predicate;
+            }
+            delete parsed;
+            if (actual != c.expected) {
+                cout << "FAILED TEST: WHERE " << c.where << " matched " << actual << ", expected " << c.expected
+                     << " (layout " << layout << ")" << endl;
+                table.drop();
+                return false;
+            }
+        }
+        ValueDict where;
+        where["l"] = Value::bigint(60000000000LL);
+        where["b"] = Value::boolean(true);
+        handles = table.select(&where);
+        ok = handles->size() == 1;
+        delete handles;
+        vector<Value> column;
+        char *buffer = new char[table.get_page_size()];
+        table.copy_block(1, buffer);
+        table.decode_column(buffer, "ts", column);
+        delete[] buffer;
+        ok = ok && !column.empty() && column[1].data_type == ColumnAttribute::TIMESTAMP
+             && column[1].l == MICROS_PER_DAY / 24;
+        table.drop();
+        if (!ok) {
+            cout << "FAILED TEST: column types select/decode_column (layout " << layout << ")" << endl;
+            return false;
+        }
+    }
+    if (value_bits(Value::real(-0.0)) != value_bits(Value::real(0.0))
+        || value_bits(Value::real(2.5)) == value_bits(Value::real(-2.5))) {
+        cout << "FAILED TEST: value_bits of DOUBLE values" << endl;
+        return false;
+    }
+    return true;
+}
+
+/*****************************************Codecs*******************************************************************/
+
+template<ColumnAttribute::DataType TYPE>
+static void marshal_fixed(const Value &value, char *field) {
+    ColumnCodec<TYPE>::write(ColumnCodec<TYPE>::get(value), field);
+}
+
+template<ColumnAttribute::DataType TYPE>
+static Value unmarshal_fixed(const char *field) {
+    return ColumnCodec<TYPE>::make(ColumnCodec<TYPE>::read(field));
+}
+
+template<ColumnAttribute::DataType TYPE>
+static CodecOps fixed_ops(const char *name) {
+    CodecOps ops = {TYPE, name, ColumnCodec<TYPE>::SIZE, ColumnCodec<TYPE>::ALIGN, marshal_fixed<TYPE>,
+                    unmarshal_fixed<TYPE>, ColumnCodec<TYPE>::compare};
+    return ops;
+}
+
+/**
+ * The codec of a type
+ * @param data_type the type
+ * @return its entry in the table (in DataType order)
+ */
+const CodecOps &codec_ops(ColumnAttribute::DataType data_type) {
+    static const CodecOps codecs[] = {
+            fixed_ops<ColumnAttribute::INT>("INT"),
+            {ColumnAttribute::TEXT, "TEXT", CodecOps::VARIABLE, 1, nullptr, nullptr, nullptr},
+            fixed_ops<ColumnAttribute::BIGINT>("BIGINT"),
+            fixed_ops<ColumnAttribute::DOUBLE>("DOUBLE"),
+            fixed_ops<ColumnAttribute::BOOLEAN>("BOOLEAN"),
+            fixed_ops<ColumnAttribute::DATE>("DATE"),
+            fixed_ops<ColumnAttribute::TIMESTAMP>("TIMESTAMP")};
+    if ((size_t) data_type >= sizeof(codecs) / sizeof(codecs[0]))
+        throw DbRelationError("unknown data type " + to_string((int) data_type));
+    return codecs[data_type];
+}
+
+// Look up a type by the name CREATE TABLE uses
+bool data_type_named(const string &name, ColumnAttribute::DataType &data_type) {
+    for (int t = ColumnAttribute::INT; t <= ColumnAttribute::TIMESTAMP; t++) {
+        if (strcasecmp(name.c_str(), codec_ops((ColumnAttribute::DataType) t).name) == 0) {
+            data_type = (ColumnAttribute::DataType) t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*****************************************Dates********************************************************************/
+
+// Days from 1970-01-01 to a date of the proleptic Gregorian calendar
+static int64_t days_from_civil(int64_t year, uint month, uint day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    uint year_of_era = (uint) (year - era * 400);
+    uint day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t) day_of_era - 719468;
+}
+
+// The date days after 1970-01-01
+static void civil_from_days(int64_t days, int64_t &year, uint &month, uint &day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint day_of_era = (uint) (days - era * 146097);
+    uint year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    uint day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    uint shifted_month = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    year = (int64_t) year_of_era + era * 400 + (month <= 2);
+}
+
+// Parse "YYYY-MM-DD" at the start of text into days since 1970-01-01; the rest of text is left in rest
+static bool parse_date(const string &text, int64_t &days, string &rest) {
+    int year, month, day, length = 0;
+    if (sscanf(text.c_str(), "%d-%d-%d%n", &year, &month, &day, &length) != 3 || month < 1 || month > 12
+        || day < 1 || day > 31)
+        return false;
+    days = days_from_civil(year, (uint) month, (uint) day);
+    int64_t check_year;
+    uint check_month, check_day;
+    civil_from_days(days, check_year, check_month, check_day);
+    if (check_month != (uint) month || check_day != (uint) day)
+        return false;  // e.g. February 30th
+    rest = text.substr((size_t) length);
+    return true;
+}
+
+// Parse "YYYY-MM-DD[( |T)HH:MM:SS[.ffffff]]" into microseconds since 1970-01-01 00:00:00
+static bool parse_timestamp(const string &text, int64_t &micros) {
+    int64_t days;
+    string rest;
+    if (!parse_date(text, days, rest))
+        return false;
+    micros = days * MICROS_PER_DAY;
+    if (rest.empty())
+        return true;
+    int hours, minutes, seconds, length = 0;
+    if ((rest[0] != ' ' && rest[0] != 'T')
+        || sscanf(rest.c_str() + 1, "%d:%d:%d%n", &hours, &minutes, &seconds, &length) != 3
+        || hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59)
+        return false;
+    micros += ((hours * 60LL + minutes) * 60 + seconds) * 1000000;
+    const char *fraction = rest.c_str() + 1 + length;
+    if (*fraction == '\0')
+        return true;
+    if (*fraction++ != '.' || *fraction == '\0')
+        return false;
+    int64_t scale = 100000;
+    for (; *fraction != '\0'; fraction++, scale /= 10) {
+        if (*fraction < '0' || *fraction > '9' || scale == 0)
+            return false;
+        micros += (*fraction - '0') * scale;
+    }
+    return true;
+}
+
+static string format_date(int64_t days) {
+    int64_t year;
+    uint month, day;
+    civil_from_days(days, year, month, day);
+    char text[32];
+    snprintf(text, sizeof(text), "%04lld-%02u-%02u", (long long) year, month, day);
+    return text;
+}
+
+static string format_timestamp(int64_t micros) {
+    int64_t days = micros / MICROS_PER_DAY, in_day = micros % MICROS_PER_DAY;
+    if (in_day < 0) {
+        days--;
+        in_day += MICROS_PER_DAY;
+    }
+    int64_t seconds = in_day / 1000000;
+    char text[32];
+    snprintf(text, sizeof(text), " %02d:%02d:%02d", (int) (seconds / 3600), (int) (seconds / 60 % 60),
+             (int) (seconds % 60));
+    string result = format_date(days) + text;
+    if (in_day % 1000000 != 0) {
+        snprintf(text, sizeof(text), ".%06d", (int) (in_day % 1000000));
+        result += text;
+    }
+    return result;
+}
+
+/*****************************************Values*******************************************************************/
+
+// Convert a value to a column's type (see column_codec.h for the conversions there are)
+Value convert_value(const Value &value, ColumnAttribute::DataType data_type) {
+    if (value.data_type == data_type)
+        return value;
+    int64_t number;
+    switch (data_type) {
+        case ColumnAttribute::INT:
+            if (value.data_type == ColumnAttribute::BIGINT && value.l >= INT32_MIN && value.l <= INT32_MAX)
+                return Value((int32_t) value.l);
+            break;
+        case ColumnAttribute::BIGINT:
+            if (value.data_type == ColumnAttribute::INT)
+                return Value::bigint(value.n);
+            break;
+        case ColumnAttribute::DOUBLE:
+            if (value.data_type == ColumnAttribute::INT)
+                return Value::real(value.n);
+            if (value.data_type == ColumnAttribute::BIGINT)
+                return Value::real((double) value.l);
+            break;
+        case ColumnAttribute::BOOLEAN:
+            if (value.data_type == ColumnAttribute::INT && (value.n == 0 || value.n == 1))
+                return Value::boolean(value.n == 1);
+            if (value.data_type == ColumnAttribute::TEXT && (strcasecmp(value.s.c_str(), "true") == 0
+                                                             || strcasecmp(value.s.c_str(), "false") == 0))
+                return Value::boolean(strcasecmp(value.s.c_str(), "true") == 0);
+            break;
+        case ColumnAttribute::DATE: {
+            string rest;
+            if (value.data_type == ColumnAttribute::TEXT && parse_date(value.s, number, rest) && rest.empty()
+                && number >= INT32_MIN && number <= INT32_MAX)
+                return Value::date((int32_t) number);
+            break;
+        }
+        case ColumnAttribute::TIMESTAMP:
+            if (value.data_type == ColumnAttribute::DATE)
+                return Value::timestamp(value.n * MICROS_PER_DAY);
+            if (value.data_type == ColumnAttribute::TEXT && parse_timestamp(value.s, number))
+                return Value::timestamp(number);
+            break;
+        default:
+            break;
+    }
+    throw DbRelationError("cannot use " + value_to_string(value) + " as a " + codec_ops(data_type).name);
+}
+
+// Print a value as SQL would write it
+string value_to_string(const Value &value) {
+    char text[32];
+    switch (value.data_type) {
+        case ColumnAttribute::INT:
+            return to_string(value.n);
+        case ColumnAttribute::TEXT:
+            return value.s;
+        case ColumnAttribute::BIGINT:
+            return to_string(value.l);
+        case ColumnAttribute::DOUBLE:
+            snprintf(text, sizeof(text), "%.15g", value.d);
+            if (strtod(text, nullptr) != value.d)
+                snprintf(text, sizeof(text), "%.17g", value.d);
+            return text;
+        case ColumnAttribute::BOOLEAN:
+            return value.n != 0 ? "true" : "false";
+        case ColumnAttribute::DATE:
+            return format_date(value.n);
+        case ColumnAttribute::TIMESTAMP:
+            return format_timestamp(value.l);
+    }
+    return "???";
+}
+
+// Compare two values of one type through their codec
+int compare_values(const Value &a, const Value &b) {
+    const CodecOps &codec = codec_ops(a.data_type);
+    if (!codec.is_fixed())
+        return a.s.compare(b.s);
+    char x[8], y[8];
+    codec.marshal(a, x);
+    codec.marshal(b, y);
+    return codec.compare(x, y);
+}
+
+// The bits of a value to hash (an INT's are its 32 bits, as before there were other types)
+u64 value_bits(const Value &value) {
+    switch (value.data_type) {
+        case ColumnAttribute::INT:
+        case ColumnAttribute::BOOLEAN:
+        case ColumnAttribute::DATE:
+            return (u64) (u_int32_t) value.n;
+        case ColumnAttribute::TEXT:
+            return (u64) std::hash<string>()(value.s);
+        case ColumnAttribute::DOUBLE: {
+            if (value.d == 0)
+                return 0;  // -0.0 is 0.0
+            u_int64_t bits;
+            memcpy(&bits, &value.d, sizeof(bits));  // not value.l: d is the member the union holds
+            return (u64) bits;
+        }
+        default:
+            return (u64) value.l;
+    }
+}
+
+// A value as a number, for interpolation
+bool value_number(const Value &value, double &number) {
+    switch (value.data_type) {
+        case ColumnAttribute::TEXT:
+            return false;
+        case ColumnAttribute::BIGINT:
+        case ColumnAttribute::TIMESTAMP:
+            number = (double) value.l;
+            return true;
+        case ColumnAttribute::DOUBLE:
+            number = value.d;
+            return true;
+        default:
+            number = value.n;
+            return true;
+    }
+}
@@ -0,0 +1,140 @@
+/**
+ * @file   column_codec.h
+ * @brief  Per-type codecs for column values: how each type is marshaled, unmarshaled, compared and printed
+ *
+ * Every fixed-width column type has a codec fixed at compile time (its native C++ type, size and alignment),
+ * so adding a type adds a specialization here and an entry in the CodecOps table, not a branch in the code
+ * that marshals, unmarshals or compares rows. Values are stored unaligned in marshal format (memcpy in and
+ * out); a PLAIN PaxPage minipage starts on an 8-byte boundary, so there each column is an aligned array.
+ *
+ * FixedCodec<Native>: reads, writes and compares one Native in marshal format
+ * ColumnCodec<type>: the codec of a fixed-width column type, and how it maps to Value
+ * CodecOps: a type's codec as function pointers, looked up once per column (HeapTable, CompiledPredicate)
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <cstring>
+#include <string>
+#include "storage_engine.h"
+
+/**
+ * @class FixedCodec - a fixed-width value stored as the bytes of a Native (little-endian, unaligned)
+ */
+template<typename Native>
+struct FixedCodec {
+    typedef Native NativeType;
+    static const u_int16_t SIZE = sizeof(Native);
+    static const u_int16_t ALIGN = alignof(Native);
+
+    static_assert(ALIGN <= 8, "PaxPage regions start on 8-byte boundaries");
+
+    static Native read(const char *field) {
+        Native native;
+        memcpy(&native, field, sizeof(Native));
+        return native;
+    }
+
+    static void write(Native native, char *field) { memcpy(field, &native, sizeof(Native)); }
+
+    // <0, 0 or >0 as the field at a is less than, equal to or greater than the one at b
+    static int compare(const char *a, const char *b) {
+        Native x = read(a), y = read(b);
+        return x < y ? -1 : (y < x ? 1 : 0);
+    }
+};
+
+/**
+ * @class ColumnCodec - FixedCodec of a column type, with get (Value to Native) and make (Native to Value)
+ */
+template<ColumnAttribute::DataType TYPE>
+struct ColumnCodec;
+
+template<>
+struct ColumnCodec<ColumnAttribute::INT> : FixedCodec<int32_t> {
+    static int32_t get(const Value &value) { return value.n; }
+
+    static Value make(int32_t native) { return Value(native); }
+};
+
+template<>
+struct ColumnCodec<ColumnAttribute::BIGINT> : FixedCodec<int64_t> {
+    static int64_t get(const Value &value) { return value.l; }
+
+    static Value make(int64_t native) { return Value::bigint(native); }
+};
+
+template<>
+struct ColumnCodec<ColumnAttribute::DOUBLE> : FixedCodec<double> {
+    static double get(const Value &value) { return value.d; }
+
+    static Value make(double native) { return Value::real(native); }
+};
+
+template<>
+struct ColumnCodec<ColumnAttribute::BOOLEAN> : FixedCodec<u_int8_t> {
+    static u_int8_t get(const Value &value) { return value.n != 0 ? 1 : 0; }
+
+    static Value make(u_int8_t native) { return Value::boolean(native != 0); }
+};
+
+template<>
+struct ColumnCodec<ColumnAttribute::DATE> : FixedCodec<int32_t> {
+    static int32_t get(const Value &value) { return value.n; }
+
+    static Value make(int32_t native) { return Value::date(native); }
+};
+
+template<>
+struct ColumnCodec<ColumnAttribute::TIMESTAMP> : FixedCodec<int64_t> {
+    static int64_t get(const Value &value) { return value.l; }
+
+    static Value make(int64_t native) { return Value::timestamp(native); }
+};
+
+/**
+ * @class CodecOps - a column type's codec, for code that learns the type at run time. TEXT has size VARIABLE
+ *      and no functions: it is a u16 length and the bytes, or an OverflowPointer, and HeapTable handles it.
+ */
+struct CodecOps {
+    static const u_int16_t VARIABLE = 0;
+
+    ColumnAttribute::DataType data_type;
+    const char *name;                                   // as written in CREATE TABLE and kept in _columns
+    u_int16_t size;                                     // bytes in marshal format, or VARIABLE
+    u_int16_t align;
+    void (*marshal)(const Value &value, char *field);   // value must be of this type
+    Value (*unmarshal)(const char *field);
+    int (*compare)(const char *a, const char *b);
+
+    bool is_fixed() const { return size != VARIABLE; }
+};
+
+// the codec of a type
+const CodecOps &codec_ops(ColumnAttribute::DataType data_type);
+
+// the type called name (case-insensitive), as in CREATE TABLE; false if there is none
+bool data_type_named(const std::string &name, ColumnAttribute::DataType &data_type);
+
+/**
+ * A value converted to a column's type: an INT to a BIGINT, DOUBLE, or BOOLEAN (0 or 1), a BIGINT to an INT
+ * (if it fits) or a DOUBLE, a DATE to a TIMESTAMP, and TEXT to a BOOLEAN ('true', 'false'), DATE ('2020-05-31')
+ * or TIMESTAMP ('2020-05-31 13:45:00', with up to 6 decimals of seconds).
+ * @throws DbRelationError if the value has no such conversion
+ */
+Value convert_value(const Value &value, ColumnAttribute::DataType data_type);
+
+// the value as SQL would write it (TEXT unquoted; DATE and TIMESTAMP as convert_value parses them)
+std::string value_to_string(const Value &value);
+
+// compare two values of one type: <0, 0 or >0
+int compare_values(const Value &a, const Value &b);
+
+// the value's bits (a fixed-width value's, widened; a hash of a TEXT value's), for hashing
+u_int64_t value_bits(const Value &value);
+
+// the value as a number, for interpolating between values; false for TEXT
+bool value_number(const Value &value, double &number);
+
+bool test_column_types();
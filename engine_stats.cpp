@@ -0,0 +1,258 @@
+/**
+ * @file   engine_stats.cpp
+ * @brief  the implementation file for LatencyHistogram, StatsSnapshot and EngineStats
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "engine_stats.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <mutex>
+#include <thread>
+using namespace std;
+
+
+thread_local EngineStats::ThreadStats *EngineStats::thread_stats = nullptr;
+
+/**
+ * The registry of every thread's stats. Threads fold their values into retired when they exit,
+ * and reset() just moves the baseline that snapshots are taken relative to.
+ */
+struct StatsRegistry {
+    mutex lock;
+    vector<EngineStats::ThreadStats *> live;
+    StatsSnapshot retired;
+    StatsSnapshot baseline;
+
+    StatsRegistry() {
+        clear(retired);
+        clear(baseline);
+    }
+
+    static void clear(StatsSnapshot &snapshot) {
+        snapshot.counters.assign(EngineStats::NUM_COUNTERS, 0);
+        snapshot.timers.assign(EngineStats::NUM_TIMERS, vector<u_int64_t>(LatencyHistogram::NUM_BUCKETS, 0));
+    }
+
+    static void add(StatsSnapshot &total, const EngineStats::ThreadStats &stats) {
+        for (uint c = 0; c < EngineStats::NUM_COUNTERS; c++)
+            total.counters[c] += stats.counters[c].load(memory_order_relaxed);
+        for (uint t = 0; t < EngineStats::NUM_TIMERS; t++)
+            for (uint b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+                total.timers[t][b] += stats.timers[t].get(b);
+    }
+
+    // caller holds lock
+    StatsSnapshot total() {
+        StatsSnapshot sum = retired;
+        for (auto stats: live)
+            add(sum, *stats);
+        return sum;
+    }
+};
+
+// never destroyed, so threads exiting during static destruction can still retire their stats
+static StatsRegistry &registry() {
+    static StatsRegistry *registry = new StatsRegistry();
+    return *registry;
+}
+
+// Retires the thread's stats when the thread exits
+struct ThreadStatsOwner {
+    EngineStats::ThreadStats *stats = nullptr;
+
+    ~ThreadStatsOwner() {
+        if (stats == nullptr)
+            return;
+        EngineStats::thread_stats = nullptr;  // stop counting this thread's allocations
+        StatsRegistry &r = registry();
+        lock_guard<mutex> guard(r.lock);
+        StatsRegistry::add(r.retired, *stats);
+        for (size_t i = 0; i < r.live.size(); i++) {
+            if (r.live[i] == stats) {
+                r.live.erase(r.live.begin() + i);
+                break;
+            }
+        }
+        delete stats;
+    }
+};
+
+/**
+ * Testing function for EngineStats.
+ * Counts from several threads (some of which exit before the snapshot) and checks the histograms.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_engine_stats() {
+    EngineStats::reset();
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.push_back(thread([]() {
+            for (int i = 0; i < 1000; i++) {
+                EngineStats::count(EngineStats::PAGE_READS);
+                EngineStats::time(EngineStats::PAGE_READ_TIME, (u_int64_t) (i + 1) * 1000);
+            }
+        }));
+    }
+    for (auto &t: threads)
+        t.join();
+    EngineStats::count(EngineStats::PAGE_WRITES, 5);
+    StatsSnapshot snapshot = EngineStats::snapshot();
+    bool ok = true;
+    if (snapshot.counters[EngineStats::PAGE_READS] != 4000 || snapshot.counters[EngineStats::PAGE_WRITES] != 5) {
+        cout << "FAILED TEST: counted " << snapshot.counters[EngineStats::PAGE_READS] << " reads, "
+             << snapshot.counters[EngineStats::PAGE_WRITES] << " writes" << endl;
+        ok = false;
+    }
+    u_int64_t p50 = snapshot.percentile(EngineStats::PAGE_READ_TIME, 50);
+    u_int64_t p99 = snapshot.percentile(EngineStats::PAGE_READ_TIME, 99);
+    if (snapshot.count(EngineStats::PAGE_READ_TIME) != 4000 || fabs(p50 / 500000.0 - 1) > 0.07
+        || fabs(p99 / 990000.0 - 1) > 0.07) {
+        cout << "FAILED TEST: p50 " << p50 << "ns, p99 " << p99 << "ns" << endl;
+        ok = false;
+    }
+    for (u_int64_t v: {0ULL, 15ULL, 16ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        uint b = LatencyHistogram::bucket(v);
+        if (b >= LatencyHistogram::NUM_BUCKETS || LatencyHistogram::bucket_value(b) < v
+            || (b > 0 && LatencyHistogram::bucket_value(b - 1) >= v)) {
+            cout << "FAILED TEST: " << v << " in the wrong histogram bucket" << endl;
+            ok = false;
+        }
+    }
+    EngineStats::reset();
+    if (EngineStats::snapshot().counters[EngineStats::PAGE_READS] != 0) {
+        cout << "FAILED TEST: reset" << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+
+/*****************************************LatencyHistogram**********************************************************/
+
+LatencyHistogram::LatencyHistogram() {
+    for (auto &count: this->counts)
+        count.store(0, memory_order_relaxed);
+}
+
+u_int64_t LatencyHistogram::bucket_value(uint bucket) {
+    if (bucket < SUB_BUCKETS)
+        return bucket;
+    uint magnitude = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    u_int64_t sub_bucket = bucket % SUB_BUCKETS;
+    uint shift = magnitude - SUB_BUCKET_BITS;
+    return ((SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+}
+
+
+/*****************************************StatsSnapshot*************************************************************/
+
+u_int64_t StatsSnapshot::count(uint timer) const {
+    u_int64_t total = 0;
+    for (auto n: this->timers[timer])
+        total += n;
+    return total;
+}
+
+u_int64_t StatsSnapshot::percentile(uint timer, double p) const {
+    u_int64_t total = count(timer);
+    if (total == 0)
+        return 0;
+    u_int64_t rank = (u_int64_t) ceil(p / 100 * total);
+    if (rank == 0)
+        rank = 1;
+    u_int64_t seen = 0;
+    for (uint b = 0; b < LatencyHistogram::NUM_BUCKETS; b++) {
+        seen += this->timers[timer][b];
+        if (seen >= rank)
+            return LatencyHistogram::bucket_value(b);
+    }
+    return LatencyHistogram::bucket_value(LatencyHistogram::NUM_BUCKETS - 1);
+}
+
+
+/*****************************************EngineStats***************************************************************/
+
+const char *EngineStats::counter_name(uint counter) {
+    static const char *names[] = {"page_reads", "page_writes", "pages_allocated", "records_added", "records_read",
+                                  "records_rewritten", "records_deleted", "slides", "slide_bytes", "rows_inserted",
+                                  "rows_updated", "rows_deleted", "rows_selected", "rows_projected", "marshal_bytes",
+                                  "unmarshal_bytes", "versions_collected", "pages_sealed", "heap_allocations",
+                                  "arena_bytes", "blocks_prefetched", "prefetch_hits", "prefetch_wasted"};
+    return counter < NUM_COUNTERS ? names[counter] : "?";
+}
+
+const char *EngineStats::timer_name(uint timer) {
+    static const char *names[] = {"heap_file.get", "heap_file.put", "heap_file.get_new", "heap_table.insert",
+                                  "heap_table.update", "heap_table.del", "heap_table.select", "heap_table.project"};
+    return timer < NUM_TIMERS ? names[timer] : "?";
+}
+
+EngineStats::ThreadStats::ThreadStats() {
+    for (auto &counter: this->counters)
+        counter.store(0, memory_order_relaxed);
+}
+
+EngineStats::ThreadStats &EngineStats::register_thread() {
+    static thread_local ThreadStatsOwner owner;
+    owner.stats = new ThreadStats();
+    StatsRegistry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.live.push_back(owner.stats);
+    thread_stats = owner.stats;
+    return *thread_stats;
+}
+
+StatsSnapshot EngineStats::snapshot() {
+    StatsRegistry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    StatsSnapshot snapshot = r.total();
+    for (uint c = 0; c < NUM_COUNTERS; c++)
+        snapshot.counters[c] -= r.baseline.counters[c];
+    for (uint t = 0; t < NUM_TIMERS; t++)
+        for (uint b = 0; b < LatencyHistogram::NUM_BUCKETS; b++)
+            snapshot.timers[t][b] -= r.baseline.timers[t][b];
+    return snapshot;
+}
+
+u_int64_t EngineStats::total(Counter counter) {
+    StatsRegistry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    u_int64_t sum = r.retired.counters[counter];
+    for (auto stats: r.live)
+        sum += stats->counters[counter].load(memory_order_relaxed);
+    return sum - r.baseline.counters[counter];
+}
+
+void EngineStats::reset() {
+    StatsRegistry &r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.baseline = r.total();
+}
+
+
+/*****************************************operator new**************************************************************/
+
+#ifndef ENGINE_STATS_DISABLED
+// Counts every allocation for heap_allocations; delete is replaced too, so both sides are malloc/free
+void *operator new(size_t size) {
+    EngineStats::count_allocation();
+    if (size == 0)
+        size = 1;
+    while (true) {
+        void *p = malloc(size);
+        if (p != nullptr)
+            return p;
+        new_handler handler = get_new_handler();
+        if (handler == nullptr)
+            throw bad_alloc();
+        handler();
+    }
+}
+
+// (not inlined: g++ would take free of memory from new as a mismatch)
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+    free(p);
+}
+#endif
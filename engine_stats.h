@@ -0,0 +1,198 @@
+/**
+ * @file   engine_stats.h
+ * @brief  Engine-wide instrumentation: event counters and latency histograms for the storage layer
+ *
+ * Each thread bumps its own counters and histograms (no sharing, no locks on the hot path); readers sum
+ * every thread's values on demand. Build with -DENGINE_STATS_DISABLED to compile all instrumentation out.
+ *
+ * LatencyHistogram: HDR-style log-linear histogram of nanosecond latencies (16 sub-buckets per power of two)
+ * EngineStats: the counters and timers, per-thread storage, snapshot and reset
+ * StatsSnapshot: totals since the last reset
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+/**
+ * @class LatencyHistogram - counts of latencies, each bucket within 1/16 (~6%) of the values it holds
+ *
+ *      Values below 16 get their own bucket; above that, each power of two [2^m, 2^(m+1)) is split into
+ *      16 equal sub-buckets. Only the owning thread writes; relaxed atomics let other threads read.
+ */
+class LatencyHistogram {
+public:
+    static const uint SUB_BUCKET_BITS = 4;
+    static const uint SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const uint NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(u_int64_t ns) {
+        std::atomic<u_int64_t> &count = counts[bucket(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    u_int64_t get(uint bucket) const { return counts[bucket].load(std::memory_order_relaxed); }
+
+    static uint bucket(u_int64_t ns) {
+        if (ns < SUB_BUCKETS)
+            return (uint) ns;
+        uint magnitude = 63 - (uint) __builtin_clzll(ns);
+        uint sub_bucket = (uint) (ns >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    // the largest value that lands in a bucket
+    static u_int64_t bucket_value(uint bucket);
+
+protected:
+    std::atomic<u_int64_t> counts[NUM_BUCKETS];
+};
+
+/**
+ * @class StatsSnapshot - counter totals and merged histograms as of one moment
+ */
+class StatsSnapshot {
+public:
+    std::vector<u_int64_t> counters;
+    std::vector<std::vector<u_int64_t> > timers;  // per timer, per bucket
+
+    // number of timed operations
+    virtual u_int64_t count(uint timer) const;
+
+    // latency at a percentile in [0, 100], in nanoseconds
+    virtual u_int64_t percentile(uint timer, double p) const;
+
+    virtual ~StatsSnapshot() {}
+};
+
+/**
+ * @class EngineStats - the engine's counters and timers
+ */
+class EngineStats {
+public:
+    enum Counter {
+        PAGE_READS,          // HeapFile::get
+        PAGE_WRITES,         // HeapFile::put
+        PAGES_ALLOCATED,     // HeapFile::get_new
+        RECORDS_ADDED,       // SlottedPage::add
+        RECORDS_READ,        // SlottedPage::get
+        RECORDS_REWRITTEN,   // SlottedPage::put
+        RECORDS_DELETED,     // SlottedPage::del
+        SLIDES,              // SlottedPage::slide calls that moved data
+        SLIDE_BYTES,         // bytes moved by those slides
+        ROWS_INSERTED,       // HeapTable::insert
+        ROWS_UPDATED,        // HeapTable::update
+        ROWS_DELETED,        // HeapTable::del
+        ROWS_SELECTED,       // handles returned by HeapTable::select
+        ROWS_PROJECTED,      // HeapTable::project
+        MARSHAL_BYTES,       // bytes produced by HeapTable::marshal
+        UNMARSHAL_BYTES,     // bytes decoded by HeapTable::unmarshal
+        VERSIONS_COLLECTED,  // dead versions removed by HeapTable::vacuum
+        PAGES_SEALED,        // PaxPage encodings chosen
+        HEAP_ALLOCATIONS,    // operator new calls (by threads that have counted something before)
+        ARENA_BYTES,         // bytes taken from Arenas (counted as they are rewound)
+        BLOCKS_PREFETCHED,   // blocks read by the read-ahead thread
+        PREFETCH_HITS,       // HeapFile::get of a block read ahead
+        PREFETCH_WASTED,     // blocks read ahead that their scan never got to
+        NUM_COUNTERS
+    };
+
+    enum Timer {
+        PAGE_READ_TIME,
+        PAGE_WRITE_TIME,
+        PAGE_ALLOCATE_TIME,
+        INSERT_TIME,
+        UPDATE_TIME,
+        DELETE_TIME,
+        SELECT_TIME,
+        PROJECT_TIME,
+        NUM_TIMERS
+    };
+
+    static const char *counter_name(uint counter);
+
+    static const char *timer_name(uint timer);
+
+    /**
+     * @class ThreadStats - one thread's counters and histograms
+     */
+    struct ThreadStats {
+        ThreadStats();
+
+        std::atomic<u_int64_t> counters[NUM_COUNTERS];
+        LatencyHistogram timers[NUM_TIMERS];
+    };
+
+    static void count(Counter counter, u_int64_t n = 1) {
+        std::atomic<u_int64_t> &value = local().counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static void time(Timer timer, u_int64_t ns) {
+        local().timers[timer].record(ns);
+    }
+
+    // totals since the last reset, summed over all threads (including ones that have exited)
+    static StatsSnapshot snapshot();
+
+    // one counter's total since the last reset, as in snapshot (but without allocating)
+    static u_int64_t total(Counter counter);
+
+    // start counting from zero again
+    static void reset();
+
+    // called by operator new: a thread with no stats yet isn't counted (registering it would allocate)
+    static void count_allocation() {
+        if (thread_stats != nullptr)
+            count(HEAP_ALLOCATIONS);
+    }
+
+    // the calling thread's stats (registered on first use)
+    static ThreadStats &local() {
+        return thread_stats != nullptr ? *thread_stats : register_thread();
+    }
+
+protected:
+    static thread_local ThreadStats *thread_stats;
+
+    static ThreadStats &register_thread();
+
+    friend struct ThreadStatsOwner;
+};
+
+/**
+ * @class ScopedTimer - records the time from construction to destruction in one of the engine's timers
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(EngineStats::Timer timer) : timer(timer), start(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        EngineStats::time(timer, (u_int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    ScopedTimer(const ScopedTimer &other) = delete;
+
+    ScopedTimer &operator=(const ScopedTimer &other) = delete;
+
+protected:
+    EngineStats::Timer timer;
+    std::chrono::steady_clock::time_point start;
+};
+
+#ifdef ENGINE_STATS_DISABLED
+#define STATS_COUNT(counter, n) ((void) 0)
+#define STATS_TIMER(timer) ((void) 0)
+#else
+#define STATS_COUNT(counter, n) EngineStats::count(EngineStats::counter, (n))
+#define STATS_TIMER(timer) ScopedTimer engine_stats_timer(EngineStats::timer)
+#endif
+
+bool test_engine_stats();
@@ -0,0 +1,916 @@
+/**
+ * @file   expr_compiler.cpp
+ * @brief  the implementation file for CompiledPredicate and ExprCompiler
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "expr_compiler.h"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include "SQLParser.h"
+#include "arena.h"
+#include "column_codec.h"
+#include "heap_storage.h"
+using namespace std;
+using namespace hsql;
+
+
+typedef u_int16_t u16;
+
+/**
+ * A register of the bytecode machine: an INT (also used for booleans) or a view of TEXT bytes
+ */
+struct CompiledPredicate::Register {
+    int32_t n;
+    const char *text;
+    u_int32_t size;
+};
+
+// Marshal a row the way HeapTable::marshal does (used by the test and benchmark)
+static string make_record(int32_t a, const string &b) {
+    string record((const char *) &a, sizeof(a));
+    u16 size = (u16) b.length();
+    record.append((const char *) &size, sizeof(size));
+    record.append(b);
+    return record;
+}
+
+// Compile a WHERE clause against the (a INT, b TEXT) test schema; nullptr if the parser rejects it
+static CompiledPredicate *compile_test_where(const string &where, SQLParserResult **parsed) {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    *parsed = SQLParser::parseSQLString("SELECT * FROM t WHERE " + where);
+    if (!(*parsed)->isValid() || (*parsed)->size() != 1)
+        return nullptr;
+    const SelectStatement *select = (const SelectStatement *) (*parsed)->getStatement(0);
+    return ExprCompiler::compile(select->whereClause, column_names, column_attributes);
+}
+
+/**
+ * Testing function for ExprCompiler and CompiledPredicate.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_expr_compiler() {
+    struct Case {
+        const char *where;
+        int32_t a;
+        const char *b;
+        bool expected;
+    } cases[] = {
+            {"a = 12",                        12, "x",     true},
+            {"a = 12",                        13, "x",     false},
+            {"12 < a",                        13, "x",     true},
+            {"a <= 12 AND b = 'Hello!'",      12, "Hello!", true},
+            {"a <= 12 AND b = 'Hello!'",      12, "Hello",  false},
+            {"a > 100 OR b >= 'm'",           1,  "zebra", true},
+            {"a > 100 OR b >= 'm'",           1,  "apple", false},
+            {"NOT a = 5",                     5,  "",      false},
+            {"a <> 5 AND (b < 'b' OR a >= 9)", 9, "c",     true},
+    };
+    for (auto const &c: cases) {
+        SQLParserResult *parsed;
+        CompiledPredicate *predicate = compile_test_where(c.where, &parsed);
+        if (predicate == nullptr) {
+            cout << "FAILED TEST: could not parse/compile " << c.where << endl;
+            delete parsed;
+            return false;
+        }
+        string record = make_record(c.a, c.b);
+        bool actual = predicate->evaluate(record.data());
+        delete predicate;
+        delete parsed;
+        if (actual != c.expected) {
+            cout << "FAILED TEST: " << c.where << " with a=" << c.a << ", b='" << c.b << "'" << endl;
+            return false;
+        }
+    }
+
+    // the ValueDict form used by HeapTable::select(where)
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    ValueDict where;
+    where["a"] = Value(12);
+    where["b"] = Value("Hello!");
+    CompiledPredicate *predicate = ExprCompiler::compile(&where, column_names, column_attributes);
+    string hit = make_record(12, "Hello!"), miss = make_record(12, "Bye");
+    const char *records[] = {hit.data(), miss.data(), hit.data()};
+    u_int8_t matches[3];
+    size_t count = predicate->evaluate_batch(records, 3, matches);
+    delete predicate;
+    if (count != 2 || !matches[0] || matches[1] || !matches[2]) {
+        cout << "FAILED TEST: ValueDict predicate batch" << endl;
+        return false;
+    }
+
+    // a table wider than the columns evaluate locates on the stack
+    ColumnNames wide_names;
+    ColumnAttributes wide_attributes;
+    string wide_record;
+    for (int32_t c = 0; c < CompiledPredicate::STACK_COLUMNS + 8; c++) {
+        wide_names.push_back("c" + to_string(c));
+        wide_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+        wide_record.append((const char *) &c, sizeof(c));
+    }
+    ValueDict wide_where;
+    wide_where[wide_names.back()] = Value(CompiledPredicate::STACK_COLUMNS + 7);
+    predicate = ExprCompiler::compile(&wide_where, wide_names, wide_attributes);
+    bool wide_hit = predicate->evaluate(wide_record.data());
+    wide_where[wide_names.back()] = Value(7);
+    delete predicate;
+    predicate = ExprCompiler::compile(&wide_where, wide_names, wide_attributes);
+    bool wide_miss = predicate->evaluate(wide_record.data());
+    delete predicate;
+    if (!wide_hit || wide_miss) {
+        cout << "FAILED TEST: predicate on column " << wide_names.back() << " of a wide table" << endl;
+        return false;
+    }
+
+    // the range of a that the ANDed comparisons allow, for a B+tree keyed on it
+    struct RangeCase {
+        const char *where;
+        const char *range;
+    } range_cases[] = {
+            {"a >= 3 AND a < 10 AND b = 'x'", "a >= 3 AND a < 10"},
+            {"a > 5 AND 7 < a AND a <= 20",   "a > 7 AND a <= 20"},
+            {"a = 4 AND a >= 2",              "a = 4"},
+            {"a = 4 OR a = 5",                ""},
+            {"NOT a < 3",                     ""},
+            {"a < 'x'",                       ""},
+    };
+    for (auto const &c: range_cases) {
+        SQLParserResult *parsed = SQLParser::parseSQLString(string("SELECT * FROM t WHERE ") + c.where);
+        const SelectStatement *select = (const SelectStatement *) parsed->getStatement(0);
+        string range = ExprCompiler::column_range(select->whereClause, column_names, column_attributes, 0).to_string("a");
+        delete parsed;
+        if (range != c.range) {
+            cout << "FAILED TEST: range of a in " << c.where << " is '" << range << "'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// The naive evaluator the benchmark compares against: recursive walk of the parse tree over a ValueDict
+static Value tree_walk(const Expr *expr, const ValueDict &row) {
+    switch (expr->type) {
+        case kExprColumnRef:
+            return row.at(expr->name);
+        case kExprLiteralInt:
+            return Value((int32_t) expr->ival);
+        case kExprLiteralString:
+            return Value(string(expr->name));
+        case kExprOperator:
+            switch (expr->opType) {
+                case Expr::AND:
+                    return Value(tree_walk(expr->expr, row).n && tree_walk(expr->expr2, row).n ? 1 : 0);
+                case Expr::OR:
+                    return Value(tree_walk(expr->expr, row).n || tree_walk(expr->expr2, row).n ? 1 : 0);
+                case Expr::NOT:
+                    return Value(tree_walk(expr->expr, row).n ? 0 : 1);
+                case Expr::NOT_EQUALS:
+                    return Value(compare_values(tree_walk(expr->expr, row), tree_walk(expr->expr2, row)) != 0);
+                case Expr::LESS_EQ:
+                    return Value(compare_values(tree_walk(expr->expr, row), tree_walk(expr->expr2, row)) <= 0);
+                case Expr::GREATER_EQ:
+                    return Value(compare_values(tree_walk(expr->expr, row), tree_walk(expr->expr2, row)) >= 0);
+                case Expr::SIMPLE_OP: {
+                    int cmp = compare_values(tree_walk(expr->expr, row), tree_walk(expr->expr2, row));
+                    return Value(expr->opChar == '=' ? cmp == 0 : (expr->opChar == '<' ? cmp < 0 : cmp > 0));
+                }
+                default:
+                    break;
+            }
+        default:
+            break;
+    }
+    throw DbRelationError("tree walk: unsupported expression");
+}
+
+/**
+ * Microbenchmark: compiled bytecode over marshaled records vs. a recursive tree walk over ValueDicts.
+ * Prints nanoseconds per row for each and the speedup.
+ * @param num_rows how many synthetic rows to evaluate
+ */
+void benchmark_expr_compiler(uint num_rows) {
+    const char *where = "a < 500 AND (b = 'group7' OR a >= 990)";
+    SQLParserResult *parsed;
+    CompiledPredicate *predicate = compile_test_where(where, &parsed);
+    if (predicate == nullptr) {
+        cout << "benchmark_expr_compiler: could not parse " << where << endl;
+        delete parsed;
+        return;
+    }
+    const Expr *tree = ((const SelectStatement *) parsed->getStatement(0))->whereClause;
+    vector<string> records;
+    vector<ValueDict> rows;
+    for (uint i = 0; i < num_rows; i++) {
+        int32_t a = (int32_t) ((i * 7919) % 1000);
+        string b = "group" + to_string(i % 37);
+        records.push_back(make_record(a, b));
+        ValueDict row;
+        row["a"] = Value(a);
+        row["b"] = Value(b);
+        rows.push_back(row);
+    }
+    vector<const char *> pointers;
+    for (auto const &record: records)
+        pointers.push_back(record.data());
+    vector<u_int8_t> matches(num_rows);
+
+    auto start = chrono::steady_clock::now();
+    size_t naive_hits = 0;
+    for (auto const &row: rows)
+        naive_hits += tree_walk(tree, row).n ? 1 : 0;
+    auto middle = chrono::steady_clock::now();
+    size_t compiled_hits = predicate->evaluate_batch(pointers.data(), num_rows, matches.data());
+    auto end = chrono::steady_clock::now();
+
+    double naive_ns = chrono::duration<double, nano>(middle - start).count() / num_rows;
+    double compiled_ns = chrono::duration<double, nano>(end - middle).count() / num_rows;
+    cout << "WHERE " << where << " over " << num_rows << " rows (" << predicate->size() << " instructions)" << endl;
+    cout << "  tree walk: " << naive_ns << " ns/row, " << naive_hits << " hits" << endl;
+    cout << "  bytecode:  " << compiled_ns << " ns/row, " << compiled_hits << " hits" << endl;
+    cout << "  speedup:   " << (compiled_ns > 0 ? naive_ns / compiled_ns : 0) << "x" << endl;
+    delete predicate;
+    delete parsed;
+}
+
+/*****************************************ColumnRange***************************************************************/
+
+bool ColumnRange::is_point() const {
+    return this->has_low && this->has_high && this->low_inclusive && this->high_inclusive
+           && value_to_string(this->low) == value_to_string(this->high);
+}
+
+string ColumnRange::to_string(const Identifier &column_name) const {
+    if (is_point())
+        return column_name + " = " + value_to_string(this->low);
+    string range;
+    if (this->has_low)
+        range = column_name + (this->low_inclusive ? " >= " : " > ") + value_to_string(this->low);
+    if (this->has_high)
+        range += (range.empty() ? "" : " AND ") + column_name + (this->high_inclusive ? " <= " : " < ")
+                 + value_to_string(this->high);
+    return range;
+}
+
+
+/*****************************************CompiledPredicate*********************************************************/
+
+/**
+ * Constructor for CompiledPredicate
+ * @param column_attributes the schema of the records it will be evaluated against
+ */
+CompiledPredicate::CompiledPredicate(const ColumnAttributes &column_attributes) :
+        codecs(), program(), int_constants(), text_constants(), fixed_constants(),
+        num_registers(0), num_columns(0), result(0), column_tests(), column_tests_only(false) {
+    for (auto const &column_attribute: column_attributes)
+        this->codecs.push_back(&codec_ops(column_attribute.get_data_type()));
+}
+
+// Whether cmp (<0, 0, >0) satisfies comparison 0..5 (EQ, NE, LT, LE, GT, GE)
+static inline bool holds(int comparison, int cmp) {
+    switch (comparison) {
+        case 0: return cmp == 0;
+        case 1: return cmp != 0;
+        case 2: return cmp < 0;
+        case 3: return cmp <= 0;
+        case 4: return cmp > 0;
+        default: return cmp >= 0;
+    }
+}
+
+// The TEXT value a record's OverflowPointer refers to
+static string read_out_of_line(OverflowFile *overflow, const char *pointer) {
+    if (overflow == nullptr)
+        throw DbRelationError("TEXT value stored out of line but no overflow file to read it from");
+    return overflow->read(OverflowPointer::read(pointer));
+}
+
+// Evaluate against a record held in a Dbt
+bool CompiledPredicate::evaluate(const Dbt *data, OverflowFile *overflow) const {
+    return evaluate((const char *) data->get_data(), overflow);
+}
+
+/**
+ * Evaluate against one marshaled record
+ * @param record   the record's bytes
+ * @param overflow where its TEXT values stored out of line are
+ * @return true if the record qualifies
+ */
+bool CompiledPredicate::evaluate(const char *record, OverflowFile *overflow) const {
+    if (this->num_columns <= STACK_COLUMNS && this->num_registers < STACK_REGISTERS) {
+        const char *fields[STACK_COLUMNS];
+        u_int32_t sizes[STACK_COLUMNS];
+        bool out_of_line[STACK_COLUMNS];
+        Register r[STACK_REGISTERS];
+        return run(record, overflow, fields, sizes, out_of_line, r);
+    }
+    ArenaScope scope;  // a wide table or a long clause: a bump allocation, freed on return
+    Arena &arena = scope.get_arena();
+    return run(record, overflow, arena.allocate_array<const char *>(this->num_columns),
+               arena.allocate_array<u_int32_t>(this->num_columns), arena.allocate_array<bool>(this->num_columns),
+               arena.allocate_array<Register>(this->num_registers + 1u));
+}
+
+/**
+ * Run the program against one marshaled record
+ * @param record       the record's bytes
+ * @param overflow     where its TEXT values stored out of line are
+ * @param fields       room for num_columns column addresses
+ * @param sizes        room for num_columns sizes
+ * @param out_of_line  room for num_columns flags
+ * @param r            room for num_registers + 1 registers
+ * @return true if the record qualifies
+ */
+bool CompiledPredicate::run(const char *record, OverflowFile *overflow, const char **fields, u_int32_t *sizes,
+                            bool *out_of_line, Register *r) const {
+    // locate the leading columns the program references (a TEXT value out of line is located by its pointer)
+    uint offset = 0;
+    for (u16 c = 0; c < this->num_columns; c++) {
+        out_of_line[c] = false;
+        u16 size = this->codecs[c]->size;
+        if (size != CodecOps::VARIABLE) {
+            fields[c] = record + offset;
+            sizes[c] = size;
+            offset += size;
+        } else if (OverflowPointer::is_pointer(record + offset)) {
+            out_of_line[c] = true;
+            fields[c] = record + offset;
+            sizes[c] = OverflowPointer::read(record + offset).length;
+            offset += OverflowPointer::SIZE;
+        } else {
+            u16 size;
+            memcpy(&size, record + offset, sizeof(u16));
+            sizes[c] = size;
+            fields[c] = record + offset + sizeof(u16);
+            offset += sizeof(u16) + size;
+        }
+    }
+    vector<string> fetched;  // the out-of-line values loaded so far (allocated only if there are any)
+
+    r[this->result].n = 0;
+    const Instruction *program = this->program.data();
+    size_t end = this->program.size();
+    for (size_t pc = 0; pc < end; pc++) {
+        const Instruction &in = program[pc];
+        int cmp;
+        switch (in.op) {
+            case LOAD_INT_COLUMN:
+                memcpy(&r[in.dst].n, fields[in.a], sizeof(int32_t));
+                break;
+            case LOAD_TEXT_COLUMN:
+                if (out_of_line[in.a]) {
+                    if (fetched.empty())
+                        fetched.resize(this->num_columns);
+                    fetched[in.a] = read_out_of_line(overflow, fields[in.a]);
+                    fields[in.a] = fetched[in.a].data();
+                    out_of_line[in.a] = false;
+                }
+                r[in.dst].text = fields[in.a];
+                r[in.dst].size = sizes[in.a];
+                break;
+            case LOAD_INT_CONST:
+                r[in.dst].n = this->int_constants[in.a];
+                break;
+            case LOAD_TEXT_CONST:
+                r[in.dst].text = this->text_constants[in.a].data();
+                r[in.dst].size = (u_int32_t) this->text_constants[in.a].size();
+                break;
+            case EQ_INT: r[in.dst].n = r[in.a].n == r[in.b].n; break;
+            case NE_INT: r[in.dst].n = r[in.a].n != r[in.b].n; break;
+            case LT_INT: r[in.dst].n = r[in.a].n < r[in.b].n; break;
+            case LE_INT: r[in.dst].n = r[in.a].n <= r[in.b].n; break;
+            case GT_INT: r[in.dst].n = r[in.a].n > r[in.b].n; break;
+            case GE_INT: r[in.dst].n = r[in.a].n >= r[in.b].n; break;
+            case EQ_TEXT: case NE_TEXT: case LT_TEXT: case LE_TEXT: case GT_TEXT: case GE_TEXT:
+                cmp = memcmp(r[in.a].text, r[in.b].text, min(r[in.a].size, r[in.b].size));
+                if (cmp == 0)
+                    cmp = (int) r[in.a].size - (int) r[in.b].size;
+                r[in.dst].n = in.op == EQ_TEXT ? cmp == 0 : in.op == NE_TEXT ? cmp != 0 : in.op == LT_TEXT ? cmp < 0
+                            : in.op == LE_TEXT ? cmp <= 0 : in.op == GT_TEXT ? cmp > 0 : cmp >= 0;
+                break;
+            case EQ_INT_COLUMN_CONST: case NE_INT_COLUMN_CONST: case LT_INT_COLUMN_CONST:
+            case LE_INT_COLUMN_CONST: case GT_INT_COLUMN_CONST: case GE_INT_COLUMN_CONST: {
+                int32_t n, k = this->int_constants[in.b];
+                memcpy(&n, fields[in.a], sizeof(int32_t));
+                r[in.dst].n = in.op == EQ_INT_COLUMN_CONST ? n == k : in.op == NE_INT_COLUMN_CONST ? n != k
+                            : in.op == LT_INT_COLUMN_CONST ? n < k : in.op == LE_INT_COLUMN_CONST ? n <= k
+                            : in.op == GT_INT_COLUMN_CONST ? n > k : n >= k;
+                break;
+            }
+            case NOT:
+                r[in.dst].n = !r[in.a].n;
+                break;
+            case MOVE:
+                r[in.dst].n = r[in.a].n;
+                break;
+            case JUMP_IF_FALSE:
+                if (!r[in.a].n)
+                    pc = in.b - 1;
+                break;
+            case JUMP_IF_TRUE:
+                if (r[in.a].n)
+                    pc = in.b - 1;
+                break;
+            case CONST_TRUE:
+                r[in.dst].n = 1;
+                break;
+            case EQ_FIXED_COLUMN_CONST: case NE_FIXED_COLUMN_CONST: case LT_FIXED_COLUMN_CONST:
+            case LE_FIXED_COLUMN_CONST: case GT_FIXED_COLUMN_CONST: case GE_FIXED_COLUMN_CONST:
+                cmp = this->codecs[in.a]->compare(fields[in.a], this->fixed_constants[in.b].data());
+                r[in.dst].n = holds(in.op - EQ_FIXED_COLUMN_CONST, cmp);
+                break;
+            case EQ_FIXED_COLUMNS: case NE_FIXED_COLUMNS: case LT_FIXED_COLUMNS:
+            case LE_FIXED_COLUMNS: case GT_FIXED_COLUMNS: case GE_FIXED_COLUMNS:
+                cmp = this->codecs[in.a]->compare(fields[in.a], fields[in.b]);
+                r[in.dst].n = holds(in.op - EQ_FIXED_COLUMNS, cmp);
+                break;
+        }
+    }
+    return r[this->result].n != 0;
+}
+
+/**
+ * Evaluate against a batch of marshaled records
+ * @param records the records' bytes
+ * @param count   number of records
+ * @param matches receives 1 or 0 per record
+ * @param overflow where their TEXT values stored out of line are
+ * @return the number of qualifying records
+ */
+size_t CompiledPredicate::evaluate_batch(const char *const *records, size_t count, u_int8_t *matches,
+                                         OverflowFile *overflow) const {
+    size_t hits = 0;
+    for (size_t i = 0; i < count; i++) {
+        matches[i] = evaluate(records[i], overflow) ? 1 : 0;
+        hits += matches[i];
+    }
+    return hits;
+}
+
+// Disassemble the program, one instruction per line
+string CompiledPredicate::to_string() const {
+    static const char *names[] = {
+            "LOAD_INT_COLUMN", "LOAD_TEXT_COLUMN", "LOAD_INT_CONST", "LOAD_TEXT_CONST",
+            "EQ_INT", "NE_INT", "LT_INT", "LE_INT", "GT_INT", "GE_INT",
+            "EQ_TEXT", "NE_TEXT", "LT_TEXT", "LE_TEXT", "GT_TEXT", "GE_TEXT",
+            "EQ_INT_COLUMN_CONST", "NE_INT_COLUMN_CONST", "LT_INT_COLUMN_CONST",
+            "LE_INT_COLUMN_CONST", "GT_INT_COLUMN_CONST", "GE_INT_COLUMN_CONST",
+            "NOT", "MOVE", "JUMP_IF_FALSE", "JUMP_IF_TRUE", "CONST_TRUE",
+            "EQ_FIXED_COLUMN_CONST", "NE_FIXED_COLUMN_CONST", "LT_FIXED_COLUMN_CONST",
+            "LE_FIXED_COLUMN_CONST", "GT_FIXED_COLUMN_CONST", "GE_FIXED_COLUMN_CONST",
+            "EQ_FIXED_COLUMNS", "NE_FIXED_COLUMNS", "LT_FIXED_COLUMNS",
+            "LE_FIXED_COLUMNS", "GT_FIXED_COLUMNS", "GE_FIXED_COLUMNS"};
+    stringstream res;
+    for (size_t pc = 0; pc < this->program.size(); pc++) {
+        const Instruction &in = this->program[pc];
+        res << pc << ": " << names[in.op] << " r" << in.dst << ", " << in.a << ", " << in.b << endl;
+    }
+    res << "result r" << this->result;
+    return res.str();
+}
+
+// Allocate a fresh register
+u16 CompiledPredicate::new_register() {
+    return this->num_registers++;
+}
+
+/**
+ * Append an instruction
+ * @return the instruction's index (for patch_jump)
+ */
+size_t CompiledPredicate::emit(OpCode op, u16 dst, u16 a, u16 b) {
+    Instruction in;
+    in.op = (u_int8_t) op;
+    in.dst = dst;
+    in.a = a;
+    in.b = b;
+    this->program.push_back(in);
+    return this->program.size() - 1;
+}
+
+// Add a typed INT constant; returns its index
+u16 CompiledPredicate::add_constant(int32_t n) {
+    this->int_constants.push_back(n);
+    return (u16) (this->int_constants.size() - 1);
+}
+
+// Add a typed TEXT constant; returns its index
+u16 CompiledPredicate::add_constant(const string &s) {
+    this->text_constants.push_back(s);
+    return (u16) (this->text_constants.size() - 1);
+}
+
+// Add a constant for comparing with a fixed-width column (value is of the column's type); returns its index
+u16 CompiledPredicate::add_fixed_constant(u16 ordinal, const Value &value) {
+    const CodecOps &codec = *this->codecs[ordinal];
+    string bytes(codec.size, '\0');
+    codec.marshal(value, &bytes[0]);
+    this->fixed_constants.push_back(bytes);
+    return (u16) (this->fixed_constants.size() - 1);
+}
+
+// Point a previously emitted jump at target
+void CompiledPredicate::patch_jump(size_t instruction, size_t target) {
+    this->program[instruction].b = (u16) target;
+}
+
+// Record that the program reads column #ordinal (so evaluate locates it)
+void CompiledPredicate::use_column(u16 ordinal) {
+    if (ordinal + 1 > this->num_columns)
+        this->num_columns = ordinal + 1;
+}
+
+/*****************************************ExprCompiler**************************************************************/
+
+/**
+ * Compile an hsql WHERE expression against a table schema
+ * @param where             the where clause, or nullptr for all rows
+ * @param column_names      the table's columns in storage order
+ * @param column_attributes the table's column types
+ * @return the compiled predicate (freed by caller)
+ */
+CompiledPredicate *ExprCompiler::compile(const Expr *where, const ColumnNames &column_names,
+                                         const ColumnAttributes &column_attributes) {
+    CompiledPredicate *predicate = new CompiledPredicate(column_attributes);
+    try {
+        if (where == nullptr) {
+            u16 r = predicate->new_register();
+            predicate->emit(CompiledPredicate::CONST_TRUE, r);
+            predicate->set_result(r);
+            predicate->set_column_tests_only(true);
+        } else {
+            ColumnAttribute::DataType type;
+            predicate->set_result(compile_expr(predicate, where, column_names, column_attributes, type));
+            if (type != ColumnAttribute::INT)
+                throw DbRelationError("WHERE clause is not a boolean expression");
+            predicate->set_column_tests_only(collect_column_tests(predicate, where, column_names, column_attributes));
+        }
+    } catch (...) {
+        delete predicate;
+        throw;
+    }
+    return predicate;
+}
+
+/**
+ * Compile a conjunction of column = value equalities
+ * @param where             column names to required values (nullptr or empty for all rows)
+ * @param column_names      the table's columns in storage order
+ * @param column_attributes the table's column types
+ * @return the compiled predicate (freed by caller)
+ */
+CompiledPredicate *ExprCompiler::compile(const ValueDict *where, const ColumnNames &column_names,
+                                         const ColumnAttributes &column_attributes) {
+    CompiledPredicate *predicate = new CompiledPredicate(column_attributes);
+    u16 result = predicate->new_register();
+    predicate->emit(CompiledPredicate::CONST_TRUE, result);
+    vector<size_t> jumps;
+    bool tests_only = true;
+    try {
+        if (where != nullptr) {
+            for (auto const &equality: *where) {
+                u16 ordinal = column_ordinal(equality.first.c_str(), column_names);
+                ColumnAttribute::DataType type = column_attributes[ordinal].get_data_type();
+                Value value = equality.second;
+                if (value.data_type != type) {
+                    try {
+                        value = convert_value(value, type);
+                    } catch (DbRelationError &e) {
+                        throw DbRelationError("type mismatch comparing column " + equality.first);
+                    }
+                }
+                predicate->use_column(ordinal);
+                if (type == ColumnAttribute::INT || type == ColumnAttribute::TEXT) {
+                    ColumnTest test = {ordinal, 0, value};
+                    predicate->add_column_test(test);
+                } else {
+                    tests_only = false;
+                }
+                if (type == ColumnAttribute::INT) {
+                    predicate->emit(CompiledPredicate::EQ_INT_COLUMN_CONST, result, ordinal,
+                                    predicate->add_constant(value.n));
+                } else if (type != ColumnAttribute::TEXT) {
+                    predicate->emit(CompiledPredicate::EQ_FIXED_COLUMN_CONST, result, ordinal,
+                                    predicate->add_fixed_constant(ordinal, value));
+                } else {
+                    u16 column = predicate->new_register(), constant = predicate->new_register();
+                    predicate->emit(CompiledPredicate::LOAD_TEXT_COLUMN, column, ordinal);
+                    predicate->emit(CompiledPredicate::LOAD_TEXT_CONST, constant,
+                                    predicate->add_constant(value.s));
+                    predicate->emit(CompiledPredicate::EQ_TEXT, result, column, constant);
+                }
+                jumps.push_back(predicate->emit(CompiledPredicate::JUMP_IF_FALSE, 0, result));
+            }
+        }
+    } catch (...) {
+        delete predicate;
+        throw;
+    }
+    for (auto jump: jumps)
+        predicate->patch_jump(jump, predicate->size());
+    predicate->set_result(result);
+    predicate->set_column_tests_only(tests_only);
+    return predicate;
+}
+
+/**
+ * Compile one (sub)expression
+ * @param predicate the program being built
+ * @param expr      the expression
+ * @param type      set to the type of the expression's value (booleans are INT 0/1)
+ * @return the register holding the expression's value
+ */
+u16 ExprCompiler::compile_expr(CompiledPredicate *predicate, const Expr *expr, const ColumnNames &column_names,
+                               const ColumnAttributes &column_attributes, ColumnAttribute::DataType &type) {
+    u16 r;
+    switch (expr->type) {
+        case kExprColumnRef: {
+            u16 ordinal = column_ordinal(expr->name, column_names);
+            type = column_attributes[ordinal].get_data_type();
+            if (type != ColumnAttribute::INT && type != ColumnAttribute::TEXT)
+                throw DbRelationError(string("column ") + expr->name + " can only be compared with a literal or "
+                                      + "another " + codec_ops(type).name + " column");
+            predicate->use_column(ordinal);
+            r = predicate->new_register();
+            predicate->emit(type == ColumnAttribute::INT ? CompiledPredicate::LOAD_INT_COLUMN
+                                                         : CompiledPredicate::LOAD_TEXT_COLUMN, r, ordinal);
+            return r;
+        }
+        case kExprLiteralInt:
+            if (expr->ival < INT32_MIN || expr->ival > INT32_MAX)
+                throw DbRelationError("integer literal out of range: " + std::to_string(expr->ival));
+            type = ColumnAttribute::INT;
+            r = predicate->new_register();
+            predicate->emit(CompiledPredicate::LOAD_INT_CONST, r, predicate->add_constant((int32_t) expr->ival));
+            return r;
+        case kExprLiteralString:
+            type = ColumnAttribute::TEXT;
+            r = predicate->new_register();
+            predicate->emit(CompiledPredicate::LOAD_TEXT_CONST, r, predicate->add_constant(string(expr->name)));
+            return r;
+        case kExprOperator:
+            break;
+        default:
+            throw DbRelationError("unsupported expression in WHERE clause");
+    }
+
+    type = ColumnAttribute::INT;
+    ColumnAttribute::DataType operand_type;
+    switch (expr->opType) {
+        case Expr::AND:
+        case Expr::OR: {
+            r = predicate->new_register();
+            predicate->emit(CompiledPredicate::MOVE, r,
+                            compile_expr(predicate, expr->expr, column_names, column_attributes, operand_type));
+            size_t jump = predicate->emit(expr->opType == Expr::AND ? CompiledPredicate::JUMP_IF_FALSE
+                                                                    : CompiledPredicate::JUMP_IF_TRUE, 0, r);
+            predicate->emit(CompiledPredicate::MOVE, r,
+                            compile_expr(predicate, expr->expr2, column_names, column_attributes, operand_type));
+            predicate->patch_jump(jump, predicate->size());
+            return r;
+        }
+        case Expr::NOT:
+            r = predicate->new_register();
+            predicate->emit(CompiledPredicate::NOT, r,
+                            compile_expr(predicate, expr->expr, column_names, column_attributes, operand_type));
+            return r;
+        case Expr::SIMPLE_OP:
+        case Expr::NOT_EQUALS:
+        case Expr::LESS_EQ:
+        case Expr::GREATER_EQ:
+            return compile_comparison(predicate, expr, column_names, column_attributes);
+        default:
+            throw DbRelationError("unsupported operator in WHERE clause");
+    }
+}
+
+/**
+ * Compile a comparison; a column vs. a literal, or two columns of one fixed-width type other than INT, become
+ * one fused instruction
+ * @return the register holding the boolean result
+ */
+u16 ExprCompiler::compile_comparison(CompiledPredicate *predicate, const Expr *expr, const ColumnNames &column_names,
+                                     const ColumnAttributes &column_attributes) {
+    int cmp = comparison_code(expr);
+    if (cmp < 0)
+        throw DbRelationError(string("unsupported comparison operator ") + expr->opChar);
+
+    const Expr *left = expr->expr, *right = expr->expr2;
+    Value literal;
+    if (literal_value(left, literal) && right->type == kExprColumnRef) {
+        static const int flipped[] = {0, 1, 4, 5, 2, 3};
+        swap(left, right);
+        cmp = flipped[cmp];
+    }
+    if (left->type == kExprColumnRef && literal_value(right, literal)) {
+        u16 ordinal = column_ordinal(left->name, column_names);
+        ColumnAttribute::DataType type = column_attributes[ordinal].get_data_type();
+        if (type == ColumnAttribute::INT && literal.data_type == ColumnAttribute::INT) {
+            predicate->use_column(ordinal);
+            u16 r = predicate->new_register();
+            predicate->emit((CompiledPredicate::OpCode) (CompiledPredicate::EQ_INT_COLUMN_CONST + cmp), r, ordinal,
+                            predicate->add_constant(literal.n));
+            return r;
+        }
+        if (type != ColumnAttribute::INT && codec_ops(type).is_fixed()) {
+            try {
+                literal = convert_value(literal, type);
+            } catch (DbRelationError &e) {
+                throw DbRelationError(string("type mismatch comparing column ") + left->name + ": " + e.what());
+            }
+            predicate->use_column(ordinal);
+            u16 r = predicate->new_register();
+            predicate->emit((CompiledPredicate::OpCode) (CompiledPredicate::EQ_FIXED_COLUMN_CONST + cmp), r, ordinal,
+                            predicate->add_fixed_constant(ordinal, literal));
+            return r;
+        }
+    }
+    if (left->type == kExprColumnRef && right->type == kExprColumnRef) {
+        u16 a = column_ordinal(left->name, column_names), b = column_ordinal(right->name, column_names);
+        ColumnAttribute::DataType type = column_attributes[a].get_data_type();
+        if (type != ColumnAttribute::INT && codec_ops(type).is_fixed()) {
+            if (column_attributes[b].get_data_type() != type)
+                throw DbRelationError("type mismatch in WHERE comparison");
+            predicate->use_column(a);
+            predicate->use_column(b);
+            u16 r = predicate->new_register();
+            predicate->emit((CompiledPredicate::OpCode) (CompiledPredicate::EQ_FIXED_COLUMNS + cmp), r, a, b);
+            return r;
+        }
+    }
+
+    ColumnAttribute::DataType left_type, right_type;
+    u16 a = compile_expr(predicate, left, column_names, column_attributes, left_type);
+    u16 b = compile_expr(predicate, right, column_names, column_attributes, right_type);
+    if (left_type != right_type)
+        throw DbRelationError("type mismatch in WHERE comparison");
+    u16 r = predicate->new_register();
+    CompiledPredicate::OpCode base = left_type == ColumnAttribute::INT ? CompiledPredicate::EQ_INT
+                                                                        : CompiledPredicate::EQ_TEXT;
+    predicate->emit((CompiledPredicate::OpCode) (base + cmp), r, a, b);
+    return r;
+}
+
+// Which comparison an operator expression is
+int ExprCompiler::comparison_code(const Expr *expr) {
+    if (expr->type != kExprOperator)
+        return -1;
+    if (expr->opType == Expr::NOT_EQUALS)
+        return 1;
+    if (expr->opType == Expr::LESS_EQ)
+        return 3;
+    if (expr->opType == Expr::GREATER_EQ)
+        return 5;
+    if (expr->opType != Expr::SIMPLE_OP)
+        return -1;
+    return expr->opChar == '=' ? 0 : expr->opChar == '<' ? 2 : expr->opChar == '>' ? 4 : -1;
+}
+
+/**
+ * Find the comparisons of a column with a literal of its type that expr ANDs together (expr has compiled)
+ * @return true if expr is nothing but those
+ */
+bool ExprCompiler::collect_column_tests(CompiledPredicate *predicate, const Expr *expr, const ColumnNames &column_names,
+                                        const ColumnAttributes &column_attributes) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        bool left = collect_column_tests(predicate, expr->expr, column_names, column_attributes);
+        return collect_column_tests(predicate, expr->expr2, column_names, column_attributes) && left;
+    }
+    int cmp = comparison_code(expr);
+    if (cmp < 0)
+        return false;
+    const Expr *column = expr->expr, *literal = expr->expr2;
+    if (column->type != kExprColumnRef) {
+        static const int flipped[] = {0, 1, 4, 5, 2, 3};
+        swap(column, literal);
+        cmp = flipped[cmp];
+    }
+    if (column->type != kExprColumnRef)
+        return false;
+    ColumnTest test;
+    test.ordinal = column_ordinal(column->name, column_names);
+    test.comparison = cmp;
+    if (literal->type == kExprLiteralInt && column_attributes[test.ordinal].get_data_type() == ColumnAttribute::INT)
+        test.constant = Value((int32_t) literal->ival);
+    else if (literal->type == kExprLiteralString
+             && column_attributes[test.ordinal].get_data_type() == ColumnAttribute::TEXT)
+        test.constant = Value(string(literal->name));
+    else
+        return false;
+    predicate->add_column_test(test);
+    return true;
+}
+
+// The Value of a literal: INT if an integer fits in one (BIGINT if not), DOUBLE, or TEXT
+bool ExprCompiler::literal_value(const Expr *expr, Value &value) {
+    bool negate = false;
+    if (expr->type == kExprOperator && expr->opType == Expr::UMINUS && expr->expr != nullptr) {
+        negate = true;
+        expr = expr->expr;
+    }
+    switch (expr->type) {
+        case kExprLiteralInt: {
+            int64_t n = negate ? -expr->ival : expr->ival;
+            value = n >= INT32_MIN && n <= INT32_MAX ? Value((int32_t) n) : Value::bigint(n);
+            return true;
+        }
+        case kExprLiteralFloat:
+            value = Value::real(negate ? -expr->fval : expr->fval);
+            return true;
+        case kExprLiteralString:
+            if (negate)
+                return false;
+            value = Value(string(expr->name));
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Resolve a column name to its ordinal in the schema
+u16 ExprCompiler::column_ordinal(const char *name, const ColumnNames &column_names) {
+    for (size_t i = 0; i < column_names.size(); i++)
+        if (column_names[i] == name)
+            return (u16) i;
+    throw DbRelationError(string("unknown column ") + name);
+}
+
+/**
+ * The range of a column that a WHERE clause's top-level ANDed comparisons with literals allow
+ * @param where             the parsed where clause (nullptr for "all rows")
+ * @param column_names      the table's columns, in storage order
+ * @param column_attributes the table's column types
+ * @param ordinal           the column
+ * @return the range (unbounded where nothing narrows it)
+ */
+ColumnRange ExprCompiler::column_range(const Expr *where, const ColumnNames &column_names,
+                                       const ColumnAttributes &column_attributes, u16 ordinal) {
+    ColumnRange range;
+    if (where != nullptr && codec_ops(column_attributes[ordinal].get_data_type()).is_fixed())
+        narrow_range(range, where, column_names, column_attributes, ordinal);
+    return range;
+}
+
+// Tighten range by each "column op literal" ANDed at the top of expr; anything else can only narrow it further
+void ExprCompiler::narrow_range(ColumnRange &range, const Expr *expr, const ColumnNames &column_names,
+                                const ColumnAttributes &column_attributes, u16 ordinal) {
+    if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+        narrow_range(range, expr->expr, column_names, column_attributes, ordinal);
+        narrow_range(range, expr->expr2, column_names, column_attributes, ordinal);
+        return;
+    }
+    int cmp = comparison_code(expr);
+    if (cmp < 0 || cmp == 1)
+        return;
+    const Expr *column = expr->expr, *literal = expr->expr2;
+    if (column->type != kExprColumnRef) {
+        static const int flipped[] = {0, 1, 4, 5, 2, 3};
+        swap(column, literal);
+        cmp = flipped[cmp];
+    }
+    Value value;
+    if (column->type != kExprColumnRef || column_ordinal(column->name, column_names) != ordinal
+        || !literal_value(literal, value))
+        return;
+    const CodecOps &codec = codec_ops(column_attributes[ordinal].get_data_type());
+    try {
+        if (value.data_type != codec.data_type)
+            value = convert_value(value, codec.data_type);
+    } catch (DbRelationError &e) {
+        return;  // left to the predicate, which reports the mismatch
+    }
+    // compare in the column's own order, as its codec does
+    auto compare = [&codec](const Value &a, const Value &b) {
+        char a_bytes[sizeof(int64_t)], b_bytes[sizeof(int64_t)];
+        codec.marshal(a, a_bytes);
+        codec.marshal(b, b_bytes);
+        return codec.compare(a_bytes, b_bytes);
+    };
+    bool inclusive = cmp == 0 || cmp == 3 || cmp == 5;
+    if (cmp == 0 || cmp == 4 || cmp == 5) {  // EQ, GT, GE: a low bound
+        int order = range.has_low ? compare(value, range.low) : 1;
+        if (order > 0 || (order == 0 && !inclusive)) {
+            range.has_low = true;
+            range.low = value;
+            range.low_inclusive = inclusive;
+        }
+    }
+    if (cmp == 0 || cmp == 2 || cmp == 3) {  // EQ, LT, LE: a high bound
+        int order = range.has_high ? compare(value, range.high) : -1;
+        if (order < 0 || (order == 0 && !inclusive)) {
+            range.has_high = true;
+            range.high = value;
+            range.high_inclusive = inclusive;
+        }
+    }
+}
@@ -0,0 +1,236 @@
+/**
+ * @file   expr_compiler.h
+ * @brief  Compile WHERE clauses into flat register bytecode evaluated directly on marshaled records
+ *
+ * ColumnTest: a comparison of a column with a constant that a WHERE clause ANDs in
+ * CompiledPredicate: the bytecode program plus its pre-typed constants
+ * ExprCompiler: builds a CompiledPredicate from an hsql::Expr tree or a ValueDict of equalities
+ * ColumnRange: the values of one column a WHERE clause can accept, for a B+tree table's range scan
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "storage_engine.h"
+
+namespace hsql {
+    struct Expr;
+}
+
+class OverflowFile;
+struct CodecOps;
+
+/**
+ * @class ColumnTest - "column op constant", ANDed into a WHERE clause at its top level. A storage engine that
+ *      can test one column by itself (PaxPage::filter) need not rebuild the records such a test rules out.
+ */
+struct ColumnTest {
+    u_int16_t ordinal;  // the column
+    int comparison;     // 0..5: EQ, NE, LT, LE, GT, GE, as the *_COLUMN_CONST opcodes
+    Value constant;
+};
+
+/**
+ * @class ColumnRange - the values of a column between a low and a high bound, each of which may be missing
+ *      (unbounded) or exclusive. ExprCompiler::column_range finds one in a WHERE clause so a BTreeTable reads only
+ *      the leaves its key's range covers; the clause itself still decides which rows in the range qualify.
+ */
+struct ColumnRange {
+    bool has_low = false;
+    bool low_inclusive = true;
+    Value low;   // in the column's type
+    bool has_high = false;
+    bool high_inclusive = true;
+    Value high;
+
+    // a single value (column = constant)
+    bool is_point() const;
+
+    // as SQL: "id >= 10 AND id < 20", "id = 5", or "" if unbounded
+    std::string to_string(const Identifier &column_name) const;
+};
+
+/**
+ * @class CompiledPredicate - a WHERE clause compiled once per query
+ *
+ *      Column references are resolved to ordinals of the table's schema and literals to typed
+ *      constants, so evaluation is a single loop over a flat instruction array with no name lookups,
+ *      no recursion and no allocation. Records are read in HeapTable::marshal format
+ *      (INT: 4 bytes, TEXT: u16 length + bytes, or an OverflowPointer read from the table's OverflowFile only
+ *      when the program loads that column). AND/OR short-circuit with forward jumps.
+ *      Columns of the other fixed-width types are compared in place by their codec (column_codec.h), with a
+ *      literal converted to the column's type once, at compile time.
+ */
+class CompiledPredicate {
+public:
+    enum OpCode {
+        LOAD_INT_COLUMN,    // r[dst] = INT column #a
+        LOAD_TEXT_COLUMN,   // r[dst] = TEXT column #a
+        LOAD_INT_CONST,     // r[dst] = int_constants[a]
+        LOAD_TEXT_CONST,    // r[dst] = text_constants[a]
+        EQ_INT, NE_INT, LT_INT, LE_INT, GT_INT, GE_INT,             // r[dst] = r[a] op r[b]
+        EQ_TEXT, NE_TEXT, LT_TEXT, LE_TEXT, GT_TEXT, GE_TEXT,
+        EQ_INT_COLUMN_CONST, NE_INT_COLUMN_CONST, LT_INT_COLUMN_CONST,  // r[dst] = INT column #a op int_constants[b]
+        LE_INT_COLUMN_CONST, GT_INT_COLUMN_CONST, GE_INT_COLUMN_CONST,
+        NOT,                // r[dst] = !r[a]
+        MOVE,               // r[dst] = r[a]
+        JUMP_IF_FALSE,      // if !r[a] goto b (r[a] is the AND result)
+        JUMP_IF_TRUE,       // if r[a] goto b (r[a] is the OR result)
+        CONST_TRUE,         // r[dst] = 1
+        EQ_FIXED_COLUMN_CONST, NE_FIXED_COLUMN_CONST, LT_FIXED_COLUMN_CONST,  // r[dst] = column #a op
+        LE_FIXED_COLUMN_CONST, GT_FIXED_COLUMN_CONST, GE_FIXED_COLUMN_CONST,  //     fixed_constants[b]
+        EQ_FIXED_COLUMNS, NE_FIXED_COLUMNS, LT_FIXED_COLUMNS,                 // r[dst] = column #a op column #b
+        LE_FIXED_COLUMNS, GT_FIXED_COLUMNS, GE_FIXED_COLUMNS                  //     (both of one fixed type)
+    };
+
+    struct Instruction {
+        u_int8_t op;
+        u_int16_t dst;
+        u_int16_t a;
+        u_int16_t b;
+    };
+
+    // evaluate locates this many columns, and has this many registers, in arrays on the stack; a program that
+    // needs more takes them from the thread's scratch arena
+    static const u_int16_t STACK_COLUMNS = 32;
+    static const u_int16_t STACK_REGISTERS = 64;
+
+    CompiledPredicate(const ColumnAttributes &column_attributes);
+
+    virtual ~CompiledPredicate() {}
+
+    /**
+     * Evaluate against one marshaled record.
+     * @param data      the record as stored in a block
+     * @param overflow  where the record's TEXT values stored out of line are (nullptr if it has none)
+     * @returns         true if the record qualifies
+     */
+    virtual bool evaluate(const Dbt *data, OverflowFile *overflow = nullptr) const;
+
+    virtual bool evaluate(const char *record, OverflowFile *overflow = nullptr) const;
+
+    /**
+     * Evaluate against a batch of marshaled records.
+     * @param records   the records
+     * @param count     how many records
+     * @param matches   set to 1/0 per record
+     * @param overflow  as for evaluate
+     * @returns         the number of qualifying records
+     */
+    virtual size_t evaluate_batch(const char *const *records, size_t count, u_int8_t *matches,
+                                  OverflowFile *overflow = nullptr) const;
+
+    // one line per instruction, for debugging and EXPLAIN-style output
+    virtual std::string to_string() const;
+
+    // the ColumnTests the clause is a conjunction of (some of them, if not is_column_tests_only())
+    virtual const std::vector<ColumnTest> &get_column_tests() const { return column_tests; }
+
+    // whether a record that passes every ColumnTest qualifies without running the program
+    virtual bool is_column_tests_only() const { return column_tests_only; }
+
+    // -- used by ExprCompiler --
+    virtual u_int16_t new_register();
+
+    virtual size_t emit(OpCode op, u_int16_t dst, u_int16_t a = 0, u_int16_t b = 0);
+
+    virtual u_int16_t add_constant(int32_t n);
+
+    virtual u_int16_t add_constant(const std::string &s);
+
+    // a constant of a fixed-width column's type, in marshal format
+    virtual u_int16_t add_fixed_constant(u_int16_t ordinal, const Value &value);
+
+    virtual void patch_jump(size_t instruction, size_t target);
+
+    virtual void use_column(u_int16_t ordinal);
+
+    virtual void set_result(u_int16_t result) { this->result = result; }
+
+    virtual void add_column_test(const ColumnTest &test) { column_tests.push_back(test); }
+
+    virtual void set_column_tests_only(bool only) { column_tests_only = only; }
+
+    virtual size_t size() const { return program.size(); }
+
+protected:
+    struct Register;
+
+    std::vector<const CodecOps *> codecs;  // each column's
+    std::vector<Instruction> program;
+    std::vector<int32_t> int_constants;
+    std::vector<std::string> text_constants;
+    std::vector<std::string> fixed_constants;
+    u_int16_t num_registers;
+    u_int16_t num_columns;  // only the leading columns up to the highest referenced one are located
+    u_int16_t result;
+    std::vector<ColumnTest> column_tests;
+    bool column_tests_only;
+
+    // evaluate with arrays of at least num_columns fields and num_registers + 1 registers
+    bool run(const char *record, OverflowFile *overflow, const char **fields, u_int32_t *sizes, bool *out_of_line,
+             Register *r) const;
+};
+
+/**
+ * @class ExprCompiler - turns WHERE clauses into CompiledPredicates for a given table schema
+ */
+class ExprCompiler {
+public:
+    /**
+     * Compile an hsql WHERE expression.
+     * @param where              the parsed where clause (nullptr for "all rows")
+     * @param column_names       the table's columns, in storage order
+     * @param column_attributes  the table's column types
+     * @returns                  the compiled predicate (freed by caller)
+     * @throws                   DbRelationError for unknown columns, type mismatches or unsupported operators
+     */
+    static CompiledPredicate *compile(const hsql::Expr *where, const ColumnNames &column_names,
+                                      const ColumnAttributes &column_attributes);
+
+    /**
+     * Compile a conjunction of column = value equalities (as in DbRelation::select(where)).
+     */
+    static CompiledPredicate *compile(const ValueDict *where, const ColumnNames &column_names,
+                                      const ColumnAttributes &column_attributes);
+
+    /**
+     * The range of a fixed-width column that the comparisons of it with literals ANDed at the top of a WHERE
+     * clause allow (other conjuncts, and literals that don't convert to the column's type, don't narrow it).
+     * @param where    the parsed where clause (nullptr for "all rows")
+     * @param ordinal  the column
+     * @returns        the range, unbounded if nothing narrows it (or the column is TEXT)
+     */
+    static ColumnRange column_range(const hsql::Expr *where, const ColumnNames &column_names,
+                                    const ColumnAttributes &column_attributes, u_int16_t ordinal);
+
+protected:
+    static u_int16_t compile_expr(CompiledPredicate *predicate, const hsql::Expr *expr,
+                                  const ColumnNames &column_names, const ColumnAttributes &column_attributes,
+                                  ColumnAttribute::DataType &type);
+
+    static u_int16_t compile_comparison(CompiledPredicate *predicate, const hsql::Expr *expr,
+                                        const ColumnNames &column_names, const ColumnAttributes &column_attributes);
+
+    // 0..5 for EQ, NE, LT, LE, GT, GE, or -1 if expr is not a comparison
+    static int comparison_code(const hsql::Expr *expr);
+
+    // add the column-vs-literal comparisons ANDed at the top of expr as ColumnTests; true if that is all of it
+    static bool collect_column_tests(CompiledPredicate *predicate, const hsql::Expr *expr,
+                                     const ColumnNames &column_names, const ColumnAttributes &column_attributes);
+
+    // narrow range by the comparisons of column #ordinal with a literal ANDed at the top of expr
+    static void narrow_range(ColumnRange &range, const hsql::Expr *expr, const ColumnNames &column_names,
+                             const ColumnAttributes &column_attributes, u_int16_t ordinal);
+
+    static u_int16_t column_ordinal(const char *name, const ColumnNames &column_names);
+
+    // the value of a number or string literal (possibly negated); false if expr is not one
+    static bool literal_value(const hsql::Expr *expr, Value &value);
+};
+
+bool test_expr_compiler();
+
+void benchmark_expr_compiler(uint num_rows);
@@ -0,0 +1,20 @@
+/**
+ * @file   fnv_hash.h
+ * @brief  FNV-1a: the log's record checksum and the workload driver's key scrambler
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+
+// 32-bit FNV-1a of size bytes (the log's records are checked with it, so it must not change)
+inline u_int32_t fnv1a(const void *bytes, size_t size) {
+    const unsigned char *p = (const unsigned char *) bytes;
+    u_int32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
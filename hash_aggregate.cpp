@@ -0,0 +1,609 @@
+/**
+ * @file   hash_aggregate.cpp
+ * @brief  the implementation file for AggregateHashTable and HashAggregate
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "hash_aggregate.h"
+#include "column_codec.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <thread>
+using namespace std;
+
+
+typedef u_int16_t u16;
+typedef u_int64_t u64;
+
+// deepest re-partitioning of a spilled partition before we stop honoring the memory budget
+static const uint MAX_SPILL_LEVEL = 16;
+
+static void write_group(FILE *file, u64 hash, const ValueList &key, const AggregateStates &states);
+static void rewind_spill(FILE *file);
+
+/**
+ * Testing function for HashAggregate.
+ * Forces spilling with a tiny group budget and checks the results against a straightforward tally; a spill
+ * file that cannot be written is an error.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_hash_aggregate() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_hash_aggregate_cpp", column_names, column_attributes);
+    table.create();
+
+    const int num_rows = 2000, num_groups = 37;
+    map<string, int> counts, sums, mins, maxs;
+    for (int i = 0; i < num_rows; i++) {
+        ValueDict row;
+        int a = (i * 7919) % 1000;
+        string b = "group" + to_string(i % num_groups);
+        row["a"] = Value(a);
+        row["b"] = Value(b);
+        table.insert(&row);
+        if (counts[b]++ == 0)
+            mins[b] = maxs[b] = a;
+        sums[b] += a;
+        mins[b] = min(mins[b], a);
+        maxs[b] = max(maxs[b], a);
+    }
+
+    ColumnNames group_by;
+    group_by.push_back("b");
+    AggregateSpecs aggregates;
+    aggregates.push_back(AggregateSpec(AggregateSpec::COUNT, "*"));
+    aggregates.push_back(AggregateSpec(AggregateSpec::SUM, "a"));
+    aggregates.push_back(AggregateSpec(AggregateSpec::MIN, "a"));
+    aggregates.push_back(AggregateSpec(AggregateSpec::MAX, "a"));
+    HashAggregate aggregate(table, group_by, aggregates, 4, 5);
+    ValueDicts *results = aggregate.execute();
+    bool ok = true;
+    if (results->size() != (size_t) num_groups) {
+        cout << "FAILED TEST: expected " << num_groups << " groups, got " << results->size() << endl;
+        ok = false;
+    }
+    if (aggregate.get_spilled() == 0) {
+        cout << "FAILED TEST: expected the small budget to spill" << endl;
+        ok = false;
+    }
+    for (auto const &row: *results) {
+        string b = (*row)["b"].s;
+        if ((*row)["COUNT(*)"].l != counts[b] || (*row)["SUM(a)"].l != sums[b]
+            || (*row)["MIN(a)"].n != mins[b] || (*row)["MAX(a)"].n != maxs[b]) {
+            cout << "FAILED TEST: wrong aggregates for " << b << endl;
+            ok = false;
+        }
+        delete row;
+    }
+    delete results;
+    table.drop();
+
+    FILE *full = fopen("/dev/full", "w");
+    if (full != nullptr) {
+        try {
+            ValueList key(1, Value(string(100, 'k')));
+            AggregateStates states(4);
+            for (int i = 0; i < 10000; i++)
+                write_group(full, i, key, states);
+            rewind_spill(full);
+            cout << "FAILED TEST: spill to a full filesystem did not fail" << endl;
+            ok = false;
+        } catch (DbRelationError &e) {
+        }
+        fclose(full);
+    }
+    return ok;
+}
+
+/**
+ * Mix the bits of a 64-bit value (splitmix64 finalizer)
+ * @param x value to mix
+ * @return mixed value
+ */
+static u64 mix(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Close the spill files still open (after an error)
+static void close_spills(vector<FILE *> &spills) {
+    for (auto &partition: spills)
+        if (partition != nullptr) {
+            fclose(partition);
+            partition = nullptr;
+        }
+}
+
+// Hash the group-by values of a row
+static u64 hash_key(const ValueList &key) {
+    u64 hash = 0x243f6a8885a308d3ULL;
+    for (auto const &value: key) {
+        hash = mix(hash ^ value_bits(value));
+    }
+    return hash;
+}
+
+// Compare two values of the same column
+static bool value_equal(const Value &a, const Value &b) {
+    if (a.data_type != b.data_type)
+        return false;
+    return a.data_type == ColumnAttribute::INT ? a.n == b.n : compare_values(a, b) == 0;
+}
+
+static bool value_less(const Value &a, const Value &b) {
+    return a.data_type == ColumnAttribute::INT ? a.n < b.n : compare_values(a, b) < 0;
+}
+
+// Which of the spill partitions a group belongs to at a given re-partitioning level (uses the high hash bits)
+static uint partition_of(u64 hash, uint level) {
+    return (uint) (hash >> (61 - 3 * level)) & (HashAggregate::SPILL_PARTITIONS - 1);
+}
+
+/*****************************************Spill Files***************************************************************/
+
+// Write to a spill file; a short write (say, a full temp filesystem) must not silently drop groups
+static void write_spill(FILE *file, const void *bytes, size_t size) {
+    if (size > 0 && fwrite(bytes, 1, size, file) != size)
+        throw DbRelationError(string("aggregation spill file write failed: ") + strerror(errno));
+}
+
+// Go back to the start of a spill file to read it, after making sure everything buffered was written
+static void rewind_spill(FILE *file) {
+    if (fflush(file) != 0 || ferror(file))
+        throw DbRelationError(string("aggregation spill file write failed: ") + strerror(errno));
+    rewind(file);
+}
+
+// Write a value to a spill file: type byte, then the value in marshal format or the u16-length-prefixed TEXT
+static void write_value(FILE *file, const Value &value) {
+    char type = (char) value.data_type;
+    write_spill(file, &type, sizeof(type));
+    const CodecOps &codec = codec_ops(value.data_type);
+    if (codec.is_fixed()) {
+        char field[8];
+        codec.marshal(value, field);
+        write_spill(file, field, codec.size);
+    } else {
+        u16 size = (u16) value.s.length();
+        write_spill(file, &size, sizeof(size));
+        write_spill(file, value.s.data(), size);
+    }
+}
+
+static Value read_value(FILE *file) {
+    char type = 0;
+    if (fread(&type, sizeof(type), 1, file) != 1)
+        throw DbRelationError("truncated aggregation spill file");
+    const CodecOps &codec = codec_ops((ColumnAttribute::DataType) type);
+    if (codec.is_fixed()) {
+        char field[8];
+        if (fread(field, 1, codec.size, file) != codec.size)
+            throw DbRelationError("truncated aggregation spill file");
+        return codec.unmarshal(field);
+    }
+    u16 size = 0;
+    if (fread(&size, sizeof(size), 1, file) != 1)
+        throw DbRelationError("truncated aggregation spill file");
+    string s(size, '\0');
+    if (size > 0 && fread(&s[0], 1, size, file) != size)
+        throw DbRelationError("truncated aggregation spill file");
+    return Value(s);
+}
+
+// Write one group's partial states: hash, key values, then count/sum/min/max per aggregate
+static void write_group(FILE *file, u64 hash, const ValueList &key, const AggregateStates &states) {
+    write_spill(file, &hash, sizeof(hash));
+    for (auto const &value: key)
+        write_value(file, value);
+    for (auto const &state: states) {
+        write_spill(file, &state.count, sizeof(state.count));
+        write_spill(file, &state.sum, sizeof(state.sum));
+        write_value(file, state.min);
+        write_value(file, state.max);
+    }
+}
+
+// Read one group back; returns false at end of file
+static bool read_group(FILE *file, u64 &hash, ValueList &key, AggregateStates &states) {
+    if (fread(&hash, sizeof(hash), 1, file) != 1)
+        return false;
+    for (auto &value: key)
+        value = read_value(file);
+    for (auto &state: states) {
+        if (fread(&state.count, sizeof(state.count), 1, file) != 1
+            || fread(&state.sum, sizeof(state.sum), 1, file) != 1)
+            throw DbRelationError("truncated aggregation spill file");
+        state.min = read_value(file);
+        state.max = read_value(file);
+    }
+    return true;
+}
+
+/*****************************************Aggregate State***********************************************************/
+
+// Name of the aggregate's column in the result, e.g. "MIN(a)"
+Identifier AggregateSpec::output_name() const {
+    static const char *names[] = {"COUNT", "SUM", "MIN", "MAX"};
+    return string(names[this->function]) + "(" + this->column_name + ")";
+}
+
+// Fold one input value into the running state
+void AggregateState::add(const Value &value) {
+    if (this->count == 0) {
+        this->min = value;
+        this->max = value;
+    } else {
+        if (value_less(value, this->min))
+            this->min = value;
+        if (value_less(this->max, value))
+            this->max = value;
+    }
+    if (value.data_type == ColumnAttribute::INT)
+        this->sum += value.n;
+    else if (value.data_type == ColumnAttribute::BIGINT)
+        this->sum += value.l;
+    this->count++;
+}
+
+// Fold another partial state of the same group into this one
+void AggregateState::merge(const AggregateState &other) {
+    if (other.count == 0)
+        return;
+    if (this->count == 0) {
+        this->min = other.min;
+        this->max = other.max;
+    } else {
+        if (value_less(other.min, this->min))
+            this->min = other.min;
+        if (value_less(this->max, other.max))
+            this->max = other.max;
+    }
+    this->count += other.count;
+    this->sum += other.sum;
+}
+
+/*****************************************Aggregate Hash Table******************************************************/
+
+/**
+ * Constructor for AggregateHashTable
+ * @param num_aggregates how many AggregateStates each group carries
+ * @param max_groups     the most groups the table will accept before refusing new ones
+ */
+AggregateHashTable::AggregateHashTable(size_t num_aggregates, size_t max_groups) :
+        num_aggregates(num_aggregates), max_groups(max_groups), mask(15), slots(16, 0), entries() {
+}
+
+/**
+ * Find a group's states, adding an empty group if it is new and there is still room
+ * @param key  the group-by values
+ * @param hash hash_key(key)
+ * @return the group's states, or nullptr if the group is new and the table is full
+ */
+AggregateStates *AggregateHashTable::find_or_insert(const ValueList &key, u_int64_t hash) {
+    size_t slot = probe(key, hash);
+    if (this->slots[slot] != 0)
+        return &this->entries[this->slots[slot] - 1].states;
+    if (this->entries.size() >= this->max_groups)
+        return nullptr;
+    Entry entry;
+    entry.hash = hash;
+    entry.key = key;
+    entry.states.resize(this->num_aggregates);
+    this->entries.push_back(entry);
+    this->slots[slot] = (u_int32_t) this->entries.size();
+    if (this->entries.size() * 2 > this->slots.size())
+        grow();
+    return &this->entries.back().states;
+}
+
+/**
+ * Find a group's states without inserting
+ * @param key  the group-by values
+ * @param hash hash_key(key)
+ * @return the group's states, or nullptr if it isn't in the table
+ */
+AggregateStates *AggregateHashTable::find(const ValueList &key, u_int64_t hash) {
+    size_t slot = probe(key, hash);
+    return this->slots[slot] == 0 ? nullptr : &this->entries[this->slots[slot] - 1].states;
+}
+
+// Linear probe for key: returns the slot holding it, or the empty slot where it would go
+size_t AggregateHashTable::probe(const ValueList &key, u_int64_t hash) {
+    size_t slot = hash & this->mask;
+    while (this->slots[slot] != 0) {
+        const Entry &entry = this->entries[this->slots[slot] - 1];
+        if (entry.hash == hash) {
+            bool same = true;
+            for (size_t i = 0; same && i < key.size(); i++)
+                same = value_equal(entry.key[i], key[i]);
+            if (same)
+                return slot;
+        }
+        slot = (slot + 1) & this->mask;
+    }
+    return slot;
+}
+
+// Double the probe array and re-insert every entry (keeps the load factor under one half)
+void AggregateHashTable::grow() {
+    this->slots.assign(this->slots.size() * 2, 0);
+    this->mask = this->slots.size() - 1;
+    for (size_t i = 0; i < this->entries.size(); i++) {
+        size_t slot = this->entries[i].hash & this->mask;
+        while (this->slots[slot] != 0)
+            slot = (slot + 1) & this->mask;
+        this->slots[slot] = (u_int32_t) (i + 1);
+    }
+}
+
+/*****************************************Hash Aggregate************************************************************/
+
+/**
+ * Constructor for HashAggregate
+ * @param table       the table to aggregate
+ * @param group_by    the grouping columns (empty for a single global group)
+ * @param aggregates  the aggregate functions to compute per group
+ * @param num_threads how many workers scan and pre-aggregate blocks
+ * @param max_groups  memory budget, as the number of groups held in memory at once
+ */
+HashAggregate::HashAggregate(HeapTable &table, const ColumnNames &group_by, const AggregateSpecs &aggregates,
+                             uint num_threads, size_t max_groups, const CompiledPredicate *predicate) :
+        table(table), group_by(group_by), aggregates(aggregates), num_threads(num_threads ? num_threads : 1),
+        max_groups(max_groups ? max_groups : 1), predicate(predicate), input_columns(group_by), spilled(0),
+        spill_mutex() {
+    for (auto const &aggregate: aggregates)
+        if (aggregate.column_name != "*"
+            && find(this->input_columns.begin(), this->input_columns.end(), aggregate.column_name)
+               == this->input_columns.end())
+            this->input_columns.push_back(aggregate.column_name);
+}
+
+/**
+ * Run the aggregation: parallel partial aggregation, merge, then the spilled partitions.
+ * @return one row per group (freed by caller)
+ */
+ValueDicts *HashAggregate::execute() {
+    this->spilled = 0;
+    SpillFiles spills(SPILL_PARTITIONS, nullptr);
+    Snapshot snapshot;  // every worker reads the table as of the same moment
+    BlockIDs *block_ids = this->table.block_ids();
+
+    // phase 1: thread-local partial aggregation
+    size_t worker_budget = this->max_groups / this->num_threads;
+    vector<AggregateHashTable *> partials;
+    vector<exception_ptr> errors(this->num_threads);
+    vector<thread> workers;
+    for (uint worker = 0; worker < this->num_threads; worker++)
+        partials.push_back(new AggregateHashTable(this->aggregates.size(), worker_budget ? worker_budget : 1));
+    for (uint worker = 0; worker < this->num_threads; worker++) {
+        workers.push_back(thread([this, block_ids, worker, &partials, &spills, &errors, &snapshot]() {
+            try {
+                aggregate_blocks(block_ids, worker, partials[worker], &spills, &snapshot);
+            } catch (...) {
+                errors[worker] = current_exception();
+            }
+        }));
+    }
+    for (auto &worker: workers)
+        worker.join();
+    delete block_ids;
+
+    // phase 2: merge the partials (groups that don't fit go to the spill partitions)
+    AggregateHashTable final_groups(this->aggregates.size(), this->max_groups);
+    ValueDicts *results = new ValueDicts();
+    try {
+        {
+            TRACE_SPAN("HashAggregate::merge", "operator");
+            for (auto &partial: partials) {
+                for (auto const &entry: partial->get_entries())
+                    merge_or_spill(&final_groups, entry.key, entry.hash, entry.states, &spills, 0);
+                delete partial;
+                partial = nullptr;
+            }
+        }
+        for (auto const &error: errors)
+            if (error)
+                rethrow_exception(error);
+
+        // phase 3: spilled groups either belong to a resident group or get aggregated partition by partition
+        for (auto &partition: spills) {
+            if (partition == nullptr)
+                continue;
+            rewind_spill(partition);
+            ValueList key(this->group_by.size());
+            AggregateStates states(this->aggregates.size());
+            u64 hash;
+            FILE *rest = tmpfile();
+            if (rest == nullptr)
+                throw DbRelationError("could not create aggregation spill file");
+            try {
+                while (read_group(partition, hash, key, states)) {
+                    AggregateStates *resident = final_groups.find(key, hash);
+                    if (resident != nullptr) {
+                        for (size_t i = 0; i < states.size(); i++)
+                            (*resident)[i].merge(states[i]);
+                    } else {
+                        write_group(rest, hash, key, states);
+                    }
+                }
+            } catch (...) {
+                fclose(rest);
+                throw;
+            }
+            fclose(partition);
+            partition = nullptr;
+            aggregate_partition(rest, 1, results);
+        }
+        emit(&final_groups, results);
+    } catch (...) {
+        for (auto partial: partials)
+            delete partial;
+        close_spills(spills);
+        for (auto row: *results)
+            delete row;
+        delete results;
+        throw;
+    }
+
+    // a global aggregate over an empty table still produces one row
+    if (this->group_by.empty() && results->empty()) {
+        AggregateHashTable empty(this->aggregates.size(), 1);
+        empty.find_or_insert(ValueList(), hash_key(ValueList()));
+        emit(&empty, results);
+    }
+    return results;
+}
+
+/**
+ * Worker body: fetch this worker's share of the blocks and aggregate their rows into a partial table
+ * @param block_ids all the blocks of the table
+ * @param worker    this worker's number; it takes every num_threads-th block starting here
+ * @param partial   this worker's hash table
+ * @param spills    the shared level-0 spill partitions
+ * @param snapshot  which versions of the rows to aggregate
+ */
+void HashAggregate::aggregate_blocks(const BlockIDs *block_ids, uint worker, AggregateHashTable *partial,
+                                     SpillFiles *spills, const Snapshot *snapshot) {
+    TRACE_SPAN("HashAggregate::worker", "operator");
+    vector<char> buffer(this->table.get_page_size());
+    ValueList key(this->group_by.size());
+    ValueDicts rows;
+    for (size_t i = worker; i < block_ids->size(); i += this->num_threads) {
+        this->table.copy_block((*block_ids)[i], buffer.data());
+        this->table.decode_block(buffer.data(), rows, this->predicate, snapshot, &this->input_columns);
+        for (auto row: rows) {
+            for (size_t k = 0; k < this->group_by.size(); k++)
+                key[k] = (*row)[this->group_by[k]];
+            u64 hash = hash_key(key);
+            AggregateStates *states = partial->find_or_insert(key, hash);
+            AggregateStates single;
+            if (states == nullptr) {
+                single.resize(this->aggregates.size());
+                states = &single;
+            }
+            for (size_t a = 0; a < this->aggregates.size(); a++) {
+                const AggregateSpec &spec = this->aggregates[a];
+                if (spec.column_name == "*")
+                    (*states)[a].count++;
+                else
+                    (*states)[a].add((*row)[spec.column_name]);
+            }
+            if (states == &single)
+                merge_or_spill(nullptr, key, hash, single, spills, 0);
+            delete row;
+        }
+        rows.clear();
+    }
+}
+
+/**
+ * Merge a group's partial states into target, or write them to a spill partition if target is full
+ * @param target  table to merge into (nullptr to always spill)
+ * @param key     the group-by values
+ * @param hash    hash_key(key)
+ * @param states  the group's partial states
+ * @param spills  spill partitions for this level (created on demand)
+ * @param level   re-partitioning level, selects which hash bits pick the partition
+ */
+void HashAggregate::merge_or_spill(AggregateHashTable *target, const ValueList &key, u_int64_t hash,
+                                   const AggregateStates &states, SpillFiles *spills, uint level) {
+    AggregateStates *existing = target == nullptr ? nullptr : target->find_or_insert(key, hash);
+    if (existing != nullptr) {
+        for (size_t i = 0; i < states.size(); i++)
+            (*existing)[i].merge(states[i]);
+        return;
+    }
+    lock_guard<mutex> lock(this->spill_mutex);
+    FILE *&partition = (*spills)[partition_of(hash, level)];
+    if (partition == nullptr) {
+        partition = tmpfile();
+        if (partition == nullptr)
+            throw DbRelationError("could not create aggregation spill file");
+    }
+    write_group(partition, hash, key, states);
+    this->spilled++;
+}
+
+/**
+ * Aggregate one spilled partition with a fresh table, re-partitioning whatever still doesn't fit
+ * @param partition the partition's spill file (closed here)
+ * @param level     re-partitioning level of this partition's children
+ * @param results   finished groups are appended here
+ */
+void HashAggregate::aggregate_partition(FILE *partition, uint level, ValueDicts *results) {
+    size_t budget = level >= MAX_SPILL_LEVEL ? (size_t) -1 : this->max_groups;
+    AggregateHashTable groups(this->aggregates.size(), budget);
+    SpillFiles children(SPILL_PARTITIONS, nullptr);
+    ValueList key(this->group_by.size());
+    AggregateStates states(this->aggregates.size());
+    u64 hash;
+    try {
+        rewind_spill(partition);
+        while (read_group(partition, hash, key, states))
+            merge_or_spill(&groups, key, hash, states, &children, level);
+    } catch (...) {
+        fclose(partition);
+        close_spills(children);
+        throw;
+    }
+    fclose(partition);
+    emit(&groups, results);
+    for (auto &child: children) {
+        if (child == nullptr)
+            continue;
+        FILE *next = child;
+        child = nullptr;
+        try {
+            aggregate_partition(next, level + 1, results);
+        } catch (...) {
+            close_spills(children);
+            throw;
+        }
+    }
+}
+
+/**
+ * Turn every group of a table into a result row
+ * @param groups  the finished groups
+ * @param results rows are appended here (freed by caller)
+ */
+void HashAggregate::emit(AggregateHashTable *groups, ValueDicts *results) {
+    for (auto const &entry: groups->get_entries()) {
+        ValueDict *row = new ValueDict();
+        for (size_t k = 0; k < this->group_by.size(); k++)
+            (*row)[this->group_by[k]] = entry.key[k];
+        for (size_t a = 0; a < this->aggregates.size(); a++) {
+            const AggregateSpec &spec = this->aggregates[a];
+            const AggregateState &state = entry.states[a];
+            Value value;
+            switch (spec.function) {
+                case AggregateSpec::COUNT:
+                    value = Value::bigint(state.count);
+                    break;
+                case AggregateSpec::SUM:
+                    value = Value::bigint(state.sum);  // of INTs too: a big group's sum needs more than 32 bits
+                    break;
+                case AggregateSpec::MIN:
+                    value = state.min;
+                    break;
+                case AggregateSpec::MAX:
+                    value = state.max;
+                    break;
+            }
+            (*row)[spec.output_name()] = value;
+        }
+        results->push_back(row);
+    }
+}
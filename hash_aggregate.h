@@ -0,0 +1,168 @@
+/**
+ * @file   hash_aggregate.h
+ * @brief  Hash aggregation (GROUP BY with COUNT/SUM/MIN/MAX) over a HeapTable
+ *
+ * AggregateHashTable: open-addressing table of groups keyed on the group-by column values
+ * HashAggregate: the operator -- parallel partial aggregation, merge, and spill by hash partition
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <cstdio>
+#include <mutex>
+#include "heap_storage.h"
+
+/**
+ * @class AggregateSpec - one aggregate function in a select list, e.g. SUM(b) or COUNT(*)
+ */
+class AggregateSpec {
+public:
+    enum Function {
+        COUNT, SUM, MIN, MAX
+    };
+
+    AggregateSpec(Function function, Identifier column_name) : function(function), column_name(column_name) {}
+
+    virtual ~AggregateSpec() {}
+
+    // column name used for this aggregate in the result rows, e.g. "SUM(b)"
+    virtual Identifier output_name() const;
+
+    Function function;
+    Identifier column_name;  // "*" for COUNT(*)
+};
+
+typedef std::vector<AggregateSpec> AggregateSpecs;
+typedef std::vector<Value> ValueList;
+
+/**
+ * @class AggregateState - running COUNT/SUM/MIN/MAX for one aggregate of one group
+ */
+class AggregateState {
+public:
+    int64_t count;
+    int64_t sum;
+    Value min;
+    Value max;
+
+    AggregateState() : count(0), sum(0) {}
+
+    // fold one input value into the state
+    void add(const Value &value);
+
+    // fold another partial state for the same group into this one
+    void merge(const AggregateState &other);
+};
+
+typedef std::vector<AggregateState> AggregateStates;
+
+/**
+ * @class AggregateHashTable - open-addressing (linear probing) hash table of groups
+ *
+ *      Groups live densely in a vector; the probe array holds (entry index + 1), zero meaning empty.
+ *      The table refuses new groups once it holds max_groups of them so the caller can spill.
+ */
+class AggregateHashTable {
+public:
+    struct Entry {
+        u_int64_t hash;
+        ValueList key;
+        AggregateStates states;
+    };
+
+    AggregateHashTable(size_t num_aggregates, size_t max_groups);
+
+    virtual ~AggregateHashTable() {}
+
+    AggregateHashTable(const AggregateHashTable &other) = delete;
+
+    AggregateHashTable &operator=(const AggregateHashTable &other) = delete;
+
+    /**
+     * Find the states for a group without inserting it.
+     * @returns  the group's states, or nullptr if the group isn't in the table
+     */
+    virtual AggregateStates *find(const ValueList &key, u_int64_t hash);
+
+    /**
+     * Find the states for a group, inserting an empty group if there is room.
+     * @returns  the group's states, or nullptr if the group is new and the table is full
+     */
+    virtual AggregateStates *find_or_insert(const ValueList &key, u_int64_t hash);
+
+    virtual size_t size() const { return entries.size(); }
+
+    virtual std::vector<Entry> &get_entries() { return entries; }
+
+protected:
+    size_t num_aggregates;
+    size_t max_groups;
+    size_t mask;
+    std::vector<u_int32_t> slots;
+    std::vector<Entry> entries;
+
+    virtual size_t probe(const ValueList &key, u_int64_t hash);
+
+    virtual void grow();
+};
+
+/**
+ * @class HashAggregate - SELECT <group_by>, <aggregates> FROM <table> GROUP BY <group_by>
+ *
+ *      Each worker thread aggregates a disjoint subset of the table's blocks into its own
+ *      AggregateHashTable (fetching blocks under shared page latches), then the partials are merged.
+ *      Whenever a table would exceed the memory budget (max_groups), the overflowing groups are
+ *      written as partial states to one of SPILL_PARTITIONS temporary files chosen by hash, and each
+ *      partition is aggregated on its own afterwards (re-partitioning with fresh hash bits if needed).
+ */
+class HashAggregate {
+public:
+    static const uint SPILL_PARTITIONS = 8;
+    static const size_t DEFAULT_MAX_GROUPS = 1 << 20;
+
+    // predicate, if given, is a WHERE clause compiled against the table; only rows it accepts are aggregated
+    HashAggregate(HeapTable &table, const ColumnNames &group_by, const AggregateSpecs &aggregates,
+                  uint num_threads = 1, size_t max_groups = DEFAULT_MAX_GROUPS,
+                  const CompiledPredicate *predicate = nullptr);
+
+    virtual ~HashAggregate() {}
+
+    HashAggregate(const HashAggregate &other) = delete;
+
+    HashAggregate &operator=(const HashAggregate &other) = delete;
+
+    /**
+     * Run the aggregation.
+     * @returns  one row per group keyed by the group-by columns and each aggregate's output_name() (freed by caller)
+     */
+    virtual ValueDicts *execute();
+
+    // number of group states written to spill files by the last execute()
+    virtual size_t get_spilled() const { return spilled; }
+
+protected:
+    typedef std::vector<FILE *> SpillFiles;
+
+    HeapTable &table;
+    ColumnNames group_by;
+    AggregateSpecs aggregates;
+    uint num_threads;
+    size_t max_groups;
+    const CompiledPredicate *predicate;
+    ColumnNames input_columns;  // the group-by columns and aggregate arguments: the only ones decoded
+    size_t spilled;
+    std::mutex spill_mutex;
+
+    virtual void aggregate_blocks(const BlockIDs *block_ids, uint worker, AggregateHashTable *partial,
+                                  SpillFiles *spills, const Snapshot *snapshot);
+
+    virtual void merge_or_spill(AggregateHashTable *target, const ValueList &key, u_int64_t hash,
+                                const AggregateStates &states, SpillFiles *spills, uint level);
+
+    virtual void aggregate_partition(FILE *partition, uint level, ValueDicts *results);
+
+    virtual void emit(AggregateHashTable *groups, ValueDicts *results);
+};
+
+bool test_hash_aggregate();
@@ -4,14 +4,27 @@
  * @authors Ethan Guttman, XingZheng
  */
 #include "heap_storage.h"
+#include "arena.h"
+#include "column_codec.h"
+#include "expr_compiler.h"
+#include "mvcc.h"
+#include "engine_stats.h"
+#include "trace.h"
+#include "wal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <exception>
 #include <map>
+#include <set>
+#include <thread>
 #include <utility>
 #include <vector>
 using namespace std;
 
 
+typedef u_int8_t u8;
 typedef u_int16_t u16;
 typedef u_int32_t u32;
 
@@ -26,14 +39,16 @@ bool assertion_failure(string message) {
 }
 
 /**
- * Testing function for SlottedPage.
- * @return true if testing succeeded, false otherwise 
+ * Testing function for one kind and size of SlottedPage.
+ * @param page_size the block's size
+ * @return true if testing succeeded, false otherwise
  */
-bool test_slotted_page() {
+template<typename Page>
+static bool test_slotted_page_of(uint page_size) {
     // construct one
-    char blank_space[DbBlock::BLOCK_SZ];
-    Dbt block_dbt(blank_space, sizeof(blank_space));
-    SlottedPage slot(block_dbt, 1, true);
+    vector<char> blank_space(page_size);
+    Dbt block_dbt(blank_space.data(), page_size);
+    Page slot(block_dbt, 1, true);
     // add a record
     char rec1[] = "hello";
     Dbt rec1_dbt(rec1, sizeof(rec1));
@@ -107,7 +122,7 @@ bool test_slotted_page() {
     if (get_dbt != nullptr)
         return assertion_failure("get of deleted record was not null");
     // try adding something too big
-    rec2_dbt = Dbt(nullptr, DbBlock::BLOCK_SZ - 10); // too big, but only because we have a record in there
+    rec2_dbt = Dbt(nullptr, page_size - 10); // too big, but only because we have a record in there
     try {
         slot.add(&rec2_dbt);
         return assertion_failure("failed to throw when add too big");
@@ -117,11 +132,39 @@ bool test_slotted_page() {
         // Note that this won't catch segfault signals -- but in that case we also know the test failed
         return assertion_failure("wrong type thrown when add too big");
     }
+    // the largest record an empty page is said to hold fits
+    vector<char> big(SlottedPage::max_record_size(page_size), 'x');
+    Dbt big_dbt(big.data(), big.size());
+    Page empty(block_dbt, 2, true);
+    try {
+        empty.add(&big_dbt);
+    } catch (const DbBlockNoRoomError &exc) {
+        return assertion_failure("a record of max_record_size did not fit in an empty page");
+    }
+    return true;
+}
+
+/**
+ * Testing function for SlottedPage: compact and wide pages at the smallest and largest page sizes.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_slotted_page() {
+    if (!test_slotted_page_of<CompactSlottedPage>(DbBlock::BLOCK_SZ)
+        || !test_slotted_page_of<CompactSlottedPage>(SlottedPage::COMPACT_MAX_SZ)
+        || !test_slotted_page_of<WideSlottedPage>(HeapFile::MAX_PAGE_SZ))
+        return false;
+    char blank_space[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(blank_space, sizeof(blank_space));
+    SlottedPage *page = SlottedPage::make(block_dbt, 1, true);
+    bool compact = dynamic_cast<CompactSlottedPage *>(page) != nullptr;
+    delete page;
+    if (!compact)
+        return assertion_failure("make did not choose a compact page for " + to_string(DbBlock::BLOCK_SZ) + " bytes");
     return true;
 }
 
 /**
- * Testing function for heap storage.
+ * Testing function for heap storage (a failed insert is not counted in ROWS_INSERTED).
  * @return true if testing succeeded, false otherwise 
  */
 bool test_heap_storage() {
@@ -147,7 +190,20 @@ bool test_heap_storage() {
     row["a"] = Value(12);
     row["b"] = Value("Hello!");
     cout << "try insert" << endl;
+    u_int64_t inserted_before = EngineStats::snapshot().counters[EngineStats::ROWS_INSERTED];
     table.insert(&row);
+    ValueDict incomplete;
+    incomplete["a"] = Value(13);
+    try {
+        table.insert(&incomplete);
+        return assertion_failure("insert of a row without every column");
+    } catch (DbRelationError &e) {
+    }
+#ifndef ENGINE_STATS_DISABLED
+    if (EngineStats::snapshot().counters[EngineStats::ROWS_INSERTED] != inserted_before + 1)
+        return assertion_failure("a failed insert was counted");
+#endif
+    (void) inserted_before;
     cout << "insert ok" << endl;
     cout << "try select" << endl;
     Handles* handles = table.select();
@@ -163,22 +219,669 @@ bool test_heap_storage() {
     if (value.s != "Hello!"){
 		return false;
 	}
+    delete result;
+    delete handles;
+    table.drop();
+
+    // a row too wide for the default page fits in a table with 64K pages, which keep their size when reopened
+    HeapTable wide("_test_wide_pages_cpp", column_names, column_attributes, HeapFile::MAX_PAGE_SZ);
+    wide.create();
+    row["b"] = Value(string(15000, 'w'));
+    wide.insert(&row);
+    wide.insert(&row);
+    wide.close();
+    HeapTable reopened("_test_wide_pages_cpp", column_names, column_attributes);
+    if (reopened.get_page_size() != HeapFile::MAX_PAGE_SZ)
+        return assertion_failure("page size not kept by the file: " + to_string(reopened.get_page_size()));
+    handles = reopened.select();
+    bool wide_ok = handles->size() == 2;
+    for (auto const &handle: *handles) {
+        result = reopened.project(handle);
+        wide_ok = wide_ok && (*result)["b"].s.size() == 15000;
+        delete result;
+    }
+    delete handles;
+    reopened.drop();
+    if (!wide_ok)
+        return assertion_failure("wide rows not read back from 64K pages");
+    // with 4K pages the same value is stored out of line
+    HeapTable narrow("_test_narrow_pages_cpp", column_names, column_attributes);
+    narrow.create();
+    result = narrow.project(narrow.insert(&row));
+    bool narrow_ok = (*result)["b"].s == row["b"].s;
+    delete result;
+    narrow.drop();
+    if (!narrow_ok)
+        return assertion_failure("a 15000-byte value not read back from a table with 4K pages");
+    return true;
+}
+
+/**
+ * Testing function for concurrent access to a HeapTable.
+ * Several threads insert (one row at a time and in batches) while others scan and project, then every row
+ * must be there exactly once and readers must never have seen a torn row.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_heap_concurrency() {
+    const int num_writers = 4, rows_per_writer = 1500, num_readers = 2;
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_heap_concurrency_cpp", column_names, column_attributes);
+    table.create();
+
+    atomic<bool> writing(true);
+    atomic<int> bad_rows(0);
+    vector<thread> threads;
+    for (int w = 0; w < num_writers; w++) {
+        threads.push_back(thread([&table, w]() {
+            ValueDicts batch;
+            for (int i = 0; i < rows_per_writer; i++) {
+                int a = w * rows_per_writer + i;
+                ValueDict *row = new ValueDict();
+                (*row)["a"] = Value(a);
+                (*row)["b"] = Value("row " + to_string(a));
+                if (w % 2 == 0) {
+                    table.insert(row);
+                    delete row;
+                } else {
+                    batch.push_back(row);
+                }
+                if (batch.size() == 100 || (i == rows_per_writer - 1 && !batch.empty())) {
+                    delete table.insert_batch(&batch);
+                    for (auto r: batch)
+                        delete r;
+                    batch.clear();
+                }
+            }
+        }));
+    }
+    for (int r = 0; r < num_readers; r++) {
+        threads.push_back(thread([&table, &writing, &bad_rows]() {
+            do {
+                Handles *handles = table.select();
+                for (auto const &handle: *handles) {
+                    ValueDict *row = table.project(handle);
+                    if ((*row)["b"].s != "row " + to_string((*row)["a"].n))
+                        bad_rows++;
+                    delete row;
+                }
+                delete handles;
+            } while (writing);
+        }));
+    }
+    for (int w = 0; w < num_writers; w++)
+        threads[w].join();
+    writing = false;
+    for (int r = 0; r < num_readers; r++)
+        threads[num_writers + r].join();
+
+    vector<int> seen(num_writers * rows_per_writer, 0);
+    Handles *handles = table.select();
+    for (auto const &handle: *handles) {
+        ValueDict *row = table.project(handle);
+        int a = (*row)["a"].n;
+        if (a >= 0 && a < (int) seen.size())
+            seen[a]++;
+        delete row;
+    }
+    size_t found = handles->size();
+    delete handles;
+    table.drop();
+    if (bad_rows > 0)
+        return assertion_failure("readers saw " + to_string(bad_rows) + " torn rows");
+    if (found != seen.size())
+        return assertion_failure("found " + to_string(found) + " rows, expected " + to_string(seen.size()));
+    for (size_t a = 0; a < seen.size(); a++)
+        if (seen[a] != 1)
+            return assertion_failure("row " + to_string(a) + " found " + to_string(seen[a]) + " times");
+    return true;
+}
+
+// The number of blocks in a table's overflow file (the table must be closed)
+static size_t overflow_blocks(const string &table_name) {
+    HeapFile file(OverflowFile::name_for(table_name));
+    file.open();
+    BlockIDs *block_ids = file.block_ids();
+    size_t count = block_ids->size();
+    delete block_ids;
+    file.close();
+    return count;
+}
+
+/**
+ * Testing function for TEXT values stored out of line.
+ * Rows with values far larger than a page, and rows only too large as a whole, must read back intact through
+ * project (all columns or some), predicates on either kind of column and update; the rows themselves must
+ * stay small, and chains freed by vacuum must be reused.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_overflow() {
+    const string table_name = "_test_overflow_cpp";
+    const int num_rows = 40;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    column_names.push_back("a");
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    for (auto name: {"b", "c", "d", "e"}) {
+        column_names.push_back(name);
+        column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    }
+    // even rows: one huge value in b; odd rows: four values under the inline limit that don't fit together
+    auto make_row = [](int a) {
+        ValueDict row;
+        row["a"] = Value(a);
+        if (a % 2 == 0) {
+            string big;
+            while (big.size() < (size_t) 5000 + a * 2000)
+                big += "row " + to_string(a) + " ";
+            row["b"] = Value(big);
+            row["c"] = Value("small " + to_string(a));
+            row["d"] = Value(string());
+            row["e"] = Value(string(a, 'e'));
+        } else {
+            for (auto name: {"b", "c", "d", "e"})
+                row[name] = Value(string(1020, name[0]) + to_string(a));
+        }
+        return row;
+    };
+
+    HeapTable table(table_name, column_names, column_attributes);
+    table.create();
+    for (int a = 0; a < num_rows; a += 2) {
+        ValueDict row = make_row(a);
+        table.insert(&row);
+    }
+    // only the pointers are in the rows: one block holds all the even ones
+    BlockIDs *block_ids = table.block_ids();
+    size_t heap_blocks = block_ids->size();
+    delete block_ids;
+    if (heap_blocks != 1) {
+        table.drop();
+        return assertion_failure("rows with values out of line took " + to_string(heap_blocks) + " blocks");
+    }
+    for (int a = 1; a < num_rows; a += 2) {
+        ValueDict row = make_row(a);
+        table.insert(&row);
+    }
+
+    Handles *handles = table.select();
+    bool ok = handles->size() == (size_t) num_rows;
+    ColumnNames some_columns;
+    some_columns.push_back("a");
+    some_columns.push_back("c");
+    for (auto const &handle: *handles) {
+        ValueDict *row = table.project(handle);
+        ValueDict expected = make_row((*row)["a"].n);
+        for (auto const &name: column_names)
+            ok = ok && (*row)[name].s == expected[name].s;
+        delete row;
+        row = table.project(handle, &some_columns);
+        ok = ok && row->size() == 2 && (*row)["c"].s == make_row((*row)["a"].n)["c"].s;
+        delete row;
+    }
+    delete handles;
+    if (!ok) {
+        table.drop();
+        return assertion_failure("values stored out of line not read back");
+    }
+
+    // predicates on a value out of line and on an inline column next to one
+    ValueDict where;
+    where["b"] = make_row(10)["b"];
+    handles = table.select(&where);
+    size_t by_big = handles->size();
+    delete handles;
+    where.clear();
+    where["c"] = Value("small 12");
+    handles = table.select(&where);
+    size_t by_small = handles->size();
+    if (by_big != 1 || by_small != 1) {
+        delete handles;
+        table.drop();
+        return assertion_failure("select by values out of line found " + to_string(by_big) + " and "
+                                 + to_string(by_small) + " rows");
+    }
+
+    // an update writes the new version's own chain; the old one is freed by vacuum
+    ValueDict changes;
+    changes["c"] = Value("changed");
+    Handle updated = table.update((*handles)[0], &changes);
+    delete handles;
+    handles = table.select(&where);
+    ok = handles->empty();
+    delete handles;
+    where["c"] = Value("changed");
+    handles = table.select(&where);
+    if (ok && handles->size() == 1 && (*handles)[0] == updated) {
+        ValueDict *row = table.project((*handles)[0]);
+        ok = (*row)["b"].s == make_row(12)["b"].s;
+        delete row;
+    } else {
+        ok = false;
+    }
+    delete handles;
+    if (!ok) {
+        table.drop();
+        return assertion_failure("update of a row with a value out of line");
+    }
+
+    // delete everything, vacuum, and load it again: the freed blocks are reused (after reopening, too)
+    handles = table.select();
+    for (auto const &handle: *handles)
+        table.del(handle);
+    delete handles;
+    table.vacuum(VersionClock::oldest_snapshot());
+    table.close();
+    size_t before = overflow_blocks(table_name);
+    for (int a = 0; a < num_rows; a++) {
+        ValueDict row = make_row(a);
+        table.insert(&row);
+    }
+    table.close();
+    size_t after = overflow_blocks(table_name);
+    handles = table.select();
+    size_t reloaded = handles->size();
+    delete handles;
     table.drop();
+    if (reloaded != (size_t) num_rows)
+        return assertion_failure("reloaded " + to_string(reloaded) + " rows");
+    if (after != before)
+        return assertion_failure("freed overflow blocks not reused: " + to_string(before) + " blocks, then "
+                                 + to_string(after));
+    return true;
+}
+
+// A record with the fields INT, TEXT, INT, as HeapTable marshals them
+static string pax_record(int32_t a, const string &text, int32_t b) {
+    string record((const char *) &a, sizeof(a));
+    u16 size = (u16) text.size();
+    record.append((const char *) &size, sizeof(size));
+    record.append(text);
+    record.append((const char *) &b, sizeof(b));
+    return record;
+}
+
+/**
+ * Testing function for PaxPage and the PAX layout of HeapTable.
+ * Fills a page with records whose text grows from short to long, so it is laid out again both ways, then
+ * changes and deletes some and reads the page back from its bytes. Then runs a PAX table through inserts
+ * (with a value out of line), reopening, select, update, delete and vacuum, and compares its column scans
+ * with a ROW table's.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_pax_page() {
+    PaxPage::Fields fields;
+    fields.push_back(sizeof(int32_t));
+    fields.push_back(PaxPage::VARIABLE);
+    fields.push_back(sizeof(int32_t));
+    char *bytes = new char[DbBlock::BLOCK_SZ];
+    Dbt block_dbt(bytes, DbBlock::BLOCK_SZ);
+    PaxPage *page = new PaxPage(block_dbt, 1, fields, true);
+    vector<string> expected(1);  // by record id
+    try {
+        for (int i = 0; ; i++) {
+            string record = pax_record(i, string(i < 150 ? 2 : 10 + i % 50, 'a' + i % 26), -i);
+            Dbt data((void *) record.data(), record.size());
+            if (page->add(&data) != (RecordID) expected.size())
+                return assertion_failure("pax add returned the wrong id");
+            expected.push_back(record);
+        }
+    } catch (DbBlockNoRoomError &e) {
+    }
+    if (expected.size() <= 160)
+        return assertion_failure("pax page full after " + to_string(expected.size() - 1) + " records");
+    for (RecordID id = 1; id < expected.size(); id += 3)
+        page->del(id);
+    string changed = pax_record(7, "xy", 8);
+    Dbt changed_data((void *) changed.data(), changed.size());
+    page->put(2, changed_data);  // same sizes: in place
+    expected[2] = changed;
+    string longer = pax_record(9, string(300, 'z'), 10);
+    Dbt longer_data((void *) longer.data(), longer.size());
+    page->put(3, longer_data);  // the page has to be laid out again to find the room
+    expected[3] = longer;
+    for (RecordID id = 1; id < expected.size(); id += 3)
+        expected[id].clear();
+
+    // read it back from its bytes, as HeapFile::get would
+    Dbt copy_dbt(page->get_data(), DbBlock::BLOCK_SZ);
+    SlottedPage *reread = SlottedPage::make(copy_dbt, 1);
+    bool ok = dynamic_cast<PaxPage *>(reread) != nullptr;
+    for (RecordID id = 1; ok && id < expected.size(); id++) {
+        Dbt *data = reread->get(id);
+        ok = expected[id].empty() ? data == nullptr
+                                  : data != nullptr && string((char *) data->get_data(), data->get_size()) == expected[id];
+        delete data;
+    }
+    RecordIDs *record_ids = reread->ids();
+    ok = ok && record_ids->size() == expected.size() - 1 - (expected.size() + 1) / 3;
+    delete record_ids;
+    delete reread;
+    delete page;
+    if (!ok)
+        return assertion_failure("pax page records not read back");
+
+    // tables: the same rows in each layout
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable rows_table("_test_row_layout_cpp", column_names, column_attributes);
+    HeapTable pax_table("_test_pax_layout_cpp", column_names, column_attributes);
+    pax_table.set_layout(HeapTable::PAX);
+    HeapTable *tables[] = {&rows_table, &pax_table};
+    for (auto table: tables) {
+        table->create();
+        for (int i = 0; i < 600; i++) {
+            ValueDict row;
+            row["a"] = Value(i);
+            row["b"] = Value(i == 300 ? string(3000, 'o') : "text " + to_string(i % 17));
+            table->insert(&row);
+        }
+        table->close();
+    }
+    HeapTable reopened("_test_pax_layout_cpp", column_names, column_attributes);
+    if (reopened.get_layout() != HeapTable::PAX || rows_table.get_layout() != HeapTable::ROW) {
+        rows_table.drop();
+        reopened.drop();
+        return assertion_failure("layout not kept by the file");
+    }
+    HeapTable *layouts[] = {&rows_table, &reopened};
+    vector<Value> columns[2][2];
+    for (int t = 0; t < 2; t++) {
+        HeapTable *table = layouts[t];
+        ValueDict where;
+        where["a"] = Value(5);
+        Handles *handles = table->select(&where);
+        ValueDict changes;
+        changes["b"] = Value("changed");
+        table->update((*handles)[0], &changes);
+        delete handles;
+        where["a"] = Value(6);
+        handles = table->select(&where);
+        table->del((*handles)[0]);
+        delete handles;
+        table->vacuum(VersionClock::oldest_snapshot());
+
+        vector<char> buffer(table->get_page_size());
+        BlockIDs *block_ids = table->block_ids();
+        for (auto const &block_id: *block_ids) {
+            table->copy_block(block_id, buffer.data());
+            table->decode_column(buffer.data(), "a", columns[t][0]);
+            table->decode_column(buffer.data(), "b", columns[t][1]);
+        }
+        delete block_ids;
+    }
+    ok = columns[0][0].size() == 599 && columns[1][0].size() == 599;
+    for (int c = 0; ok && c < 2; c++) {
+        // updated rows move, so compare as sets
+        multiset<string> row_values, pax_values;
+        for (size_t i = 0; i < columns[0][c].size(); i++) {
+            row_values.insert(c == 0 ? to_string(columns[0][c][i].n) : columns[0][c][i].s);
+            pax_values.insert(c == 0 ? to_string(columns[1][c][i].n) : columns[1][c][i].s);
+        }
+        ok = row_values == pax_values;
+    }
+    ValueDict where;
+    where["b"] = Value("changed");
+    Handles *handles = reopened.select(&where);
+    if (ok && handles->size() == 1) {
+        ValueDict *row = reopened.project((*handles)[0]);
+        ok = (*row)["a"].n == 5;
+        delete row;
+    } else {
+        ok = false;
+    }
+    delete handles;
+    rows_table.drop();
+    reopened.drop();
+    if (!ok)
+        return assertion_failure("pax table differs from the row table");
+    return true;
+}
+
+// How many records a filter left set
+static size_t count_matches(const vector<u_int8_t> &matches) {
+    size_t count = 0;
+    for (auto match: matches)
+        count += match;
+    return count;
+}
+
+/**
+ * Testing function for sealed PaxPages: fills a page with a small-range INT, a TEXT with four values and an INT
+ * in long runs, so each gets encoded, and checks it takes far more records than unsealed, reads back, filters on
+ * the encoded values (including constants outside the page's frame), and takes puts in place and out of the
+ * encodings. Then compares a PAX table's blocks and selects with a ROW table's.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_page_compression() {
+    PaxPage::Fields fields;
+    fields.push_back(sizeof(int32_t));
+    fields.push_back(PaxPage::VARIABLE);
+    fields.push_back(sizeof(int32_t));
+    const char *COLORS[] = {"blue", "green", "red", "yellow"};
+    vector<string> expected;  // by record id
+    PaxPage *page = nullptr;
+    for (int limit: {INT32_MAX, 1000}) {  // full, then with room to spare
+        delete page;
+        char *bytes = new char[DbBlock::BLOCK_SZ];
+        Dbt block_dbt(bytes, DbBlock::BLOCK_SZ);
+        page = new PaxPage(block_dbt, 1, fields, true);
+        expected.assign(1, "");
+        try {
+            for (int i = 0; i < limit; i++) {
+                string record = pax_record(100 + i % 8, COLORS[i % 4], i / 300);
+                Dbt data((void *) record.data(), record.size());
+                if (page->add(&data) != (RecordID) expected.size()) {
+                    delete page;
+                    return assertion_failure("sealed add returned the wrong id");
+                }
+                expected.push_back(record);
+            }
+        } catch (DbBlockNoRoomError &e) {
+        }
+        size_t plain = DbBlock::BLOCK_SZ / (1 + 4 + 4 + 4 + 2 + 5);  // unsealed, at best
+        if (!page->is_sealed() || expected.size() < min((size_t) limit, 3 * plain)) {
+            delete page;
+            return assertion_failure("sealed page full after " + to_string(expected.size() - 1) + " records");
+        }
+    }
+    if (page->get_encoding(0) != PaxPage::PACKED || page->get_encoding(1) != PaxPage::PACKED
+        || page->get_encoding(2) != PaxPage::RLE) {
+        delete page;
+        return assertion_failure("unexpected encodings");
+    }
+
+    string in_frame = pax_record(101, "red", 0);  // fits the encodings: in place
+    Dbt in_frame_data((void *) in_frame.data(), in_frame.size());
+    page->put(2, in_frame_data);
+    expected[2] = in_frame;
+    string out_of_frame = pax_record(-5000, "purple", 0);  // doesn't: the page is sealed again
+    Dbt out_of_frame_data((void *) out_of_frame.data(), out_of_frame.size());
+    for (RecordID id = 10; id < expected.size(); id += 2)
+        page->del(id);
+    page->put(3, out_of_frame_data);
+    expected[3] = out_of_frame;
+    for (RecordID id = 10; id < expected.size(); id += 2)
+        expected[id].clear();
+
+    Dbt copy_dbt(page->get_data(), DbBlock::BLOCK_SZ);
+    PaxPage *reread = dynamic_cast<PaxPage *>(SlottedPage::make(copy_dbt, 1));
+    bool ok = reread != nullptr && reread->is_sealed();
+    for (RecordID id = 1; ok && id < expected.size(); id++) {
+        Dbt *data = reread->get(id);
+        ok = expected[id].empty() ? data == nullptr
+                                  : data != nullptr && string((char *) data->get_data(), data->get_size()) == expected[id];
+        delete data;
+    }
+    if (!ok) {
+        delete reread;
+        delete page;
+        return assertion_failure("sealed page records not read back");
+    }
+
+    // filters against what the records say
+    vector<int32_t> ints(reread->get_num_records());
+    reread->read_ints(0, ints.data());
+    struct Case {
+        uint field_num;
+        PaxPage::Comparison comparison;
+        Value constant;
+    } cases[] = {{1, PaxPage::EQ, Value(103)}, {1, PaxPage::GE, Value(105)}, {1, PaxPage::LT, Value(-10000)},
+                 {1, PaxPage::NE, Value(1000)}, {2, PaxPage::EQ, Value("green")}, {2, PaxPage::LE, Value("purple")},
+                 {2, PaxPage::GT, Value("orange")}, {3, PaxPage::EQ, Value(1)}, {3, PaxPage::GE, Value(2)}};
+    for (auto const &test: cases) {
+        vector<u_int8_t> matches(reread->get_num_records(), 1);
+        if (!reread->filter(test.field_num - 1, test.comparison, test.constant, matches.data()))
+            ok = false;
+        size_t count = 0;
+        for (RecordID id = 1; id < expected.size(); id++) {
+            if (expected[id].empty())
+                continue;
+            const char *record = expected[id].data();
+            u16 size;
+            memcpy(&size, record + 4, sizeof(u16));
+            int64_t cmp;
+            if (test.field_num == 2) {
+                string text(record + 6, size);
+                cmp = text.compare(test.constant.s);
+            } else {
+                int32_t n;
+                memcpy(&n, test.field_num == 1 ? record : record + 6 + size, sizeof(int32_t));
+                cmp = (int64_t) n - test.constant.n;
+                if (test.field_num == 1 && ints[id - 1] != n)
+                    ok = false;
+            }
+            bool holds = test.comparison == PaxPage::EQ ? cmp == 0 : test.comparison == PaxPage::NE ? cmp != 0
+                       : test.comparison == PaxPage::LT ? cmp < 0 : test.comparison == PaxPage::LE ? cmp <= 0
+                       : test.comparison == PaxPage::GT ? cmp > 0 : cmp >= 0;
+            count += holds ? 1 : 0;
+            if (holds != (matches[id - 1] != 0))
+                ok = false;
+        }
+        if (count_matches(matches) != count)
+            ok = false;
+    }
+    delete reread;
+    delete page;
+    if (!ok)
+        return assertion_failure("sealed page filters wrong");
+
+    // tables: a PAX table holds the same rows in fewer blocks, and selects the same ones
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable rows_table("_test_compression_row_cpp", column_names, column_attributes);
+    HeapTable pax_table("_test_compression_pax_cpp", column_names, column_attributes);
+    pax_table.set_layout(HeapTable::PAX);
+    HeapTable *tables[] = {&rows_table, &pax_table};
+    size_t blocks[2], selected[2][3];
+    for (int t = 0; t < 2; t++) {
+        HeapTable *table = tables[t];
+        table->create();
+        ValueDicts rows;
+        for (int i = 0; i < 3000; i++) {
+            ValueDict *row = new ValueDict();
+            (*row)["a"] = Value(i % 50);
+            (*row)["b"] = Value(string(COLORS[i % 3]) + " and more words");
+            rows.push_back(row);
+        }
+        delete table->insert_batch(&rows);
+        for (auto row: rows)
+            delete row;
+        ValueDict where;
+        where["a"] = Value(7);
+        Handles *handles = table->select(&where);
+        ValueDict changes;
+        changes["a"] = Value(100000);  // out of every page's frame
+        for (size_t i = 0; i < handles->size(); i += 2)
+            table->update((*handles)[i], &changes);
+        delete handles;
+        table->vacuum(VersionClock::oldest_snapshot());
+
+        BlockIDs *block_ids = table->block_ids();
+        blocks[t] = block_ids->size();
+        delete block_ids;
+        for (int s = 0; s < 3; s++) {
+            ValueDict select_where;
+            if (s == 1)
+                select_where["b"] = Value("green and more words");
+            else
+                select_where["a"] = Value(s == 0 ? 7 : 100000);
+            handles = table->select(&select_where);
+            selected[t][s] = handles->size();
+            delete handles;
+        }
+    }
+    rows_table.drop();
+    pax_table.drop();
+    if (blocks[1] * 2 > blocks[0])
+        return assertion_failure("pax table in " + to_string(blocks[1]) + " blocks, row table in "
+                                 + to_string(blocks[0]));
+    for (int s = 0; s < 3; s++)
+        if (selected[0][s] != selected[1][s] || selected[0][s] == 0)
+            return assertion_failure("compressed table selected " + to_string(selected[1][s]) + " rows, not "
+                                     + to_string(selected[0][s]));
     return true;
 }
 
 /*****************************************SlottedPage***************************************************************/
 
 /**
- * Constructor for SlottedPage
+ * Constructor for SlottedPage (the header is read or written by BasicSlottedPage)
+ * @param block the block that holds all records
+ * @param block_id the id for the block passed in
+ * @param owns_data the page frees the block's memory (allocated with new char[]) when destroyed
+ */
+SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool owns_data) :
+        DbBlock(block, block_id), owns_data(owns_data) {
+}
+
+// Destructor for SlottedPage: frees the block's memory if it is ours
+SlottedPage::~SlottedPage() {
+    if (this->owns_data)
+        delete[] (char*) this->block.get_data();
+}
+
+// The page type for the block: a PaxPage if it says so, else by its size: 16-bit fields while every offset fits,
+// 32-bit beyond
+SlottedPage* SlottedPage::make(Dbt &block, BlockID block_id, bool is_new, bool owns_data) {
+    if (!is_new && PaxPage::is_pax(block))
+        return new PaxPage(block, block_id, owns_data);
+    if (block.get_size() <= COMPACT_MAX_SZ)
+        return new CompactSlottedPage(block, block_id, is_new, owns_data);
+    return new WideSlottedPage(block, block_id, is_new, owns_data);
+}
+
+// The page header and the record's own header take two fields each; the last byte of the block is unused
+uint SlottedPage::max_record_size(uint page_size) {
+    uint field = page_size <= COMPACT_MAX_SZ ? sizeof(u16) : sizeof(u32);
+    return page_size - 1 - 4 * field;
+}
+
+/**
+ * Constructor for BasicSlottedPage
  * @param block the block that holds all records
  * @param block_id the id for the block passed in
  * @param is_new indicates if the block passed in is a new one
+ * @param owns_data the page frees the block's memory (allocated with new char[]) when destroyed
  */
-SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
+template<typename Offset>
+BasicSlottedPage<Offset>::BasicSlottedPage(Dbt &block, BlockID block_id, bool is_new, bool owns_data) :
+        SlottedPage(block, block_id, owns_data) {
     if (is_new) {
         this->num_records = 0;
-        this->end_free = DbBlock::BLOCK_SZ - 1;
+        this->end_free = (Offset) (block.get_size() - 1);
         put_header();
     } else {
         get_header(this->num_records, this->end_free);
@@ -189,13 +892,15 @@ SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(bl
  * Add a new record to the block. Return its id.
  * @param data the record needed to be stored in block
  */
-RecordID SlottedPage::add(const Dbt* data) {
-    if (!has_room(data->get_size()))
+template<typename Offset>
+RecordID BasicSlottedPage<Offset>::add(const Dbt* data) {
+    if (data->get_size() > this->block.get_size() || !has_room((Offset) data->get_size()))
         throw DbBlockNoRoomError("not enough room for new record");
-    u16 id = ++this->num_records;
-    u16 size = (u16) data->get_size();
+    STATS_COUNT(RECORDS_ADDED, 1);
+    RecordID id = ++this->num_records;
+    Offset size = (Offset) data->get_size();
     this->end_free -= size;
-    u16 loc = this->end_free + 1;
+    Offset loc = this->end_free + 1;
     put_header();
     put_header(id, size, loc);
     memcpy(this->address(loc), data->get_data(), size);
@@ -206,13 +911,15 @@ RecordID SlottedPage::add(const Dbt* data) {
  * Get a record by the record_id
  * @param record_id record ID
  */
-Dbt* SlottedPage::get(RecordID record_id){
-    u16 loc, size;
+template<typename Offset>
+Dbt* BasicSlottedPage<Offset>::get(RecordID record_id){
+    Offset loc, size;
     get_header(size, loc, record_id);
     if(loc == 0){
         // tombstone
         return NULL;
     }
+    STATS_COUNT(RECORDS_READ, 1);
 	//change based on lecture code
     Dbt* r = new Dbt(this->address(loc), size);
     return r;
@@ -223,19 +930,21 @@ Dbt* SlottedPage::get(RecordID record_id){
  * @param record_id record id
  * @param data the record
  */
-void SlottedPage::put(RecordID record_id, const Dbt &data){
-	u16 loc, size;
+template<typename Offset>
+void BasicSlottedPage<Offset>::put(RecordID record_id, const Dbt &data){
+	Offset loc, size;
     get_header(size, loc, record_id);
-    u16 new_size = data.get_size();
+    STATS_COUNT(RECORDS_REWRITTEN, 1);
+    Offset new_size = data.get_size();
     if(new_size > size){
-        u16 extra = new_size - size;
+        Offset extra = new_size - size;
         if(!has_room(extra)){
             throw DbBlockNoRoomError("not enough room for new record");
         }
         slide(loc, loc-extra);
         memcpy(this->address(loc - extra), data.get_data(), new_size);
     } else {
-        memcpy(this->address(loc), data.get_data(), new_size);
+        memmove(this->address(loc), data.get_data(), new_size);  // data may be this record itself
         slide(loc + new_size, loc + size);
     }
     get_header(size, loc, record_id);
@@ -246,32 +955,39 @@ void SlottedPage::put(RecordID record_id, const Dbt &data){
  * Delete a record
  * @param record_id record id
  */
-void SlottedPage::del(RecordID record_id){
-	u16 size, loc;
+template<typename Offset>
+void BasicSlottedPage<Offset>::del(RecordID record_id){
+	Offset size, loc;
 	get_header(size, loc, record_id);
+	STATS_COUNT(RECORDS_DELETED, 1);
 	put_header(record_id, 0, 0);
 	slide(loc, loc + size);
 }
 
 // Return all records
-RecordIDs* SlottedPage::ids(void){
+template<typename Offset>
+RecordIDs* BasicSlottedPage<Offset>::ids(void){
     RecordIDs *allIDs = new RecordIDs();
-    for(int i = 1; i < this->num_records + 1; i ++){
-        if(get(i) != NULL){
+    for(uint i = 1; i < (uint) this->num_records + 1; i ++){
+        Offset size, loc;
+        get_header(size, loc, i);
+        if(loc != 0){
             allIDs->push_back(i);
         }
     }
     return allIDs;
 }
 
-// Get 2-byte integer at given offset in block.
-u16 SlottedPage::get_n(u16 offset) {
-    return *(u16*)this->address(offset);
+// Get the header field at given offset in block.
+template<typename Offset>
+Offset BasicSlottedPage<Offset>::get_n(Offset offset) {
+    return *(Offset*)this->address(offset);
 }
 
-// Put a 2-byte integer at given offset in block.
-void SlottedPage::put_n(u16 offset, u16 n) {
-    *(u16*)this->address(offset) = n;
+// Put a header field at given offset in block.
+template<typename Offset>
+void BasicSlottedPage<Offset>::put_n(Offset offset, Offset n) {
+    *(Offset*)this->address(offset) = n;
 }
 
 /**
@@ -279,25 +995,26 @@ void SlottedPage::put_n(u16 offset, u16 n) {
  * @param start the old position of the block
  * @param end the new position of the block
  */
-void SlottedPage::slide(u16 start, u16 end){
-	u16 shift = end - start;
+template<typename Offset>
+void BasicSlottedPage<Offset>::slide(Offset start, Offset end){
+	Offset shift = end - start;
     if(shift == 0){
         return ;
     }
 
     // slide data
-    void *to = this->address((u16)(this->end_free + 1 + shift));
-    void *from = this->address((u16)(this->end_free + 1));
-    u16 bytes = start - (this->end_free + 1);
-    char temp[bytes];
-    memcpy(temp, from, bytes);
-    memcpy(to, temp, bytes);
+    void *to = this->address((Offset)(this->end_free + 1 + shift));
+    void *from = this->address((Offset)(this->end_free + 1));
+    Offset bytes = start - (this->end_free + 1);
+    STATS_COUNT(SLIDES, 1);
+    STATS_COUNT(SLIDE_BYTES, bytes);
+    memmove(to, from, bytes);
 
     RecordIDs *allIDs = ids();
     auto it = allIDs->begin();
     while(it != allIDs->end()){
-        u16 id = *it;
-        u16 size, loc;
+        RecordID id = *it;
+        Offset size, loc;
         get_header(size, loc, id);
         if(loc <= start){
             loc += shift;
@@ -311,287 +1028,2103 @@ void SlottedPage::slide(u16 start, u16 end){
 }
 
 // Make a void* pointer for a given offset into the data block.
-void* SlottedPage::address(u16 offset) {
+template<typename Offset>
+void* BasicSlottedPage<Offset>::address(Offset offset) {
     return (void*)((char*)this->block.get_data() + offset);
 }
 
 // Store the size and offset for given id. For id of zero, store the block header.
-void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
+template<typename Offset>
+void BasicSlottedPage<Offset>::put_header(RecordID id, Offset size, Offset loc) {
     if (id == 0) { // called the put_header() version and using the default params
         size = this->num_records;
         loc = this->end_free;
     }
-    put_n(4*id, size);
-    put_n(4*id + 2, loc);
+    put_n(2 * sizeof(Offset) * id, size);
+    put_n(2 * sizeof(Offset) * id + sizeof(Offset), loc);
 }
 
 // Return the header information
-void SlottedPage::get_header(u16 &size, u16 &loc, RecordID id){
-	size = get_n(4 * id);
-    loc = get_n(4 * id + 2);
+template<typename Offset>
+void BasicSlottedPage<Offset>::get_header(Offset &size, Offset &loc, RecordID id){
+	size = get_n(2 * sizeof(Offset) * id);
+    loc = get_n(2 * sizeof(Offset) * id + sizeof(Offset));
 }
 
 // Return if there is available room in the block
-bool SlottedPage::has_room(u16 size){
-	u16 available = this->end_free - (this->num_records + 1) * 4;
-    return size <= available;
+template<typename Offset>
+bool BasicSlottedPage<Offset>::has_room(Offset size){
+    // signed arithmetic: a nearly-full page must not wrap around, and count the new record's header
+	int64_t available = (int64_t) this->end_free - (int64_t) (this->num_records + 2) * 2 * sizeof(Offset);
+    return (int64_t) size <= available;
 }
 
+template class BasicSlottedPage<u16>;
+template class BasicSlottedPage<u32>;
 
-/*****************************************Heap File***************************************************************/
-// Create a new Heapfile
-void HeapFile::create(void){
-    db_open(DB_CREATE|DB_EXCL);
-    get_new();
-}
 
-// Drop a Heapfile physically
-void HeapFile::drop(void){
-    close();
-    Db db(_DB_ENV, 0);
-    db.remove(this->dbfilename.c_str(), nullptr, 0);
+/*****************************************PAX Page******************************************************************/
+
+const u16 PaxPage::VARIABLE;
+const u32 PaxPage::MAGIC;
+const u32 PaxPage::SEALED_MAGIC;
+const u32 PaxPage::FieldEncoding::SIZE;
+
+// Round up to the next 8-byte boundary
+static u32 align8(u32 n) {
+    return (n + 7) & ~(u32) 7;
 }
 
-// Open a Heapfile
-void HeapFile::open(void){
-    db_open();
+// The bytes a field takes in its minipage for one record
+static u32 slot_width(u16 width) {
+    return width == PaxPage::VARIABLE ? 2 * sizeof(u16) : width;
 }
 
-// Close a Heapfile
-void HeapFile::close(void){
-    this->db.close(0);
-    this->closed = true;
+// The size of a VARIABLE field's value: a u16 length and the bytes, or an OverflowPointer
+static u32 variable_size(const char *value) {
+    if (OverflowPointer::is_pointer(value))
+        return OverflowPointer::SIZE;
+    u16 length;
+    memcpy(&length, value, sizeof(u16));
+    return sizeof(u16) + length;
 }
 
-/**
- * Open the db
- * @param flags flags used in opening DB
- */
-void HeapFile::db_open(uint flags) {
-    if(!this->closed){
-        return ;
-    }
-    try{
-        this->db.set_re_len(DbBlock::BLOCK_SZ);
-        this->db.open(NULL, this->dbfilename.c_str(), NULL, DB_RECNO, flags, 0644);
-    } catch(exception &e) {
-        cerr << "db open failed: " << e.what() << endl;
-    }
-    DB_BTREE_STAT* stat;
-    this->db.stat(nullptr, &stat, DB_FAST_STAT);
-    this->last = flags ? 0:stat->bt_ndata;
-    this->closed = false;
+// The fewest bits that hold every code up to max_code
+static u8 bits_for(u32 max_code) {
+    u8 bits = 0;
+    while (bits < 32 && (max_code >> bits) != 0)
+        bits++;
+    return bits;
 }
 
-/**
- * Allocate a new block for the database file.
- * Returns the new empty DbBlock that is managing the records in this block and its block id.
- */
-SlottedPage* HeapFile::get_new(void) {
-    char block[DbBlock::BLOCK_SZ];
-    memset(block, 0, sizeof(block));
-    Dbt data(block, sizeof(block));
+// The largest code that fits in bits
+static u32 max_code(u8 bits) {
+    return bits >= 32 ? UINT32_MAX : ((u32) 1 << bits) - 1;
+}
 
-    BlockID block_id = ++this->last;
-    Dbt key(&block_id, sizeof(block_id));
+// The bytes of a PACKED region for capacity codes (with slack so that any code can be read as 8 bytes)
+static u32 packed_bytes(uint capacity, u8 bits) {
+    return bits == 0 ? 0 : align8((u32) (((uint64_t) capacity * bits + 7) / 8) + sizeof(uint64_t));
+}
 
-    // write out an empty block and read it back in so Berkeley DB is managing the memory
-    SlottedPage* page = new SlottedPage(data, this->last, true);
-    this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
-    this->db.get(nullptr, &key, &data, 0);
-    return page;
+static u32 read_packed(const char *codes, uint r, u8 bits) {
+    if (bits == 0)
+        return 0;
+    uint64_t bit = (uint64_t) r * bits, word;
+    memcpy(&word, codes + bit / 8, sizeof(word));
+    return (u32) ((word >> (bit % 8)) & max_code(bits));
 }
 
-// Get a block by block_id
-SlottedPage* HeapFile::get(BlockID block_id){
-    Dbt key(&block_id, sizeof(block_id));
-    Dbt data;
-    this->db.get(nullptr, &key, &data, 0);
-    return new SlottedPage(data, block_id, false);
+static void write_packed(char *codes, uint r, u8 bits, u32 code) {
+    if (bits == 0)
+        return;
+    uint64_t bit = (uint64_t) r * bits, word, mask = (uint64_t) max_code(bits) << (bit % 8);
+    memcpy(&word, codes + bit / 8, sizeof(word));
+    word = (word & ~mask) | ((uint64_t) code << (bit % 8));
+    memcpy(codes + bit / 8, &word, sizeof(word));
 }
 
-// Put a block into Heapfile
-void HeapFile::put(DbBlock *block){
-    BlockID block_id = block->get_block_id();
-    Dbt key(&block_id, sizeof(block_id));
-    try{
-        this->db.put(nullptr, &key, block->get_block(), 0);
-    } catch(exception &e) {
-        cerr << "db put block failed: " << e.what() << endl;
-        exit(-1);
-    } 
+// Order two TEXT values as CompiledPredicate does: by their bytes, then by length
+static int compare_text(const char *a, u32 a_size, const char *b, u32 b_size) {
+    int cmp = memcmp(a, b, min(a_size, b_size));
+    return cmp != 0 ? cmp : (int) a_size - (int) b_size;
 }
 
-// Return all blocks
-BlockIDs* HeapFile::block_ids(){
-    BlockIDs *allIDs = new BlockIDs();
-    for(BlockID cID = 1; cID <= this->last; cID ++){
-        allIDs->push_back(cID);
+// Whether "a comparison b" holds, given the sign of a - b
+static bool holds(PaxPage::Comparison comparison, int64_t cmp) {
+    switch (comparison) {
+        case PaxPage::EQ:
+            return cmp == 0;
+        case PaxPage::NE:
+            return cmp != 0;
+        case PaxPage::LT:
+            return cmp < 0;
+        case PaxPage::LE:
+            return cmp <= 0;
+        case PaxPage::GT:
+            return cmp > 0;
+        default:
+            return cmp >= 0;
     }
-    return allIDs;
 }
 
+// Whether the block starts with PaxPage::MAGIC or SEALED_MAGIC
+bool PaxPage::is_pax(const Dbt &block) {
+    u32 magic;
+    if (block.get_size() < sizeof(magic))
+        return false;
+    memcpy(&magic, block.get_data(), sizeof(magic));
+    return magic == MAGIC || magic == SEALED_MAGIC;
+}
 
-/*****************************************Heap Table***************************************************************/
-
-/** 
- * @brief  Constructor for HeapTable that initializes variables including HeapFile
- * @param  Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes
- */
-HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes) : 
-					DbRelation(table_name, column_names, column_attributes),
-					file(table_name){
+// The fixed part of a record comes with it; the rest of the page can go to its heap bytes
+uint PaxPage::max_record_size(uint page_size, const Fields &fields) {
+    uint fixed = 0;
+    for (auto width: fields)
+        fixed += width;
+    return page_size - fixed_end(fields, 1) + fixed;
 }
 
-// Call create on file object HeapTable holds
-void HeapTable::create(){
-	this->file.create();
+// Where the minipages for this many records end (the header, the flags, then each field's)
+u32 PaxPage::fixed_end(const Fields &fields, uint capacity) {
+    u32 end = align8(header_size(fields)) + align8(capacity);
+    for (auto width: fields)
+        end += align8(capacity * slot_width(width));
+    return end;
 }
 
-// Ok as create but tests if the object doesn't exist first
-void HeapTable::create_if_not_exists(){
-	try{
-		this->file.open();
-	}catch(DbException &e){
-		create();
-	}
+/**
+ * Constructor for an existing PaxPage: reads the fields and the layout (and encodings, if sealed) from the header
+ * @param block     the block
+ * @param block_id  its id
+ * @param owns_data whether the page frees the block's memory
+ */
+PaxPage::PaxPage(Dbt &block, BlockID block_id, bool owns_data) : SlottedPage(block, block_id, owns_data) {
+    const char *header = (const char *) this->block.get_data();
+    u32 magic;
+    u16 num_fields;
+    memcpy(&magic, header, sizeof(u32));
+    memcpy(&this->num_records, header + 4, sizeof(u16));
+    memcpy(&this->capacity, header + 6, sizeof(u16));
+    memcpy(&this->heap_start, header + 8, sizeof(u32));
+    memcpy(&num_fields, header + 12, sizeof(u16));
+    this->fields.resize(num_fields);
+    memcpy(this->fields.data(), header + 14, num_fields * sizeof(u16));
+    this->decoded.resize(num_fields);
+    this->flags_offset = align8(header_size(this->fields, magic == SEALED_MAGIC));
+    if (magic == SEALED_MAGIC) {
+        const char *table = header + 14 + num_fields * sizeof(u16);
+        for (u16 f = 0; f < num_fields; f++) {
+            const char *entry = table + f * FieldEncoding::SIZE;
+            FieldEncoding encoding;
+            memcpy(&encoding.encoding, entry, sizeof(u8));
+            memcpy(&encoding.bits, entry + 1, sizeof(u8));
+            memcpy(&encoding.base, entry + 4, sizeof(int32_t));
+            memcpy(&encoding.offset, entry + 8, sizeof(u32));
+            memcpy(&encoding.entries, entry + 12, sizeof(u32));
+            memcpy(&encoding.runs, entry + 16, sizeof(u32));
+            this->encodings.push_back(encoding);
+            this->offsets.push_back(encoding.offset);
+        }
+        vector<FieldEncoding> layout = this->encodings;
+        this->regions_end = sealed_layout(this->fields, layout, this->capacity);
+        return;
+    }
+    u32 offset = this->flags_offset + align8(this->capacity);
+    for (auto width: this->fields) {
+        this->offsets.push_back(offset);
+        offset += align8(this->capacity * slot_width(width));
+    }
+    this->regions_end = offset;
 }
 
-// Calls the destructor on the HeapFile the HeapTable contains
-void HeapTable::drop(){
-	this->file.drop();
+/**
+ * Constructor for a new, empty PaxPage
+ * @param block     the block (its contents are overwritten)
+ * @param block_id  its id
+ * @param fields    the width of each field of the records, or VARIABLE
+ * @param owns_data whether the page frees the block's memory
+ */
+PaxPage::PaxPage(Dbt &block, BlockID block_id, const Fields &fields, bool owns_data) :
+        SlottedPage(block, block_id, owns_data), fields(fields), num_records(0), capacity(0),
+        heap_start(block.get_size()), flags_offset(align8(header_size(fields))), regions_end(0),
+        decoded(fields.size()) {
+    uint variable = 0;
+    for (auto width: fields)
+        variable += width == VARIABLE ? 1 : 0;
+    lay_out(fit_capacity(0, 0, 16 * variable));  // a guess at the heap bytes, corrected as records come
 }
 
-// Opens the HeapFile the HeapTable contains for insert, update, delete, select, and project methods
-void HeapTable::open(){
-	this->file.open();
+// Destructor for PaxPage: frees the records get() rebuilt
+PaxPage::~PaxPage() {
+    for (auto record: this->rebuilt)
+        delete[] record;
 }
 
-// Closes the HeapFile the HeapTable contains, temporarily disabling insert, update, delete, select, and project methods
-void HeapTable::close(){
-	this->file.close();
+/**
+ * The largest capacity for the page's records so far and more of the same mean size
+ * @param min_capacity slots needed for the records so far
+ * @param heap_bytes   their heap bytes
+ * @param per_record   the heap bytes to expect for each record after those
+ * @return             the capacity (min_capacity if not even that fits)
+ */
+uint PaxPage::fit_capacity(uint min_capacity, uint heap_bytes, uint per_record) {
+    uint size = this->block.get_size();
+    uint record_bytes = 1 + per_record;
+    for (auto width: this->fields)
+        record_bytes += slot_width(width);
+    int64_t spare = (int64_t) size - fixed_end(this->fields, min_capacity) - heap_bytes;
+    uint capacity = min_capacity;
+    if (spare > 0)
+        capacity = min((uint) UINT16_MAX, min_capacity + (uint) (spare / record_bytes));
+    while (capacity > min_capacity
+           && fixed_end(this->fields, capacity) + heap_bytes + (capacity - min_capacity) * per_record > size)
+        capacity--;
+    return capacity;
 }
 
-/** @brief inserts a row into the table
-    *  @param  ValueDict row (specifying the type and value)
-    *  @return Handle to the record id and block id of insertion
-    */
-Handle HeapTable::insert(const ValueDict *row){
-	this->open();
-    ValueDict* validatedDict = validate(row);
-    Handle handle = this->append(validatedDict);
-    delete validatedDict;
-    return handle;
+/**
+ * Lay an unsealed page out again for a new capacity, keeping its records and packing their heap bytes at the end
+ * @param capacity at least the number of records (the caller has checked that it fits)
+ */
+void PaxPage::lay_out(uint capacity) {
+    uint size = this->block.get_size();
+    vector<char> old((char *) this->block.get_data(), (char *) this->block.get_data() + size);
+    vector<u32> old_offsets = this->offsets;
+
+    memset(address(0), 0, size);
+    this->capacity = (u16) capacity;
+    this->offsets.clear();
+    u32 offset = this->flags_offset + align8(capacity);
+    for (auto width: this->fields) {
+        this->offsets.push_back(offset);
+        offset += align8(capacity * slot_width(width));
+    }
+    this->regions_end = offset;
+    this->heap_start = size;
+    if (this->num_records > 0) {
+        memcpy(address(this->flags_offset), old.data() + this->flags_offset, this->num_records);
+        for (size_t f = 0; f < this->fields.size(); f++) {
+            if (this->fields[f] != VARIABLE) {
+                memcpy(address(this->offsets[f]), old.data() + old_offsets[f], this->num_records * this->fields[f]);
+                continue;
+            }
+            for (uint r = 0; r < this->num_records; r++) {
+                u16 pair[2];
+                memcpy(pair, old.data() + old_offsets[f] + r * sizeof(pair), sizeof(pair));
+                if (pair[1] > 0) {
+                    this->heap_start -= pair[1];
+                    memcpy(address(this->heap_start), old.data() + pair[0], pair[1]);
+                    pair[0] = (u16) this->heap_start;
+                }
+                memcpy(address(this->offsets[f] + r * sizeof(pair)), pair, sizeof(pair));
+            }
+        }
+    }
+    put_header();
 }
 
-/** @brief corresponds to the SQL query SELECT * FROM...WHERE. 
-    *  @param  ValueDict representing a SQL WHERE clause
-    *  @return Handles to the matching rows
-    */
-Handles* HeapTable::select(const ValueDict* where) {
-    this->open();
-    Handles* handles = new Handles();
-    BlockIDs* block_ids = this->file.block_ids();
-    for (auto const& block_id: *block_ids) {
-        SlottedPage* block = this->file.get(block_id);
-        RecordIDs* record_ids = block->ids();
-        for (auto const& record_id: *record_ids)
-            handles->push_back(Handle(block_id, record_id));
-        delete record_ids;
-        delete block;
+// Write the header fields (and a sealed page's encoding table)
+void PaxPage::put_header() {
+    char *header = (char *) address(0);
+    u32 magic = is_sealed() ? SEALED_MAGIC : MAGIC;
+    u16 num_fields = (u16) this->fields.size();
+    memcpy(header, &magic, sizeof(u32));
+    memcpy(header + 4, &this->num_records, sizeof(u16));
+    memcpy(header + 6, &this->capacity, sizeof(u16));
+    memcpy(header + 8, &this->heap_start, sizeof(u32));
+    memcpy(header + 12, &num_fields, sizeof(u16));
+    memcpy(header + 14, this->fields.data(), num_fields * sizeof(u16));
+    char *table = header + 14 + num_fields * sizeof(u16);
+    for (size_t f = 0; f < this->encodings.size(); f++) {
+        char *entry = table + f * FieldEncoding::SIZE;
+        const FieldEncoding &encoding = this->encodings[f];
+        memset(entry, 0, FieldEncoding::SIZE);
+        memcpy(entry, &encoding.encoding, sizeof(u8));
+        memcpy(entry + 1, &encoding.bits, sizeof(u8));
+        memcpy(entry + 4, &encoding.base, sizeof(int32_t));
+        memcpy(entry + 8, &encoding.offset, sizeof(u32));
+        memcpy(entry + 12, &encoding.entries, sizeof(u32));
+        memcpy(entry + 16, &encoding.runs, sizeof(u32));
     }
-    delete block_ids;
-    return handles;
 }
 
-/** @brief corresponds to the SQL query SELECT * FROM... 
-    *  @return Handles to the matching rows
-    */
-Handles* HeapTable::select() {
-    return select(nullptr);
+// Sum the sizes of a record's VARIABLE fields, checking that its fields add up to its size
+int64_t PaxPage::heap_bytes(const Dbt *data) {
+    const char *bytes = (const char *) data->get_data();
+    int64_t size = data->get_size(), offset = 0, heap = 0;
+    for (auto width: this->fields) {
+        int64_t length = width;
+        if (width == VARIABLE) {
+            if (offset + (int64_t) sizeof(u16) > size)
+                return -1;
+            length = variable_size(bytes + offset);
+            heap += length;
+        }
+        offset += length;
+    }
+    return offset == size ? heap : -1;
 }
 
-/** @brief Check if the given row can be inserted 
-    *  @param  ValueDict representing the row to be inserted
-    *  @return rows that can be inserted
-    */
-ValueDict* HeapTable::validate(const ValueDict *row){
-	ValueDict* full_row = new ValueDict();
-	for(ValueDict::const_iterator itr = row->begin();itr != row->end();itr++){
-		bool existence = false;
-		for(ColumnAttribute columnAttri : this->column_attributes){
-			if(itr->second.data_type == columnAttri.get_data_type()){
-				existence = true;
-                break;
-			}
-		}
-		if(!existence){
-			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
-		} else {
-		    full_row->insert(pair<Identifier, Value>(itr->first,itr->second));
+// The heap bytes of the live records of an unsealed page (its heap may also hold deleted and rewritten ones')
+u32 PaxPage::live_heap_bytes() {
+    u32 heap = 0;
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        if (this->fields[f] != VARIABLE)
+            continue;
+        for (uint r = 0; r < this->num_records; r++) {
+            u16 pair[2];
+            memcpy(pair, address(this->offsets[f] + r * sizeof(pair)), sizeof(pair));
+            heap += pair[1];
         }
-	}
-	return full_row;
+    }
+    return heap;
 }
 
-/** @brief Assumes row is fully fleshed-out. Appends a record to the file. 
-    *  @param  ValueDict representing a row
-    *  @return Handles to the block and record id values where it was appended
+// Scatter a record's fields into the minipages and the heap of an unsealed page
+void PaxPage::place(RecordID record_id, const Dbt *data) {
+    const char *bytes = (const char *) data->get_data();
+    uint r = record_id - 1, offset = 0;
+    *(char *) address(this->flags_offset + r) = 1;
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        u16 width = this->fields[f];
+        if (width != VARIABLE) {
+            memcpy(address(this->offsets[f] + r * width), bytes + offset, width);
+            offset += width;
+            continue;
+        }
+        u16 pair[2];
+        pair[1] = (u16) variable_size(bytes + offset);
+        this->heap_start -= pair[1];
+        pair[0] = (u16) this->heap_start;
+        memcpy(address(this->heap_start), bytes + offset, pair[1]);
+        memcpy(address(this->offsets[f] + r * sizeof(pair)), pair, sizeof(pair));
+        offset += pair[1];
+    }
+}
+
+/**
+ * Add a new record to the page: an unsealed page is laid out again if the slots or the heap (but not both) have
+ * run out, and sealed if both have; a sealed page takes it as it is if it fits its encodings, else is sealed again
+ * @param data the record, in the page's fields
+ * @return the new record's id
+ */
+RecordID PaxPage::add(const Dbt *data) {
+    int64_t heap = heap_bytes(data);
+    if (heap < 0)
+        throw DbRelationError("record does not match the fields of a PAX page");
+    if (is_sealed()) {
+        vector<u32> codes;
+        if (this->num_records < this->capacity && encodable(data, this->num_records + 1, codes))
+            place_sealed(this->num_records + 1, data, codes);
+        else if (this->num_records >= UINT16_MAX || !seal(data, this->num_records + 1))
+            throw DbBlockNoRoomError("not enough room for new record");
+        STATS_COUNT(RECORDS_ADDED, 1);
+        return this->num_records;
+    }
+    if (this->num_records >= this->capacity || this->heap_start < fixed_end(this->fields, this->capacity) + heap) {
+        u32 live = live_heap_bytes();
+        if (this->num_records >= UINT16_MAX)
+            throw DbBlockNoRoomError("not enough room for new record");
+        if (fixed_end(this->fields, this->num_records + 1) + live + heap > this->block.get_size()) {
+            if (!seal(data, this->num_records + 1))
+                throw DbBlockNoRoomError("not enough room for new record");
+            STATS_COUNT(RECORDS_ADDED, 1);
+            return this->num_records;
+        }
+        uint per_record = (uint) ((live + heap) / (this->num_records + 1));
+        lay_out(fit_capacity(this->num_records + 1, (uint) (live + heap), per_record));
+    }
+    STATS_COUNT(RECORDS_ADDED, 1);
+    RecordID id = ++this->num_records;
+    place(id, data);
+    put_header();
+    return id;
+}
+
+/**
+ * Rebuild a record from its fields
+ * @param record_id the record
+ * @return the record (nullptr if it was deleted), in memory the page owns
+ */
+Dbt *PaxPage::get(RecordID record_id) {
+    if (!is_live(record_id))
+        return nullptr;
+    STATS_COUNT(RECORDS_READ, 1);
+    u32 size = record_size(record_id);
+    char *record = new char[size];
+    this->rebuilt.push_back(record);
+    copy_record(record_id, record);
+    return new Dbt(record, size);
+}
+
+// The size of a live record
+u32 PaxPage::record_size(RecordID record_id) const {
+    u32 size = 0;
+    for (size_t f = 0; f < this->fields.size(); f++)
+        size += this->fields[f] != VARIABLE ? this->fields[f] : variable_size(field(record_id, f));
+    return size;
+}
+
+// Gather a live record's fields into record (record_size bytes)
+void PaxPage::copy_record(RecordID record_id, char *record) const {
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        const char *value = field(record_id, f);
+        u32 length = this->fields[f] != VARIABLE ? this->fields[f] : variable_size(value);
+        memcpy(record, value, length);
+        record += length;
+    }
+}
+
+/**
+ * Replace a record: in place if its VARIABLE fields keep their sizes (and, on a sealed page, its values fit the
+ * encodings), else with new heap bytes, laying out or sealing the page again if they need the room
+ * @param record_id the record
+ * @param data      its new contents
+ */
+void PaxPage::put(RecordID record_id, const Dbt &data) {
+    int64_t heap = heap_bytes(&data);
+    if (heap < 0)
+        throw DbRelationError("record does not match the fields of a PAX page");
+    STATS_COUNT(RECORDS_REWRITTEN, 1);
+    if (is_sealed()) {
+        vector<u32> codes;
+        if (encodable(&data, record_id, codes))
+            place_sealed(record_id, &data, codes);
+        else if (!seal(&data, record_id))
+            throw DbBlockNoRoomError("not enough room for new record");
+        return;
+    }
+    u32 old_heap = 0;
+    bool same_sizes = true;
+    const char *bytes = (const char *) data.get_data();
+    uint offset = 0;
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        u32 length = this->fields[f];
+        if (length == VARIABLE) {
+            u16 pair[2];
+            memcpy(pair, address(this->offsets[f] + (record_id - 1) * sizeof(pair)), sizeof(pair));
+            length = variable_size(bytes + offset);
+            same_sizes = same_sizes && length == pair[1];
+            old_heap += pair[1];
+        }
+        offset += length;
+    }
+    if (same_sizes) {
+        offset = 0;
+        for (size_t f = 0; f < this->fields.size(); f++) {
+            char *destination = (char *) field(record_id, f);
+            u32 length = this->fields[f] != VARIABLE ? this->fields[f] : variable_size(destination);
+            memmove(destination, bytes + offset, length);
+            offset += length;
+        }
+        return;
+    }
+    if (this->heap_start < fixed_end(this->fields, this->capacity) + heap) {
+        if (fixed_end(this->fields, this->capacity) + live_heap_bytes() - old_heap + heap > this->block.get_size()) {
+            if (!seal(&data, record_id))
+                throw DbBlockNoRoomError("not enough room for new record");
+            return;
+        }
+        del(record_id);  // drops its heap bytes from the new layout
+        lay_out(this->capacity);
+    }
+    place(record_id, &data);
+    put_header();
+}
+
+// Mark a record deleted; its heap bytes are reclaimed the next time the page is laid out or sealed
+void PaxPage::del(RecordID record_id) {
+    if (!is_live(record_id))
+        return;
+    STATS_COUNT(RECORDS_DELETED, 1);
+    uint r = record_id - 1;
+    *(char *) address(this->flags_offset + r) = 0;
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        if (this->fields[f] == VARIABLE && get_encoding(f) == PLAIN)
+            memset(address(this->offsets[f] + r * 2 * sizeof(u16)), 0, 2 * sizeof(u16));
+    }
+}
+
+// The ids of the live records
+RecordIDs *PaxPage::ids(void) {
+    RecordIDs *all_ids = new RecordIDs();
+    const char *flags = (const char *) address(this->flags_offset);
+    for (uint r = 0; r < this->num_records; r++)
+        if (flags[r])
+            all_ids->push_back((RecordID) (r + 1));
+    return all_ids;
+}
+
+// Whether a record id names a record that has not been deleted
+bool PaxPage::is_live(RecordID record_id) const {
+    return record_id >= 1 && record_id <= this->num_records
+           && *(const char *) address(this->flags_offset + record_id - 1) != 0;
+}
+
+/**
+ * Where a record's field is: in its minipage if fixed, in the heap if VARIABLE. An encoded VARIABLE field's
+ * value is its dictionary entry; an encoded fixed field's is decoded into memory the page owns, which holds it
+ * until the next call for the same field.
+ */
+const char *PaxPage::field(RecordID record_id, uint field_num) const {
+    u16 width = this->fields[field_num];
+    if (get_encoding(field_num) != PLAIN) {
+        u32 c = code(field_num, record_id - 1);
+        if (width != VARIABLE) {
+            this->decoded[field_num] = (int32_t) ((u32) this->encodings[field_num].base + c);
+            return (const char *) &this->decoded[field_num];
+        }
+        u16 pair[2];
+        dictionary_entry(field_num, c, pair);
+        return (const char *) address(pair[0]);
+    }
+    if (width != VARIABLE)
+        return (const char *) address(this->offsets[field_num] + (record_id - 1) * width);
+    u16 pair[2];
+    memcpy(pair, address(this->offsets[field_num] + (record_id - 1) * sizeof(pair)), sizeof(pair));
+    return (const char *) address(pair[0]);
+}
+
+// How a field is stored (always PLAIN on an unsealed page)
+PaxPage::Encoding PaxPage::get_encoding(uint field_num) const {
+    return is_sealed() ? (Encoding) this->encodings[field_num].encoding : PLAIN;
+}
+
+// Every record's value of a 4-byte field
+void PaxPage::read_ints(uint field_num, int32_t *values) const {
+    Encoding encoding = get_encoding(field_num);
+    if (encoding == PLAIN) {
+        memcpy(values, minipage(field_num), this->num_records * sizeof(int32_t));
+        return;
+    }
+    const FieldEncoding &field_encoding = this->encodings[field_num];
+    const char *codes = (const char *) address(codes_offset(field_num));
+    if (encoding == PACKED) {
+        for (uint r = 0; r < this->num_records; r++)
+            values[r] = (int32_t) ((u32) field_encoding.base + read_packed(codes, r, field_encoding.bits));
+        return;
+    }
+    u32 start = 0;
+    for (u32 run = 0; run < field_encoding.runs; run++) {
+        u32 run_code, end;
+        memcpy(&run_code, codes + run * 2 * sizeof(u32), sizeof(u32));
+        memcpy(&end, codes + run * 2 * sizeof(u32) + sizeof(u32), sizeof(u32));
+        int32_t value = (int32_t) ((u32) field_encoding.base + run_code);
+        for (u32 r = start; r < end && r < this->num_records; r++)
+            values[r] = value;
+        start = end;
+    }
+}
+
+/**
+ * Test a field of every record against a constant (see heap_storage.h). A 4-byte field's constant is put in the
+ * frame of the page's codes once, so codes are compared without decoding them; a constant outside the frame
+ * settles every record at once. A dictionary's entries are compared once each, and a run once for all its records.
+ */
+bool PaxPage::filter(uint field_num, Comparison comparison, const Value &constant, u8 *matches) const {
+    for (uint r = 0; r < this->num_records; r++)
+        matches[r] = matches[r] && is_live(r + 1);
+    Encoding encoding = get_encoding(field_num);
+    u16 width = this->fields[field_num];
+    if (encoding == PLAIN && width != VARIABLE) {
+        const char *values = minipage(field_num);
+        for (uint r = 0; r < this->num_records; r++) {
+            int32_t n;
+            memcpy(&n, values + r * sizeof(int32_t), sizeof(int32_t));
+            matches[r] = matches[r] && holds(comparison, (int64_t) n - constant.n);
+        }
+        return true;
+    }
+    if (encoding == PLAIN) {
+        bool exact = true;
+        for (uint r = 0; r < this->num_records; r++) {
+            if (!matches[r])
+                continue;
+            const char *value = field(r + 1, field_num);
+            if (OverflowPointer::is_pointer(value)) {
+                exact = false;
+                continue;
+            }
+            u16 size;
+            memcpy(&size, value, sizeof(u16));
+            matches[r] = holds(comparison, compare_text(value + sizeof(u16), size, constant.s.data(),
+                                                        (u32) constant.s.size()));
+        }
+        return exact;
+    }
+
+    // what each code gives: the constant's place in the frame, or each dictionary entry compared once
+    const FieldEncoding &field_encoding = this->encodings[field_num];
+    int64_t frame = (int64_t) constant.n - field_encoding.base;
+    vector<u8> outcomes;
+    if (width == VARIABLE) {
+        outcomes.resize(field_encoding.entries);
+        for (u32 c = 0; c < field_encoding.entries; c++) {
+            u16 pair[2], size;
+            dictionary_entry(field_num, c, pair);
+            memcpy(&size, address(pair[0]), sizeof(u16));
+            outcomes[c] = holds(comparison, compare_text((const char *) address(pair[0]) + sizeof(u16), size,
+                                                         constant.s.data(), (u32) constant.s.size()));
+        }
+    } else if (frame < 0 || frame > max_code(field_encoding.bits)) {
+        if (!holds(comparison, frame < 0 ? 1 : -1))
+            memset(matches, 0, this->num_records);
+        return true;
+    }
+    const char *codes = (const char *) address(codes_offset(field_num));
+    if (encoding == PACKED) {
+        for (uint r = 0; r < this->num_records; r++) {
+            if (!matches[r])
+                continue;
+            u32 c = read_packed(codes, r, field_encoding.bits);
+            matches[r] = width == VARIABLE ? outcomes[c] : holds(comparison, (int64_t) c - frame);
+        }
+        return true;
+    }
+    u32 start = 0;
+    for (u32 run = 0; run < field_encoding.runs && start < this->num_records; run++) {
+        u32 c, end;
+        memcpy(&c, codes + run * 2 * sizeof(u32), sizeof(u32));
+        memcpy(&end, codes + run * 2 * sizeof(u32) + sizeof(u32), sizeof(u32));
+        end = min(end, (u32) this->num_records);
+        if (!(width == VARIABLE ? outcomes[c] : holds(comparison, (int64_t) c - frame)))
+            memset(matches + start, 0, end - start);
+        start = end;
+    }
+    return true;
+}
+
+// Where a field's codes (PACKED) or runs (RLE) are: after the dictionary of a VARIABLE field
+u32 PaxPage::codes_offset(uint field_num) const {
+    const FieldEncoding &encoding = this->encodings[field_num];
+    return this->fields[field_num] == VARIABLE ? encoding.offset + align8(encoding.entries * 2 * sizeof(u16))
+                                               : encoding.offset;
+}
+
+// The code of record r (0-based) in an encoded field
+u32 PaxPage::code(uint field_num, uint r) const {
+    const FieldEncoding &encoding = this->encodings[field_num];
+    const char *codes = (const char *) address(codes_offset(field_num));
+    if (encoding.encoding == PACKED)
+        return read_packed(codes, r, encoding.bits);
+    u32 low = 0, high = encoding.runs;  // the first run ending after r
+    while (low < high) {
+        u32 middle = (low + high) / 2, end;
+        memcpy(&end, codes + middle * 2 * sizeof(u32) + sizeof(u32), sizeof(u32));
+        if (end > r)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    u32 c;
+    memcpy(&c, codes + low * 2 * sizeof(u32), sizeof(u32));
+    return c;
+}
+
+// Change the code of record r in a PACKED field
+void PaxPage::set_code(uint field_num, uint r, u32 code) {
+    write_packed((char *) address(codes_offset(field_num)), r, this->encodings[field_num].bits, code);
+}
+
+void PaxPage::dictionary_entry(uint field_num, u32 code, u16 pair[2]) const {
+    memcpy(pair, address(this->encodings[field_num].offset + code * 2 * sizeof(u16)), 2 * sizeof(u16));
+}
+
+// Each field's region follows the flags: PLAIN minipages as unsealed, a dictionary before codes or runs
+u32 PaxPage::sealed_layout(const Fields &fields, vector<FieldEncoding> &encodings, uint capacity) {
+    u32 offset = align8(header_size(fields, true)) + align8(capacity);
+    for (size_t f = 0; f < fields.size(); f++) {
+        FieldEncoding &encoding = encodings[f];
+        encoding.offset = offset;
+        if (encoding.encoding == PLAIN) {
+            offset += align8(capacity * slot_width(fields[f]));
+            continue;
+        }
+        if (fields[f] == VARIABLE)
+            offset += align8(encoding.entries * 2 * sizeof(u16));
+        offset += encoding.encoding == PACKED ? packed_bytes(capacity, encoding.bits)
+                                              : align8(encoding.runs * 2 * sizeof(u32));
+    }
+    return offset;
+}
+
+// Whether a record fits a sealed page's encodings as they are (see heap_storage.h)
+bool PaxPage::encodable(const Dbt *data, RecordID record_id, vector<u32> &codes) const {
+    const char *bytes = (const char *) data->get_data();
+    bool adding = record_id > this->num_records;
+    u32 heap = 0, offset = 0;
+    codes.assign(this->fields.size(), 0);
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        u16 width = this->fields[f];
+        const char *value = bytes + offset;
+        u32 length = width != VARIABLE ? width : variable_size(value);
+        offset += length;
+        const FieldEncoding &encoding = this->encodings[f];
+        if (encoding.encoding == PLAIN) {
+            if (width == VARIABLE) {
+                u16 pair[2] = {0, 0};
+                if (!adding)
+                    memcpy(pair, address(this->offsets[f] + (record_id - 1) * sizeof(pair)), sizeof(pair));
+                heap += pair[1] == length ? 0 : length;
+            }
+            continue;
+        }
+        if (width != VARIABLE) {
+            int32_t n;
+            memcpy(&n, value, sizeof(int32_t));
+            int64_t c = (int64_t) n - encoding.base;
+            if (c < 0 || c > max_code(encoding.bits))
+                return false;
+            codes[f] = (u32) c;
+        } else {
+            if (OverflowPointer::is_pointer(value))
+                return false;
+            u16 size, pair[2], entry_size;
+            memcpy(&size, value, sizeof(u16));
+            u32 low = 0, high = encoding.entries;  // the first entry not before the value
+            while (low < high) {
+                u32 middle = (low + high) / 2;
+                dictionary_entry(f, middle, pair);
+                memcpy(&entry_size, address(pair[0]), sizeof(u16));
+                if (compare_text((const char *) address(pair[0]) + sizeof(u16), entry_size, value + sizeof(u16), size) < 0)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            if (low == encoding.entries)
+                return false;
+            dictionary_entry(f, low, pair);
+            if (pair[1] != length || memcmp(address(pair[0]), value, length) != 0)
+                return false;
+            codes[f] = low;
+        }
+        if (encoding.encoding == RLE) {
+            if (!adding) {
+                if (code(f, record_id - 1) != codes[f])
+                    return false;
+            } else {
+                if (encoding.runs == 0)
+                    return false;
+                const char *last = (const char *) address(codes_offset(f)) + (encoding.runs - 1) * 2 * sizeof(u32);
+                u32 last_code, last_end;
+                memcpy(&last_code, last, sizeof(u32));
+                memcpy(&last_end, last + sizeof(u32), sizeof(u32));
+                if (last_code != codes[f] || last_end != this->num_records)
+                    return false;
+            }
+        }
+    }
+    return this->heap_start >= this->regions_end + heap;
+}
+
+// Write a record that encodable() has accepted into a sealed page
+void PaxPage::place_sealed(RecordID record_id, const Dbt *data, const vector<u32> &codes) {
+    const char *bytes = (const char *) data->get_data();
+    uint r = record_id - 1, offset = 0;
+    bool adding = record_id > this->num_records;
+    for (size_t f = 0; f < this->fields.size(); f++) {
+        u16 width = this->fields[f];
+        const char *value = bytes + offset;
+        u32 length = width != VARIABLE ? width : variable_size(value);
+        offset += length;
+        switch (this->encodings[f].encoding) {
+            case PLAIN:
+                if (width != VARIABLE) {
+                    memcpy(address(this->offsets[f] + r * width), value, width);
+                } else {
+                    u16 pair[2] = {0, 0};
+                    if (!adding)
+                        memcpy(pair, address(this->offsets[f] + r * sizeof(pair)), sizeof(pair));
+                    if (pair[1] != length) {
+                        this->heap_start -= length;
+                        pair[0] = (u16) this->heap_start;
+                        pair[1] = (u16) length;
+                    }
+                    memmove(address(pair[0]), value, length);
+                    memcpy(address(this->offsets[f] + r * sizeof(pair)), pair, sizeof(pair));
+                }
+                break;
+            case PACKED:
+                set_code(f, r, codes[f]);
+                break;
+            default:
+                if (adding) {  // the last run goes on to this record
+                    u32 end = record_id;
+                    memcpy(address(codes_offset(f) + (this->encodings[f].runs - 1) * 2 * sizeof(u32) + sizeof(u32)),
+                           &end, sizeof(u32));
+                }
+                break;
+        }
+    }
+    *(char *) address(this->flags_offset + r) = 1;
+    if (adding)
+        this->num_records = (u16) record_id;
+    put_header();
+}
+
+/**
+ * Choose each field's encoding for the page's records and write the page again, sealed. A 4-byte field's frame
+ * is centered on its values where the bits allow, so later values a little outside them still fit.
+ */
+bool PaxPage::seal(const Dbt *data, RecordID record_id) {
+    uint size = this->block.get_size();
+    uint n = max((uint) this->num_records, (uint) record_id);
+    size_t num_fields = this->fields.size();
+
+    // the records as they will be, and where each field's values are in them
+    vector<string> records(n);
+    vector<bool> live(n, false);
+    for (RecordID id = 1; id <= this->num_records; id++) {
+        if (id == record_id || !is_live(id))
+            continue;
+        records[id - 1].resize(record_size(id));
+        copy_record(id, &records[id - 1][0]);
+        live[id - 1] = true;
+    }
+    records[record_id - 1].assign((const char *) data->get_data(), data->get_size());
+    live[record_id - 1] = true;
+    vector<vector<const char *>> values(num_fields, vector<const char *>(n, nullptr));
+    uint num_live = 0;
+    for (uint r = 0; r < n; r++) {
+        if (!live[r])
+            continue;
+        num_live++;
+        const char *value = records[r].data();
+        for (size_t f = 0; f < num_fields; f++) {
+            values[f][r] = value;
+            value += this->fields[f] != VARIABLE ? this->fields[f] : variable_size(value);
+        }
+    }
+
+    vector<FieldEncoding> encodings(num_fields);
+    vector<vector<u32>> codes(num_fields);
+    vector<vector<string>> dictionaries(num_fields);  // entries in code order, as stored
+    u32 heap = 0, per_record = 0;  // heap bytes now, and expected for each record added later
+    for (size_t f = 0; f < num_fields; f++) {
+        FieldEncoding &encoding = encodings[f];
+        memset(&encoding, 0, sizeof(encoding));
+        encoding.encoding = PLAIN;
+        u16 width = this->fields[f];
+        uint64_t plain_bytes = (uint64_t) n * slot_width(width), dictionary_bytes = 0;
+        u32 plain_heap = 0;
+        bool encodable = width == sizeof(int32_t) || width == VARIABLE;
+        if (width == VARIABLE) {
+            for (uint r = 0; r < n; r++) {
+                if (live[r]) {
+                    plain_heap += variable_size(values[f][r]);
+                    encodable = encodable && !OverflowPointer::is_pointer(values[f][r]);
+                }
+            }
+        }
+        if (encodable) {
+            vector<u32> &field_codes = codes[f];
+            field_codes.assign(n, UINT32_MAX);
+            u32 top;
+            if (width != VARIABLE) {
+                int64_t low = INT64_MAX, high = INT64_MIN;
+                for (uint r = 0; r < n; r++) {
+                    if (live[r]) {
+                        int32_t value;
+                        memcpy(&value, values[f][r], sizeof(int32_t));
+                        low = min(low, (int64_t) value);
+                        high = max(high, (int64_t) value);
+                    }
+                }
+                encoding.base = (int32_t) max((int64_t) INT32_MIN, low - (max_code(bits_for((u32) (high - low)))
+                                                                          - (high - low)) / 2);
+                for (uint r = 0; r < n; r++) {
+                    if (live[r]) {
+                        int32_t value;
+                        memcpy(&value, values[f][r], sizeof(int32_t));
+                        field_codes[r] = (u32) ((int64_t) value - encoding.base);
+                    }
+                }
+                top = (u32) (high - encoding.base);
+            } else {
+                map<string, u32> dictionary;  // by value, which is the order of its codes
+                for (uint r = 0; r < n; r++) {
+                    if (live[r]) {
+                        u16 length;
+                        memcpy(&length, values[f][r], sizeof(u16));
+                        dictionary[string(values[f][r] + sizeof(u16), length)] = 0;
+                    }
+                }
+                for (auto &entry: dictionary) {
+                    entry.second = (u32) dictionaries[f].size();
+                    u16 length = (u16) entry.first.size();
+                    dictionaries[f].push_back(string((const char *) &length, sizeof(u16)) + entry.first);
+                    dictionary_bytes += 2 * sizeof(u16) + sizeof(u16) + length;
+                }
+                for (uint r = 0; r < n; r++) {
+                    if (live[r]) {
+                        u16 length;
+                        memcpy(&length, values[f][r], sizeof(u16));
+                        field_codes[r] = dictionary[string(values[f][r] + sizeof(u16), length)];
+                    }
+                }
+                encoding.entries = (u32) dictionary.size();
+                top = encoding.entries - 1;
+                plain_bytes += plain_heap;
+            }
+            // a deleted record continues the run it is in
+            u32 previous = UINT32_MAX, runs = 0;
+            for (uint r = 0; r < n; r++)
+                if (field_codes[r] != UINT32_MAX && previous == UINT32_MAX)
+                    previous = field_codes[r];
+            for (uint r = 0; r < n; r++) {
+                if (field_codes[r] == UINT32_MAX)
+                    field_codes[r] = previous;
+                runs += r == 0 || field_codes[r] != previous ? 1 : 0;
+                previous = field_codes[r];
+            }
+            u8 bits = bits_for(top);
+            uint64_t packed = dictionary_bytes + packed_bytes(n, bits);
+            uint64_t rle = dictionary_bytes + align8(runs * 2 * sizeof(u32));
+            if (packed < plain_bytes || rle < plain_bytes) {
+                encoding.encoding = (u8) (rle < packed ? RLE : PACKED);
+                encoding.bits = bits;
+                encoding.runs = rle < packed ? runs : 0;
+            }
+        }
+        if (width == VARIABLE && encoding.encoding == PLAIN) {
+            heap += plain_heap;
+            per_record += plain_heap / num_live;
+        } else if (width == VARIABLE) {
+            for (auto const &entry: dictionaries[f])
+                heap += (u32) entry.size();
+        }
+    }
+
+    // as many slots as fit with the records so far
+    if ((uint64_t) sealed_layout(this->fields, encodings, n) + heap > size)
+        return false;
+    uint low = n, high = UINT16_MAX;
+    while (low < high) {
+        uint middle = (low + high + 1) / 2;
+        if ((uint64_t) sealed_layout(this->fields, encodings, middle) + heap + (uint64_t) (middle - n) * per_record <= size)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    uint capacity = low;
+    u32 regions_end = sealed_layout(this->fields, encodings, capacity);
+
+    // write the page
+    vector<char> page(size, 0);
+    u32 heap_start = size;
+    u32 flags_offset = align8(header_size(this->fields, true));
+    for (uint r = 0; r < n; r++)
+        page[flags_offset + r] = live[r] ? 1 : 0;
+    for (size_t f = 0; f < num_fields; f++) {
+        const FieldEncoding &encoding = encodings[f];
+        u16 width = this->fields[f];
+        char *region = &page[encoding.offset];
+        if (encoding.encoding == PLAIN) {
+            for (uint r = 0; r < n; r++) {
+                if (!live[r])
+                    continue;
+                if (width != VARIABLE) {
+                    memcpy(region + r * width, values[f][r], width);
+                    continue;
+                }
+                u16 pair[2];
+                pair[1] = (u16) variable_size(values[f][r]);
+                heap_start -= pair[1];
+                pair[0] = (u16) heap_start;
+                memcpy(&page[heap_start], values[f][r], pair[1]);
+                memcpy(region + r * sizeof(pair), pair, sizeof(pair));
+            }
+            continue;
+        }
+        if (width == VARIABLE) {
+            for (u32 c = 0; c < encoding.entries; c++) {
+                u16 pair[2];
+                pair[1] = (u16) dictionaries[f][c].size();
+                heap_start -= pair[1];
+                pair[0] = (u16) heap_start;
+                memcpy(&page[heap_start], dictionaries[f][c].data(), pair[1]);
+                memcpy(region + c * sizeof(pair), pair, sizeof(pair));
+            }
+            region += align8(encoding.entries * 2 * sizeof(u16));
+        }
+        if (encoding.encoding == PACKED) {
+            for (uint r = 0; r < n; r++)
+                write_packed(region, r, encoding.bits, codes[f][r]);
+            continue;
+        }
+        u32 run = 0;
+        for (uint r = 0; r < n; r++) {
+            if (r + 1 < n && codes[f][r + 1] == codes[f][r])
+                continue;
+            u32 end = r + 1;
+            memcpy(region + run * 2 * sizeof(u32), &codes[f][r], sizeof(u32));
+            memcpy(region + run * 2 * sizeof(u32) + sizeof(u32), &end, sizeof(u32));
+            run++;
+        }
+    }
+
+    memcpy(address(0), page.data(), size);
+    this->num_records = (u16) n;
+    this->capacity = (u16) capacity;
+    this->heap_start = heap_start;
+    this->flags_offset = flags_offset;
+    this->regions_end = regions_end;
+    this->encodings = encodings;
+    for (size_t f = 0; f < num_fields; f++)
+        this->offsets[f] = encodings[f].offset;
+    put_header();
+    STATS_COUNT(PAGES_SEALED, 1);
+    return true;
+}
+
+
+/*****************************************Heap File***************************************************************/
+
+/**
+ * Constructor for HeapFile
+ * @param name the file's name (the Berkeley DB file is name.db)
+ * @param page_size the size of the blocks, if the file is created
+ */
+HeapFile::HeapFile(string name, uint page_size) : DbFile(name), dbfilename(name + ".db"), page_size(page_size),
+                                                  last(0), allocated(0), closed(true), open_mutex(), db(_DB_ENV, 0),
+                                                  read_ahead(*this) {
+    for (uint i = 0; i < NUM_LATCHES; i++)
+        pthread_rwlock_init(&this->latches[i], nullptr);
+}
+
+// Destructor for HeapFile
+HeapFile::~HeapFile() {
+    WriteAheadLog::remove_file(this);
+    for (uint i = 0; i < NUM_LATCHES; i++)
+        pthread_rwlock_destroy(&this->latches[i]);
+}
+
+// Create a new Heapfile
+void HeapFile::create(void){
+    db_open(DB_CREATE|DB_EXCL);
+    delete get_new();
+}
+
+// Drop a Heapfile physically
+void HeapFile::drop(void){
+    close();
+    WriteAheadLog::log_drop(this->name);
+    Db db(_DB_ENV, 0);
+    db.remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+// Open a Heapfile
+void HeapFile::open(void){
+    db_open();
+}
+
+// Close a Heapfile
+void HeapFile::close(void){
+    WriteAheadLog::remove_file(this);
+    this->read_ahead.cancel();
+    lock_guard<mutex> lock(this->open_mutex);
+    this->db.close(0);
+    this->closed = true;
+}
+
+// A power of two from MIN_PAGE_SZ to MAX_PAGE_SZ
+bool HeapFile::valid_page_size(uint page_size) {
+    return page_size >= MIN_PAGE_SZ && page_size <= MAX_PAGE_SZ && (page_size & (page_size - 1)) == 0;
+}
+
+// The largest record an empty block holds, for the file's kind of page
+uint HeapFile::max_record_size() const {
+    if (this->pax_fields.empty())
+        return SlottedPage::max_record_size(this->page_size);
+    return PaxPage::max_record_size(this->page_size, this->pax_fields);
+}
+
+// Open a Heapfile, creating it if it is missing
+void HeapFile::open_or_create(void){
+    db_open(DB_CREATE);
+}
+
+// Flush a Heapfile's blocks to disk
+void HeapFile::sync(void){
+    TRACE_SPAN("Db::sync", "bdb");
+    this->db.sync(0);
+}
+
+/**
+ * Open the db (once, however many threads ask at the same time)
+ * @param flags flags used in opening DB
+ */
+void HeapFile::db_open(uint flags) {
+    if(!this->closed){
+        return ;
+    }
+    lock_guard<mutex> lock(this->open_mutex);
+    if(!this->closed){
+        return ;
+    }
+    TRACE_SPAN("Db::open", "bdb");
+    try{
+        this->db.set_re_len(this->page_size);
+        this->db.open(NULL, this->dbfilename.c_str(), NULL, DB_RECNO, flags | DB_THREAD, 0644);
+    } catch(exception &e) {
+        cerr << "db open failed: " << e.what() << endl;
+    }
+    u32 re_len = this->page_size;
+    this->db.get_re_len(&re_len);  // an existing file keeps the record length it was created with
+    this->page_size = re_len;
+    DB_BTREE_STAT* stat;
+    this->db.stat(nullptr, &stat, DB_FAST_STAT);
+    this->last = (flags & DB_EXCL) ? 0:stat->bt_ndata;
+    this->allocated = this->last.load();
+    free(stat);
+    if (this->last > 0) {
+        // an existing file: its first block tells what its pages are
+        SlottedPage *first = get(1);
+        PaxPage *pax = dynamic_cast<PaxPage*>(first);
+        if (pax != nullptr)
+            this->pax_fields = pax->get_fields();
+        else
+            this->pax_fields.clear();
+        delete first;
+    }
+    this->closed = false;
+    WriteAheadLog::add_file(this);
+}
+
+/**
+ * Allocate a new block for the database file.
+ * Returns the new empty DbBlock that is managing the records in this block and its block id.
+ * The block is written out before other threads can see it (in get_last_block_id and block_ids); from
+ * then on they may change it, so callers that add to it must latch it and read it again.
+ */
+SlottedPage* HeapFile::get_new(void) {
+    STATS_TIMER(PAGE_ALLOCATE_TIME);
+    TRACE_SPAN("HeapFile::get_new", "storage");
+    STATS_COUNT(PAGES_ALLOCATED, 1);
+    char *block = new char[this->page_size];
+    memset(block, 0, this->page_size);
+    Dbt data(block, this->page_size);
+
+    BlockID block_id = ++this->allocated;
+    Dbt key(&block_id, sizeof(block_id));
+    SlottedPage *page = this->pax_fields.empty() ? SlottedPage::make(data, block_id, true, true)
+                                                 : new PaxPage(data, block_id, this->pax_fields, true);
+    WriteAheadLog::log_page(this->name, page);
+    {
+        TRACE_SPAN("Db::put", "bdb");
+        this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
+    }
+
+    // publish in id order, so last never passes a block another thread has yet to write
+    u32 previous = block_id - 1;
+    while (!this->last.compare_exchange_weak(previous, block_id)) {
+        previous = block_id - 1;
+        this_thread::yield();
+    }
+    return page;
+}
+
+// Get a block by block_id (a copy of it: the page owns its memory)
+SlottedPage* HeapFile::get(BlockID block_id){
+    STATS_TIMER(PAGE_READ_TIME);
+    STATS_COUNT(PAGE_READS, 1);
+    TRACE_SPAN("HeapFile::get", "storage");
+    this->read_ahead.on_read(block_id);
+    Dbt key(&block_id, sizeof(block_id));
+    char *block = new char[this->page_size];
+    Dbt data(block, this->page_size);
+    data.set_ulen(this->page_size);
+    data.set_flags(DB_DBT_USERMEM);
+    {
+        TRACE_SPAN("Db::get", "bdb");
+        this->db.get(nullptr, &key, &data, 0);
+    }
+    return SlottedPage::make(data, block_id, false, true);
+}
+
+// Get a block by block_id into arena memory (for a caller that is done with it before its ArenaScope ends)
+SlottedPage* HeapFile::get(BlockID block_id, Arena &arena){
+    STATS_TIMER(PAGE_READ_TIME);
+    STATS_COUNT(PAGE_READS, 1);
+    TRACE_SPAN("HeapFile::get", "storage");
+    this->read_ahead.on_read(block_id);
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(arena.allocate(this->page_size), this->page_size);
+    data.set_ulen(this->page_size);
+    data.set_flags(DB_DBT_USERMEM);
+    {
+        TRACE_SPAN("Db::get", "bdb");
+        this->db.get(nullptr, &key, &data, 0);
+    }
+    return SlottedPage::make(data, block_id, false, false);
+}
+
+// Read a block and throw it away: it stays in Berkeley DB's cache for the get that follows
+void HeapFile::prefetch(BlockID block_id, char *buffer){
+    TRACE_SPAN("HeapFile::prefetch", "storage");
+    Dbt key(&block_id, sizeof(block_id));
+    Dbt data(buffer, this->page_size);
+    data.set_ulen(this->page_size);
+    data.set_flags(DB_DBT_USERMEM);
+    try{
+        this->db.get(nullptr, &key, &data, 0);
+    } catch(exception &e) {
+        // only a hint: the scan's own get will report what is wrong
+    }
+}
+
+// Put a block into Heapfile
+void HeapFile::put(DbBlock *block){
+    STATS_TIMER(PAGE_WRITE_TIME);
+    STATS_COUNT(PAGE_WRITES, 1);
+    TRACE_SPAN("HeapFile::put", "storage");
+    BlockID block_id = block->get_block_id();
+    Dbt key(&block_id, sizeof(block_id));
+    try{
+        TRACE_SPAN("Db::put", "bdb");
+        this->db.put(nullptr, &key, block->get_block(), 0);
+    } catch(exception &e) {
+        cerr << "db put block failed: " << e.what() << endl;
+        exit(-1);
+    } 
+}
+
+// Return all blocks
+BlockIDs* HeapFile::block_ids(){
+    BlockIDs *allIDs = new BlockIDs();
+    BlockID last = this->last;
+    for(BlockID cID = 1; cID <= last; cID ++){
+        allIDs->push_back(cID);
+    }
+    return allIDs;
+}
+
+
+/*****************************************Page Latch***************************************************************/
+
+/**
+ * Constructor for PageLatch: waits for the page's latch
+ * @param file      the file the page is in
+ * @param block_id  the page
+ * @param exclusive true to change the page, false to read it
+ */
+PageLatch::PageLatch(HeapFile &file, BlockID block_id, bool exclusive) : lock(file.latch(block_id)) {
+    if (exclusive)
+        pthread_rwlock_wrlock(this->lock);
+    else
+        pthread_rwlock_rdlock(this->lock);
+}
+
+// Release the latch (if still held)
+void PageLatch::release() {
+    if (this->lock != nullptr) {
+        pthread_rwlock_unlock(this->lock);
+        this->lock = nullptr;
+    }
+}
+
+
+/*****************************************Overflow File************************************************************/
+
+// Constructor for OverflowFile: nothing is opened or created until a value is written or read
+OverflowFile::OverflowFile(const string &table_name, uint page_size) : file(name_for(table_name), page_size),
+                                                                        free_mutex(), free_blocks(),
+                                                                        free_blocks_known(false) {
+}
+
+// Open the file (once), creating it with blocks of page_size bytes if it does not exist yet
+void OverflowFile::open(uint page_size) {
+    if (this->file.is_open())
+        return;
+    lock_guard<mutex> guard(this->free_mutex);
+    if (this->file.is_open())
+        return;
+    this->file.set_page_size(page_size);
+    this->file.open_or_create();
+}
+
+/**
+ * A block for a new chain: a freed one if there is any, else a new one. The first call after opening the file
+ * finds the freed blocks by scanning it; no chain is being written then, so every empty block is free.
+ * @return the block's id
+ */
+BlockID OverflowFile::allocate() {
+    lock_guard<mutex> guard(this->free_mutex);
+    if (!this->free_blocks_known) {
+        BlockIDs *block_ids = this->file.block_ids();
+        for (auto const &block_id: *block_ids) {
+            SlottedPage *block = this->file.get(block_id);
+            RecordIDs *record_ids = block->ids();
+            if (record_ids->empty())
+                this->free_blocks.insert(block_id);
+            delete record_ids;
+            delete block;
+        }
+        delete block_ids;
+        this->free_blocks_known = true;
+    }
+    if (!this->free_blocks.empty()) {
+        BlockID block_id = *this->free_blocks.begin();
+        this->free_blocks.erase(this->free_blocks.begin());
+        return block_id;
+    }
+    SlottedPage *block = this->file.get_new();
+    BlockID block_id = block->get_block_id();
+    delete block;
+    return block_id;
+}
+
+/**
+ * Store a value as a new chain. Its blocks are private to the writer until the row pointing to them is added,
+ * so they are written without latches; each is rebuilt from scratch, whatever it held before.
+ * @param value     the value
+ * @param page_size the size of the blocks if the file has to be created
+ * @return          the pointer to keep in the row
+ */
+OverflowPointer OverflowFile::write(const string &value, uint page_size) {
+    TRACE_SPAN("OverflowFile::write", "storage");
+    open(page_size);
+    page_size = this->file.get_page_size();
+    size_t chunk = SlottedPage::max_record_size(page_size) - sizeof(BlockID);
+    size_t num_blocks = max((size_t) 1, (value.size() + chunk - 1) / chunk);
+    vector<BlockID> chain(num_blocks);
+    for (auto &block_id: chain)
+        block_id = allocate();
+
+    vector<char> record(sizeof(BlockID) + chunk);
+    for (size_t i = 0; i < num_blocks; i++) {
+        BlockID next = i + 1 < num_blocks ? chain[i + 1] : 0;
+        size_t offset = i * chunk;
+        size_t size = min(chunk, value.size() - offset);
+        memcpy(record.data(), &next, sizeof(next));
+        memcpy(record.data() + sizeof(next), value.data() + offset, size);
+        Dbt data(record.data(), sizeof(next) + size);
+
+        char *bytes = new char[page_size];
+        memset(bytes, 0, page_size);
+        Dbt block_dbt(bytes, page_size);
+        SlottedPage *block = SlottedPage::make(block_dbt, chain[i], true, true);
+        block->add(&data);
+        WriteAheadLog::log_page(this->file.get_name(), block);
+        this->file.put(block);
+        delete block;
+    }
+    OverflowPointer pointer;
+    pointer.length = (u32) value.size();
+    pointer.first = chain[0];
+    return pointer;
+}
+
+// Read a value by following its chain
+string OverflowFile::read(const OverflowPointer &pointer) {
+    TRACE_SPAN("OverflowFile::read", "storage");
+    open(this->file.get_page_size());
+    string value;
+    value.reserve(pointer.length);
+    BlockID block_id = pointer.first;
+    while (block_id != 0 && value.size() < pointer.length) {
+        SlottedPage *block = this->file.get(block_id);
+        Dbt *data = block->get(1);
+        if (data == nullptr) {
+            delete block;
+            break;
+        }
+        const char *bytes = (const char *) data->get_data();
+        memcpy(&block_id, bytes, sizeof(block_id));
+        value.append(bytes + sizeof(BlockID), data->get_size() - sizeof(BlockID));
+        delete data;
+        delete block;
+    }
+    if (value.size() != pointer.length)
+        throw DbRelationError("overflow chain of " + this->file.get_name() + " at block "
+                              + to_string(pointer.first) + " is broken");
+    return value;
+}
+
+// Empty the blocks of a chain and keep them for the next chains
+void OverflowFile::free(const OverflowPointer &pointer) {
+    TRACE_SPAN("OverflowFile::free", "storage");
+    open(this->file.get_page_size());
+    vector<BlockID> freed;
+    BlockID block_id = pointer.first;
+    while (block_id != 0) {
+        SlottedPage *block = this->file.get(block_id);
+        Dbt *data = block->get(1);
+        BlockID next = 0;
+        if (data != nullptr) {
+            memcpy(&next, data->get_data(), sizeof(next));
+            delete data;
+            block->del(1);
+            WriteAheadLog::log_page(this->file.get_name(), block);
+            this->file.put(block);
+            freed.push_back(block_id);
+        }
+        delete block;
+        block_id = next;
+    }
+    // until the file has been scanned, the scan will find them
+    lock_guard<mutex> guard(this->free_mutex);
+    if (this->free_blocks_known)
+        this->free_blocks.insert(freed.begin(), freed.end());
+}
+
+// Close the file (if open); the freed blocks are found again the next time it is written
+void OverflowFile::close() {
+    lock_guard<mutex> guard(this->free_mutex);
+    if (this->file.is_open())
+        this->file.close();
+    this->free_blocks.clear();
+    this->free_blocks_known = false;
+}
+
+// Remove the file; a table that never stored a value out of line has none
+void OverflowFile::drop() {
+    close();
+    try{
+        this->file.drop();
+    }catch(DbException &e){
+    }
+}
+
+
+/*****************************************Heap Table***************************************************************/
+
+// Whether a record this size fits in an empty block of the file at all
+static bool fits_in_empty_block(HeapFile &file, const Dbt *data) {
+    return data->get_size() <= file.max_record_size();
+}
+
+// Mark a record as ended by the given write (in the block, which the caller puts)
+static void end_version(SlottedPage *block, RecordID record_id, Dbt *data, TxnStamp stamp) {
+    VersionHeader header = VersionHeader::read(data->get_data());
+    header.end = stamp;
+    header.write(data->get_data());
+    block->put(record_id, *data);
+}
+
+// The size of a field in marshal format
+static uint marshaled_size(const CodecOps &codec, const char *field) {
+    if (codec.is_fixed())
+        return codec.size;
+    if (OverflowPointer::is_pointer(field))
+        return OverflowPointer::SIZE;
+    return sizeof(u16) + *(u16*) field;
+}
+
+/** 
+ * @brief  Constructor for HeapTable that initializes variables including HeapFile
+ * @param  Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes
+ */
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+                     uint page_size) :
+					DbRelation(table_name, column_names, column_attributes),
+					file(table_name, page_size), overflow(table_name, page_size){
+	for (auto const& column_attribute: this->column_attributes)
+		this->codecs.push_back(&codec_ops(column_attribute.get_data_type()));
+}
+
+// Destructor for HeapTable: the garbage collector must let go of it first
+HeapTable::~HeapTable(){
+	VersionCollector::remove(this);
+}
+
+// Call create on file object HeapTable holds
+void HeapTable::create(){
+	DurableWrite durable;
+	this->file.create();
+	VersionCollector::add(this);
+}
+
+// Ok as create but tests if the object doesn't exist first
+void HeapTable::create_if_not_exists(){
+	try{
+		this->open();
+	}catch(DbException &e){
+		create();
+	}
+}
+
+// Calls the destructor on the HeapFile the HeapTable contains
+void HeapTable::drop(){
+	DurableWrite durable;
+	VersionCollector::remove(this);
+	this->file.drop();
+	this->overflow.drop();
+}
+
+// Opens the HeapFile the HeapTable contains for insert, update, delete, select, and project methods
+void HeapTable::open(){
+	if (this->file.is_open())
+		return;
+	this->file.open();
+	VersionCollector::add(this);
+}
+
+// Closes the HeapFile the HeapTable contains, temporarily disabling insert, update, delete, select, and project methods
+void HeapTable::close(){
+	VersionCollector::remove(this);
+	this->file.close();
+	this->overflow.close();
+}
+
+/** @brief inserts a row into the table
+    *  @param  ValueDict row (specifying the type and value)
+    *  @return Handle to the record id and block id of insertion
     */
-Handle HeapTable::append(const ValueDict *row){
-	RecordID recId;
-	BlockID lastBlockId = this->file.get_last_block_id();
-	Dbt* data = marshal(row);
-	SlottedPage* block = this->file.get(lastBlockId);
+Handle HeapTable::insert(const ValueDict *row){
+	STATS_TIMER(INSERT_TIME);
+	TRACE_SPAN("HeapTable::insert", "storage");
+	this->open();
+    ArenaScope row_scope;  // the marshaled row and the page it goes into
+    ValueDict converted;
+    const ValueDict* full_row = validate(row, converted);
+    VersionWrite write;
+    DurableWrite durable;  // committed before the row becomes visible
+    Dbt data;
+    marshal(full_row, write.get_stamp(), data);
+    Handle handle;
+    try{
+        handle = this->append(&data);
+    }catch(...){
+        free_overflow(&data);
+        throw;
+    }
+    STATS_COUNT(ROWS_INSERTED, 1);  // only rows that made it into the table
+    return handle;
+}
+
+// Insert many rows, writing each block once when it is full (or at the end) rather than once per row
+Handles* HeapTable::insert_batch(const ValueDicts *rows, size_t *stored){
+	STATS_TIMER(INSERT_TIME);
+	TRACE_SPAN("HeapTable::insert_batch", "storage");
+	this->open();
+	VersionWrite write;  // the whole batch becomes visible at once
+	DurableWrite durable;
+	Handles* handles = new Handles();
+	Dbt data;  // the next row, marshaled
+	bool marshaled = false;
+	vector<char> pending;  // the bytes of a row that didn't fit in the last block, kept for the next
+	size_t next = 0;
 	try{
-		recId = block->add(data);
-	}catch(DbBlockNoRoomError &e){
-		block = this->file.get_new();
+		while (next < rows->size()) {
+			// fill the last block, holding its latch until it is written out
+			BlockID blockId = this->file.get_last_block_id();
+			PageLatch latch(this->file, blockId, true);
+			ArenaScope block_scope;
+			SlottedPage* block = this->file.get(blockId, block_scope.get_arena());
+			size_t added = 0;
+			try{
+				for (; next < rows->size(); next++) {
+					ArenaScope row_scope;
+					if (!marshaled) {
+						ValueDict converted;
+						marshal(validate((*rows)[next], converted), write.get_stamp(), data);
+						marshaled = true;
+					}
+					RecordID recId;
+					try{
+						recId = block->add(&data);
+					}catch(DbBlockNoRoomError &e){
+						if (data.get_data() != pending.data()) {
+							const char* bytes = (const char*) data.get_data();
+							pending.assign(bytes, bytes + data.get_size());
+							data.set_data(pending.data());
+						}
+						throw;
+					}catch(...){
+						free_overflow(&data);
+						marshaled = false;
+						throw;
+					}
+					marshaled = false;
+					handles->push_back(Handle(blockId, recId));
+					added++;
+				}
+			}catch(DbBlockNoRoomError &e){
+				if (added == 0 && !fits_in_empty_block(this->file, &data)) {
+					delete block;
+					throw DbRelationError("row too large to fit in one block");
+				}
+			}catch(...){
+				if (added > 0) {
+					// keep the rows added before the failure
+					WriteAheadLog::log_page(this->file.get_name(), block);
+					this->file.put(block);
+				}
+				delete block;
+				throw;
+			}
+			if (added > 0) {
+				WriteAheadLog::log_page(this->file.get_name(), block);
+				this->file.put(block);
+			}
+			delete block;
+			if (next < rows->size() && this->file.get_last_block_id() == blockId)
+				delete this->file.get_new();
+		}
+	}catch(...){
+		if (marshaled)
+			free_overflow(&data);
+		STATS_COUNT(ROWS_INSERTED, handles->size());
+		if (stored != nullptr)
+			*stored = handles->size();  // each row added went out with its block
+		delete handles;
+		throw;
+	}
+	STATS_COUNT(ROWS_INSERTED, handles->size());
+	if (stored != nullptr)
+		*stored = handles->size();
+	return handles;
+}
+
+/** @brief corresponds to the SQL query SELECT * FROM...WHERE. 
+    *  @param  ValueDict representing a SQL WHERE clause
+    *  @return Handles to the matching rows
+    */
+Handles* HeapTable::select(const ValueDict* where) {
+    if (where == nullptr || where->empty())
+        return select((const CompiledPredicate*) nullptr);
+    CompiledPredicate* predicate = ExprCompiler::compile(where, this->column_names, this->column_attributes);
+    Handles* handles = select(predicate);
+    delete predicate;
+    return handles;
+}
+
+/** @brief SELECT * FROM...WHERE with a WHERE clause already compiled against this table's schema
+    *  @param  CompiledPredicate for the WHERE clause (nullptr for all rows)
+    *  @return Handles to the matching rows
+    */
+Handles* HeapTable::select(const CompiledPredicate* predicate) {
+    STATS_TIMER(SELECT_TIME);
+    TRACE_SPAN("HeapTable::select", "storage");
+    this->open();
+    Snapshot snapshot;
+    Handles* handles = new Handles();
+    BlockIDs* block_ids = this->file.block_ids();
+    for (auto const& block_id: *block_ids) {
+        SlottedPage* block;
+        {
+            PageLatch latch(this->file, block_id, false);
+            block = this->file.get(block_id);
+        }
+        PaxPage* pax = dynamic_cast<PaxPage*>(block);
+        if (pax != nullptr) {
+            vector<u_int8_t> matches;
+            try{
+                filter_pax_block(pax, predicate, snapshot, matches);
+            }catch(...){
+                delete block;
+                delete block_ids;
+                delete handles;
+                throw;
+            }
+            for (size_t r = 0; r < matches.size(); r++)
+                if (matches[r])
+                    handles->push_back(Handle(block_id, (RecordID) (r + 1)));
+            delete block;
+            continue;
+        }
+        RecordIDs* record_ids = block->ids();
+        for (auto const& record_id: *record_ids) {
+            Dbt* data = block->get(record_id);
+            const char* record = (const char*) data->get_data();
+            bool qualifies = snapshot.visible(VersionHeader::read(record))
+                             && (predicate == nullptr || predicate->evaluate(record + VersionHeader::SIZE, &this->overflow));
+            delete data;
+            if (qualifies)
+                handles->push_back(Handle(block_id, record_id));
+        }
+        delete record_ids;
+        delete block;
+    }
+    delete block_ids;
+    STATS_COUNT(ROWS_SELECTED, handles->size());
+    return handles;
+}
+
+/** @brief corresponds to the SQL query SELECT * FROM... 
+    *  @return Handles to the matching rows
+    */
+Handles* HeapTable::select() {
+    return select((const ValueDict*) nullptr);
+}
+
+// Return all the block ids of the underlying HeapFile (freed by caller)
+BlockIDs* HeapTable::block_ids() {
+    this->open();
+    return this->file.block_ids();
+}
+
+// The size of the table's blocks (opens the table to learn it)
+uint HeapTable::get_page_size() {
+    this->open();
+    return this->file.get_page_size();
+}
+
+// Choose the page size the table is created with
+void HeapTable::set_page_size(uint page_size) {
+    if (!HeapFile::valid_page_size(page_size))
+        throw DbRelationError("page size must be a power of two from " + to_string(HeapFile::MIN_PAGE_SZ) + " to "
+                              + to_string(HeapFile::MAX_PAGE_SZ));
+    this->file.set_page_size(page_size);
+}
+
+// The layout of the table's pages (opens the table: an existing table's first block tells)
+HeapTable::PageLayout HeapTable::get_layout() {
+    this->open();
+    return this->file.get_pax_fields().empty() ? ROW : PAX;
+}
+
+// Choose the layout the table is created with
+void HeapTable::set_layout(PageLayout layout) {
+    this->file.set_pax_fields(layout == PAX ? pax_fields() : PaxPage::Fields());
+}
+
+// The PaxPage fields for this table's records: the version header, then each column
+PaxPage::Fields HeapTable::pax_fields() const {
+    PaxPage::Fields fields(1, VersionHeader::SIZE);
+    for (auto codec: this->codecs)
+        fields.push_back(codec->is_fixed() ? codec->size : PaxPage::VARIABLE);
+    return fields;
+}
+
+/**
+ * Copy the raw bytes of a block into a caller-owned buffer of get_page_size() bytes
+ * @param block_id which block to copy
+ * @param buffer   destination for the block's bytes
+ */
+void HeapTable::copy_block(BlockID block_id, char *buffer) {
+    PageLatch latch(this->file, block_id, false);
+    SlottedPage* block = this->file.get(block_id);
+    memcpy(buffer, block->get_data(), block->get_size());
+    delete block;
+}
+
+/**
+ * Unmarshal every visible (and qualifying) record in a block previously fetched with copy_block
+ * @param buffer    the block's bytes
+ * @param rows      decoded rows are appended here (freed by caller)
+ * @param predicate if given, only records it accepts are decoded
+ * @param snapshot  which versions to decode (this thread's current snapshot, or a new one, if nullptr)
+ * @param column_names the columns to decode (all of them if nullptr)
+ */
+void HeapTable::decode_block(char *buffer, ValueDicts &rows, const CompiledPredicate *predicate,
+                             const Snapshot *snapshot, const ColumnNames *column_names) {
+    TRACE_SPAN("HeapTable::decode_block", "storage");
+    Snapshot local;
+    if (snapshot == nullptr)
+        snapshot = &local;
+    Dbt block_dbt(buffer, this->file.get_page_size());
+    SlottedPage* block = SlottedPage::make(block_dbt, 0, false);
+    PaxPage* pax = dynamic_cast<PaxPage*>(block);
+    if (pax != nullptr) {
         try{
-		    recId = block->add(data);
-            lastBlockId = block->get_block_id();
-        } catch(DbBlockNoRoomError &e){
-            cerr << "data is too large to be hold in one block" << endl;
-            exit(-1);
+            decode_pax_block(pax, rows, predicate, snapshot, column_names);
+        }catch(...){
+            delete block;
+            throw;
         }
-	}
-    this->file.put(block);
-    delete data;
+        delete block;
+        return;
+    }
+    RecordIDs* record_ids = block->ids();
+    for (auto const& record_id: *record_ids) {
+        Dbt* data = block->get(record_id);
+        const char* record = (const char*) data->get_data();
+        if (snapshot->visible(VersionHeader::read(record))
+            && (predicate == nullptr || predicate->evaluate(record + VersionHeader::SIZE, &this->overflow)))
+            rows.push_back(unmarshal(data, column_names));
+        delete data;
+    }
+    delete record_ids;
+    delete block;
+}
+
+/**
+ * decode_block for a PaxPage: visibility comes from the version minipage and each column from its own, so only
+ * the columns asked for are read (and the whole record only for a predicate)
+ * @param block        the page
+ * @param rows         decoded rows are appended here (freed by caller)
+ * @param predicate    if given, only records it accepts are decoded
+ * @param snapshot     which versions to decode
+ * @param column_names the columns to decode (all of them if nullptr)
+ */
+void HeapTable::decode_pax_block(PaxPage *block, ValueDicts &rows, const CompiledPredicate *predicate,
+                                 const Snapshot *snapshot, const ColumnNames *column_names) {
+    vector<size_t> wanted;
+    for (size_t c = 0; c < this->column_names.size(); c++)
+        if (column_names == nullptr
+            || find(column_names->begin(), column_names->end(), this->column_names[c]) != column_names->end())
+            wanted.push_back(c);
+    vector<u_int8_t> matches;
+    filter_pax_block(block, predicate, *snapshot, matches);
+    for (size_t r = 0; r < matches.size(); r++) {
+        if (!matches[r])
+            continue;
+        ValueDict* row = new ValueDict();
+        try{
+            for (auto c: wanted)
+                (*row)[this->column_names[c]] = unmarshal_field(this->column_attributes[c],
+                                                                block->field((RecordID) (r + 1), c + 1));
+        }catch(...){
+            delete row;
+            throw;
+        }
+        rows.push_back(row);
+    }
+}
+
+/**
+ * Find the records of a PaxPage that a snapshot sees and a predicate accepts. Visibility comes from the version
+ * minipage; the predicate's column tests run on the columns' minipages (on the encoded values of a sealed page),
+ * and the rest of it on the records still left, rebuilt.
+ * @param block     the page
+ * @param predicate the WHERE clause, or nullptr for all rows
+ * @param snapshot  which versions count
+ * @param matches   set to 1 or 0 for each record id - 1
+ */
+void HeapTable::filter_pax_block(PaxPage *block, const CompiledPredicate *predicate, const Snapshot &snapshot,
+                                 vector<u_int8_t> &matches) {
+    RecordID num_records = block->get_num_records();
+    matches.assign(num_records, 0);
+    for (RecordID record_id = 1; record_id <= num_records; record_id++)
+        matches[record_id - 1] = block->is_live(record_id)
+                                 && snapshot.visible(VersionHeader::read(block->field(record_id, 0)));
+    if (predicate == nullptr)
+        return;
+    bool exact = predicate->is_column_tests_only();
+    for (auto const& test: predicate->get_column_tests())
+        exact = block->filter(test.ordinal + 1, (PaxPage::Comparison) test.comparison, test.constant,
+                              matches.data()) && exact;
+    if (exact)
+        return;
+    for (RecordID record_id = 1; record_id <= num_records; record_id++) {
+        if (!matches[record_id - 1])
+            continue;
+        Dbt* data = block->get(record_id);
+        matches[record_id - 1] = predicate->evaluate((const char*) data->get_data() + VersionHeader::SIZE,
+                                                     &this->overflow);
+        delete data;
+    }
+}
+
+/**
+ * Read one column of every visible row in a block previously fetched with copy_block
+ * @param buffer      the block's bytes
+ * @param column_name the column
+ * @param values      its values are appended here
+ * @param snapshot    which versions to read (this thread's current snapshot, or a new one, if nullptr)
+ */
+void HeapTable::decode_column(char *buffer, const Identifier &column_name, vector<Value> &values,
+                              const Snapshot *snapshot) {
+    TRACE_SPAN("HeapTable::decode_column", "storage");
+    size_t ordinal = find(this->column_names.begin(), this->column_names.end(), column_name) - this->column_names.begin();
+    if (ordinal == this->column_names.size())
+        throw DbRelationError("unknown column " + column_name);
+    const ColumnAttribute &column_attribute = this->column_attributes[ordinal];
+    Snapshot local;
+    if (snapshot == nullptr)
+        snapshot = &local;
+    Dbt block_dbt(buffer, this->file.get_page_size());
+    SlottedPage* block = SlottedPage::make(block_dbt, 0, false);
+    PaxPage* pax = dynamic_cast<PaxPage*>(block);
+    RecordIDs* record_ids = block->ids();
+    if (pax != nullptr && column_attribute.get_data_type() == ColumnAttribute::DataType::INT) {
+        // two arrays, read in step (the INTs decoded first if the page is sealed)
+        const char* versions = pax->minipage(0);
+        vector<int32_t> ints(pax->get_num_records());
+        pax->read_ints(ordinal + 1, ints.data());
+        for (auto const& record_id: *record_ids)
+            if (snapshot->visible(VersionHeader::read(versions + (record_id - 1) * VersionHeader::SIZE)))
+                values.push_back(Value(ints[record_id - 1]));
+    } else {
+        try{
+            for (auto const& record_id: *record_ids) {
+                if (pax != nullptr) {
+                    if (snapshot->visible(VersionHeader::read(pax->field(record_id, 0))))
+                        values.push_back(unmarshal_field(column_attribute, pax->field(record_id, ordinal + 1)));
+                    continue;
+                }
+                Dbt* data = block->get(record_id);
+                const char* record = (const char*) data->get_data();
+                if (snapshot->visible(VersionHeader::read(record))) {
+                    const char* field = record + VersionHeader::SIZE;
+                    for (size_t c = 0; c < ordinal; c++)
+                        field += marshaled_size(*this->codecs[c], field);
+                    try{
+                        values.push_back(unmarshal_field(column_attribute, field));
+                    }catch(...){
+                        delete data;
+                        throw;
+                    }
+                }
+                delete data;
+            }
+        }catch(...){
+            delete record_ids;
+            delete block;
+            throw;
+        }
+    }
+    delete record_ids;
     delete block;
-    return Handle(lastBlockId, recId);
 }
 
 /**
- * Return the bits to go into the fil
- * caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
+ * Remove the versions no snapshot can see any more: those ended at or below horizon
+ * @param horizon  VersionClock::oldest_snapshot() (or older)
+ * @return         how many were removed
+ */
+size_t HeapTable::vacuum(TxnStamp horizon) {
+    TRACE_SPAN("HeapTable::vacuum", "storage");
+    if (!this->file.is_open())
+        return 0;
+    DurableWrite durable;
+    size_t removed = 0;
+    BlockIDs* block_ids = this->file.block_ids();
+    for (auto const& block_id: *block_ids) {
+        PageLatch latch(this->file, block_id, true);
+        SlottedPage* block = this->file.get(block_id);
+        RecordIDs* record_ids = block->ids();
+        size_t dead = 0;
+        for (auto const& record_id: *record_ids) {
+            Dbt* data = block->get(record_id);
+            VersionHeader header = VersionHeader::read(data->get_data());
+            if (header.end != 0 && header.end <= horizon) {
+                free_overflow(data);
+                block->del(record_id);
+                dead++;
+            }
+            delete data;
+        }
+        if (dead > 0) {
+            WriteAheadLog::log_page(this->file.get_name(), block);
+            this->file.put(block);
+        }
+        removed += dead;
+        delete record_ids;
+        delete block;
+    }
+    delete block_ids;
+    STATS_COUNT(VERSIONS_COLLECTED, removed);
+    return removed;
+}
+
+/** @brief Check if the given row can be inserted 
+    *  @param  ValueDict representing the row to be inserted
+    *  @param  converted filled with the row, its values converted to the columns' types, if any need it
+    *  @return the row to insert: row itself unless a value needed converting, else converted (no copy is
+    *          made of a row that is fine as it is)
+    */
+const ValueDict* HeapTable::validate(const ValueDict *row, ValueDict &converted){
+	bool converting = false;
+	uint col_num = 0;
+	for(auto const& column_name: this->column_names){
+		ColumnAttribute::DataType data_type = this->column_attributes[col_num++].get_data_type();
+		ValueDict::const_iterator column = row->find(column_name);
+		if(column == row->end()){
+			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+		}
+		if(column->second.data_type == data_type){
+			if(converting)
+				converted[column_name] = column->second;
+			continue;
+		}
+		if(!converting){
+			// copy the columns checked so far, which were fine
+			converting = true;
+			for(uint c = 0; c < col_num - 1; c++)
+				converted[this->column_names[c]] = row->find(this->column_names[c])->second;
+		}
+		// a literal of a type that converts to the column's (an INT for a BIGINT, a string for a DATE, ...)
+		try{
+			converted[column_name] = convert_value(column->second, data_type);
+		}catch(DbRelationError &e){
+			throw DbRelationError("wrong type of value for column " + column_name + ": " + e.what());
+		}
+	}
+	return converting ? &converted : row;
+}
+
+/** @brief Appends a marshaled record to the file. 
+    *  @param  the record (still owned by the caller)
+    *  @return Handles to the block and record id values where it was appended
+    */
+Handle HeapTable::append(const Dbt *data){
+	while (true) {
+		BlockID lastBlockId = this->file.get_last_block_id();
+		PageLatch latch(this->file, lastBlockId, true);
+		ArenaScope block_scope;
+		SlottedPage* block = this->file.get(lastBlockId, block_scope.get_arena());
+		try{
+			RecordID recId = block->add(data);
+			WriteAheadLog::log_add(this->file.get_name(), block, recId, data);
+			this->file.put(block);
+			delete block;
+			return Handle(lastBlockId, recId);
+		}catch(DbBlockNoRoomError &e){
+			delete block;
+		}
+		if (!fits_in_empty_block(this->file, data))
+			throw DbRelationError("row too large to fit in one block");
+		// the block is full: add one after it, unless another thread got there first
+		if (this->file.get_last_block_id() == lastBlockId)
+			delete this->file.get_new();
+	}
+}
+
+/**
+ * Return the bits to go into the file, in the thread's scratch arena: they are freed when the caller's
+ * ArenaScope ends, as are marshal's own temporaries, so marshaling a row makes no heap allocation.
+ * TEXT values over inline_text_limit go out of line, then the longest of the others until the row fits in a block.
  * @param row the data needed to be marshal
+ * @param begin the stamp of the write creating this version
+ * @param data set to the record
  */
-Dbt* HeapTable::marshal(const ValueDict* row) {
-    char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-    uint offset = 0;
-    uint col_num = 0;
-    for (auto const& column_name: this->column_names) {
-        ColumnAttribute ca = this->column_attributes[col_num++];
-        ValueDict::const_iterator column = row->find(column_name);
-        Value value = column->second;
-        if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-            *(int32_t*) (bytes + offset) = value.n;
-            offset += sizeof(int32_t);
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            uint size = value.s.length();
-            *(u16*) (bytes + offset) = size;
-            offset += sizeof(u16);
-            memcpy(bytes+offset, value.s.c_str(), size); // assume ascii for now
-            offset += size;
+void HeapTable::marshal(const ValueDict* row, TxnStamp begin, Dbt &data) {
+    TRACE_SPAN("HeapTable::marshal", "storage");
+    Arena &arena = Arena::scratch();
+    uint page_size = this->file.get_page_size();
+    size_t num_columns = this->column_names.size();
+    ArenaVector<const Value*> values(num_columns, nullptr, ArenaAllocator<const Value*>(arena));
+    ArenaVector<bool> out_of_line(num_columns, false, ArenaAllocator<bool>(arena));
+    size_t size = VersionHeader::SIZE;
+    for (size_t c = 0; c < num_columns; c++) {
+        values[c] = &row->find(this->column_names[c])->second;
+        if (this->codecs[c]->is_fixed()) {
+            size += this->codecs[c]->size;
         } else {
-            throw DbRelationError("Only know how to marshal INT and TEXT");
+            out_of_line[c] = values[c]->s.length() > inline_text_limit(page_size);
+            size += out_of_line[c] ? OverflowPointer::SIZE : sizeof(u16) + values[c]->s.length();
+        }
+    }
+    while (size > this->file.max_record_size()) {
+        size_t longest = num_columns;
+        for (size_t c = 0; c < num_columns; c++)
+            if (!this->codecs[c]->is_fixed() && !out_of_line[c]
+                && (longest == num_columns || values[c]->s.length() > values[longest]->s.length()))
+                longest = c;
+        if (longest == num_columns || sizeof(u16) + values[longest]->s.length() <= OverflowPointer::SIZE)
+            throw DbRelationError("row too large to fit in one block");
+        out_of_line[longest] = true;
+        size -= sizeof(u16) + values[longest]->s.length() - OverflowPointer::SIZE;
+    }
+
+    char *bytes = (char*) arena.allocate(size);
+    VersionHeader header;
+    header.begin = begin;
+    header.end = 0;
+    header.write(bytes);
+    uint offset = VersionHeader::SIZE;
+    ArenaVector<OverflowPointer> written{ArenaAllocator<OverflowPointer>(arena)};
+    try{
+        for (size_t c = 0; c < num_columns; c++) {
+            const Value &value = *values[c];
+            const CodecOps &codec = *this->codecs[c];
+            if (codec.is_fixed()) {
+                codec.marshal(value, bytes + offset);
+                offset += codec.size;
+            } else if (out_of_line[c]) {
+                OverflowPointer pointer = this->overflow.write(value.s, page_size);
+                written.push_back(pointer);
+                pointer.write(bytes + offset);
+                offset += OverflowPointer::SIZE;
+            } else {
+                *(u16*) (bytes + offset) = value.s.length();
+                offset += sizeof(u16);
+                memcpy(bytes+offset, value.s.c_str(), value.s.length()); // assume ascii for now
+                offset += value.s.length();
+            }
         }
+    }catch(...){
+        for (auto const &pointer: written)
+            this->overflow.free(pointer);
+        throw;
     }
-    char *right_size_bytes = new char[offset];
-    memcpy(right_size_bytes, bytes, offset);
-    delete[] bytes;
-    Dbt *data = new Dbt(right_size_bytes, offset);
-    return data;
+    STATS_COUNT(MARSHAL_BYTES, offset - VersionHeader::SIZE);
+    data.set_data(bytes);
+    data.set_size(offset);
 }
 
 /**
@@ -600,59 +3133,256 @@ Dbt* HeapTable::marshal(const ValueDict* row) {
  * @param Handle holding the record id and block id of desired data
  */
 ValueDict* HeapTable::project(Handle handle){
+    return project(handle, nullptr);
+}
+
+/**
+ * Return the values of the given columns for the row at handle; TEXT values stored out of line are read only
+ * for these columns
+ * returned value must be deallocated by caller
+ * @param Handle holding the record id and block id of desired data
+ * @param column_names the columns to return (all of them if nullptr or empty)
+ */
+ValueDict* HeapTable::project(Handle handle, const ColumnNames *column_names){
+    STATS_TIMER(PROJECT_TIME);
+    STATS_COUNT(ROWS_PROJECTED, 1);
+    TRACE_SPAN("HeapTable::project", "storage");
+    if(column_names != nullptr && column_names->empty()){
+        column_names = nullptr;
+    }
+    if(column_names != nullptr){
+        for(auto const& column_name: *column_names){
+            if(find(this->column_names.begin(), this->column_names.end(), column_name) == this->column_names.end()){
+                throw DbRelationError("unknown column " + column_name);
+            }
+        }
+    }
     ValueDict * row;
 	Dbt* data;
 	u32 blockId = handle.first;
 	u16 recId = handle.second;
-	SlottedPage * block = this->file.get(blockId);
+	SlottedPage * block;
+	ArenaScope page_scope;
+	{
+		PageLatch latch(this->file, blockId, false);
+		block = this->file.get(blockId, page_scope.get_arena());
+	}
 	data = block->get(recId);
-	row = unmarshal(data);
+	if(data == NULL){
+		delete block;
+		throw DbRelationError("no such record");
+	}
+	try{
+		row = unmarshal(data, column_names);
+	}catch(...){
+		delete block;
+		delete data;
+		throw;
+	}
 	delete block;
 	delete data;
 	return row;
 }
 
-// TODO
-ValueDict* HeapTable::project(Handle handle, const ColumnNames *column_names){
-    return NULL;
-}
-
 /**
  * Return the fields decoded from the bits
  * caller responsible for freeing the returned ValueDict
  * @param Dbt holding the bits representing the data
+ * @param column_names the columns to decode (all of them if nullptr); the others are skipped without being read
  */
-ValueDict* HeapTable::unmarshal(Dbt *data){
+ValueDict* HeapTable::unmarshal(Dbt *data, const ColumnNames *column_names){
+    TRACE_SPAN("HeapTable::unmarshal", "storage");
     ValueDict* row = new ValueDict();
-	char *block_bytes = (char*)data->get_data();
+	char *block_bytes = (char*)data->get_data() + VersionHeader::SIZE;
 	uint offset = 0;
 	uint col_num = 0;
 	for (auto const& column_name: this->column_names) {
-		ColumnAttribute ca = this->column_attributes[col_num++];
-		Value value;
-		if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-			value = Value(*(u32*) (block_bytes + offset));
-			(*row)[column_name] = value;
-			offset += 4;
-        } else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-            uint size = *(u16*) (block_bytes + offset);
-			offset += sizeof(u16);
-			char* s = new char[size + 1];
-			memcpy(s, block_bytes+offset, size);
-			s[size] = '\0';
-			value = Value(s);
-			(*row)[column_name] = value;
-			offset += size;
-			delete [] s;
+		const CodecOps &codec = *this->codecs[col_num++];
+		bool wanted = column_names == nullptr
+		              || find(column_names->begin(), column_names->end(), column_name) != column_names->end();
+		if (codec.is_fixed()) {
+			if (wanted)
+				(*row)[column_name] = codec.unmarshal(block_bytes + offset);
+			offset += codec.size;
         } else {
-            throw DbRelationError("Only know how to unmarshal INT and TEXT");
+            if (OverflowPointer::is_pointer(block_bytes + offset)) {
+                if (wanted) {
+                    try{
+                        (*row)[column_name] = Value(this->overflow.read(OverflowPointer::read(block_bytes + offset)));
+                    }catch(...){
+                        delete row;
+                        throw;
+                    }
+                }
+                offset += OverflowPointer::SIZE;
+            } else {
+                uint size = *(u16*) (block_bytes + offset);
+                offset += sizeof(u16);
+                if (wanted)
+                    (*row)[column_name] = Value(string(block_bytes + offset, size));
+                offset += size;
+            }
         }
 	}
+	STATS_COUNT(UNMARSHAL_BYTES, offset);
 	return row;
 }
 
-// TODO
-void HeapTable::update(const Handle handle, const ValueDict *new_values){}
+/**
+ * Decode one field in marshal format
+ * @param column_attribute the column's type
+ * @param field            the field's bytes
+ * @return its value (a TEXT value stored out of line is read from the overflow file)
+ */
+Value HeapTable::unmarshal_field(const ColumnAttribute &column_attribute, const char *field){
+    const CodecOps &codec = codec_ops(column_attribute.get_data_type());
+    if (codec.is_fixed())
+        return codec.unmarshal(field);
+    if (OverflowPointer::is_pointer(field))
+        return Value(this->overflow.read(OverflowPointer::read(field)));
+    return Value(string(field + sizeof(u16), *(u16*) field));
+}
+
+/**
+ * Free the overflow chains of the TEXT values a record stores out of line
+ * @param data the record (as marshaled, version header included)
+ */
+void HeapTable::free_overflow(const Dbt *data){
+    const char *bytes = (const char*) data->get_data() + VersionHeader::SIZE;
+    uint offset = 0;
+    for (auto codec: this->codecs) {
+        if (codec->is_fixed()) {
+            offset += codec->size;
+        } else if (OverflowPointer::is_pointer(bytes + offset)) {
+            this->overflow.free(OverflowPointer::read(bytes + offset));
+            offset += OverflowPointer::SIZE;
+        } else {
+            offset += sizeof(u16) + *(u16*) (bytes + offset);
+        }
+    }
+}
+
+/**
+ * Change some of the values of the row at handle: a new version is added (in the same block if it fits) and
+ * only then is the old one ended, so snapshots taken before the update still see the old values and a
+ * failed write leaves the row as it was
+ * @param handle     the row
+ * @param new_values the columns to change and their new values
+ * @return the handle of the row's new version (the old handle now names a version that has ended)
+ */
+Handle HeapTable::update(const Handle handle, const ValueDict *new_values){
+	STATS_TIMER(UPDATE_TIME);
+	STATS_COUNT(ROWS_UPDATED, 1);
+	TRACE_SPAN("HeapTable::update", "storage");
+	this->open();
+	VersionWrite write;
+	DurableWrite durable;
+	ArenaScope row_scope;  // the pages and the marshaled row
+	Dbt data;
+	{
+		PageLatch latch(this->file, handle.first, true);
+		SlottedPage* block = this->file.get(handle.first, row_scope.get_arena());
+		Dbt* old_data = block->get(handle.second);
+		if(old_data == NULL){
+			delete block;
+			throw DbRelationError("no such record");
+		}
+		if(VersionHeader::read(old_data->get_data()).end != 0){
+			delete old_data;
+			delete block;
+			throw DbRelationError("row was changed by a concurrent statement");
+		}
+		ValueDict* row = unmarshal(old_data);
+		for(auto const& column: *new_values){
+			(*row)[column.first] = column.second;
+		}
+		try{
+			ValueDict converted;
+			marshal(validate(row, converted), write.get_stamp(), data);
+		}catch(...){
+			delete row;
+			delete old_data;
+			delete block;
+			throw;
+		}
+		delete row;
+		RecordID recId = 0;
+		bool added = true;
+		try{
+			recId = block->add(&data);
+		}catch(DbBlockNoRoomError &e){
+			added = false;
+		}
+		try{
+			if(added){
+				WriteAheadLog::log_add(this->file.get_name(), block, recId, &data);
+			}
+			// old_data was read before the add, so it still describes the old version's bytes
+			end_version(block, handle.second, old_data, write.get_stamp());
+			WriteAheadLog::log_end(this->file.get_name(), block, handle.second, write.get_stamp());
+		}catch(...){
+			delete old_data;
+			delete block;  // never put: the page on disk still holds only the old version
+			free_overflow(&data);
+			throw;
+		}
+		delete old_data;
+		this->file.put(block);
+		delete block;
+		if(added){
+			return Handle(handle.first, recId);
+		}
+	}
+	// no room next to the old version: it stays ended (so a concurrent update of it conflicts) while the new
+	// one goes at the end of the table; if that fails, the old version is reopened
+	try{
+		return this->append(&data);
+	}catch(...){
+		free_overflow(&data);
+		reopen_version(handle);
+		throw;
+	}
+}
+
+/**
+ * Undo the ending of a version by an update whose new version could not be written
+ * @param handle the version
+ */
+void HeapTable::reopen_version(const Handle handle){
+	PageLatch latch(this->file, handle.first, true);
+	ArenaScope block_scope;
+	SlottedPage* block = this->file.get(handle.first, block_scope.get_arena());
+	Dbt* data = block->get(handle.second);
+	end_version(block, handle.second, data, 0);
+	delete data;
+	WriteAheadLog::log_end(this->file.get_name(), block, handle.second, 0);
+	this->file.put(block);
+	delete block;
+}
 
-// TODO
-void HeapTable::del(const Handle handle){}
+// Delete the row at handle (ends its version; the garbage collector removes it once no snapshot can see it)
+void HeapTable::del(const Handle handle){
+	STATS_TIMER(DELETE_TIME);
+	STATS_COUNT(ROWS_DELETED, 1);
+	TRACE_SPAN("HeapTable::del", "storage");
+	this->open();
+	VersionWrite write;
+	DurableWrite durable;
+	PageLatch latch(this->file, handle.first, true);
+	SlottedPage* block = this->file.get(handle.first);
+	Dbt* data = block->get(handle.second);
+	if(data == NULL){
+		delete block;
+		throw DbRelationError("no such record");
+	}
+	if(VersionHeader::read(data->get_data()).end != 0){
+		delete data;
+		delete block;
+		throw DbRelationError("row was changed by a concurrent statement");
+	}
+	end_version(block, handle.second, data, write.get_stamp());
+	delete data;
+	WriteAheadLog::log_end(this->file.get_name(), block, handle.second, write.get_stamp());
+	this->file.put(block);
+	delete block;
+}
@@ -9,9 +9,20 @@
  */
 #pragma once
 
+#include <pthread.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <vector>
 #include "db_cxx.h"
+#include "mvcc.h"
+#include "read_ahead.h"
 #include "storage_engine.h"
 
+class Arena;
+class CompiledPredicate;
+struct CodecOps;
+
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
  *
@@ -24,15 +35,26 @@
             Bytes 0x04 - 0x05: size of record 1
             Bytes 0x06 - 0x07: offset to record 1
             etc.
+        That is the layout of the compact page (16-bit sizes and offsets), used for blocks up to
+        COMPACT_MAX_SZ. Larger blocks use the wide page, whose header fields are 32 bits each. Both are
+        BasicSlottedPage, specialized on the width of its fields; make() picks one by the block's size.
  *
  */
 class SlottedPage : public DbBlock {
 public:
-    SlottedPage(Dbt &block, BlockID block_id, bool is_new = false);
+    static const uint COMPACT_MAX_SZ = 32768;
+
+    /**
+     * The page for a block of any supported size (see HeapFile::MIN_PAGE_SZ and MAX_PAGE_SZ)
+     * @param owns_data  the block's memory was allocated with new[] for this page alone and is freed with it
+     * @return           a CompactSlottedPage or a WideSlottedPage (freed by caller)
+     */
+    static SlottedPage *make(Dbt &block, BlockID block_id, bool is_new = false, bool owns_data = false);
+
+    // the largest record an empty page of this size holds
+    static uint max_record_size(uint page_size);
 
-    // Big 5 - we only need the destructor, copy-ctor, move-ctor, and op= are unnecessary
-    // but we delete them explicitly just to make sure we don't use them accidentally
-    virtual ~SlottedPage() {}
+    virtual ~SlottedPage();
 
     SlottedPage(const SlottedPage &other) = delete;
 
@@ -42,6 +64,29 @@ public:
 
     SlottedPage &operator=(SlottedPage &temp) = delete;
 
+    // record ids are never reused, so this is also the id of the last record added
+    virtual RecordID get_num_records() = 0;
+
+    // the block's size in bytes
+    virtual uint get_size() { return block.get_size(); }
+
+protected:
+    bool owns_data;
+
+    SlottedPage(Dbt &block, BlockID block_id, bool owns_data);
+};
+
+/**
+ * @class BasicSlottedPage - SlottedPage with header fields (record count, free space and each record's size
+ *      and offset) of type Offset: u_int16_t for CompactSlottedPage, u_int32_t for WideSlottedPage
+ */
+template<typename Offset>
+class BasicSlottedPage : public SlottedPage {
+public:
+    BasicSlottedPage(Dbt &block, BlockID block_id, bool is_new = false, bool owns_data = false);
+
+    virtual ~BasicSlottedPage() {}
+
     virtual RecordID add(const Dbt *data);
 
     virtual Dbt *get(RecordID record_id);
@@ -52,23 +97,213 @@ public:
 
     virtual RecordIDs *ids(void);
 
+    virtual RecordID get_num_records() { return num_records; }
+
 protected:
+    Offset num_records;
+    Offset end_free;
+
+    virtual void get_header(Offset &size, Offset &loc, RecordID id = 0);
+
+    virtual void put_header(RecordID id = 0, Offset size = 0, Offset loc = 0);
+
+    virtual bool has_room(Offset size);
+
+    virtual void slide(Offset start, Offset end);
+
+    virtual Offset get_n(Offset offset);
+
+    virtual void put_n(Offset offset, Offset n);
+
+    virtual void *address(Offset offset);
+};
+
+typedef BasicSlottedPage<u_int16_t> CompactSlottedPage;
+typedef BasicSlottedPage<u_int32_t> WideSlottedPage;
+
+/**
+ * @class PaxPage - a page that stores its records column by column (PAX: Partition Attributes Across)
+ *
+ *      Records are split into fields described in the page header: fixed-width fields (a HeapTable's version
+ *      header and fixed-width columns) or VARIABLE ones (TEXT columns, in marshal format: a u16 length and the
+ *      bytes, or an OverflowPointer). Each field has a minipage holding it for every record, so scanning one column
+ *      reads a contiguous array instead of every byte of the page:
+ *          header: u32 MAGIC (which no slotted page starts with), u16 number of records, u16 capacity,
+ *                  u32 start of the heap, u16 number of fields, u16 width of each field
+ *          a live flag per record
+ *          per fixed field: capacity values; per VARIABLE field: capacity (u16 offset, u16 size) pairs
+ *          free space, then the heap of VARIABLE fields' bytes, growing down from the end of the block
+ *      Each region starts on an 8-byte boundary. The capacity is sized from the records' mean heap bytes:
+ *      when it runs out while the heap has room, or the heap runs out while slots are left, the page is
+ *      laid out again for its records so far. Record ids behave as in SlottedPage (never reused, deleted ones
+ *      give nullptr); get() rebuilds the record in memory the page owns until it is deleted.
+ *
+ *      When a record no longer fits, the page is sealed: each 4-byte field (a HeapTable INT or DATE) and each
+ *      VARIABLE field gets the smallest of these encodings for the page's values, and the page is written again:
+ *          PLAIN   the minipage as above
+ *          PACKED  a code per record in as few bits as the page needs: the value minus the page's smallest
+ *                  (frame of reference) for 4-byte fields, an index into a sorted dictionary of the page's
+ *                  values for VARIABLE ones
+ *          RLE     (u32 code, u32 end) runs of records with the same code
+ *      A sealed page starts with SEALED_MAGIC and has an encoding table after the field widths. Records that
+ *      fit its encodings as they are (a value in the frame or dictionary, a run continued) are added or put in
+ *      place; any other makes the page choose its encodings again. The version header is never encoded.
+ */
+class PaxPage : public SlottedPage {
+public:
+    typedef std::vector<u_int16_t> Fields;  // the width of each field in bytes, or VARIABLE
+    static const u_int16_t VARIABLE = 0;
+    static const u_int32_t MAGIC = 0xFFFFFFFF;
+    static const u_int32_t SEALED_MAGIC = 0xFFFFFFFE;
+
+    enum Encoding {
+        PLAIN = 0,
+        PACKED = 1,
+        RLE = 2
+    };
+
+    // as CompiledPredicate orders them: field op constant
+    enum Comparison {
+        EQ, NE, LT, LE, GT, GE
+    };
+
+    // whether the block holds a PaxPage
+    static bool is_pax(const Dbt &block);
+
+    // the largest record an empty page of this size and these fields holds
+    static uint max_record_size(uint page_size, const Fields &fields);
+
+    // an existing page (its fields are in its header)
+    PaxPage(Dbt &block, BlockID block_id, bool owns_data = false);
+
+    // a new, empty page
+    PaxPage(Dbt &block, BlockID block_id, const Fields &fields, bool owns_data = false);
+
+    virtual ~PaxPage();
+
+    virtual RecordID add(const Dbt *data);
+
+    virtual Dbt *get(RecordID record_id);
+
+    virtual void put(RecordID record_id, const Dbt &data);
+
+    virtual void del(RecordID record_id);
+
+    virtual RecordIDs *ids(void);
+
+    virtual RecordID get_num_records() { return num_records; }
+
+    // -- column access: no record is rebuilt --
+
+    virtual const Fields &get_fields() const { return fields; }
+
+    virtual bool is_live(RecordID record_id) const;
+
+    // a record's field: width bytes for a fixed field; a u16 length and the bytes, or an OverflowPointer, for
+    // a VARIABLE one (record_id must be live)
+    virtual const char *field(RecordID record_id, uint field_num) const;
+
+    // a PLAIN fixed field's minipage: record r's value is at (r - 1) * width
+    virtual const char *minipage(uint field_num) const { return (const char *) address(offsets[field_num]); }
+
+    virtual bool is_sealed() const { return !encodings.empty(); }
+
+    virtual Encoding get_encoding(uint field_num) const;
+
+    // every record's value of a 4-byte field, decoded (deleted records' are undefined)
+    virtual void read_ints(uint field_num, int32_t *values) const;
+
+    /**
+     * Clear matches[r - 1] for each record r whose field fails "field comparison constant", on the encoded
+     * values if the field is encoded (a dictionary entry or run is compared once, however many records share it).
+     * @param field_num   a 4-byte field (with an INT constant) or a VARIABLE one (with a TEXT constant)
+     * @param comparison  the comparison
+     * @param constant    the value to compare with
+     * @param matches     a flag per record
+     * @return            false if some records could not be tested (TEXT stored out of line): their flags are kept
+     */
+    virtual bool filter(uint field_num, Comparison comparison, const Value &constant, u_int8_t *matches) const;
+
+protected:
+    /**
+     * @class FieldEncoding - how a sealed page stores a field (the page header holds one per field)
+     */
+    struct FieldEncoding {
+        static const u_int32_t SIZE = 20;
+        u_int8_t encoding;
+        u_int8_t bits;      // PACKED: bits per code
+        int32_t base;       // 4-byte fields: the value of code 0
+        u_int32_t offset;   // where its region starts (VARIABLE: the dictionary's (offset, size) pairs, then codes)
+        u_int32_t entries;  // VARIABLE: dictionary entries
+        u_int32_t runs;     // RLE: runs
+    };
+
+    Fields fields;
     u_int16_t num_records;
-    u_int16_t end_free;
+    u_int16_t capacity;
+    u_int32_t heap_start;
+    u_int32_t flags_offset;
+    u_int32_t regions_end;                  // where the flags and minipages (or a sealed page's regions) end
+    std::vector<u_int32_t> offsets;         // where each field's minipage starts, for this capacity
+    std::vector<FieldEncoding> encodings;   // empty unless sealed
+    std::vector<char *> rebuilt;            // records handed out by get()
+    mutable std::vector<int32_t> decoded;   // field() of an encoded 4-byte field
+
+    static u_int32_t header_size(const Fields &fields, bool sealed = false) {
+        return 14 + 2 * fields.size() + (sealed ? FieldEncoding::SIZE * fields.size() : 0);
+    }
+
+    static u_int32_t fixed_end(const Fields &fields, uint capacity);
+
+    // the largest capacity (at least min_capacity) that leaves room for heap_bytes now and per_record more each
+    virtual uint fit_capacity(uint min_capacity, uint heap_bytes, uint per_record);
+
+    virtual void lay_out(uint capacity);
+
+    virtual void put_header();
+
+    // the heap bytes of a record's VARIABLE fields, or -1 if the record is malformed for these fields
+    virtual int64_t heap_bytes(const Dbt *data);
+
+    virtual u_int32_t live_heap_bytes();
+
+    // write a record into slot record_id, whose fixed part is reserved and heap space is free
+    virtual void place(RecordID record_id, const Dbt *data);
+
+    virtual u_int32_t record_size(RecordID record_id) const;
 
-    virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id = 0);
+    virtual void copy_record(RecordID record_id, char *record) const;
 
-    virtual void put_header(RecordID id = 0, u_int16_t size = 0, u_int16_t loc = 0);
+    // -- sealed pages --
 
-    virtual bool has_room(u_int16_t size);
+    // where each field's region starts for this capacity (into encodings), and where the regions end
+    static u_int32_t sealed_layout(const Fields &fields, std::vector<FieldEncoding> &encodings, uint capacity);
 
-    virtual void slide(u_int16_t start, u_int16_t end);
+    /**
+     * Choose the encodings again and rewrite the page, with a record replaced or added
+     * @param data       the record
+     * @param record_id  which record it is (num_records + 1 to add it)
+     * @return           false, leaving the page as it was, if the records don't fit
+     */
+    virtual bool seal(const Dbt *data, RecordID record_id);
 
-    virtual u_int16_t get_n(u_int16_t offset);
+    // the codes of a record's encoded fields if they fit the encodings as they are and the heap has room for
+    // its PLAIN VARIABLE fields
+    virtual bool encodable(const Dbt *data, RecordID record_id, std::vector<u_int32_t> &codes) const;
 
-    virtual void put_n(u_int16_t offset, u_int16_t n);
+    // write a record that is encodable into a sealed page
+    virtual void place_sealed(RecordID record_id, const Dbt *data, const std::vector<u_int32_t> &codes);
 
-    virtual void *address(u_int16_t offset);
+    virtual u_int32_t code(uint field_num, uint r) const;
+
+    virtual void set_code(uint field_num, uint r, u_int32_t code);
+
+    // a VARIABLE field's dictionary entry: offset and size in the heap
+    virtual void dictionary_entry(uint field_num, u_int32_t code, u_int16_t pair[2]) const;
+
+    virtual u_int32_t codes_offset(uint field_num) const;
+
+    virtual void *address(u_int32_t offset) const { return (char *) this->block.get_data() + offset; }
 };
 
 /**
@@ -78,14 +313,28 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+
+        Safe to share between threads: every page handed out is a private copy of the block, blocks are
+        allocated with an atomic counter, and each page has a shared/exclusive latch (see PageLatch) that
+        HeapTable holds around reading a block, or around reading, changing and writing it back.
+        In durable mode (see wal.h) new blocks and drops are logged, and open files are synced at checkpoints.
+        Sequential gets make its ReadAhead read the blocks after them in the background (see read_ahead.h).
+
+        Blocks are DbBlock::BLOCK_SZ bytes unless the file is created with another page size (a power of two
+        from MIN_PAGE_SZ to MAX_PAGE_SZ). The size is kept in the file, so opening it needs no configuration.
+        Likewise its pages are SlottedPages unless it is created with PAX fields; then they are PaxPages, which
+        describe themselves, and opening the file learns the fields from its first block.
  */
 class HeapFile : public DbFile {
 public:
-    HeapFile(std::string name):DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0){
-        this->dbfilename = this->name + ".db";
-    }
+    static const uint NUM_LATCHES = 256;
+    static const uint MIN_PAGE_SZ = 4096;
+    static const uint MAX_PAGE_SZ = 65536;
 
-    virtual ~HeapFile() {}
+    // page_size: the size of the blocks if the file is created (an existing file has its own)
+    HeapFile(std::string name, uint page_size = DbBlock::BLOCK_SZ);
+
+    virtual ~HeapFile();
 
     HeapFile(const HeapFile &other) = delete;
 
@@ -103,34 +352,208 @@ public:
 
     virtual void close(void);
 
+    // open the file, creating it empty if it does not exist (for recovery, which writes blocks by id)
+    virtual void open_or_create(void);
+
+    // flush the file's changed blocks to disk
+    virtual void sync(void);
+
     virtual SlottedPage *get_new(void);
 
     virtual SlottedPage *get(BlockID block_id);
 
+    // a copy of the block whose bytes are in arena (the page does not free them)
+    virtual SlottedPage *get(BlockID block_id, Arena &arena);
+
+    // read a block into Berkeley DB's cache (buffer: get_page_size() bytes to read it into), for ReadAhead
+    virtual void prefetch(BlockID block_id, char *buffer);
+
     virtual void put(DbBlock *block);
 
     virtual BlockIDs *block_ids();
 
-    virtual u_int32_t get_last_block_id() { return last; }
+    virtual u_int32_t get_last_block_id() { return last.load(); }
+
+    virtual bool is_open() { return !closed; }
+
+    virtual const std::string &get_name() const { return name; }
+
+    // the size of the blocks: the file's once it has been opened
+    virtual uint get_page_size() const { return page_size; }
+
+    // change the page size the file is created with (an existing file keeps its own)
+    virtual void set_page_size(uint page_size) { this->page_size = page_size; }
+
+    // the fields of the file's PaxPages, or empty if it has slotted pages: the file's once it has been opened
+    virtual const PaxPage::Fields &get_pax_fields() const { return pax_fields; }
+
+    // make the file's pages PaxPages with these fields if it is created (an existing file keeps its pages)
+    virtual void set_pax_fields(const PaxPage::Fields &fields) { this->pax_fields = fields; }
+
+    // the largest record an empty block of the file holds
+    virtual uint max_record_size() const;
+
+    static bool valid_page_size(uint page_size);
+
+    // the latch for a page; pages whose ids are NUM_LATCHES apart share one
+    virtual pthread_rwlock_t *latch(BlockID block_id) { return &latches[block_id % NUM_LATCHES]; }
+
+    virtual ReadAhead &get_read_ahead() { return read_ahead; }
 
 protected:
     std::string dbfilename;
-    u_int32_t last;
-    bool closed;
+    uint page_size;
+    PaxPage::Fields pax_fields;
+    std::atomic<u_int32_t> last;       // highest block written out (what readers see)
+    std::atomic<u_int32_t> allocated;  // highest block id handed out by get_new
+    std::atomic<bool> closed;
+    std::mutex open_mutex;
     Db db;
+    pthread_rwlock_t latches[NUM_LATCHES];
+    ReadAhead read_ahead;  // last, so it is gone (and nothing is being read ahead) before db is
 
     virtual void db_open(uint flags = 0);
 };
 
+/**
+ * @class PageLatch - holds a page's latch for as long as it lives: shared to read the block, exclusive to
+ *      change it. A thread holds at most one page latch at a time, so latches never deadlock.
+ */
+class PageLatch {
+public:
+    PageLatch(HeapFile &file, BlockID block_id, bool exclusive);
+
+    virtual ~PageLatch() { release(); }
+
+    PageLatch(const PageLatch &other) = delete;
+
+    PageLatch &operator=(const PageLatch &other) = delete;
+
+    // let go before the end of the scope
+    virtual void release();
+
+protected:
+    pthread_rwlock_t *lock;
+};
+
+/**
+ * @class OverflowPointer - what a record holds in place of a TEXT value stored out of line: the marker where
+ *      an inline value's u16 length would be, then the value's length and the first block of its chain
+ */
+struct OverflowPointer {
+    static const u_int16_t MARKER = 0xFFFF;  // never an inline length: inline values are under a quarter page
+    static const uint SIZE = sizeof(u_int16_t) + sizeof(u_int32_t) + sizeof(BlockID);  // with the marker
+
+    u_int32_t length;
+    BlockID first;
+
+    // whether the TEXT field starting here is stored out of line
+    static bool is_pointer(const void *field) {
+        u_int16_t size;
+        memcpy(&size, field, sizeof(size));
+        return size == MARKER;
+    }
+
+    // read and write the pointer (marker included) at the start of a field, which need not be aligned
+    static OverflowPointer read(const void *field) {
+        OverflowPointer pointer;
+        const char *bytes = (const char *) field + sizeof(u_int16_t);
+        memcpy(&pointer.length, bytes, sizeof(pointer.length));
+        memcpy(&pointer.first, bytes + sizeof(pointer.length), sizeof(pointer.first));
+        return pointer;
+    }
+
+    void write(void *field) const {
+        char *bytes = (char *) field;
+        u_int16_t marker = MARKER;
+        memcpy(bytes, &marker, sizeof(marker));
+        memcpy(bytes + sizeof(marker), &this->length, sizeof(this->length));
+        memcpy(bytes + sizeof(marker) + sizeof(this->length), &this->first, sizeof(this->first));
+    }
+};
+
+/**
+ * @class OverflowFile - the TEXT values of a HeapTable too large to keep in its rows
+ *
+ *      Kept in a HeapFile of its own, <table>.ovf, created when the first value goes out of line. A value is
+ *      a chain of blocks each holding one record: the next block's id (0 at the end) and a chunk of the value.
+ *      A chain belongs to exactly one version of a row: it is written before the row is, never changed, and
+ *      freed when vacuum removes the version. Freed blocks are reused by later chains; the list of them is
+ *      rebuilt by scanning the file the first time a chain is written after opening it.
+ *      Blocks are written whole and logged as page images, so recovery needs nothing special for them.
+ */
+class OverflowFile {
+public:
+    // the file's name for a table (table names can't contain '.', so this never names a table)
+    static std::string name_for(const std::string &table_name) { return table_name + ".ovf"; }
+
+    OverflowFile(const std::string &table_name, uint page_size = DbBlock::BLOCK_SZ);
+
+    virtual ~OverflowFile() {}
+
+    OverflowFile(const OverflowFile &other) = delete;
+
+    OverflowFile &operator=(const OverflowFile &other) = delete;
+
+    /**
+     * Store a value as a new chain.
+     * @param value      the value
+     * @param page_size  the size of the blocks if the file has to be created
+     * @return           the pointer to keep in the row
+     */
+    virtual OverflowPointer write(const std::string &value, uint page_size);
+
+    // the value a pointer refers to
+    virtual std::string read(const OverflowPointer &pointer);
+
+    // give the chain's blocks back for reuse
+    virtual void free(const OverflowPointer &pointer);
+
+    virtual void close();
+
+    // remove the file, if it was ever created
+    virtual void drop();
+
+protected:
+    HeapFile file;
+    std::mutex free_mutex;
+    std::set<BlockID> free_blocks;
+    bool free_blocks_known;
+
+    virtual void open(uint page_size);
+
+    virtual BlockID allocate();
+};
+
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ *      Records are versioned (see mvcc.h): scans see the rows as of their snapshot, update and del end the
+ *      current version instead of overwriting it, and vacuum removes versions no snapshot can see.
+ *      In durable mode every change is logged (see wal.h) and each write commits before it returns.
+ *      TEXT values longer than a quarter of a page are stored out of line (see OverflowFile), leaving an
+ *      OverflowPointer in the row, so rows stay small whatever their text. Predicates and project fetch such a
+ *      value only when they use its column.
+ *      Pages are slotted (ROW layout) unless the table is created with the PAX layout: then each page keeps a
+ *      minipage per column, with the version headers as one more, and decode_block and decode_column read only
+ *      the columns they are asked for.
+ *      Fixed-width columns (every type but TEXT) are marshaled, unmarshaled and compared by their type's codec
+ *      (column_codec.h), looked up once per column when the table is constructed.
+ *      The per-row temporaries of insert, update and project (the marshaled record, the page it goes into or
+ *      comes from) are taken from the thread's scratch arena (arena.h) and freed with the row's ArenaScope.
  */
 
 class HeapTable : public DbRelation {
 public:
-    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+    enum PageLayout {
+        ROW,  // SlottedPage: each record's bytes together
+        PAX   // PaxPage: each column's values together
+    };
 
-    virtual ~HeapTable() {}
+    HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+              uint page_size = DbBlock::BLOCK_SZ);
+
+    virtual ~HeapTable();
 
     HeapTable(const HeapTable &other) = delete;
 
@@ -152,7 +575,16 @@ public:
 
     virtual Handle insert(const ValueDict *row);
 
-    virtual void update(const Handle handle, const ValueDict *new_values);
+    /**
+     * Insert many rows, filling each block before writing it out (one write per block, not per row).
+     * If a row fails, the rows before it stay in the table.
+     * @param rows    the rows, in order
+     * @param stored  if given, set to how many rows (from the first) are in the table, also when it throws
+     * @return        their handles, in the same order (freed by caller)
+     */
+    virtual Handles *insert_batch(const ValueDicts *rows, size_t *stored = nullptr);
+
+    virtual Handle update(const Handle handle, const ValueDict *new_values);
 
     virtual void del(const Handle handle);
 
@@ -160,21 +592,96 @@ public:
 
     virtual Handles *select(const ValueDict *where);
 
+    virtual Handles *select(const CompiledPredicate *predicate);
+
     virtual ValueDict *project(Handle handle);
 
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names);
 
+    // Block-at-a-time access for operators that decode pages themselves (e.g., parallel aggregation).
+    // Both may be called from several threads at once; decode_block only reads the buffer.
+    virtual BlockIDs *block_ids();
+
+    // buffer holds get_page_size() bytes
+    virtual void copy_block(BlockID block_id, char *buffer);
+
+    // column_names: the columns to decode (all of them if nullptr); values out of line are fetched only for these
+    virtual void decode_block(char *buffer, ValueDicts &rows, const CompiledPredicate *predicate = nullptr,
+                              const Snapshot *snapshot = nullptr, const ColumnNames *column_names = nullptr);
+
+    virtual size_t vacuum(TxnStamp horizon);
+
+    // the size of the table's blocks (and of copy_block's buffer)
+    virtual uint get_page_size();
+
+    /**
+     * Choose the page size for create() (an existing table keeps the size it was created with).
+     * @param page_size  a power of two from HeapFile::MIN_PAGE_SZ to HeapFile::MAX_PAGE_SZ
+     * @throws           DbRelationError if it is not
+     */
+    virtual void set_page_size(uint page_size);
+
+    // the layout of the table's pages (opens the table to learn it)
+    virtual PageLayout get_layout();
+
+    // choose the layout for create() (an existing table keeps the one it was created with)
+    virtual void set_layout(PageLayout layout);
+
+    /**
+     * Read one column of every visible row in a block previously fetched with copy_block. With the PAX
+     * layout only that column's minipage (and the version headers') is read.
+     * @param buffer       the block's bytes
+     * @param column_name  the column
+     * @param values       its values are appended here, in record order
+     * @param snapshot     as for decode_block
+     */
+    virtual void decode_column(char *buffer, const Identifier &column_name, std::vector<Value> &values,
+                               const Snapshot *snapshot = nullptr);
+
 protected:
     HeapFile file;
+    OverflowFile overflow;
+    std::vector<const CodecOps *> codecs;  // each column's
+
+    // TEXT values longer than this are stored out of line
+    static uint inline_text_limit(uint page_size) { return page_size / 4; }
+
+    // the fields of the table's records for PaxPage: the version header, then a field per column
+    virtual PaxPage::Fields pax_fields() const;
+
+    // decode a field in marshal format (a fixed-width value, or a TEXT value inline or out of line)
+    virtual Value unmarshal_field(const ColumnAttribute &column_attribute, const char *field);
+
+    // the PAX version of decode_block
+    virtual void decode_pax_block(PaxPage *block, ValueDicts &rows, const CompiledPredicate *predicate,
+                                  const Snapshot *snapshot, const ColumnNames *column_names);
 
-    virtual ValueDict *validate(const ValueDict *row);
+    // set matches[r - 1] for the records of a PaxPage the snapshot sees and the predicate (if any) accepts
+    virtual void filter_pax_block(PaxPage *block, const CompiledPredicate *predicate, const Snapshot &snapshot,
+                                  std::vector<u_int8_t> &matches);
 
-    virtual Handle append(const ValueDict *row);
+    // row itself if it has every column in its type, else converted, filled with the converted row
+    virtual const ValueDict *validate(const ValueDict *row, ValueDict &converted);
 
-    virtual Dbt *marshal(const ValueDict *row);
+    virtual Handle append(const Dbt *data);
 
-    virtual ValueDict *unmarshal(Dbt *data);
+    // clear the end stamp of a version an update ended but could not replace
+    virtual void reopen_version(const Handle handle);
+
+    // data points to the record, in the thread's scratch arena (see arena.h) until the caller's ArenaScope ends
+    virtual void marshal(const ValueDict *row, TxnStamp begin, Dbt &data);
+
+    // column_names: the columns to decode (all of them if nullptr)
+    virtual ValueDict *unmarshal(Dbt *data, const ColumnNames *column_names = nullptr);
+
+    // free the overflow chains a record points to (when its version is removed, or it was never added)
+    virtual void free_overflow(const Dbt *data);
 };
 
 bool test_heap_storage();
 bool test_slotted_page();
+bool test_heap_concurrency();
+bool test_overflow();
+bool test_pax_page();
+
+bool test_page_compression();
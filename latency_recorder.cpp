@@ -0,0 +1,60 @@
+/**
+ * @file   latency_recorder.cpp
+ * @brief  the implementation file for LatencyRecorder and BenchmarkReporter
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "latency_recorder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+using namespace std;
+
+
+void LatencyRecorder::merge(const LatencyRecorder &other) {
+    this->samples.insert(this->samples.end(), other.samples.begin(), other.samples.end());
+    this->total_ns += other.total_ns;
+    this->sorted = false;
+}
+
+u_int64_t LatencyRecorder::percentile(double p) {
+    if (this->samples.empty())
+        return 0;
+    if (!this->sorted) {
+        sort(this->samples.begin(), this->samples.end());
+        this->sorted = true;
+    }
+    size_t rank = (size_t) ceil(p / 100 * this->samples.size());
+    return this->samples[rank == 0 ? 0 : min(rank, this->samples.size()) - 1];
+}
+
+void LatencyRecorder::clear() {
+    this->samples.clear();
+    this->total_ns = 0;
+    this->sorted = false;
+}
+
+void BenchmarkReporter::report(const string &name, LatencyRecorder &latency, double seconds) {
+    if (seconds <= 0)
+        seconds = latency.get_total_ns() / 1e9;
+    size_t ops = latency.count();
+    double ops_per_sec = seconds > 0 ? ops / seconds : 0;
+    double mean_ns = ops ? (double) latency.get_total_ns() / ops : 0;
+    char line[512];
+    if (this->json) {
+        snprintf(line, sizeof(line),
+                 "{\"name\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mean_ns\": %.1f, "
+                 "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                 name.c_str(), ops, seconds, ops_per_sec, mean_ns,
+                 (unsigned long long) latency.percentile(50), (unsigned long long) latency.percentile(99),
+                 (unsigned long long) latency.percentile(99.9), (unsigned long long) latency.percentile(100));
+    } else {
+        if (!this->header_done)
+            this->out << "name\tops\tseconds\tops_per_sec\tmean_ns\tp50_ns\tp99_ns\tp999_ns\tmax_ns" << endl;
+        snprintf(line, sizeof(line), "%s\t%zu\t%.6f\t%.1f\t%.1f\t%llu\t%llu\t%llu\t%llu",
+                 name.c_str(), ops, seconds, ops_per_sec, mean_ns,
+                 (unsigned long long) latency.percentile(50), (unsigned long long) latency.percentile(99),
+                 (unsigned long long) latency.percentile(99.9), (unsigned long long) latency.percentile(100));
+    }
+    this->header_done = true;
+    this->out << line << endl;
+}
@@ -0,0 +1,85 @@
+/**
+ * @file   latency_recorder.h
+ * @brief  Latency sampling and machine-readable result lines for the benchmark drivers
+ *
+ * LatencyRecorder: per-operation latencies of one benchmark, with percentiles
+ * BenchmarkReporter: prints one result line per benchmark as TSV (with a header) or as JSON lines
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * @class LatencyRecorder - collects the latency of every operation of one benchmark
+ */
+class LatencyRecorder {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    LatencyRecorder() : total_ns(0), sorted(false) {}
+
+    virtual ~LatencyRecorder() {}
+
+    // time since start, recorded as one operation
+    void record(Clock::time_point start) {
+        record_ns((u_int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    void record_ns(u_int64_t ns) {
+        samples.push_back(ns);
+        total_ns += ns;
+    }
+
+    // fold another recorder's samples into this one (e.g. from another thread)
+    virtual void merge(const LatencyRecorder &other);
+
+    virtual size_t count() const { return samples.size(); }
+
+    virtual u_int64_t get_total_ns() const { return total_ns; }
+
+    /**
+     * Latency at a percentile (nearest rank).
+     * @param p  percentile in [0, 100]
+     * @returns  nanoseconds (0 if nothing was recorded)
+     */
+    virtual u_int64_t percentile(double p);
+
+    virtual void clear();
+
+protected:
+    std::vector<u_int64_t> samples;
+    u_int64_t total_ns;
+    bool sorted;
+};
+
+/**
+ * @class BenchmarkReporter - prints benchmark results in a stable, machine-readable format
+ *
+ *      TSV:  name ops seconds ops_per_sec mean_ns p50_ns p99_ns p999_ns max_ns
+ *      JSON: {"name": ..., "ops": ..., ...} one object per line
+ */
+class BenchmarkReporter {
+public:
+    BenchmarkReporter(std::ostream &out, bool json) : out(out), json(json), header_done(false) {}
+
+    virtual ~BenchmarkReporter() {}
+
+    /**
+     * Print one result.
+     * @param name     benchmark name, e.g. "slotted_page.add/size=64"
+     * @param latency  the per-operation latencies
+     * @param seconds  wall-clock time of the run (defaults to the sum of the latencies)
+     */
+    virtual void report(const std::string &name, LatencyRecorder &latency, double seconds = 0);
+
+protected:
+    std::ostream &out;
+    bool json;
+    bool header_done;
+};
@@ -0,0 +1,375 @@
+/**
+ * @file   mvcc.cpp
+ * @brief  the implementation file for VersionClock, VersionWrite, Snapshot and VersionCollector
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "mvcc.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "heap_storage.h"
+using namespace std;
+
+
+/**
+ * The clock. last is the newest stamp handed out; stamps up to reserved are recorded in _mvcc_clock.db
+ * (reserved is 0 until the clock has been read from there). writing holds the stamps of writes in
+ * progress, snapshots the as_of of every open snapshot.
+ */
+struct ClockState {
+    mutex lock;
+    TxnStamp last = 0;
+    TxnStamp reserved = 0;
+    set<TxnStamp> writing;
+    multiset<TxnStamp> snapshots;
+};
+
+// never destroyed, so tables written during static destruction are safe
+static ClockState &clock_state() {
+    static ClockState *state = new ClockState();
+    return *state;
+}
+
+/**
+ * Read the clock from the environment the first time, then record the next block of stamps as used.
+ * A restart continues after the last block recorded, which is past any stamp written to a table.
+ */
+static void reserve(ClockState &state) {
+    Db db(_DB_ENV, 0);
+    db.open(nullptr, "_mvcc_clock.db", nullptr, DB_RECNO, DB_CREATE, 0644);
+    u_int32_t record_number = 1;
+    Dbt key(&record_number, sizeof(record_number));
+    if (state.reserved == 0) {
+        TxnStamp saved = 0;
+        Dbt data(&saved, sizeof(saved));
+        data.set_ulen(sizeof(saved));
+        data.set_flags(DB_DBT_USERMEM);
+        if (db.get(nullptr, &key, &data, 0) == 0)
+            state.last = state.reserved = saved;
+    }
+    state.reserved += VersionClock::RESERVE;
+    Dbt data(&state.reserved, sizeof(state.reserved));
+    db.put(nullptr, &key, &data, 0);
+    db.sync(0);
+    db.close(0);
+}
+
+static TxnStamp horizon_locked(ClockState &state) {
+    if (state.reserved == 0)
+        reserve(state);
+    return state.writing.empty() ? state.last : *state.writing.begin() - 1;
+}
+
+// which tables the collector looks after, and its thread
+struct CollectorState {
+    mutex lock;   // held for the table set and for a whole pass
+    set<HeapTable *> tables;
+    mutex thread_lock;
+    condition_variable wake;
+    bool stopping = false;
+    thread *collector = nullptr;
+};
+
+static CollectorState &collector_state() {
+    static CollectorState *state = new CollectorState();
+    return *state;
+}
+
+thread_local Snapshot *Snapshot::current_snapshot = nullptr;
+
+/**
+ * Testing function for MVCC.
+ * Snapshot isolation against writes from another thread, seeing one's own writes, garbage collection
+ * respecting open snapshots, and scans that never see a row twice (or not at all) while it is updated.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_mvcc() {
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_mvcc_cpp", column_names, column_attributes);
+    table.create();
+    auto failed = [&table](string message) {
+        cout << "FAILED TEST: " << message << endl;
+        table.drop();
+        return false;
+    };
+    // the table's rows as a -> b, as seen by this thread now
+    auto contents = [&table]() {
+        map<int, string> rows;
+        Handles *handles = table.select();
+        for (auto const &handle: *handles) {
+            ValueDict *row = table.project(handle);
+            rows[(*row)["a"].n] = (*row)["b"].s;
+            delete row;
+        }
+        delete handles;
+        return rows;
+    };
+
+    ValueDict row;
+    for (int a = 1; a <= 3; a++) {
+        row["a"] = Value(a);
+        row["b"] = Value("v1");
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+    Handle first = (*handles)[0], second = (*handles)[1];
+    delete handles;
+    {
+        Snapshot snapshot;
+        thread writer([&]() {
+            ValueDict changes;
+            changes["b"] = Value("v2");
+            table.update(first, &changes);
+            table.del(second);
+            ValueDict added;
+            added["a"] = Value(4);
+            added["b"] = Value("v1");
+            table.insert(&added);
+        });
+        writer.join();
+        map<int, string> seen = contents();
+        if (seen.size() != 3 || seen[1] != "v1" || seen[2] != "v1")
+            return failed("snapshot saw another thread's later writes");
+        if (table.vacuum(VersionClock::oldest_snapshot()) != 0)
+            return failed("vacuum removed versions an open snapshot can see");
+
+        row["a"] = Value(5);
+        table.insert(&row);
+        if (contents().count(5) != 1)
+            return failed("snapshot did not see its own insert");
+        try {
+            ValueDict changes;
+            changes["b"] = Value("v3");
+            table.update(first, &changes);
+            return failed("update of a row already replaced did not conflict");
+        } catch (DbRelationError &e) {
+        }
+    }
+    map<int, string> now = contents();
+    if (now.size() != 4 || now[1] != "v2" || now.count(2) != 0 || now.count(4) != 1)
+        return failed("new snapshot did not see the committed writes");
+    size_t removed = table.vacuum(VersionClock::oldest_snapshot());
+    if (removed != 2)
+        return failed("vacuum removed " + to_string(removed) + " versions, expected 2");
+    if (contents() != now)
+        return failed("vacuum changed what a scan sees");
+
+    // readers scanning while every row is updated over and over must always see each row exactly once
+    const int num_rows = 200;
+    for (int a = 6; a < 6 + num_rows - (int) now.size(); a++) {
+        row["a"] = Value(a);
+        table.insert(&row);
+    }
+    atomic<bool> updating(true);
+    atomic<int> bad_scans(0);
+    thread reader([&]() {
+        do {
+            Snapshot snapshot;
+            map<int, string> seen;
+            size_t count = 0;
+            Handles *scan = table.select();
+            for (auto const &handle: *scan) {
+                ValueDict *values = table.project(handle);
+                seen[(*values)["a"].n] = (*values)["b"].s;
+                count++;
+                delete values;
+            }
+            delete scan;
+            if (count != (size_t) num_rows || seen.size() != (size_t) num_rows)
+                bad_scans++;
+        } while (updating);
+    });
+    VersionCollector::start(1);
+    for (int round = 0; round < 5; round++) {
+        Handles *current = table.select();
+        for (auto const &handle: *current) {
+            ValueDict changes;
+            changes["b"] = Value("round " + to_string(round));
+            table.update(handle, &changes);
+        }
+        delete current;
+    }
+    updating = false;
+    reader.join();
+    VersionCollector::stop();
+    if (bad_scans > 0)
+        return failed(to_string(bad_scans) + " scans saw a row twice or not at all");
+    table.drop();
+    return true;
+}
+
+
+/*****************************************VersionClock*************************************************************/
+
+TxnStamp VersionClock::begin_write() {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    if (state.reserved == 0 || state.last == state.reserved)
+        reserve(state);
+    TxnStamp stamp = ++state.last;
+    state.writing.insert(stamp);
+    return stamp;
+}
+
+void VersionClock::end_write(TxnStamp stamp) {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    state.writing.erase(stamp);
+}
+
+TxnStamp VersionClock::horizon() {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    return horizon_locked(state);
+}
+
+TxnStamp VersionClock::open_snapshot() {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    TxnStamp as_of = horizon_locked(state);
+    state.snapshots.insert(as_of);
+    return as_of;
+}
+
+void VersionClock::close_snapshot(TxnStamp as_of) {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    auto it = state.snapshots.find(as_of);
+    if (it != state.snapshots.end())
+        state.snapshots.erase(it);
+}
+
+TxnStamp VersionClock::oldest_snapshot() {
+    ClockState &state = clock_state();
+    lock_guard<mutex> guard(state.lock);
+    TxnStamp horizon = horizon_locked(state);
+    return state.snapshots.empty() ? horizon : min(horizon, *state.snapshots.begin());
+}
+
+
+/*****************************************VersionWrite*************************************************************/
+
+VersionWrite::VersionWrite() : stamp(VersionClock::begin_write()) {
+}
+
+// publish the write, and let this thread's snapshot see it
+VersionWrite::~VersionWrite() {
+    VersionClock::end_write(this->stamp);
+    Snapshot::wrote(this->stamp);
+}
+
+
+/*****************************************Snapshot*****************************************************************/
+
+Snapshot::Snapshot() : outer(current_snapshot), as_of(0), own() {
+    if (this->outer == nullptr) {
+        this->as_of = VersionClock::open_snapshot();
+        current_snapshot = this;
+    }
+}
+
+Snapshot::~Snapshot() {
+    if (this->outer == nullptr) {
+        VersionClock::close_snapshot(this->as_of);
+        current_snapshot = nullptr;
+    }
+}
+
+/**
+ * A version is visible if the write that began it is, and the write that ended it (if any) is not
+ * @param header  the version's stamps
+ */
+bool Snapshot::visible(const VersionHeader &header) const {
+    const Snapshot &snapshot = root();
+    bool begun = header.begin <= snapshot.as_of || snapshot.seen(header.begin);
+    bool ended = header.end != 0 && (header.end <= snapshot.as_of || snapshot.seen(header.end));
+    return begun && !ended;
+}
+
+// whether a write after as_of was made by this snapshot's own thread
+bool Snapshot::seen(TxnStamp stamp) const {
+    return stamp > this->as_of && find(this->own.begin(), this->own.end(), stamp) != this->own.end();
+}
+
+const Snapshot *Snapshot::current() {
+    return current_snapshot;
+}
+
+void Snapshot::wrote(TxnStamp stamp) {
+    if (current_snapshot != nullptr)
+        current_snapshot->own.push_back(stamp);
+}
+
+
+/*****************************************VersionCollector*********************************************************/
+
+void VersionCollector::start(uint interval_ms) {
+    CollectorState &state = collector_state();
+    lock_guard<mutex> guard(state.thread_lock);
+    if (state.collector != nullptr)
+        return;
+    state.stopping = false;
+    state.collector = new thread([&state, interval_ms]() {
+        unique_lock<mutex> wait_lock(state.thread_lock);
+        while (!state.wake.wait_for(wait_lock, chrono::milliseconds(interval_ms), [&state]() {
+            return state.stopping;
+        })) {
+            wait_lock.unlock();
+            try {
+                collect();
+            } catch (exception &e) {
+                cerr << "version collector: " << e.what() << endl;
+            }
+            wait_lock.lock();
+        }
+    });
+}
+
+void VersionCollector::stop() {
+    CollectorState &state = collector_state();
+    thread *collector;
+    {
+        lock_guard<mutex> guard(state.thread_lock);
+        collector = state.collector;
+        state.collector = nullptr;
+        state.stopping = true;
+    }
+    state.wake.notify_all();
+    if (collector != nullptr) {
+        collector->join();
+        delete collector;
+    }
+}
+
+size_t VersionCollector::collect() {
+    CollectorState &state = collector_state();
+    lock_guard<mutex> guard(state.lock);
+    TxnStamp horizon = VersionClock::oldest_snapshot();
+    size_t removed = 0;
+    for (auto table: state.tables)
+        removed += table->vacuum(horizon);
+    return removed;
+}
+
+void VersionCollector::add(HeapTable *table) {
+    CollectorState &state = collector_state();
+    lock_guard<mutex> guard(state.lock);
+    state.tables.insert(table);
+}
+
+void VersionCollector::remove(HeapTable *table) {
+    CollectorState &state = collector_state();
+    lock_guard<mutex> guard(state.lock);
+    state.tables.erase(table);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file   mvcc.h
+ * @brief  Multi-version concurrency control for HeapTable: write stamps, snapshots, and garbage collection
+ *
+ * Every HeapTable record starts with a VersionHeader: the stamp of the write that created the version
+ * (begin) and of the write that deleted or replaced it (end, 0 while it is current). Updates add a new
+ * version rather than changing the old one in place, and deletes only set end, so a scan reads the table
+ * as of its snapshot without waiting for writers: a version is visible if it was begun, and not ended,
+ * by a write published before the snapshot was taken (or by the snapshot's own thread).
+ *
+ * VersionClock: hands out and publishes write stamps; knows the oldest live snapshot
+ * VersionWrite: one write, from taking its stamp to publishing it
+ * Snapshot: while in scope, reads on this thread see the tables as of its start
+ * VersionCollector: removes versions no snapshot can see any more (on demand, or on a background thread)
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <cstring>
+#include <vector>
+
+typedef u_int32_t TxnStamp;
+
+class HeapTable;
+
+/**
+ * @class VersionHeader - the first bytes of every HeapTable record
+ */
+struct VersionHeader {
+    TxnStamp begin;   // the write that created this version
+    TxnStamp end;     // the write that deleted or replaced it (0: still current)
+
+    static const uint SIZE = 2 * sizeof(TxnStamp);
+
+    // read and write the header at the front of a record (which need not be aligned)
+    static VersionHeader read(const void *record) {
+        VersionHeader header;
+        memcpy(&header, record, SIZE);
+        return header;
+    }
+
+    void write(void *record) const { memcpy(record, this, SIZE); }
+};
+
+/**
+ * @class VersionClock - the source of write stamps
+ *
+ *      Stamps are handed out in increasing order but writes finish in any order, so a snapshot only
+ *      trusts stamps below the oldest write still in progress (the horizon). Stamps are reserved in blocks
+ *      recorded in the environment's _mvcc_clock.db, so stamps on disk stay below the clock across restarts.
+ */
+class VersionClock {
+public:
+    static const TxnStamp RESERVE = 1 << 16;
+
+    // start a write: its stamp (not yet visible to anyone else)
+    static TxnStamp begin_write();
+
+    // the write is done; snapshots taken from now on may see it
+    static void end_write(TxnStamp stamp);
+
+    // every write stamped at or below this is published
+    static TxnStamp horizon();
+
+    // a snapshot as of the horizon, counted until closed
+    static TxnStamp open_snapshot();
+
+    static void close_snapshot(TxnStamp as_of);
+
+    // no live or future snapshot can see a version ended at or below this
+    static TxnStamp oldest_snapshot();
+};
+
+/**
+ * @class VersionWrite - a write's stamp, published when it goes out of scope (also if the write throws)
+ */
+class VersionWrite {
+public:
+    VersionWrite();
+
+    virtual ~VersionWrite();
+
+    VersionWrite(const VersionWrite &other) = delete;
+
+    VersionWrite &operator=(const VersionWrite &other) = delete;
+
+    TxnStamp get_stamp() const { return stamp; }
+
+protected:
+    TxnStamp stamp;
+};
+
+/**
+ * @class Snapshot - a consistent view of the tables for the reads on one thread
+ *
+ *      A Snapshot made while another is in scope on the same thread joins it, so a statement's snapshot
+ *      covers all the scans inside it. Writes made on the thread while it is in scope are visible to it.
+ *      Other threads may check visibility against it (e.g., aggregation workers) while it is in scope.
+ */
+class Snapshot {
+public:
+    Snapshot();
+
+    virtual ~Snapshot();
+
+    Snapshot(const Snapshot &other) = delete;
+
+    Snapshot &operator=(const Snapshot &other) = delete;
+
+    // whether the version with this header is part of the snapshot
+    virtual bool visible(const VersionHeader &header) const;
+
+    TxnStamp get_as_of() const { return root().as_of; }
+
+    // the innermost snapshot in scope on this thread (nullptr if none)
+    static const Snapshot *current();
+
+    // record a write made on this thread, so its snapshot sees it
+    static void wrote(TxnStamp stamp);
+
+protected:
+    Snapshot *outer;               // the snapshot this one joined
+    TxnStamp as_of;
+    std::vector<TxnStamp> own;     // writes made on this thread since the snapshot was taken
+
+    const Snapshot &root() const { return outer ? *outer : *this; }
+
+    bool seen(TxnStamp stamp) const;
+
+    static thread_local Snapshot *current_snapshot;
+};
+
+/**
+ * @class VersionCollector - the garbage collector for dead versions
+ *
+ *      HeapTables register while their files are open. Each pass vacuums every registered table with
+ *      VersionClock::oldest_snapshot() as the horizon: versions ended at or below it are removed from
+ *      their blocks.
+ */
+class VersionCollector {
+public:
+    static const uint DEFAULT_INTERVAL_MS = 1000;
+
+    // run a pass every interval on a background thread
+    static void start(uint interval_ms = DEFAULT_INTERVAL_MS);
+
+    // stop the background thread (waits for a pass in progress)
+    static void stop();
+
+    // run a pass now; returns the number of versions removed
+    static size_t collect();
+
+    static void add(HeapTable *table);
+
+    // after this returns no pass is using the table
+    static void remove(HeapTable *table);
+};
+
+bool test_mvcc();
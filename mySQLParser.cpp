@@ -171,6 +171,9 @@ namespace myhsql{
             case kExprLiteralInt:
                 res << to_string(expr->ival);
                 break;
+            case kExprPlaceholder:
+                res << "?";
+                break;
             case kExprFunctionRef:
                 res << expr->name << "?" << expr->expr->name;
                 break;
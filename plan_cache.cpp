@@ -0,0 +1,416 @@
+/**
+ * @file   plan_cache.cpp
+ * @brief  the implementation file for CachedPlan and PlanCache
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "plan_cache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+using namespace std;
+using namespace hsql;
+
+
+/**
+ * Testing function for PlanCache.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_plan_cache() {
+    SQLLiterals literals;
+    string normalized = PlanCache::normalize("select *  from t1\n where a = 12 and b = 'it''s' or c < 1.5e3 ; ", literals);
+    if (normalized != "select * from t1 where a = ? and b = ? or c < ?")
+        return cout << "FAILED TEST: normalize gave " << normalized << endl, false;
+    if (literals.size() != 3 || literals[0].kind != SQLLiteral::INT || literals[0].text != "12"
+        || literals[1].kind != SQLLiteral::STRING || literals[1].text != "it's"
+        || literals[2].kind != SQLLiteral::FLOAT)
+        return cout << "FAILED TEST: normalize literals" << endl, false;
+
+    PlanCache cache(2);
+    CachedPlanPtr first = cache.get("SELECT a FROM t WHERE a = 1");
+    CachedPlanPtr second = cache.get("SELECT a FROM t WHERE a = 2");
+    if (first == nullptr || second != first || cache.hits != 1 || cache.misses != 1)
+        return cout << "FAILED TEST: repeated statement was not served from the cache" << endl, false;
+    const SelectStatement *select = (const SelectStatement *) second->parsed->getStatement(0);
+    if (select->whereClause->expr2->type != kExprLiteralInt || select->whereClause->expr2->ival != 2)
+        return cout << "FAILED TEST: literal was not bound into the cached plan" << endl, false;
+
+    cache.get("SELECT b FROM t");
+    cache.get("SELECT c FROM t");
+    if (cache.evictions != 1)
+        return cout << "FAILED TEST: LRU eviction" << endl, false;
+
+    if (!cache.prepare("q", "SELECT a FROM t WHERE a = ? AND b = 'x'"))
+        return cout << "FAILED TEST: prepare" << endl, false;
+    CachedPlanPtr executed = cache.execute("q", "7");
+    select = (const SelectStatement *) executed->parsed->getStatement(0);
+    if (select->whereClause->expr->expr2->ival != 7 || string(select->whereClause->expr2->expr2->name) != "x")
+        return cout << "FAILED TEST: execute bound the wrong values" << endl, false;
+    try {
+        cache.execute("q", "7, 8");
+        return cout << "FAILED TEST: execute with too many arguments" << endl, false;
+    } catch (invalid_argument &e) {
+        // expected
+    }
+    return cache.deallocate("q") && !cache.deallocate("q");
+}
+
+/*****************************************Placeholders**************************************************************/
+
+static void collect_placeholders(Expr *expr, vector<Expr *> &placeholders);
+
+static void collect_placeholders(const SelectStatement *stmt, vector<Expr *> &placeholders);
+
+static void collect_placeholders(TableRef *table, vector<Expr *> &placeholders) {
+    if (table == nullptr)
+        return;
+    switch (table->type) {
+        case kTableSelect:
+            collect_placeholders(table->select, placeholders);
+            break;
+        case kTableJoin:
+            collect_placeholders(table->join->left, placeholders);
+            collect_placeholders(table->join->right, placeholders);
+            collect_placeholders(table->join->condition, placeholders);
+            break;
+        case kTableCrossProduct:
+            for (TableRef *tbl : *table->list)
+                collect_placeholders(tbl, placeholders);
+            break;
+        default:
+            break;
+    }
+}
+
+static void collect_placeholders(Expr *expr, vector<Expr *> &placeholders) {
+    if (expr == nullptr)
+        return;
+    if (expr->type == kExprPlaceholder)
+        placeholders.push_back(expr);
+    collect_placeholders(expr->expr, placeholders);
+    collect_placeholders(expr->expr2, placeholders);
+}
+
+static void collect_placeholders(const SelectStatement *stmt, vector<Expr *> &placeholders) {
+    if (stmt == nullptr)
+        return;
+    for (Expr *expr : *stmt->selectList)
+        collect_placeholders(expr, placeholders);
+    collect_placeholders(stmt->fromTable, placeholders);
+    collect_placeholders(stmt->whereClause, placeholders);
+    if (stmt->groupBy != nullptr) {
+        if (stmt->groupBy->columns != nullptr)
+            for (Expr *expr : *stmt->groupBy->columns)
+                collect_placeholders(expr, placeholders);
+        collect_placeholders(stmt->groupBy->having, placeholders);
+    }
+}
+
+// Find every placeholder in a statement
+static void collect_placeholders(const SQLStatement *stmt, vector<Expr *> &placeholders) {
+    switch (stmt->type()) {
+        case kStmtSelect:
+            collect_placeholders((const SelectStatement *) stmt, placeholders);
+            break;
+        case kStmtInsert: {
+            const InsertStatement *insert = (const InsertStatement *) stmt;
+            if (insert->values != nullptr)
+                for (Expr *expr : *insert->values)
+                    collect_placeholders(expr, placeholders);
+            collect_placeholders(insert->select, placeholders);
+            break;
+        }
+        case kStmtUpdate: {
+            const UpdateStatement *update = (const UpdateStatement *) stmt;
+            for (UpdateClause *clause : *update->updates)
+                collect_placeholders(clause->value, placeholders);
+            collect_placeholders(update->where, placeholders);
+            break;
+        }
+        case kStmtDelete:
+            collect_placeholders(((const DeleteStatement *) stmt)->expr, placeholders);
+            break;
+        default:
+            break;
+    }
+}
+
+/*****************************************CachedPlan****************************************************************/
+
+/**
+ * Constructor for CachedPlan
+ * @param normalized    the normalized SQL text (the cache key)
+ * @param parsed        the parse of the normalized text (owned by this plan from now on)
+ * @param parameterized true if parsed has one placeholder per literal of the key
+ */
+CachedPlan::CachedPlan(string normalized, SQLParserResult *parsed, bool parameterized) :
+        normalized(normalized), parsed(parsed), parameterized(parameterized), placeholders() {
+    if (parsed == nullptr)
+        return;
+    for (size_t i = 0; i < parsed->size(); i++)
+        collect_placeholders(parsed->getStatement(i), this->placeholders);
+    // the parser numbers placeholders by their position in the text
+    stable_sort(this->placeholders.begin(), this->placeholders.end(),
+                [](const Expr *a, const Expr *b) { return a->ival < b->ival; });
+}
+
+CachedPlan::~CachedPlan() {
+    delete this->parsed;
+}
+
+/**
+ * Overwrite the placeholders with literal values
+ * @param literals the values, in textual order
+ */
+void CachedPlan::bind(const SQLLiterals &literals) {
+    for (size_t i = 0; i < this->placeholders.size(); i++) {
+        Expr *expr = this->placeholders[i];
+        const SQLLiteral &literal = literals[i];
+        free(expr->name);
+        expr->name = nullptr;
+        switch (literal.kind) {
+            case SQLLiteral::INT:
+                expr->type = kExprLiteralInt;
+                expr->ival = strtoll(literal.text.c_str(), nullptr, 10);
+                break;
+            case SQLLiteral::FLOAT:
+                expr->type = kExprLiteralFloat;
+                expr->fval = strtod(literal.text.c_str(), nullptr);
+                break;
+            case SQLLiteral::STRING:
+                expr->type = kExprLiteralString;
+                expr->name = strdup(literal.text.c_str());
+                break;
+            case SQLLiteral::PARAMETER:
+                throw invalid_argument("unbound parameter");
+        }
+    }
+}
+
+/*****************************************PlanCache*****************************************************************/
+
+/**
+ * Constructor for PlanCache
+ * @param capacity most normalized statements kept
+ */
+PlanCache::PlanCache(size_t capacity) : hits(0), misses(0), bypassed(0), evictions(0),
+                                        capacity(capacity ? capacity : 1), lru(), index(), prepared() {
+}
+
+/**
+ * Get the parse of an ad-hoc statement with its literals bound
+ * @param sql the statement text
+ * @return the bound plan, or nullptr if the SQL is invalid
+ */
+CachedPlanPtr PlanCache::get(const string &sql) {
+    SQLLiterals literals;
+    string normalized = normalize(sql, literals);
+    bool has_parameters = false;
+    for (auto const &literal: literals)
+        has_parameters |= literal.kind == SQLLiteral::PARAMETER;
+
+    CachedPlanPtr plan = has_parameters ? nullptr : lookup(normalized, literals.size());
+    if (plan != nullptr && plan->parameterized) {
+        plan->bind(literals);
+        return plan;
+    }
+    // the statement can't be served from a parameterized parse, so parse it as written
+    this->bypassed++;
+    SQLParserResult *parsed = SQLParser::parseSQLString(sql);
+    if (!parsed->isValid()) {
+        delete parsed;
+        return nullptr;
+    }
+    return make_shared<CachedPlan>(normalized, parsed, false);
+}
+
+/**
+ * PREPARE name FROM 'sql'
+ * @param name the statement's name (replaces any previous statement with this name)
+ * @param sql  the statement, with '?' for parameters
+ * @return false if the SQL is invalid or can't take parameters
+ */
+bool PlanCache::prepare(const string &name, const string &sql) {
+    SQLLiterals literals;
+    string normalized = normalize(sql, literals);
+    CachedPlanPtr plan = lookup(normalized, literals.size());
+    if (plan == nullptr || !plan->parameterized)
+        return false;
+    Prepared statement;
+    statement.plan = plan;
+    statement.literals = literals;
+    this->prepared[name] = statement;
+    return true;
+}
+
+/**
+ * EXECUTE name (arguments)
+ * @param name      a prepared statement
+ * @param arguments comma-separated SQL literals for its parameters
+ * @return the plan with parameters and the statement's own literals bound
+ */
+CachedPlanPtr PlanCache::execute(const string &name, const string &arguments) {
+    auto found = this->prepared.find(name);
+    if (found == this->prepared.end())
+        throw invalid_argument("unknown prepared statement " + name);
+    SQLLiterals values;
+    normalize(arguments, values);
+    SQLLiterals literals = found->second.literals;
+    size_t next = 0;
+    for (auto &literal: literals) {
+        if (literal.kind != SQLLiteral::PARAMETER)
+            continue;
+        if (next >= values.size() || values[next].kind == SQLLiteral::PARAMETER)
+            throw invalid_argument("not enough values for " + name);
+        literal = values[next++];
+    }
+    if (next != values.size())
+        throw invalid_argument("too many values for " + name);
+    this->hits++;
+    found->second.plan->bind(literals);
+    return found->second.plan;
+}
+
+// DEALLOCATE PREPARE name
+bool PlanCache::deallocate(const string &name) {
+    return this->prepared.erase(name) > 0;
+}
+
+// Counters as one line of text
+string PlanCache::stats() const {
+    stringstream res;
+    u_int64_t lookups = this->hits + this->misses;
+    res << "plan cache: " << this->hits << " hits, " << this->misses << " misses (" << fixed << setprecision(1)
+        << (lookups ? 100.0 * this->hits / lookups : 0.0) << "% hit rate), " << this->bypassed << " bypassed, "
+        << this->evictions << " evictions, " << this->lru.size() << "/" << this->capacity << " entries, "
+        << this->prepared.size() << " prepared";
+    return res.str();
+}
+
+void PlanCache::reset_stats() {
+    this->hits = this->misses = this->bypassed = this->evictions = 0;
+}
+
+/**
+ * Find (or parse and insert) the plan for a normalized statement
+ * @param normalized   the normalized text
+ * @param num_literals how many placeholders the parse must have to be reusable
+ * @return the plan, or nullptr if the statement is invalid SQL
+ */
+CachedPlanPtr PlanCache::lookup(const string &normalized, size_t num_literals) {
+    auto found = this->index.find(normalized);
+    if (found != this->index.end()) {
+        this->lru.splice(this->lru.begin(), this->lru, found->second);
+        if ((*found->second)->parameterized)
+            this->hits++;
+        return *found->second;
+    }
+    this->misses++;
+    SQLParserResult *parsed = SQLParser::parseSQLString(normalized);
+    CachedPlanPtr plan;
+    if (parsed->isValid()) {
+        plan = make_shared<CachedPlan>(normalized, parsed, true);
+        plan->parameterized = plan->num_placeholders() == num_literals;
+    } else {
+        delete parsed;
+        if (num_literals == 0)
+            return nullptr;  // nothing was replaced, so the statement itself is invalid
+        // some literal sits where the grammar doesn't allow a '?'; remember to parse these as written
+        plan = make_shared<CachedPlan>(normalized, nullptr, false);
+    }
+    this->lru.push_front(plan);
+    this->index[normalized] = this->lru.begin();
+    if (this->lru.size() > this->capacity) {
+        this->index.erase(this->lru.back()->normalized);
+        this->lru.pop_back();
+        this->evictions++;
+    }
+    return plan;
+}
+
+/**
+ * Normalize SQL text so statements differing only in literals share a key
+ * @param sql      the statement text
+ * @param literals receives the literals in textual order
+ * @return the normalized text
+ */
+string PlanCache::normalize(const string &sql, SQLLiterals &literals) {
+    string res;
+    size_t i = 0, n = sql.length();
+    bool pending_space = false;
+    while (i < n) {
+        char c = sql[i];
+        if (isspace((unsigned char) c)) {
+            pending_space = !res.empty();
+            i++;
+            continue;
+        }
+        if (c == '-' && i + 1 < n && sql[i + 1] == '-') {
+            while (i < n && sql[i] != '\n')
+                i++;
+            continue;
+        }
+        if (pending_space) {
+            res += ' ';
+            pending_space = false;
+        }
+        char previous = res.empty() ? ' ' : res[res.length() - 1];
+        bool in_identifier = isalnum((unsigned char) previous) || previous == '_';
+        if (c == '\'') {
+            string text;
+            for (i++; i < n; i++) {
+                if (sql[i] == '\'') {
+                    if (i + 1 < n && sql[i + 1] == '\'') {
+                        text += '\'';
+                        i++;
+                    } else {
+                        break;
+                    }
+                } else {
+                    text += sql[i];
+                }
+            }
+            i++;
+            literals.push_back(SQLLiteral(SQLLiteral::STRING, text));
+            res += '?';
+        } else if (c == '"') {
+            // quoted identifier: copy through
+            size_t end = sql.find('"', i + 1);
+            end = end == string::npos ? n : end + 1;
+            res.append(sql, i, end - i);
+            i = end;
+        } else if (!in_identifier && (isdigit((unsigned char) c)
+                                      || (c == '.' && i + 1 < n && isdigit((unsigned char) sql[i + 1])))) {
+            size_t start = i;
+            bool is_float = false;
+            while (i < n && (isdigit((unsigned char) sql[i]) || sql[i] == '.')) {
+                is_float |= sql[i] == '.';
+                i++;
+            }
+            if (i < n && (sql[i] == 'e' || sql[i] == 'E')) {
+                size_t exponent = i + 1;
+                if (exponent < n && (sql[exponent] == '+' || sql[exponent] == '-'))
+                    exponent++;
+                if (exponent < n && isdigit((unsigned char) sql[exponent])) {
+                    is_float = true;
+                    for (i = exponent; i < n && isdigit((unsigned char) sql[i]); i++);
+                }
+            }
+            literals.push_back(SQLLiteral(is_float ? SQLLiteral::FLOAT : SQLLiteral::INT, sql.substr(start, i - start)));
+            res += '?';
+        } else if (c == '?') {
+            literals.push_back(SQLLiteral(SQLLiteral::PARAMETER, "?"));
+            res += '?';
+            i++;
+        } else {
+            res += c;
+            i++;
+        }
+    }
+    while (!res.empty() && (res[res.length() - 1] == ';' || res[res.length() - 1] == ' '))
+        res.erase(res.length() - 1);
+    return res;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file   plan_cache.h
+ * @brief  LRU cache of parsed statements keyed by normalized SQL, plus PREPARE/EXECUTE support
+ *
+ * SQL text is normalized by collapsing whitespace and replacing every literal with '?'. The normalized
+ * text is parsed once; later statements that differ only in their literals bind them into the cached
+ * parse tree's placeholders instead of going through hsql::SQLParser again.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SQLParser.h"
+
+/**
+ * @class SQLLiteral - a literal lifted out of SQL text by normalization (or a '?' parameter)
+ */
+class SQLLiteral {
+public:
+    enum Kind {
+        INT, FLOAT, STRING, PARAMETER
+    };
+
+    SQLLiteral(Kind kind, std::string text) : kind(kind), text(text) {}
+
+    Kind kind;
+    std::string text;  // unquoted for STRING
+};
+
+typedef std::vector<SQLLiteral> SQLLiterals;
+
+/**
+ * @class CachedPlan - the parse tree of one normalized statement and its placeholders in textual order
+ */
+class CachedPlan {
+public:
+    CachedPlan(std::string normalized, hsql::SQLParserResult *parsed, bool parameterized);
+
+    virtual ~CachedPlan();
+
+    CachedPlan(const CachedPlan &other) = delete;
+
+    CachedPlan &operator=(const CachedPlan &other) = delete;
+
+    /**
+     * Overwrite the placeholders with literal values (in textual order).
+     * @param literals  one value per placeholder; no PARAMETERs may remain
+     */
+    virtual void bind(const SQLLiterals &literals);
+
+    virtual size_t num_placeholders() const { return placeholders.size(); }
+
+    std::string normalized;
+    hsql::SQLParserResult *parsed;
+    bool parameterized;  // false if the normalized text didn't parse; then the raw text is parsed every time
+
+protected:
+    std::vector<hsql::Expr *> placeholders;
+};
+
+typedef std::shared_ptr<CachedPlan> CachedPlanPtr;
+
+/**
+ * @class PlanCache - LRU cache of CachedPlans with hit-rate counters
+ */
+class PlanCache {
+public:
+    static const size_t DEFAULT_CAPACITY = 128;
+
+    PlanCache(size_t capacity = DEFAULT_CAPACITY);
+
+    virtual ~PlanCache() {}
+
+    PlanCache(const PlanCache &other) = delete;
+
+    PlanCache &operator=(const PlanCache &other) = delete;
+
+    /**
+     * Get the parse of an ad-hoc statement, with its literals bound.
+     * @param sql  the statement text
+     * @returns    the bound plan, or nullptr if the SQL is invalid
+     */
+    virtual CachedPlanPtr get(const std::string &sql);
+
+    /**
+     * PREPARE name FROM 'sql' -- sql may contain '?' parameters.
+     * @returns  false if the SQL is invalid (or can't take parameters)
+     */
+    virtual bool prepare(const std::string &name, const std::string &sql);
+
+    /**
+     * EXECUTE name (values...)
+     * @param name       a prepared statement
+     * @param arguments  the values for its '?' parameters, as SQL literal text, e.g. "1, 'abc'"
+     * @returns          the bound plan
+     * @throws           std::invalid_argument for unknown statements or the wrong number of arguments
+     */
+    virtual CachedPlanPtr execute(const std::string &name, const std::string &arguments);
+
+    // DEALLOCATE PREPARE name; returns false if there was no such statement
+    virtual bool deallocate(const std::string &name);
+
+    // counters, e.g. "plan cache: 98 hits, 2 misses (98.0% hit rate), 0 bypassed, 0 evictions, 2/128 entries"
+    virtual std::string stats() const;
+
+    virtual void reset_stats();
+
+    /**
+     * Normalize SQL text: collapse whitespace, drop comments and a trailing ';', replace literals with '?'.
+     * @param sql       the statement text
+     * @param literals  receives the literals in textual order ('?' in the input gives a PARAMETER)
+     * @returns         the normalized text
+     */
+    static std::string normalize(const std::string &sql, SQLLiterals &literals);
+
+    u_int64_t hits;
+    u_int64_t misses;
+    u_int64_t bypassed;
+    u_int64_t evictions;
+
+protected:
+    struct Prepared {
+        CachedPlanPtr plan;
+        SQLLiterals literals;  // the statement's own literals, with PARAMETERs to fill at EXECUTE
+    };
+
+    size_t capacity;
+    std::list<CachedPlanPtr> lru;  // most recently used first
+    std::unordered_map<std::string, std::list<CachedPlanPtr>::iterator> index;
+    std::map<std::string, Prepared> prepared;
+
+    virtual CachedPlanPtr lookup(const std::string &normalized, size_t num_literals);
+};
+
+bool test_plan_cache();
@@ -0,0 +1,271 @@
+/**
+ * @file   read_ahead.cpp
+ * @brief  the implementation file for ReadAhead, and the read-ahead thread
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "read_ahead.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "engine_stats.h"
+#include "heap_storage.h"
+using namespace std;
+
+
+/**
+ * Testing function for ReadAhead.
+ * A forward scan that waits for the read-ahead after each block finds every block after the first few read
+ * ahead; scattered gets start nothing; a scan abandoned part way counts the rest of its window wasted; and
+ * nothing is read ahead while read-ahead is off.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_read_ahead() {
+    const BlockID NUM_BLOCKS = 100;
+    bool ok = true;
+    bool was_enabled = ReadAhead::enabled();
+    ReadAhead::set_enabled(true);
+    HeapFile file("_test_read_ahead");
+    file.create();
+    while (file.get_last_block_id() < NUM_BLOCKS)
+        delete file.get_new();
+    ReadAhead &read_ahead = file.get_read_ahead();
+
+    for (BlockID block_id = 1; block_id <= NUM_BLOCKS; block_id++) {
+        delete file.get(block_id);
+        read_ahead.wait();
+    }
+    ReadAheadStats stats = read_ahead.get_stats();
+    // blocks 1 to 3 set the stream off; every one after was read ahead, and the last window stops at the end
+    if (stats.prefetched != NUM_BLOCKS - 3 || stats.hits != NUM_BLOCKS - 3 || stats.wasted != 0) {
+        cout << "FAILED TEST: sequential scan read ahead " << stats.prefetched << " blocks with " << stats.hits
+             << " hits and " << stats.wasted << " wasted" << endl;
+        ok = false;
+    }
+
+    for (BlockID block_id: {50, 10, 90, 30, 70, 20}) {
+        delete file.get(block_id);
+        read_ahead.wait();
+    }
+    if (read_ahead.get_stats().prefetched != stats.prefetched) {
+        cout << "FAILED TEST: scattered gets were read ahead" << endl;
+        ok = false;
+    }
+
+    for (BlockID block_id = 40; block_id <= 42; block_id++)
+        delete file.get(block_id);
+    read_ahead.wait();
+    read_ahead.cancel();
+    ReadAheadStats abandoned = read_ahead.get_stats();
+    if (abandoned.prefetched != stats.prefetched + ReadAhead::MIN_WINDOW
+        || abandoned.wasted != ReadAhead::MIN_WINDOW) {
+        cout << "FAILED TEST: an abandoned scan wasted " << abandoned.wasted << " blocks" << endl;
+        ok = false;
+    }
+
+    ReadAhead::set_enabled(false);
+    for (BlockID block_id = 1; block_id <= 10; block_id++)
+        delete file.get(block_id);
+    read_ahead.wait();
+    if (read_ahead.get_stats().prefetched != abandoned.prefetched) {
+        cout << "FAILED TEST: read ahead while turned off" << endl;
+        ok = false;
+    }
+    ReadAhead::set_enabled(was_enabled);
+    file.drop();
+    return ok;
+}
+
+
+/*****************************************Read-ahead thread*********************************************************/
+
+namespace {
+
+// blocks first to last of a stream, still to be read
+struct ReadRequest {
+    ReadAhead *read_ahead;
+    uint stream;
+    u_int64_t generation;
+    BlockID next;
+    BlockID last;
+};
+
+/**
+ * The queue of blocks to read ahead, and its one thread. The thread reads a block of the request at the front
+ * and moves the request to the back, so scans of different files take turns.
+ */
+struct ReadAheadThread {
+    mutex lock;
+    condition_variable changed;  // a request was queued, or a block was read
+    deque<ReadRequest> queue;
+    ReadAhead *reading = nullptr;  // whose block the thread is reading
+    bool started = false;
+};
+
+// never destroyed: the thread waits on it until the process exits
+ReadAheadThread &read_ahead_thread() {
+    static ReadAheadThread *state = new ReadAheadThread();
+    return *state;
+}
+
+void run_read_ahead() {
+    ReadAheadThread &state = read_ahead_thread();
+    vector<char> buffer(HeapFile::MAX_PAGE_SZ);
+    unique_lock<mutex> lock(state.lock);
+    while (true) {
+        state.changed.wait(lock, [&state]() { return !state.queue.empty(); });
+        ReadRequest request = state.queue.front();
+        state.queue.pop_front();
+        if (request.next < request.last) {
+            ReadRequest rest = request;
+            rest.next++;
+            state.queue.push_back(rest);
+        }
+        state.reading = request.read_ahead;
+        lock.unlock();
+        if (request.read_ahead->wanted(request.stream, request.generation)) {
+            request.read_ahead->get_file().prefetch(request.next, buffer.data());
+            request.read_ahead->read_done(request.stream, request.generation, request.next);
+        }
+        lock.lock();
+        state.reading = nullptr;
+        state.changed.notify_all();
+    }
+}
+
+void queue_read(const ReadRequest &request) {
+    ReadAheadThread &state = read_ahead_thread();
+    lock_guard<mutex> lock(state.lock);
+    if (!state.started) {
+        thread(run_read_ahead).detach();
+        state.started = true;
+    }
+    state.queue.push_back(request);
+    state.changed.notify_all();
+}
+
+}
+
+
+/*****************************************ReadAhead*****************************************************************/
+
+atomic<bool> ReadAhead::on(true);
+
+ReadAhead::ReadAhead(HeapFile &file) : file(file), limit(MAX_WINDOW), clock(0) {}
+
+ReadAhead::~ReadAhead() {
+    cancel();
+}
+
+/**
+ * Find the stream block_id continues (or start one), count a hit if it was read ahead, and queue the blocks
+ * after it once the stream has gone far enough forward and the blocks queued so far are half gone
+ * @param block_id the block HeapFile::get is about to read
+ */
+void ReadAhead::on_read(BlockID block_id) {
+    if (!enabled())
+        return;
+    lock_guard<mutex> lock(this->stream_mutex);
+    this->clock++;
+    uint s = 0;
+    while (s < NUM_STREAMS && !(this->streams[s].last != 0 && block_id >= this->streams[s].last
+                                && block_id <= this->streams[s].last + NEAR_BLOCKS))
+        s++;
+    if (s == NUM_STREAMS) {
+        s = 0;
+        for (uint other = 1; other < NUM_STREAMS; other++)
+            if (this->streams[other].used < this->streams[s].used)
+                s = other;
+        end(this->streams[s]);
+        this->streams[s].last = block_id;
+        this->streams[s].used = this->clock;
+        return;
+    }
+    Stream &stream = this->streams[s];
+    stream.used = this->clock;
+    if (block_id == stream.last)
+        return;  // the same block again, as inserts into the last block do
+    if (stream.first != 0 && block_id >= stream.first && block_id <= stream.done) {
+        this->stats.hits++;
+        STATS_COUNT(PREFETCH_HITS, 1);
+    } else if (stream.first != 0 && block_id >= stream.first && block_id <= stream.requested) {
+        this->stats.late++;
+        stream.window = min(stream.window * 2, this->limit);
+    }
+    stream.last = block_id;
+    if (++stream.run < TRIGGER || stream.requested >= block_id + stream.window / 2)
+        return;
+    if (stream.first != 0)
+        stream.window = min(stream.window * 2, this->limit);
+    BlockID from = max(stream.requested, block_id) + 1;
+    BlockID to = min(block_id + stream.window, (BlockID) this->file.get_last_block_id());
+    if (from > to)
+        return;
+    if (stream.first == 0)
+        stream.first = from;
+    stream.requested = to;
+    queue_read(ReadRequest{this, s, stream.generation, from, to});
+}
+
+// End a stream: what was read ahead past its last block is wasted, and the file's limit follows how much
+void ReadAhead::end(Stream &stream) {
+    if (stream.first != 0) {
+        BlockID wasted = stream.done > stream.last ? stream.done - stream.last : 0;
+        this->stats.wasted += wasted;
+        STATS_COUNT(PREFETCH_WASTED, wasted);
+        if (wasted > stream.window / 2)
+            this->limit = max((uint) MIN_WINDOW, this->limit / 2);
+        else if (wasted == 0)
+            this->limit = min((uint) MAX_WINDOW, this->limit * 2);
+    }
+    u_int64_t generation = stream.generation + 1;  // what is still queued for it is dropped
+    stream = Stream();
+    stream.generation = generation;
+}
+
+void ReadAhead::cancel() {
+    {
+        lock_guard<mutex> lock(this->stream_mutex);
+        for (auto &stream: this->streams)
+            end(stream);
+    }
+    ReadAheadThread &state = read_ahead_thread();
+    unique_lock<mutex> lock(state.lock);
+    state.queue.erase(remove_if(state.queue.begin(), state.queue.end(),
+                                [this](const ReadRequest &request) { return request.read_ahead == this; }),
+                      state.queue.end());
+    state.changed.wait(lock, [this, &state]() { return state.reading != this; });
+}
+
+void ReadAhead::wait() {
+    ReadAheadThread &state = read_ahead_thread();
+    unique_lock<mutex> lock(state.lock);
+    state.changed.wait(lock, [this, &state]() {
+        return state.reading != this && none_of(state.queue.begin(), state.queue.end(),
+                                                [this](const ReadRequest &request) { return request.read_ahead == this; });
+    });
+}
+
+ReadAheadStats ReadAhead::get_stats() {
+    lock_guard<mutex> lock(this->stream_mutex);
+    return this->stats;
+}
+
+bool ReadAhead::wanted(uint stream, u_int64_t generation) {
+    lock_guard<mutex> lock(this->stream_mutex);
+    return this->streams[stream].generation == generation;
+}
+
+void ReadAhead::read_done(uint stream, u_int64_t generation, BlockID block_id) {
+    lock_guard<mutex> lock(this->stream_mutex);
+    this->stats.prefetched++;
+    STATS_COUNT(BLOCKS_PREFETCHED, 1);
+    if (this->streams[stream].generation == generation) {
+        this->streams[stream].done = block_id;
+    } else {
+        this->stats.wasted++;  // the stream ended while the block was being read
+        STATS_COUNT(PREFETCH_WASTED, 1);
+    }
+}
@@ -0,0 +1,112 @@
+/**
+ * @file   read_ahead.h
+ * @brief  Read-ahead for HeapFiles: blocks a sequential scan is about to ask for are read on a background thread
+ *
+ * HeapFile::get reads one block at a time, so a scan of a table that is not in Berkeley DB's cache waits for
+ * the disk on every block. Each HeapFile has a ReadAhead that watches the block ids get is called with. Once a
+ * few in a row go forward, it asks the read-ahead thread (one per process) to read the next blocks, which
+ * brings them into Berkeley DB's cache; the scan's own gets then find them there.
+ *
+ * The window (how many blocks ahead) starts at MIN_WINDOW and doubles every time the scan gets through half of
+ * what has been read ahead, or catches up with the thread, up to the file's limit. The limit starts at
+ * MAX_WINDOW; it halves when a scan stops with much of its window unread (a LIMIT, a scan abandoned) and doubles
+ * again when one stops with none wasted. Several scans of one file at a time are told apart by where they are.
+ *
+ * ReadAheadStats: what a file's read-ahead has done
+ * ReadAhead: the sequential-access detector for one file, and the queue to the thread
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include "storage_engine.h"
+
+class HeapFile;
+
+/**
+ * @class ReadAheadStats - what a file's read-ahead has done since it was opened
+ */
+struct ReadAheadStats {
+    u_int64_t prefetched = 0;  // blocks read ahead
+    u_int64_t hits = 0;        // gets of a block already read ahead
+    u_int64_t late = 0;        // gets of a block asked for but not read ahead yet (the window grows)
+    u_int64_t wasted = 0;      // blocks read ahead that their scan never got to
+};
+
+/**
+ * @class ReadAhead - notices sequential gets on a HeapFile and has the blocks after them read in the background
+ *
+ *      A stream is one scan's position: the last block it read and how far ahead has been asked for and read.
+ *      A get is part of a stream if it is at most NEAR_BLOCKS past its last block (so parallel scans sharing
+ *      out the blocks look like one); any other get starts a stream in place of the least recently used one.
+ *      Reading ahead starts once TRIGGER blocks of a stream have gone forward. Never reads past the last block.
+ */
+class ReadAhead {
+public:
+    static const uint MIN_WINDOW = 4;
+    static const uint MAX_WINDOW = 64;
+    static const uint TRIGGER = 2;
+    static const uint NEAR_BLOCKS = 8;
+    static const uint NUM_STREAMS = 4;
+
+    explicit ReadAhead(HeapFile &file);
+
+    // cancels what is still queued for the file
+    virtual ~ReadAhead();
+
+    ReadAhead(const ReadAhead &other) = delete;
+
+    ReadAhead &operator=(const ReadAhead &other) = delete;
+
+    // HeapFile::get is about to read block_id
+    virtual void on_read(BlockID block_id);
+
+    // forget the streams, drop the blocks still queued and wait for the one being read (before the file closes)
+    virtual void cancel();
+
+    // wait until every block queued for the file has been read
+    virtual void wait();
+
+    virtual ReadAheadStats get_stats();
+
+    // read-ahead for every file (on unless turned off)
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    static void set_enabled(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+
+    // the read-ahead thread has read block_id of stream (under generation) for the file
+    virtual void read_done(uint stream, u_int64_t generation, BlockID block_id);
+
+    // whether the read-ahead thread should still read block_id for stream
+    virtual bool wanted(uint stream, u_int64_t generation);
+
+    virtual HeapFile &get_file() { return file; }
+
+protected:
+    struct Stream {
+        BlockID last = 0;       // the last block the scan read (0: no stream)
+        uint run = 0;           // blocks it has read going forward
+        uint window = MIN_WINDOW;
+        BlockID first = 0;      // the first block read ahead for it (0: none yet)
+        BlockID requested = 0;  // the last block queued for it
+        BlockID done = 0;       // the last block read for it (they are read in order)
+        u_int64_t generation = 0;
+        u_int64_t used = 0;     // when the scan last read a block
+    };
+
+    HeapFile &file;
+    std::mutex stream_mutex;  // guards streams, limit, clock and stats
+    Stream streams[NUM_STREAMS];
+    uint limit;
+    u_int64_t clock;
+    ReadAheadStats stats;
+
+    static std::atomic<bool> on;
+
+    virtual void end(Stream &stream);
+};
+
+bool test_read_ahead();
@@ -0,0 +1,373 @@
+/**
+ * @file   schema_tables.cpp
+ * @brief  the implementation file for the catalog tables (Tables, Columns, Indices) and the schema cache
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "schema_tables.h"
+#include <algorithm>
+#include "column_codec.h"
+using namespace std;
+
+
+const Identifier Tables::TABLE_NAME = "_tables";
+const Identifier Columns::TABLE_NAME = "_columns";
+const Identifier Indices::TABLE_NAME = "_indices";
+
+/**
+ * Testing function for the catalog.
+ * Creates a table through the catalog, resolves it through the schema cache, then drops it again.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_schema_tables() {
+    Tables tables;
+    tables.create_if_not_exists();
+    Identifier table_name = "_test_schema_tables_cpp";
+
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    Handle table_handle = tables.insert(&row);
+    Handles column_handles;
+    Columns &columns = tables.get_columns_table();
+    row["column_name"] = Value("a");
+    row["data_type"] = Value("INT");
+    column_handles.push_back(columns.insert(&row));
+    row["column_name"] = Value("b");
+    row["data_type"] = Value("TEXT");
+    column_handles.push_back(columns.insert(&row));
+
+    bool ok = true;
+    try {
+        ValueDict duplicate;
+        duplicate["table_name"] = Value(table_name);
+        tables.insert(&duplicate);
+        cout << "FAILED TEST: duplicate table name accepted" << endl;
+        ok = false;
+    } catch (DbRelationError &e) {
+    }
+    try {
+        row["data_type"] = Value("BLOB");
+        columns.insert(&row);
+        cout << "FAILED TEST: unknown data type accepted" << endl;
+        ok = false;
+    } catch (DbRelationError &e) {
+    }
+
+    DbRelation &table = tables.get_table(table_name);
+    if (table.get_column_names().size() != 2 || table.get_column_names()[1] != "b"
+        || table.get_column_attributes()[1].get_data_type() != ColumnAttribute::TEXT) {
+        cout << "FAILED TEST: wrong schema read back from the catalog" << endl;
+        ok = false;
+    }
+    if (&tables.get_table(table_name) != &table) {
+        cout << "FAILED TEST: second lookup missed the schema cache" << endl;
+        ok = false;
+    }
+    table.create();
+    ValueDict data;
+    data["a"] = Value(12);
+    data["b"] = Value("Hello!");
+    table.insert(&data);
+    Handles *handles = table.select();
+    ok = ok && handles->size() == 1;
+    delete handles;
+    table.drop();
+
+    u_int64_t version = tables.get_schema_version();
+    for (auto const &handle: column_handles)
+        columns.del(handle);
+    tables.del(table_handle);
+    if (tables.get_schema_version() == version) {
+        cout << "FAILED TEST: DDL didn't bump the schema version" << endl;
+        ok = false;
+    }
+    try {
+        tables.get_table(table_name);
+        cout << "FAILED TEST: dropped table still in the schema cache" << endl;
+        ok = false;
+    } catch (DbRelationError &e) {
+    }
+    return ok;
+}
+
+
+/*****************************************Columns***************************************************************/
+
+ColumnNames &Columns::COLUMN_NAMES() {
+    static ColumnNames column_names;
+    if (column_names.empty()) {
+        column_names.push_back("table_name");
+        column_names.push_back("column_name");
+        column_names.push_back("data_type");
+    }
+    return column_names;
+}
+
+ColumnAttributes &Columns::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes column_attributes;
+    if (column_attributes.empty()) {
+        ColumnAttribute text(ColumnAttribute::TEXT);
+        column_attributes.push_back(text);
+        column_attributes.push_back(text);
+        column_attributes.push_back(text);
+    }
+    return column_attributes;
+}
+
+Columns::Columns() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+/** @brief inserts a column description, checking its data type
+    *  @param  ValueDict row (table_name, column_name, data_type)
+    *  @return Handle of the new row
+    */
+Handle Columns::insert(const ValueDict *row) {
+    ValueDict::const_iterator data_type = row->find("data_type");
+    ColumnAttribute::DataType type;
+    if (data_type == row->end() || !data_type_named(data_type->second.s, type))
+        throw DbRelationError("unknown data type");
+    return HeapTable::insert(row);
+}
+
+/**
+ * Read a table's schema from _columns (in the order the columns were inserted)
+ * @param table_name         the table
+ * @param column_names       filled with its columns
+ * @param column_attributes  filled with their types
+ */
+void Columns::get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles) {
+        ValueDict *row = project(handle);
+        column_names.push_back((*row)["column_name"].s);
+        ColumnAttribute::DataType data_type = ColumnAttribute::TEXT;
+        data_type_named((*row)["data_type"].s, data_type);
+        column_attributes.push_back(ColumnAttribute(data_type));
+        delete row;
+    }
+    delete handles;
+}
+
+
+/*****************************************Indices***************************************************************/
+
+ColumnNames &Indices::COLUMN_NAMES() {
+    static ColumnNames column_names;
+    if (column_names.empty()) {
+        column_names.push_back("table_name");
+        column_names.push_back("index_name");
+        column_names.push_back("column_name");
+        column_names.push_back("seq_in_index");
+        column_names.push_back("index_type");
+        column_names.push_back("is_unique");
+    }
+    return column_names;
+}
+
+ColumnAttributes &Indices::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes column_attributes;
+    if (column_attributes.empty()) {
+        ColumnAttribute text(ColumnAttribute::TEXT), integer(ColumnAttribute::INT);
+        column_attributes.push_back(text);
+        column_attributes.push_back(text);
+        column_attributes.push_back(text);
+        column_attributes.push_back(integer);
+        column_attributes.push_back(text);
+        column_attributes.push_back(integer);
+    }
+    return column_attributes;
+}
+
+Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+/**
+ * Names of the indices on a table
+ * @param table_name the table
+ * @return list of index names (freed by caller)
+ */
+IndexNames *Indices::get_index_names(Identifier table_name) {
+    IndexNames *index_names = new IndexNames();
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles) {
+        ValueDict *row = project(handle);
+        Identifier index_name = (*row)["index_name"].s;
+        if (find(index_names->begin(), index_names->end(), index_name) == index_names->end())
+            index_names->push_back(index_name);
+        delete row;
+    }
+    delete handles;
+    return index_names;
+}
+
+/**
+ * The key columns of an index, ordered by seq_in_index
+ * @param table_name the table
+ * @param index_name the index
+ * @param is_unique  set to whether the index enforces uniqueness
+ * @return the key columns
+ */
+ColumnNames Indices::get_index_columns(Identifier table_name, Identifier index_name, bool &is_unique) {
+    map<int32_t, Identifier> by_seq;
+    is_unique = false;
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    where["index_name"] = Value(index_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles) {
+        ValueDict *row = project(handle);
+        by_seq[(*row)["seq_in_index"].n] = (*row)["column_name"].s;
+        is_unique = (*row)["is_unique"].n != 0;
+        delete row;
+    }
+    delete handles;
+    ColumnNames column_names;
+    for (auto const &entry: by_seq)
+        column_names.push_back(entry.second);
+    return column_names;
+}
+
+
+/*****************************************Tables***************************************************************/
+
+ColumnNames &Tables::COLUMN_NAMES() {
+    static ColumnNames column_names;
+    if (column_names.empty())
+        column_names.push_back("table_name");
+    return column_names;
+}
+
+ColumnAttributes &Tables::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes column_attributes;
+    if (column_attributes.empty())
+        column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    return column_attributes;
+}
+
+Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()),
+                   columns_table(new Columns()), indices_table(new Indices()),
+                   statistics_table(new Statistics()), schema_version(0) {
+}
+
+Tables::~Tables() {
+    for (auto const &entry: this->table_cache)
+        delete entry.second;
+    delete this->columns_table;
+    delete this->indices_table;
+    delete this->statistics_table;
+}
+
+/**
+ * Open the catalog, creating it on first use. A freshly created catalog describes itself,
+ * so the schema tables show up in (and can be queried through) the catalog like any other table.
+ */
+void Tables::create_if_not_exists() {
+    this->columns_table->create_if_not_exists();
+    this->indices_table->create_if_not_exists();
+    this->statistics_table->create_if_not_exists();
+    try {
+        this->file.open();
+    } catch (DbException &e) {
+        create();
+        register_table(*this);
+        register_table(*this->columns_table);
+        register_table(*this->indices_table);
+        register_table(*this->statistics_table);
+    }
+}
+
+// Add a relation's rows to _tables and _columns
+void Tables::register_table(DbRelation &relation) {
+    ValueDict row;
+    row["table_name"] = Value(relation.get_table_name());
+    insert(&row);
+    const ColumnNames &column_names = relation.get_column_names();
+    const ColumnAttributes &column_attributes = relation.get_column_attributes();
+    for (uint i = 0; i < column_names.size(); i++) {
+        row["column_name"] = Value(column_names[i]);
+        row["data_type"] = Value(codec_ops(column_attributes[i].get_data_type()).name);
+        this->columns_table->insert(&row);
+    }
+}
+
+/** @brief adds a table to the catalog
+    *  @param  ValueDict row (table_name)
+    *  @return Handle of the new row
+    */
+Handle Tables::insert(const ValueDict *row) {
+    ValueDict::const_iterator table_name = row->find("table_name");
+    if (table_name != row->end()) {
+        ValueDict where;
+        where["table_name"] = table_name->second;
+        Handles *handles = select(&where);
+        bool exists = !handles->empty();
+        delete handles;
+        if (exists)
+            throw DbRelationError(table_name->second.s + " already exists");
+    }
+    Handle handle = HeapTable::insert(row);
+    this->schema_version++;
+    return handle;
+}
+
+// Removes a table from the catalog, and its relation from the schema cache
+void Tables::del(const Handle handle) {
+    this->open();
+    ValueDict *row = project(handle);
+    invalidate((*row)["table_name"].s);
+    delete row;
+    HeapTable::del(handle);
+}
+
+void Tables::get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes) {
+    this->columns_table->get_columns(table_name, column_names, column_attributes);
+}
+
+/**
+ * Resolve a table name through the schema cache, reading its columns (and its key, for a B+tree table) from the
+ * catalog on a miss
+ * @param table_name the table
+ * @return the relation (owned by the cache; valid until the table is invalidated)
+ */
+DbRelation &Tables::get_table(Identifier table_name) {
+    if (table_name == Tables::TABLE_NAME)
+        return *this;
+    if (table_name == Columns::TABLE_NAME)
+        return *this->columns_table;
+    if (table_name == Indices::TABLE_NAME)
+        return *this->indices_table;
+    if (table_name == Statistics::TABLE_NAME)
+        return *this->statistics_table;
+
+    auto cached = this->table_cache.find(table_name);
+    if (cached != this->table_cache.end())
+        return *cached->second;
+
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    get_columns(table_name, column_names, column_attributes);
+    if (column_names.empty())
+        throw DbRelationError("no such table " + table_name);
+    bool is_unique;
+    ColumnNames key = this->indices_table->get_index_columns(table_name, BTreeTable::PRIMARY, is_unique);
+    DbRelation *table;
+    if (key.empty())
+        table = new HeapTable(table_name, column_names, column_attributes);
+    else
+        table = new BTreeTable(table_name, column_names, column_attributes, key[0]);
+    this->table_cache[table_name] = table;
+    return *table;
+}
+
+// Drop the cached relation for a table (its schema is about to change or it is being dropped)
+void Tables::invalidate(Identifier table_name) {
+    auto cached = this->table_cache.find(table_name);
+    if (cached != this->table_cache.end()) {
+        delete cached->second;
+        this->table_cache.erase(cached);
+    }
+    this->schema_version++;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file   schema_tables.h
+ * @brief  The system catalog, stored in our own HeapTables, and the in-memory schema cache
+ *
+ * Tables: _tables (table_name) -- also resolves table names to open relations through the schema cache
+ * Columns: _columns (table_name, column_name, data_type)
+ * Indices: _indices (table_name, index_name, column_name, seq_in_index, index_type, is_unique) -- also records the
+ *          key of a B+tree table, as its index PRIMARY
+ * (_statistics, the fourth catalog table, is in statistics.h)
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <unordered_map>
+#include "btree_table.h"
+#include "heap_storage.h"
+#include "statistics.h"
+
+/**
+ * @class Columns - the _columns catalog table: one row per column of every table
+ */
+class Columns : public HeapTable {
+public:
+    static const Identifier TABLE_NAME;
+
+    Columns();
+
+    virtual ~Columns() {}
+
+    // rejects unknown data types
+    virtual Handle insert(const ValueDict *row);
+
+    /**
+     * Read a table's schema from the catalog.
+     * @param table_name         the table
+     * @param column_names       filled with its columns, in order
+     * @param column_attributes  filled with their types
+     */
+    virtual void get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes);
+
+protected:
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+};
+
+/**
+ * @class Indices - the _indices catalog table: one row per column of every index
+ */
+class Indices : public HeapTable {
+public:
+    static const Identifier TABLE_NAME;
+
+    Indices();
+
+    virtual ~Indices() {}
+
+    /**
+     * Names of the indices on a table.
+     * @returns  list of index names (freed by caller)
+     */
+    virtual IndexNames *get_index_names(Identifier table_name);
+
+    /**
+     * The key columns of an index, in key order.
+     * @param is_unique  set to whether the index enforces uniqueness
+     */
+    virtual ColumnNames get_index_columns(Identifier table_name, Identifier index_name, bool &is_unique);
+
+protected:
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+};
+
+/**
+ * @class Tables - the _tables catalog table, and the schema cache in front of the whole catalog
+ *
+ *      get_table() resolves a table name to an open relation. The first lookup of a table reads
+ *      its columns from _columns, and its engine from _indices (a BTreeTable if it has an index
+ *      PRIMARY, else a HeapTable); after that the lookup is a hash probe that never touches disk.
+ *      DDL invalidates just the affected entry and bumps the schema version, so holders of
+ *      schema-dependent state (e.g. cached plans) can cheaply tell that it went stale.
+ */
+class Tables : public HeapTable {
+public:
+    static const Identifier TABLE_NAME;
+
+    Tables();
+
+    virtual ~Tables();
+
+    // create (or open) _tables, _columns, _indices and _statistics, registering them in the catalog on first creation
+    virtual void create_if_not_exists();
+
+    // rejects duplicate table names
+    virtual Handle insert(const ValueDict *row);
+
+    // also drops the table's schema cache entry
+    virtual void del(const Handle handle);
+
+    virtual void get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes);
+
+    /**
+     * Resolve a table name to its relation (opened lazily by the relation itself).
+     * @returns  the relation, owned by the cache
+     * @throws   DbRelationError if there is no such table
+     */
+    virtual DbRelation &get_table(Identifier table_name);
+
+    // forget a cached relation after DDL on it
+    virtual void invalidate(Identifier table_name);
+
+    // incremented by every DDL
+    virtual u_int64_t get_schema_version() const { return schema_version; }
+
+    virtual Columns &get_columns_table() { return *columns_table; }
+
+    virtual Indices &get_indices_table() { return *indices_table; }
+
+    virtual Statistics &get_statistics_table() { return *statistics_table; }
+
+protected:
+    Columns *columns_table;
+    Indices *indices_table;
+    Statistics *statistics_table;
+    std::unordered_map<Identifier, DbRelation *> table_cache;
+    u_int64_t schema_version;
+
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+
+    virtual void register_table(DbRelation &relation);
+};
+
+bool test_schema_tables();
@@ -4,16 +4,38 @@
  * @authors Ethan Guttman, XingZheng
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include "db_cxx.h"
 #include "sqlhelper.h"
 #include "SQLParser.h"
 #include "mySQLParser.h"
 #include "mySQLParser.cpp"
 #include "heap_storage.h"
+#include "arena.h"
+#include "column_codec.h"
+#include "mvcc.h"
+#include "wal.h"
+#include "hash_aggregate.h"
+#include "expr_compiler.h"
+#include "plan_cache.h"
+#include "sql_exec.h"
+#include "engine_stats.h"
+#include "trace.h"
+#include "sql_script.h"
+#include "bulk_loader.h"
+#include "sql_server.h"
+#include "typed_table.h"
+#include "read_ahead.h"
+#include "btree_table.h"
 using namespace std;
 
 DbEnv *_DB_ENV;
@@ -29,19 +51,697 @@ string stringToUpper(string oString){
     return oString;
 }
 
-void init_env(string envdir){
+/** @brief split off the first whitespace-delimited word
+ *  @param text the text, left holding whatever follows the word
+ *  @return the word
+ */
+string nextWord(string &text){
+    size_t start = text.find_first_not_of(" \t");
+    if(start == string::npos){
+        text = "";
+        return "";
+    }
+    size_t end = text.find_first_of(" \t(", start);
+    string word = text.substr(start, end == string::npos ? string::npos : end - start);
+    text = end == string::npos ? "" : text.substr(end);
+    return word;
+}
+
+/** @brief print each statement of a parse, one per line, and execute it
+ *  @param the parse to run
+ *  @param timing also print how long each statement took and how many heap allocations it made
+ *  @return seconds spent executing
+ */
+double executeStatements(const hsql::SQLParserResult *result, bool timing = false){
+    double seconds = 0;
+    //loop to handle cases where there was more than one SQL statement
+    //in the input text
+    for (uint i = 0; i < result->size(); ++i) {
+        //use sqlStatementToString to transform parse result
+        //into something readable and print it out
+        cout << myhsql::sqlStatementToString(result->getStatement(i)) << endl;
+        u_int64_t allocations = EngineStats::total(EngineStats::HEAP_ALLOCATIONS);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        try {
+            TraceSpan span("SQLExec::execute", "query");
+            QueryResult *query_result = SQLExec::execute(result->getStatement(i));
+            span.finish();
+            cout << *query_result << endl;
+            delete query_result;
+        } catch (exception &e) {
+            cout << "Error: " << e.what() << endl;
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        seconds += elapsed;
+        allocations = EngineStats::total(EngineStats::HEAP_ALLOCATIONS) - allocations;
+        if(timing){
+            char time[64];
+#ifdef ENGINE_STATS_DISABLED
+            snprintf(time, sizeof(time), "(%.3f ms)", elapsed * 1000);
+#else
+            snprintf(time, sizeof(time), "(%.3f ms, %llu allocations)", elapsed * 1000,
+                     (unsigned long long) allocations);
+#endif
+            cout << time << endl;
+        }
+    }
+    return seconds;
+}
+
+/** @brief handle SHOW TABLES, SHOW COLUMNS FROM table and SHOW STATS (which the parser doesn't know)
+ *  @param query the input line
+ *  @return true if the line was one of these commands
+ */
+bool showStatement(string query){
+    if(stringToUpper(nextWord(query)) != "SHOW"){
+        return false;
+    }
+    string what = stringToUpper(nextWord(query));
+    if(!what.empty() && what.back() == ';')
+        what.pop_back();
+    QueryResult *query_result = nullptr;
+    try {
+        if(what == "STATS"){
+            query_result = SQLExec::show_stats();
+            cout << *query_result << endl;
+            delete query_result;
+            query_result = SQLExec::show_latencies();
+        } else if(what == "TABLES"){
+            query_result = SQLExec::show_tables();
+        } else if(what == "COLUMNS" && stringToUpper(nextWord(query)) == "FROM"){
+            string table_name = nextWord(query);
+            if(!table_name.empty() && table_name.back() == ';')
+                table_name.pop_back();
+            query_result = SQLExec::show_columns(table_name);
+        } else {
+            return false;
+        }
+    } catch (exception &e) {
+        cout << "Error: " << e.what() << endl;
+        return true;
+    }
+    cout << *query_result << endl;
+    delete query_result;
+    return true;
+}
+
+/** @brief handle ANALYZE [table] (which the parser doesn't know)
+ *  @param query the input line
+ *  @return true if the line was an ANALYZE
+ */
+bool analyzeStatement(string query){
+    if(stringToUpper(nextWord(query)) != "ANALYZE"){
+        return false;
+    }
+    string table_name = nextWord(query);
+    if(!table_name.empty() && table_name.back() == ';')
+        table_name.pop_back();
+    try {
+        QueryResult *query_result = SQLExec::analyze(table_name);
+        cout << *query_result << endl;
+        delete query_result;
+    } catch (exception &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    return true;
+}
+
+/** @brief handle TRACE ON [capacity], TRACE OFF and TRACE DUMP file
+ *  @param query the input line
+ *  @return true if the line was one of these commands
+ */
+bool traceStatement(string query){
+    if(stringToUpper(nextWord(query)) != "TRACE"){
+        return false;
+    }
+    string command = stringToUpper(nextWord(query));
+    string argument = nextWord(query);
+    if(!argument.empty() && argument.back() == ';')
+        argument.pop_back();
+    if(command == "ON"){
+        size_t capacity = argument.empty() ? Tracer::DEFAULT_CAPACITY : strtoul(argument.c_str(), nullptr, 10);
+        Tracer::start(capacity);
+        cout << "tracing on, keeping the last " << (capacity ? capacity : 1) << " spans" << endl;
+    } else if(command == "OFF"){
+        Tracer::stop();
+        cout << "tracing off, " << Tracer::size() << " spans held" << endl;
+    } else if(command == "DUMP" && !argument.empty()){
+        ofstream out(argument);
+        if(!out){
+            cout << "Error: cannot write " << argument << endl;
+            return true;
+        }
+        Tracer::dump(out);
+        cout << "wrote " << Tracer::size() << " spans to " << argument;
+        if(Tracer::dropped())
+            cout << " (" << Tracer::dropped() << " older spans were overwritten)";
+        cout << endl;
+    } else {
+        cout << "Usage: TRACE ON [capacity] | TRACE OFF | TRACE DUMP file" << endl;
+    }
+    return true;
+}
+
+/** @brief handle LOAD file [threads]: run a (typically INSERT-heavy) script through the parallel bulk loader
+ *  @param query the input line
+ *  @return true if the line was a LOAD
+ */
+bool loadStatement(string query){
+    if(stringToUpper(nextWord(query)) != "LOAD"){
+        return false;
+    }
+    string file_name = nextWord(query);
+    string threads = nextWord(query);
+    if(!threads.empty() && threads.back() == ';')
+        threads.pop_back();
+    else if(threads.empty() && !file_name.empty() && file_name.back() == ';')
+        file_name.pop_back();
+    ifstream script(file_name);
+    if(file_name.empty() || !script){
+        cout << "Usage: LOAD file [threads]" << endl;
+        return true;
+    }
+    BulkLoader loader((uint) strtoul(threads.c_str(), nullptr, 10));
+    LoadSummary summary;
+    try {
+        summary = loader.load(script, cout);
+    } catch (exception &e) {
+        cout << "Error: " << e.what() << endl;
+        return true;
+    }
+    char report[256];
+    snprintf(report, sizeof(report), "loaded %zu rows from %zu statements (%zu failed) in %.3f s with %u parsing"
+             " threads (parse %.3f s of worker time, insert %.3f s)", summary.rows, summary.statements, summary.failed,
+             summary.seconds, loader.get_num_threads(), summary.parse_seconds, summary.insert_seconds);
+    cout << report << endl;
+    return true;
+}
+
+/** @brief handle EXPLAIN [ANALYZE] SELECT ... (which the parser doesn't know)
+ *  @param query the input line
+ *  @param plan_cache the shell's plan cache, which parses the SELECT
+ *  @return true if the line was an EXPLAIN
+ */
+bool explainStatement(string query, PlanCache &plan_cache){
+    if(stringToUpper(nextWord(query)) != "EXPLAIN"){
+        return false;
+    }
+    string rest = query;
+    bool analyze = stringToUpper(nextWord(rest)) == "ANALYZE";
+    if(analyze)
+        query = rest;
+    CachedPlanPtr plan = plan_cache.get(query);
+    if(plan == nullptr || plan->parsed->size() != 1 || plan->parsed->getStatement(0)->type() != hsql::kStmtSelect){
+        cout << "Usage: EXPLAIN [ANALYZE] SELECT ..." << endl;
+        return true;
+    }
+    const hsql::SQLStatement *statement = plan->parsed->getStatement(0);
+    cout << myhsql::sqlStatementToString(statement) << endl;
+    try {
+        QueryResult *query_result = SQLExec::explain((const hsql::SelectStatement *) statement, analyze);
+        cout << *query_result << endl;
+        delete query_result;
+    } catch (exception &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    return true;
+}
+
+/** @brief handle CREATE TABLE ... WITH (page_size = n, layout = pax, engine = btree, key = column), and CREATE
+ *  TABLE with column types the parser doesn't know
+ *  @param query the input line
+ *  @return true if the line was such a CREATE TABLE
+ */
+bool createWithStatement(string query){
+    string create;
+    TableOptions options;
+    ColumnTypes column_types;
+    if(!SQLExec::split_create(query, create, options, column_types)){
+        return false;
+    }
+    hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString(create);
+    if(!result->isValid() || result->size() != 1 || result->getStatement(0)->type() != hsql::kStmtCreate){
+        cout << "Invalid SQL: " << query << endl;
+        delete result;
+        return true;
+    }
+    string echo = myhsql::sqlStatementToString(result->getStatement(0));
+    for(auto const &column_type: column_types){
+        for(auto before: {"(", ", "}){
+            string column = before + column_type.first + " ";
+            size_t at = echo.find(column + "INT");
+            if(at != string::npos)
+                echo.replace(at + column.length(), 3, codec_ops(column_type.second).name);
+        }
+    }
+    cout << echo;
+    if(!options.empty()){
+        cout << " WITH (";
+        for(auto it = options.begin(); it != options.end(); it++)
+            cout << (it == options.begin() ? "" : ", ") << it->first << " = " << it->second;
+        cout << ")";
+    }
+    cout << endl;
+    try {
+        QueryResult *query_result = SQLExec::create((const hsql::CreateStatement *) result->getStatement(0), options,
+                                                    column_types);
+        cout << *query_result << endl;
+        delete query_result;
+    } catch (exception &e) {
+        cout << "Error: " << e.what() << endl;
+    }
+    delete result;
+    return true;
+}
+
+/** @brief handle PREPARE name FROM 'sql', EXECUTE name [(values)] and DEALLOCATE [PREPARE] name
+ *  @param query the input line
+ *  @param plan_cache the shell's plan cache, which holds the prepared statements
+ *  @return true if the line was one of these commands
+ */
+bool preparedStatement(string query, PlanCache &plan_cache){
+    string command = stringToUpper(nextWord(query));
+    if(command == "PREPARE"){
+        string name = nextWord(query);
+        if(stringToUpper(nextWord(query)) != "FROM" || name.empty() || query.find_first_not_of(" \t") == string::npos){
+            cout << "Usage: PREPARE name FROM 'statement'" << endl;
+            return true;
+        }
+        // the statement may be given quoted (the usual form, with '' for a quote) or as-is
+        string sql = query.substr(query.find_first_not_of(" \t"));
+        size_t last = sql.find_last_not_of(" \t;");
+        if(sql.length() > 1 && sql[0] == '\'' && last != string::npos && sql[last] == '\''){
+            string quoted = sql.substr(1, last - 1);
+            sql = "";
+            for(size_t i = 0; i < quoted.length(); i++){
+                sql += quoted[i];
+                if(quoted[i] == '\'' && i + 1 < quoted.length() && quoted[i + 1] == '\'')
+                    i++;
+            }
+        }
+        cout << (plan_cache.prepare(name, sql) ? "prepared " + name : "Invalid SQL: " + sql) << endl;
+        return true;
+    }
+    if(command == "EXECUTE"){
+        string name = nextWord(query);
+        size_t open = query.find('('), close = query.rfind(')');
+        string arguments = open != string::npos && close != string::npos && close > open
+                           ? query.substr(open + 1, close - open - 1) : "";
+        try {
+            executeStatements(plan_cache.execute(name, arguments)->parsed);
+        } catch (invalid_argument &e) {
+            cout << "Error: " << e.what() << endl;
+        }
+        return true;
+    }
+    if(command == "DEALLOCATE"){
+        string name = nextWord(query);
+        if(stringToUpper(name) == "PREPARE")
+            name = nextWord(query);
+        cout << (plan_cache.deallocate(name) ? "deallocated " : "no prepared statement ") << name << endl;
+        return true;
+    }
+    return false;
+}
+
+/** @brief run one of the shell's own commands: the tests, benchmarks, and the statements the parser doesn't know
+ *  @param query the input (a line, or a statement of a script)
+ *  @param plan_cache the shell's plan cache
+ *  @return true if the input was one of these commands
+ */
+bool shellCommand(string query, PlanCache &plan_cache){
+    if(query == "test"){
+        cout << "test_heap_storage: \n" << (test_heap_storage() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test2"){
+        cout << "test_slotted_page: \n" << (test_slotted_page() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_concurrency"){
+        cout << "test_heap_concurrency: \n" << (test_heap_concurrency() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_pax"){
+        cout << "test_pax_page: \n" << (test_pax_page() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_compression"){
+        cout << "test_page_compression: \n" << (test_page_compression() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_arena"){
+        cout << "test_arena: \n" << (test_arena() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_read_ahead"){
+        cout << "test_read_ahead: \n" << (test_read_ahead() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_btree"){
+        cout << "test_btree_table: \n" << (test_btree_table() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_typed"){
+        cout << "test_typed_table: \n" << (test_typed_table() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_types"){
+        cout << "test_column_types: \n" << (test_column_types() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_overflow"){
+        cout << "test_overflow: \n" << (test_overflow() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_mvcc"){
+        cout << "test_mvcc: \n" << (test_mvcc() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_wal"){
+        cout << "test_wal: \n" << (test_wal() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_aggregate"){
+        cout << "test_hash_aggregate: \n" << (test_hash_aggregate() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_where"){
+        cout << "test_expr_compiler: \n" << (test_expr_compiler() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_plan_cache"){
+        cout << "test_plan_cache: \n" << (test_plan_cache() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_catalog"){
+        cout << "test_schema_tables: \n" << (test_schema_tables() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_statistics"){
+        cout << "test_statistics: \n" << (test_statistics() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_stats"){
+        cout << "test_engine_stats: \n" << (test_engine_stats() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_trace"){
+        cout << "test_trace: \n" << (test_trace() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_script"){
+        cout << "test_sql_script: \n" << (test_sql_script() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_load"){
+        cout << "test_bulk_loader: \n" << (test_bulk_loader() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "test_server"){
+        cout << "test_sql_server: \n" << (test_sql_server() ? "ok" : "failed") << endl;
+        return true;
+    }
+
+    if(query == "bench_where"){
+        benchmark_expr_compiler(1000000);
+        return true;
+    }
+
+    if(stringToUpper(query) == "RESET STATS"){
+        EngineStats::reset();
+        cout << "engine statistics reset" << endl;
+        return true;
+    }
+
+    if(stringToUpper(query) == "VACUUM"){
+        size_t removed = VersionCollector::collect();
+        cout << "removed " << removed << " dead row versions" << endl;
+        return true;
+    }
+
+    if(stringToUpper(query) == "CHECKPOINT"){
+        if(!WriteAheadLog::enabled()){
+            cout << "not in durable mode (start with --durable)" << endl;
+            return true;
+        }
+        try {
+            WriteAheadLog::checkpoint();
+        } catch (exception &e) {
+            cout << "Error: " << e.what() << endl;
+            return true;
+        }
+        WalStats stats = WriteAheadLog::stats();
+        cout << "checkpoint done (" << stats.commits << " commits in " << stats.flushes << " log flushes so far)"
+             << endl;
+        return true;
+    }
+
+    if(stringToUpper(query) == "SHOW PLAN CACHE"){
+        cout << plan_cache.stats() << endl;
+        return true;
+    }
+
+    if(showStatement(query)){
+        return true;
+    }
+
+    if(analyzeStatement(query)){
+        return true;
+    }
+
+    if(loadStatement(query)){
+        return true;
+    }
+
+    if(traceStatement(query)){
+        return true;
+    }
+
+    if(explainStatement(query, plan_cache)){
+        return true;
+    }
+
+    if(preparedStatement(query, plan_cache)){
+        return true;
+    }
+
+    if(createWithStatement(query)){
+        return true;
+    }
+    return false;
+}
+
+/** @brief run one line of input as the interactive loop does: a shell command, or SQL
+ *  @param query the line
+ *  @param plan_cache the shell's plan cache
+ */
+void runLine(string query, PlanCache &plan_cache){
+    if(shellCommand(query, plan_cache)){
+        return;
+    }
+    // parse the given query (or reuse the parse of an earlier one differing only in its literals),
+    // if invalid stop and if valid translate
+    TraceSpan parse("PlanCache::get", "parse");
+    parse.set_detail(query);
+    CachedPlanPtr plan = plan_cache.get(query);
+    parse.finish();
+    if (plan == nullptr) {
+        cout << "Invalid SQL: " << query << endl;
+    } else {
+        executeStatements(plan->parsed);
+    }
+}
+
+/** @brief server mode: serve clients on a Unix socket (and optionally 127.0.0.1:port) until SIGINT/SIGTERM
+ *
+ *  Each request line runs as if typed at the prompt, and what it would have printed is the response.
+ *  The catalog, tables and plan cache are not thread-safe, so requests execute one at a time under
+ *  engine_mutex; the workers overlap the rest (reading, parsing the protocol, sending results).
+ *  @param socket_path the Unix socket
+ *  @param tcp_port TCP port on localhost (0 for none)
+ *  @param num_workers worker threads
+ *  @param plan_cache the shell's plan cache, shared by all clients
+ *  @return EXIT_SUCCESS, or EXIT_FAILURE if the server could not start
+ */
+int runServer(string socket_path, uint tcp_port, uint num_workers, PlanCache &plan_cache){
+    mutex engine_mutex;
+    try {
+        SQLServer server(socket_path, tcp_port, num_workers, [&](const string &request) {
+            lock_guard<mutex> guard(engine_mutex);
+            stringstream output;
+            streambuf *console = cout.rdbuf(output.rdbuf());
+            try {
+                runLine(request, plan_cache);
+            } catch (...) {
+                cout.rdbuf(console);
+                throw;
+            }
+            cout.rdbuf(console);
+            return output.str();
+        });
+        cout << "(sqlshell: serving on " << socket_path;
+        if(tcp_port)
+            cout << " and 127.0.0.1:" << tcp_port;
+        cout << " with " << num_workers << " workers)" << endl;
+        server.run();
+    } catch (SQLServerError &e) {
+        cerr << "sql5300: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "(sqlshell: server stopped)" << endl;
+    return EXIT_SUCCESS;
+}
+
+/** @brief batch mode: run a script without prompts, timing every statement and the whole run
+ *
+ *  Statements end at ';' and may span lines. Runs of plain SQL statements are parsed together, up to
+ *  SCRIPT_CHUNK_STATEMENTS at a time; the shell's own commands (SHOW, EXPLAIN, TRACE, ...) run as they come.
+ *  @param in the script
+ *  @param plan_cache the shell's plan cache (for PREPARE/EXECUTE and EXPLAIN)
+ *  @return EXIT_SUCCESS, or EXIT_FAILURE if some statement could not be parsed
+ */
+int runScript(istream &in, PlanCache &plan_cache){
+    static const size_t SCRIPT_CHUNK_STATEMENTS = 1000;
+    static const char *SQL_KEYWORDS[] = {"SELECT", "INSERT", "CREATE", "DROP", "UPDATE", "DELETE"};
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    SQLScriptReader reader(in);
+    vector<string> chunk;
+    vector<size_t> chunk_lines;
+    size_t statements = 0, invalid = 0;
+    double parse_seconds = 0, execute_seconds = 0;
+    auto parse = [&](const string &sql) -> hsql::SQLParserResult * {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        TraceSpan span("SQLParser::parseSQLString", "parse");
+        hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString(sql);
+        parse_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    };
+    // parse and run the pending SQL statements; if the chunk doesn't parse, go one by one to find the culprit
+    auto flush = [&](){
+        if(chunk.empty())
+            return;
+        string text;
+        for(auto const &statement: chunk)
+            text += statement + ";\n";
+        hsql::SQLParserResult *result = parse(text);
+        if(result->isValid() && result->size() == chunk.size()){
+            execute_seconds += executeStatements(result, true);
+        } else {
+            for(size_t i = 0; i < chunk.size(); i++){
+                hsql::SQLParserResult *single = parse(chunk[i]);
+                if(single->isValid()){
+                    execute_seconds += executeStatements(single, true);
+                } else {
+                    cout << "Invalid SQL (line " << chunk_lines[i] << "): " << chunk[i] << endl;
+                    invalid++;
+                }
+                delete single;
+            }
+        }
+        delete result;
+        chunk.clear();
+        chunk_lines.clear();
+    };
+    string statement;
+    while(reader.next(statement)){
+        statements++;
+        string rest = statement;
+        string first = stringToUpper(nextWord(rest));
+        bool sql = false;
+        for(auto keyword: SQL_KEYWORDS)
+            sql = sql || first == keyword;
+        string create;
+        TableOptions options;
+        ColumnTypes column_types;
+        if(first == "CREATE" && SQLExec::split_create(statement, create, options, column_types))
+            sql = false;  // the shell handles WITH and the types the parser doesn't know
+        if(sql){
+            chunk.push_back(statement);
+            chunk_lines.push_back(reader.get_line());
+            if(chunk.size() >= SCRIPT_CHUNK_STATEMENTS)
+                flush();
+            continue;
+        }
+        flush();
+        if(first == "QUIT")
+            break;
+        if(!shellCommand(statement, plan_cache)){
+            chunk.push_back(statement);
+            chunk_lines.push_back(reader.get_line());
+            flush();
+        }
+    }
+    flush();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    printf("%zu statements (%zu invalid) in %.3f s: parse %.3f s, execute %.3f s\n", statements, invalid, seconds,
+           parse_seconds, execute_seconds);
+    return invalid ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Open the environment, first redoing whatever a crash left in its write-ahead log
+ * @param envdir   the environment's directory
+ * @param durable  log every change and commit it before returning (see wal.h)
+ */
+void init_env(string envdir, bool durable){
     //use the path argument to open up the DB environment
 	//if it isn't already open
     DbEnv *env = new DbEnv(0U);
     env->set_message_stream(&cout);
 	env->set_error_stream(&cerr);
     try{
-        env->open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL, 0);
+        env->open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
     } catch (DbException& e){
         cerr << "sql5300: create db env error: " << e.what() << endl;
         exit(1);
     }
     _DB_ENV = env;
+    string wal_path = envdir + "/sql5300.wal";
+    size_t replayed = WriteAheadLog::recover(wal_path);
+    if(replayed > 0)
+        cout << "(sqlshell: recovered " << replayed << " logged changes)" << endl;
+    if(durable){
+        try{
+            WriteAheadLog::open(wal_path);
+        } catch (WalError& e){
+            cerr << "sql5300: " << e.what() << endl;
+            exit(1);
+        }
+    }
+    VersionCollector::start();  // inherits main's signal mask (see SQLServer::block_signals)
+}
+
+void close_env(){
+    VersionCollector::stop();
+    try{
+        WriteAheadLog::close();
+    } catch (WalError& e){
+        cerr << "sql5300: " << e.what() << endl;
+    }
+    _DB_ENV->close(0U);
 }
 
 /**
@@ -50,14 +750,76 @@ void init_env(string envdir){
  */
 int main(int argc, char *argv[]) {
     //check for if the path argument exists and fail if it doesn't
+    // --durable may come anywhere after the environment
+    bool durable = false;
+    for(int i = 2; i < argc; i++){
+        if(string(argv[i]) == "--durable"){
+            durable = true;
+            for(int j = i; j < argc - 1; j++)
+                argv[j] = argv[j + 1];
+            argc--;
+            break;
+        }
+    }
     if(argc <= 1){
-        cerr << "Usage: ./sql5300 cpsc5300/data" << endl;
+        cerr << "Usage: ./sql5300 cpsc5300/data [--durable] [script.sql | - | --server socket [--tcp port] [--workers n]]"
+             << endl;
+        return EXIT_FAILURE;
+    }
+    string socket_path;
+    uint tcp_port = 0, num_workers = 4;
+    if(argc > 2 && string(argv[2]) == "--server"){
+        for(int i = 3; i < argc; i++){
+            string arg = argv[i];
+            if(arg == "--tcp" && i + 1 < argc)
+                tcp_port = (uint) strtoul(argv[++i], nullptr, 10);
+            else if(arg == "--workers" && i + 1 < argc)
+                num_workers = (uint) strtoul(argv[++i], nullptr, 10);
+            else if(socket_path.empty() && arg[0] != '-')
+                socket_path = arg;
+            else
+                socket_path = "";
+        }
+        if(socket_path.empty()){
+            cerr << "Usage: ./sql5300 cpsc5300/data --server socket [--tcp port] [--workers n]" << endl;
+            return EXIT_FAILURE;
+        }
+    } else if(argc > 3){
+        cerr << "Usage: ./sql5300 cpsc5300/data [script.sql | -]" << endl;
         return EXIT_FAILURE;
     }
     const char *home = getenv("HOME");
 	string envdir = string(home) + "/" + argv[1];
     cout << "(sqlshell: running with database environment at " + envdir + ")" << endl;
-    init_env(envdir);
+    // the server takes SIGINT/SIGTERM through a signalfd: block them before init_env starts any thread
+    if(!socket_path.empty())
+        SQLServer::block_signals();
+    init_env(envdir, durable);
+    PlanCache plan_cache;
+
+    if(!socket_path.empty()){
+        int status = runServer(socket_path, tcp_port, num_workers, plan_cache);
+        close_env();
+        return status;
+    }
+
+    // batch mode: a script file, or - for standard input
+    if(argc == 3){
+        int status;
+        if(string(argv[2]) == "-"){
+            status = runScript(cin, plan_cache);
+        } else {
+            ifstream script(argv[2]);
+            if(!script){
+                cerr << "sql5300: cannot read " << argv[2] << endl;
+                close_env();
+                return EXIT_FAILURE;
+            }
+            status = runScript(script, plan_cache);
+        }
+        close_env();
+        return status;
+    }
 
 	//main body of program that takes input and returns
 	//SQL parsed text back if the input is an SQL command 
@@ -74,33 +836,8 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        if(query == "test"){
-            cout << "test_heap_storage: \n" << (test_heap_storage() ? "ok" : "failed") << endl;
-            continue;
-        }
-
-        if(query == "test2"){
-            cout << "test_slotted_page: \n" << (test_slotted_page() ? "ok" : "failed") << endl;
-            continue;
-        }
-
-        // parse the given query, if invalid stop and if valid translate
-        hsql::SQLParserResult *result = hsql::SQLParser::parseSQLString(query);
-        if (!result->isValid()) {
-            cout << "Invalid SQL: " << query << endl;
-        } else {
-			//loop to handle cases where there was more than one SQL statement
-			//in the input text
-            for (uint i = 0; i < result->size(); ++i) {
-                //hsql::printStatementInfo(result->getStatement(i));
-                //use sqlStatementToString to transform parse result
-				//into something readable and print it out
-                cout << myhsql::sqlStatementToString(result->getStatement(i)) << endl;
-                //cout << "Valid SQL" << endl;
-            }
-        }
-        delete result;
+        runLine(query, plan_cache);
     }
-    _DB_ENV->close(0U);
+    close_env();
     return EXIT_SUCCESS;
 }
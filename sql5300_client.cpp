@@ -0,0 +1,195 @@
+/**
+ * @file   sql5300_client.cpp
+ * @brief  Client for sql5300 --server: an interactive prompt, or a load test of many concurrent clients
+ *
+ * Usage: ./sql5300_client [--tcp port] [--clients N --requests M] [--query SQL] [--json] [socket]
+ *      With no --clients, statements are read from standard input and each response printed.
+ *      With --clients, N connections each send the query M times (waiting for each response) and the
+ *      latencies are reported like the other benchmark drivers (TSV or --json).
+ *      socket defaults to ./sql5300.sock; --tcp connects to 127.0.0.1:port instead.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency_recorder.h"
+using namespace std;
+
+typedef LatencyRecorder::Clock Clock;
+
+/**
+ * @class ServerConnection - one connection to the server, speaking its line protocol
+ */
+class ServerConnection {
+public:
+    ServerConnection() : fd(-1) {}
+
+    virtual ~ServerConnection() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool connect_unix(const string &path) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        return fd >= 0 && connect(fd, (sockaddr *) &address, sizeof(address)) == 0;
+    }
+
+    bool connect_tcp(uint port) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((u_int16_t) port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return fd >= 0 && connect(fd, (sockaddr *) &address, sizeof(address)) == 0;
+    }
+
+    /**
+     * Send one statement and wait for its response.
+     * @param request   the statement (no newline)
+     * @param response  the output, with the protocol's framing removed
+     * @return          false if the connection failed
+     */
+    bool query(const string &request, string &response) {
+        string line = request + "\n";
+        size_t sent = 0;
+        while (sent < line.length()) {
+            ssize_t n = send(fd, line.data() + sent, line.length() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+            sent += (size_t) n;
+        }
+        response.clear();
+        while (true) {
+            size_t newline;
+            while ((newline = buffer.find('\n')) != string::npos) {
+                string received = buffer.substr(0, newline);
+                buffer.erase(0, newline + 1);
+                if (received == ".")
+                    return true;
+                response += (received[0] == '.' ? received.substr(1) : received) + "\n";
+            }
+            char chunk[64 * 1024];
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0)
+                return false;
+            buffer.append(chunk, (size_t) n);
+        }
+    }
+
+protected:
+    int fd;
+    string buffer;
+};
+
+static int usage() {
+    cerr << "Usage: ./sql5300_client [--tcp port] [--clients N --requests M] [--query SQL] [--json] [socket]" << endl;
+    return EXIT_FAILURE;
+}
+
+/**
+ * Main entry to the client
+ */
+int main(int argc, char *argv[]) {
+    string socket_path = "sql5300.sock", query = "SHOW TABLES";
+    uint tcp_port = 0, num_clients = 0;
+    size_t num_requests = 1000;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--json")
+            json = true;
+        else if (arg == "--tcp" && has_value)
+            tcp_port = (uint) strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--clients" && has_value)
+            num_clients = (uint) strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--requests" && has_value)
+            num_requests = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--query" && has_value)
+            query = argv[++i];
+        else if (arg[0] == '-')
+            return usage();
+        else
+            socket_path = arg;
+    }
+    auto connect_to_server = [&](ServerConnection &connection) {
+        return tcp_port ? connection.connect_tcp(tcp_port) : connection.connect_unix(socket_path);
+    };
+
+    // interactive: one statement per line from stdin
+    if (num_clients == 0) {
+        ServerConnection connection;
+        if (!connect_to_server(connection)) {
+            cerr << "sql5300_client: cannot connect: " << strerror(errno) << endl;
+            return EXIT_FAILURE;
+        }
+        string line, response;
+        while (getline(cin, line)) {
+            if (line.empty())
+                continue;
+            if (line == "quit")
+                break;
+            if (!connection.query(line, response)) {
+                cerr << "sql5300_client: connection lost" << endl;
+                return EXIT_FAILURE;
+            }
+            cout << response << flush;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // load test
+    vector<LatencyRecorder> latencies(num_clients);
+    vector<thread> clients;
+    mutex lock;
+    size_t failures = 0;
+    Clock::time_point begin = Clock::now();
+    for (uint c = 0; c < num_clients; c++) {
+        clients.push_back(thread([&, c]() {
+            ServerConnection connection;
+            string response;
+            if (!connect_to_server(connection)) {
+                lock_guard<mutex> guard(lock);
+                failures += num_requests;
+                return;
+            }
+            for (size_t i = 0; i < num_requests; i++) {
+                Clock::time_point start = Clock::now();
+                if (!connection.query(query, response)) {
+                    lock_guard<mutex> guard(lock);
+                    failures += num_requests - i;
+                    return;
+                }
+                latencies[c].record(start);
+            }
+        }));
+    }
+    for (auto &client: clients)
+        client.join();
+    double elapsed = chrono::duration<double>(Clock::now() - begin).count();
+
+    LatencyRecorder total;
+    for (auto const &latency: latencies)
+        total.merge(latency);
+    BenchmarkReporter reporter(cout, json);
+    reporter.report("server.query/clients=" + to_string(num_clients), total, elapsed);
+    if (failures)
+        cerr << "sql5300_client: " << failures << " requests failed" << endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,837 @@
+/**
+ * @file   sql_exec.cpp
+ * @brief  the implementation file for QueryResult and SQLExec
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "sql_exec.h"
+#include <stdlib.h>
+#include <strings.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
+#include "arena.h"
+#include "column_codec.h"
+#include "engine_stats.h"
+#include "expr_compiler.h"
+#include "hash_aggregate.h"
+#include "mvcc.h"
+#include "trace.h"
+using namespace std;
+using namespace hsql;
+
+
+Tables *SQLExec::tables = nullptr;
+
+/**
+ * Print a result as its column names, a separator, one line per row, then the message
+ * @param stream the output stream
+ * @param qres   the result to print
+ * @return the stream
+ */
+ostream &operator<<(ostream &stream, const QueryResult &qres) {
+    if (qres.column_names != nullptr) {
+        for (auto const &column_name: *qres.column_names)
+            stream << column_name << " ";
+        stream << endl << "+";
+        for (uint i = 0; i < qres.column_names->size(); i++)
+            stream << "----------+";
+        stream << endl;
+        for (auto const &row: *qres.rows) {
+            for (auto const &column_name: *qres.column_names) {
+                Value value = row->at(column_name);
+                switch (value.data_type) {
+                    case ColumnAttribute::INT:
+                        stream << value.n;
+                        break;
+                    case ColumnAttribute::TEXT:
+                        stream << "\"" << value.s << "\"";
+                        break;
+                    default:
+                        stream << value_to_string(value);
+                }
+                stream << " ";
+            }
+            stream << endl;
+        }
+    }
+    stream << qres.message;
+    return stream;
+}
+
+QueryResult::~QueryResult() {
+    delete this->column_names;
+    delete this->column_attributes;
+    if (this->rows != nullptr) {
+        for (auto row: *this->rows)
+            delete row;
+        delete this->rows;
+    }
+}
+
+PlanNode::~PlanNode() {
+    for (auto child: this->children)
+        delete child;
+}
+
+string PlanNode::to_string(uint depth) const {
+    string line = string(depth * 2, ' ') + (depth ? "-> " : "") + this->name + " " + this->detail;
+    if (this->analyzed) {
+        char actual[256];
+        snprintf(actual, sizeof(actual),
+                 " (actual time=%.3f ms rows_in=%llu rows_out=%llu pages=%llu bytes=%llu allocations=%llu)",
+                 this->seconds * 1000, (unsigned long long) this->rows_in, (unsigned long long) this->rows_out,
+                 (unsigned long long) this->pages_read, (unsigned long long) this->bytes_decoded,
+                 (unsigned long long) this->allocations);
+        line += actual;
+    }
+    line += "\n";
+    for (auto child: this->children)
+        line += child->to_string(depth + 1);
+    return line;
+}
+
+/**
+ * Measures one operator for EXPLAIN ANALYZE: wall time, plus pages read, bytes decoded and heap allocations
+ * from the engine's counters (zero if they are compiled out). Does nothing without a plan node.
+ */
+class OperatorMeter {
+public:
+    static const u_int64_t RECORDS_READ = ~0ULL;  // rows_in: take it from the records the operator read
+
+    explicit OperatorMeter(PlanNode *node) : node(node) {
+        if (node != nullptr) {
+            this->before = EngineStats::snapshot().counters;
+            this->allocations = EngineStats::total(EngineStats::HEAP_ALLOCATIONS);  // after the snapshot's own
+            this->start = chrono::steady_clock::now();
+        }
+    }
+
+    void finish(u_int64_t rows_in, u_int64_t rows_out) {
+        if (this->node == nullptr)
+            return;
+        this->node->seconds = chrono::duration<double>(chrono::steady_clock::now() - this->start).count();
+        this->node->allocations = EngineStats::total(EngineStats::HEAP_ALLOCATIONS) - this->allocations;
+        vector<u_int64_t> after = EngineStats::snapshot().counters;
+        this->node->rows_in = rows_in == RECORDS_READ ? after[EngineStats::RECORDS_READ]
+                                                        - this->before[EngineStats::RECORDS_READ] : rows_in;
+        this->node->rows_out = rows_out;
+        this->node->pages_read = after[EngineStats::PAGE_READS] - this->before[EngineStats::PAGE_READS];
+        this->node->bytes_decoded = after[EngineStats::UNMARSHAL_BYTES] - this->before[EngineStats::UNMARSHAL_BYTES];
+        this->node->analyzed = true;
+    }
+
+protected:
+    PlanNode *node;
+    vector<u_int64_t> before;
+    u_int64_t allocations;
+    chrono::steady_clock::time_point start;
+};
+
+// "a, b, c"
+static string join(const ColumnNames &names) {
+    string joined;
+    for (auto const &name: names)
+        joined += (joined.empty() ? "" : ", ") + name;
+    return joined;
+}
+
+Tables &SQLExec::get_tables() {
+    if (SQLExec::tables == nullptr) {
+        SQLExec::tables = new Tables();
+        SQLExec::tables->create_if_not_exists();
+    }
+    return *SQLExec::tables;
+}
+
+QueryResult *SQLExec::execute(const SQLStatement *statement) {
+    get_tables();
+    Snapshot snapshot;  // the statement reads the tables as of its start (and sees its own writes)
+    ArenaScope statement_scope;  // the statement's temporaries (each row's scope nests inside)
+    switch (statement->type()) {
+        case kStmtCreate:
+            return create((const CreateStatement *) statement);
+        case kStmtDrop:
+            return drop((const DropStatement *) statement);
+        case kStmtInsert:
+            return insert((const InsertStatement *) statement);
+        case kStmtSelect:
+            return select((const SelectStatement *) statement);
+        default:
+            return new QueryResult("not implemented");
+    }
+}
+
+/**
+ * CREATE TABLE [IF NOT EXISTS] name (columns) [WITH (options)]: record the table in the catalog, then create
+ * its file. If creating the file fails, the catalog rows are removed again.
+ * Options: page_size, layout (row or pax), engine (heap or btree) and key (a btree table's key column; the
+ * first column if not given), which is recorded in _indices as the table's index PRIMARY.
+ */
+QueryResult *SQLExec::create(const CreateStatement *statement, const TableOptions &options,
+                             const ColumnTypes &column_types) {
+    if (statement->type != CreateStatement::kTable)
+        return new QueryResult("not implemented");
+    get_tables();  // may be called directly, not only through execute
+    uint page_size = 0;
+    HeapTable::PageLayout layout = HeapTable::ROW;
+    bool btree = false;
+    Identifier key_column;
+    for (auto const &option: options) {
+        if (option.first == "page_size") {
+            page_size = (uint) strtoul(option.second.c_str(), nullptr, 10);
+            if (!HeapFile::valid_page_size(page_size))
+                throw SQLExecError("page_size must be a power of two from " + to_string(HeapFile::MIN_PAGE_SZ)
+                                   + " to " + to_string(HeapFile::MAX_PAGE_SZ));
+        } else if (option.first == "layout") {
+            if (strcasecmp(option.second.c_str(), "row") != 0 && strcasecmp(option.second.c_str(), "pax") != 0)
+                throw SQLExecError("layout must be row or pax");
+            layout = strcasecmp(option.second.c_str(), "pax") == 0 ? HeapTable::PAX : HeapTable::ROW;
+        } else if (option.first == "engine") {
+            if (strcasecmp(option.second.c_str(), "heap") != 0 && strcasecmp(option.second.c_str(), "btree") != 0)
+                throw SQLExecError("engine must be heap or btree");
+            btree = strcasecmp(option.second.c_str(), "btree") == 0;
+        } else if (option.first == "key") {
+            key_column = option.second;
+        } else {
+            throw SQLExecError("unknown table option " + option.first);
+        }
+    }
+    if (!btree && !key_column.empty())
+        throw SQLExecError("key needs engine = btree");
+    if (btree && layout == HeapTable::PAX)
+        throw SQLExecError("layout applies to heap tables only");
+    if (btree && key_column.empty())
+        key_column = statement->columns->at(0)->name;
+    Identifier table_name = statement->tableName;
+    ValueDict row;
+    row["table_name"] = Value(table_name);
+    ValueDicts column_rows;
+    for (auto const &column: *statement->columns) {
+        ValueDict *column_row = new ValueDict(row);
+        (*column_row)["column_name"] = Value(column->name);
+        ColumnTypes::const_iterator column_type = column_types.find(column->name);
+        bool known = true;
+        ColumnAttribute::DataType data_type = ColumnAttribute::INT;
+        if (column_type != column_types.end())
+            data_type = column_type->second;
+        else if (column->type == ColumnDefinition::TEXT)
+            data_type = ColumnAttribute::TEXT;
+        else if (column->type == ColumnDefinition::DOUBLE)
+            data_type = ColumnAttribute::DOUBLE;
+        else
+            known = column->type == ColumnDefinition::INT;
+        (*column_row)["data_type"] = Value(codec_ops(data_type).name);
+        column_rows.push_back(column_row);
+        if (!known) {
+            for (auto r: column_rows)
+                delete r;
+            throw SQLExecError("unrecognized data type for column " + string(column->name));
+        }
+    }
+
+    Handle table_handle;
+    try {
+        table_handle = tables->insert(&row);
+    } catch (DbRelationError &e) {
+        for (auto r: column_rows)
+            delete r;
+        if (statement->ifNotExists)
+            return new QueryResult("table " + table_name + " already exists");
+        throw;
+    }
+    Handles column_handles;
+    Columns &columns = tables->get_columns_table();
+    Indices &indices = tables->get_indices_table();
+    Handles index_handles;
+    try {
+        for (auto const &column_row: column_rows)
+            column_handles.push_back(columns.insert(column_row));
+        if (btree) {
+            ValueDict index_row;
+            index_row["table_name"] = Value(table_name);
+            index_row["index_name"] = Value(BTreeTable::PRIMARY);
+            index_row["column_name"] = Value(key_column);
+            index_row["seq_in_index"] = Value(1);
+            index_row["index_type"] = Value("BTREE");
+            index_row["is_unique"] = Value(1);
+            index_handles.push_back(indices.insert(&index_row));
+        }
+        DbRelation &table = tables->get_table(table_name);
+        HeapTable *heap_table = dynamic_cast<HeapTable *>(&table);
+        BTreeTable *btree_table = dynamic_cast<BTreeTable *>(&table);
+        if (page_size != 0 && heap_table != nullptr)
+            heap_table->set_page_size(page_size);
+        if (page_size != 0 && btree_table != nullptr)
+            btree_table->set_page_size(page_size);
+        if (heap_table != nullptr)
+            heap_table->set_layout(layout);
+        if (statement->ifNotExists)
+            table.create_if_not_exists();
+        else
+            table.create();
+    } catch (exception &e) {
+        try {
+            for (auto const &handle: index_handles)
+                indices.del(handle);
+            for (auto const &handle: column_handles)
+                columns.del(handle);
+            tables->del(table_handle);
+        } catch (exception &ignored) {
+        }
+        for (auto r: column_rows)
+            delete r;
+        throw;
+    }
+    for (auto r: column_rows)
+        delete r;
+    return new QueryResult("created " + table_name);
+}
+
+// text in upper case
+static string upper_case(string text) {
+    for (auto &c: text)
+        c = (char) toupper(c);
+    return text;
+}
+
+// split off the first whitespace-delimited word of text (a '(' ends it too), leaving what follows
+static string next_word(string &text) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start == string::npos) {
+        text = "";
+        return "";
+    }
+    size_t end = text.find_first_of(" \t\r\n(", start);
+    string word = text.substr(start, end == string::npos ? string::npos : end - start);
+    text = end == string::npos ? "" : text.substr(end);
+    return word;
+}
+
+bool SQLExec::split_column_types(string &create, ColumnTypes &column_types) {
+    size_t open = create.find('(');
+    size_t close = create.rfind(')');
+    if (open == string::npos || close == string::npos || close < open)
+        return false;
+    string rewritten = create.substr(0, open + 1);
+    stringstream list(create.substr(open + 1, close - open - 1));
+    string column;
+    bool first = true;
+    while (getline(list, column, ',')) {
+        string rest = column;
+        string name = next_word(rest);
+        string type = next_word(rest);
+        ColumnAttribute::DataType data_type;
+        string upper = upper_case(type);
+        if (!name.empty() && data_type_named(type, data_type) && upper != "INT" && upper != "TEXT"
+            && upper != "DOUBLE") {
+            column_types[name] = data_type;
+            column = " " + name + " INT" + rest;
+        }
+        rewritten += (first ? "" : ",") + column;
+        first = false;
+    }
+    create = rewritten + create.substr(close);
+    return !column_types.empty();
+}
+
+/**
+ * Split CREATE TABLE ... WITH (...) into the statement the parser takes and its options. The shell, its script
+ * mode and the bulk loader all run CREATE TABLE through here.
+ */
+bool SQLExec::split_create(const string &statement, string &create, TableOptions &options,
+                           ColumnTypes &column_types) {
+    string rest = statement;
+    if (upper_case(next_word(rest)) != "CREATE" || upper_case(next_word(rest)) != "TABLE")
+        return false;
+    options.clear();
+    column_types.clear();
+    create = statement.substr(0, statement.find_last_not_of(" \t\r\n;") + 1);
+    // WITH (...) comes after the column list, so it is the end of the statement
+    string upper = upper_case(statement);
+    size_t close = upper.find_last_not_of(" \t\r\n;");
+    size_t open = close == string::npos ? string::npos : upper.rfind('(', close);
+    bool with = open != string::npos && upper[close] == ')';
+    size_t with_end = with ? upper.find_last_not_of(" \t\r\n", open - 1) : string::npos;
+    with = with_end != string::npos && with_end >= 4 && upper.compare(with_end - 3, 4, "WITH") == 0;
+    size_t columns_end = with ? upper.find_last_not_of(" \t\r\n", with_end - 4) : string::npos;
+    with = columns_end != string::npos && upper[columns_end] == ')';
+    if (with) {
+        create = statement.substr(0, columns_end + 1);
+        stringstream list(statement.substr(open + 1, close - open - 1));
+        string option;
+        while (getline(list, option, ',')) {
+            size_t equals = option.find('=');
+            string name = option.substr(0, equals), value = equals == string::npos ? "" : option.substr(equals + 1);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            value.erase(0, value.find_first_not_of(" \t'"));
+            value.erase(value.find_last_not_of(" \t'") + 1);
+            for (auto &c: name)
+                c = (char) tolower(c);
+            options[name] = value;
+        }
+    }
+    bool typed = split_column_types(create, column_types);
+    return with || typed;
+}
+
+/**
+ * DROP TABLE name: remove the file, then the table's rows in _indices, _columns, _statistics and _tables
+ */
+QueryResult *SQLExec::drop(const DropStatement *statement) {
+    if (statement->type != DropStatement::kTable)
+        return new QueryResult("not implemented");
+    Identifier table_name = statement->name;
+    if (table_name == Tables::TABLE_NAME || table_name == Columns::TABLE_NAME || table_name == Indices::TABLE_NAME
+        || table_name == Statistics::TABLE_NAME)
+        throw SQLExecError("cannot drop a schema table");
+
+    DbRelation &table = tables->get_table(table_name);
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    HeapTable *catalog_tables[] = {&tables->get_indices_table(), &tables->get_columns_table()};
+    for (auto catalog_table: catalog_tables) {
+        Handles *handles = catalog_table->select(&where);
+        for (auto const &handle: *handles)
+            catalog_table->del(handle);
+        delete handles;
+    }
+    tables->get_statistics_table().remove(table_name);
+    table.drop();
+
+    Handles *handles = tables->select(&where);
+    for (auto const &handle: *handles)
+        tables->del(handle);  // also evicts the table from the schema cache
+    delete handles;
+    return new QueryResult("dropped " + table_name);
+}
+
+// The value of a literal in an INSERT: INT, or BIGINT if it doesn't fit; DOUBLE; or TEXT
+Value SQLExec::literal(const Expr *expr) {
+    bool negate = false;
+    if (expr->type == kExprOperator && expr->opType == Expr::UMINUS && expr->expr != nullptr
+        && (expr->expr->type == kExprLiteralInt || expr->expr->type == kExprLiteralFloat)) {
+        negate = true;
+        expr = expr->expr;
+    }
+    switch (expr->type) {
+        case kExprLiteralInt: {
+            int64_t n = negate ? -expr->ival : expr->ival;
+            return n >= INT32_MIN && n <= INT32_MAX ? Value((int32_t) n) : Value::bigint(n);
+        }
+        case kExprLiteralFloat:
+            return Value::real(negate ? -expr->fval : expr->fval);
+        case kExprLiteralString:
+            return Value(expr->name);
+        default:
+            throw SQLExecError("only number and string literals can be inserted");
+    }
+}
+
+/**
+ * INSERT INTO name [(columns)] VALUES (values)
+ */
+QueryResult *SQLExec::insert(const InsertStatement *statement) {
+    if (statement->type != InsertStatement::kInsertValues)
+        return new QueryResult("not implemented");
+    DbRelation &table = tables->get_table(statement->tableName);
+    const ColumnNames &table_columns = table.get_column_names();
+    ColumnNames column_names;
+    if (statement->columns != nullptr) {
+        for (auto const &column_name: *statement->columns)
+            column_names.push_back(column_name);
+    } else {
+        column_names = table_columns;
+    }
+    if (column_names.size() != statement->values->size())
+        throw SQLExecError("wrong number of values");
+
+    ValueDict row;
+    for (uint i = 0; i < column_names.size(); i++)
+        row[column_names[i]] = literal(statement->values->at(i));
+    table.insert(&row);
+    return new QueryResult("successfully inserted 1 row into " + string(statement->tableName));
+}
+
+/**
+ * SELECT columns FROM name [WHERE ...] [GROUP BY ...]
+ * The WHERE clause is compiled once against the table's schema. Aggregates (COUNT, SUM, MIN, MAX)
+ * and GROUP BY run through HashAggregate with one worker per hardware thread.
+ * @param statement the SELECT
+ * @param plan      if given, receives the operator tree (freed by caller), measured as it runs
+ * @param execute   false to only plan (for EXPLAIN); the result then has no rows
+ */
+QueryResult *SQLExec::select(const SelectStatement *statement, PlanNode **plan, bool execute) {
+    if (statement->fromTable == nullptr || statement->fromTable->type != kTableName)
+        return new QueryResult("not implemented");
+    TraceSpan planning("SQLExec::plan", "plan");
+    DbRelation &table = tables->get_table(statement->fromTable->name);
+    const ColumnNames &table_columns = table.get_column_names();
+    const ColumnAttributes &table_attributes = table.get_column_attributes();
+
+    ColumnNames *column_names = new ColumnNames();
+    ColumnAttributes *column_attributes = new ColumnAttributes();
+    ColumnNames group_by;
+    AggregateSpecs aggregates;
+    auto type_of = [&](const Identifier &column_name) -> ColumnAttribute {
+        for (uint i = 0; i < table_columns.size(); i++)
+            if (table_columns[i] == column_name)
+                return table_attributes[i];
+        delete column_names;
+        delete column_attributes;
+        throw SQLExecError("unknown column " + column_name);
+    };
+    for (auto const &expr: *statement->selectList) {
+        if (expr->type == kExprStar) {
+            column_names->insert(column_names->end(), table_columns.begin(), table_columns.end());
+            column_attributes->insert(column_attributes->end(), table_attributes.begin(), table_attributes.end());
+        } else if (expr->type == kExprColumnRef) {
+            column_attributes->push_back(type_of(expr->name));
+            column_names->push_back(expr->name);
+        } else if (expr->type == kExprFunctionRef && expr->expr != nullptr) {
+            AggregateSpec::Function function;
+            if (strcasecmp(expr->name, "COUNT") == 0)
+                function = AggregateSpec::COUNT;
+            else if (strcasecmp(expr->name, "SUM") == 0)
+                function = AggregateSpec::SUM;
+            else if (strcasecmp(expr->name, "MIN") == 0)
+                function = AggregateSpec::MIN;
+            else if (strcasecmp(expr->name, "MAX") == 0)
+                function = AggregateSpec::MAX;
+            else {
+                delete column_names;
+                delete column_attributes;
+                throw SQLExecError("unknown function " + string(expr->name));
+            }
+            Identifier argument = expr->expr->type == kExprStar ? "*" : expr->expr->name;
+            ColumnAttribute result_type(ColumnAttribute::INT);
+            if (argument != "*")
+                result_type = type_of(argument);
+            else if (function != AggregateSpec::COUNT) {
+                delete column_names;
+                delete column_attributes;
+                throw SQLExecError("only COUNT can take *");
+            }
+            if (function == AggregateSpec::SUM && result_type.get_data_type() != ColumnAttribute::INT
+                && result_type.get_data_type() != ColumnAttribute::BIGINT) {
+                delete column_names;
+                delete column_attributes;
+                throw SQLExecError("SUM needs an INT or BIGINT column");
+            }
+            if (function == AggregateSpec::COUNT || function == AggregateSpec::SUM)
+                result_type = ColumnAttribute(ColumnAttribute::BIGINT);  // a count or sum outgrows 32 bits
+            AggregateSpec aggregate(function, argument);
+            aggregates.push_back(aggregate);
+            column_names->push_back(aggregate.output_name());
+            column_attributes->push_back(result_type);
+        } else {
+            delete column_names;
+            delete column_attributes;
+            throw SQLExecError("unsupported select list expression");
+        }
+    }
+    if (statement->groupBy != nullptr && statement->groupBy->columns != nullptr) {
+        for (auto const &expr: *statement->groupBy->columns) {
+            type_of(expr->name);
+            group_by.push_back(expr->name);
+        }
+    }
+
+    CompiledPredicate *predicate = nullptr;
+    if (statement->whereClause != nullptr)
+        predicate = ExprCompiler::compile(statement->whereClause, table_columns, table_attributes);
+    HeapTable *heap_table = dynamic_cast<HeapTable *>(&table);
+    BTreeTable *btree_table = dynamic_cast<BTreeTable *>(&table);
+    ColumnRange key_range;
+    if (btree_table != nullptr)
+        key_range = ExprCompiler::column_range(statement->whereClause, table_columns, table_attributes,
+                                               btree_table->get_key_ordinal());
+    bool aggregating = !aggregates.empty() || !group_by.empty();
+    if (aggregating && heap_table == nullptr) {
+        delete predicate;
+        delete column_names;
+        delete column_attributes;
+        throw SQLExecError("aggregation needs a heap table");
+    }
+    uint num_threads = thread::hardware_concurrency();
+
+    PlanNode *root = nullptr, *scan = nullptr;
+    if (plan != nullptr) {
+        string detail = table.get_table_name();
+        if (heap_table != nullptr) {
+            AccessPath access = plan_access(*heap_table, statement->whereClause);
+            detail = access.to_string(table.get_table_name());
+            if (access.kind == AccessPath::INDEX_LOOKUP)
+                detail += " [no index access method yet: scanning]";
+        }
+        if (btree_table != nullptr) {
+            string range = key_range.to_string(btree_table->get_key_column());
+            if (key_range.is_point())
+                detail += " point lookup " + range;
+            else
+                detail += range.empty() ? " all leaves in key order" : " leaves for " + range;
+        }
+        if (predicate != nullptr)
+            detail += " filter: " + to_string(predicate->size()) + " instructions";
+        scan = new PlanNode(btree_table != nullptr ? "BTreeScan" : "TableScan", detail);
+        if (aggregating) {
+            string aggregate_detail = "group by (" + join(group_by) + ") computing";
+            for (auto const &aggregate: aggregates)
+                aggregate_detail += " " + aggregate.output_name();
+            root = new PlanNode("HashAggregate", aggregate_detail + ", " + to_string(num_threads) + " threads");
+            scan->detail += " (runs inside HashAggregate)";
+        } else {
+            root = new PlanNode("Project", "(" + join(*column_names) + ")");
+        }
+        root->children.push_back(scan);
+        *plan = root;
+        if (!execute) {
+            delete predicate;
+            return new QueryResult(column_names, column_attributes, new ValueDicts(), "");
+        }
+    }
+
+    planning.finish();
+
+    ValueDicts *rows;
+    if (aggregating) {
+        TRACE_SPAN("HashAggregate", "operator");
+        OperatorMeter meter(root);
+        HashAggregate aggregate(*heap_table, group_by, aggregates, num_threads,
+                                HashAggregate::DEFAULT_MAX_GROUPS, predicate);
+        rows = aggregate.execute();
+        meter.finish(OperatorMeter::RECORDS_READ, rows->size());
+    } else {
+        TraceSpan scan_span("TableScan", "operator");
+        OperatorMeter scan_meter(scan);
+        Handles *handles;
+        if (heap_table != nullptr)
+            handles = heap_table->select(predicate);
+        else if (btree_table != nullptr)
+            handles = btree_table->select(key_range, predicate);
+        else
+            handles = table.select();
+        scan_meter.finish(OperatorMeter::RECORDS_READ, handles->size());
+        scan_span.finish();
+        TRACE_SPAN("Project", "operator");
+        OperatorMeter project_meter(root);
+        rows = new ValueDicts();
+        for (auto const &handle: *handles)
+            rows->push_back(table.project(handle, column_names));
+        project_meter.finish(handles->size(), rows->size());
+        delete handles;
+    }
+    delete predicate;
+    return new QueryResult(column_names, column_attributes, rows,
+                           "successfully returned " + to_string(rows->size()) + " rows");
+}
+
+/**
+ * EXPLAIN [ANALYZE] SELECT ...
+ * @param statement the SELECT
+ * @param analyze   also run the query and report what each operator did
+ * @return the operator tree, one line per operator
+ */
+QueryResult *SQLExec::explain(const SelectStatement *statement, bool analyze) {
+    get_tables();
+    PlanNode *plan = nullptr;
+    auto start = chrono::steady_clock::now();
+    QueryResult *result;
+    try {
+        result = select(statement, &plan, analyze);
+    } catch (...) {
+        delete plan;
+        throw;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (plan == nullptr) {
+        delete result;
+        return new QueryResult("nothing to explain");
+    }
+    string message = plan->to_string();
+    if (analyze) {
+        char total[128];
+        snprintf(total, sizeof(total), "total: %.3f ms, %zu rows", seconds * 1000, result->get_rows()->size());
+        message += total;
+    } else {
+        message.pop_back();
+    }
+    delete plan;
+    delete result;
+    return new QueryResult(message);
+}
+
+QueryResult *SQLExec::show_tables() {
+    ColumnNames *column_names = new ColumnNames();
+    column_names->push_back("table_name");
+    ColumnAttributes *column_attributes = new ColumnAttributes();
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+
+    Tables &tables = get_tables();
+    ValueDicts *rows = new ValueDicts();
+    Handles *handles = tables.select();
+    for (auto const &handle: *handles) {
+        ValueDict *row = tables.project(handle, column_names);
+        if ((*row)["table_name"].s[0] == '_')  // schema and test tables
+            delete row;
+        else
+            rows->push_back(row);
+    }
+    delete handles;
+    return new QueryResult(column_names, column_attributes, rows,
+                           "successfully returned " + to_string(rows->size()) + " rows");
+}
+
+QueryResult *SQLExec::show_columns(Identifier table_name) {
+    ColumnNames *column_names = new ColumnNames();
+    column_names->push_back("table_name");
+    column_names->push_back("column_name");
+    column_names->push_back("data_type");
+    ColumnAttributes *column_attributes = new ColumnAttributes(3, ColumnAttribute(ColumnAttribute::TEXT));
+
+    Columns &columns = get_tables().get_columns_table();
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    ValueDicts *rows = new ValueDicts();
+    Handles *handles = columns.select(&where);
+    for (auto const &handle: *handles)
+        rows->push_back(columns.project(handle, column_names));
+    delete handles;
+    return new QueryResult(column_names, column_attributes, rows,
+                           "successfully returned " + to_string(rows->size()) + " rows");
+}
+
+// Counters can pass INT's range; clamp rather than wrap
+static Value count_value(u_int64_t n) {
+    return Value((int32_t) min(n, (u_int64_t) INT32_MAX));
+}
+
+QueryResult *SQLExec::show_stats() {
+    ColumnNames *column_names = new ColumnNames();
+    column_names->push_back("counter");
+    column_names->push_back("value");
+    ColumnAttributes *column_attributes = new ColumnAttributes();
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::INT));
+    StatsSnapshot snapshot = EngineStats::snapshot();
+    ValueDicts *rows = new ValueDicts();
+    for (uint c = 0; c < EngineStats::NUM_COUNTERS; c++) {
+        ValueDict *row = new ValueDict();
+        (*row)["counter"] = Value(EngineStats::counter_name(c));
+        (*row)["value"] = count_value(snapshot.counters[c]);
+        rows->push_back(row);
+    }
+    return new QueryResult(column_names, column_attributes, rows,
+                           "successfully returned " + to_string(rows->size()) + " rows");
+}
+
+QueryResult *SQLExec::show_latencies() {
+    ColumnNames *column_names = new ColumnNames();
+    column_names->push_back("operation");
+    column_names->push_back("count");
+    column_names->push_back("p50_ns");
+    column_names->push_back("p99_ns");
+    column_names->push_back("p999_ns");
+    column_names->push_back("max_ns");
+    ColumnAttributes *column_attributes = new ColumnAttributes(column_names->size(),
+                                                               ColumnAttribute(ColumnAttribute::INT));
+    (*column_attributes)[0] = ColumnAttribute(ColumnAttribute::TEXT);
+    StatsSnapshot snapshot = EngineStats::snapshot();
+    ValueDicts *rows = new ValueDicts();
+    for (uint t = 0; t < EngineStats::NUM_TIMERS; t++) {
+        ValueDict *row = new ValueDict();
+        (*row)["operation"] = Value(EngineStats::timer_name(t));
+        (*row)["count"] = count_value(snapshot.count(t));
+        (*row)["p50_ns"] = count_value(snapshot.percentile(t, 50));
+        (*row)["p99_ns"] = count_value(snapshot.percentile(t, 99));
+        (*row)["p999_ns"] = count_value(snapshot.percentile(t, 99.9));
+        (*row)["max_ns"] = count_value(snapshot.percentile(t, 100));
+        rows->push_back(row);
+    }
+#ifdef ENGINE_STATS_DISABLED
+    string message = "engine statistics were compiled out (ENGINE_STATS_DISABLED)";
+#else
+    string message = "successfully returned " + to_string(rows->size()) + " rows";
+#endif
+    return new QueryResult(column_names, column_attributes, rows, message);
+}
+
+/**
+ * ANALYZE: gather and store statistics for one table, or for every user table
+ * @param table_name the table, or "" for all of them
+ * @return a row per analyzed column
+ */
+QueryResult *SQLExec::analyze(Identifier table_name) {
+    Tables &tables = get_tables();
+    ColumnNames table_names;
+    if (table_name.empty()) {
+        Handles *handles = tables.select();
+        for (auto const &handle: *handles) {
+            ValueDict *row = tables.project(handle);
+            if ((*row)["table_name"].s[0] != '_')
+                table_names.push_back((*row)["table_name"].s);
+            delete row;
+        }
+        delete handles;
+    } else {
+        table_names.push_back(table_name);
+    }
+
+    ColumnNames *column_names = new ColumnNames();
+    column_names->push_back("table_name");
+    column_names->push_back("column_name");
+    column_names->push_back("row_count");
+    column_names->push_back("block_count");
+    column_names->push_back("distinct_values");
+    ColumnAttributes *column_attributes = new ColumnAttributes();
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::INT));
+    ValueDicts *rows = new ValueDicts();
+    size_t analyzed = 0;
+    ColumnNames skipped;  // statistics are kept for heap tables only
+    try {
+        for (auto const &name: table_names) {
+            HeapTable *table = dynamic_cast<HeapTable *>(&tables.get_table(name));
+            if (table == nullptr) {
+                skipped.push_back(name);
+                continue;
+            }
+            analyzed++;
+            TableStatistics statistics = Analyzer::analyze(*table);
+            tables.get_statistics_table().put(name, statistics);
+            for (auto const &column: table->get_column_names()) {
+                ValueDict *row = new ValueDict();
+                (*row)["table_name"] = Value(name);
+                (*row)["column_name"] = Value(column);
+                (*row)["row_count"] = Value((int32_t) statistics.row_count);
+                (*row)["block_count"] = Value((int32_t) statistics.block_count);
+                (*row)["distinct_values"] = Value((int32_t) statistics.columns[column].distinct);
+                rows->push_back(row);
+            }
+        }
+    } catch (...) {
+        QueryResult partial(column_names, column_attributes, rows, "");  // frees what we built so far
+        throw;
+    }
+    string message = "analyzed " + to_string(analyzed) + " tables";
+    if (!skipped.empty())
+        message += "; skipped " + join(skipped) + " (not heap tables)";
+    return new QueryResult(column_names, column_attributes, rows, message);
+}
+
+AccessPath SQLExec::plan_access(HeapTable &table, const hsql::Expr *where) {
+    Tables &tables = get_tables();
+    const TableStatistics &statistics = tables.get_statistics_table().get(table);
+    map<Identifier, ColumnNames> index_columns;
+    Indices &indices = tables.get_indices_table();
+    IndexNames *index_names = indices.get_index_names(table.get_table_name());
+    for (auto const &index_name: *index_names) {
+        bool is_unique;
+        index_columns[index_name] = indices.get_index_columns(table.get_table_name(), index_name, is_unique);
+    }
+    delete index_names;
+    return CostModel::choose_access_path(where, statistics, index_columns);
+}
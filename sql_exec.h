@@ -0,0 +1,189 @@
+/**
+ * @file   sql_exec.h
+ * @brief  Execution of parsed SQL statements against the catalog and the heap storage engine
+ *
+ * QueryResult: the column names, types and rows a statement produced, plus a message
+ * SQLExec: runs CREATE TABLE, DROP TABLE, INSERT and SELECT (including COUNT/SUM/MIN/MAX and GROUP BY),
+ *          and ANALYZE
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <iostream>
+#include <map>
+#include <string>
+#include "SQLParser.h"
+#include "schema_tables.h"
+
+/**
+ * @class SQLExecError - exception for SQLExec methods
+ */
+class SQLExecError : public std::runtime_error {
+public:
+    explicit SQLExecError(std::string s) : runtime_error(s) {}
+};
+
+// the options of CREATE TABLE ... WITH (name = value, ...), by lower-case name
+typedef std::map<std::string, std::string> TableOptions;
+
+// the types of CREATE TABLE columns the parser doesn't know (it is given INT for them), by column name
+typedef std::map<Identifier, ColumnAttribute::DataType> ColumnTypes;
+
+/**
+ * @class QueryResult - data structure to hold all the returned data for a query execution
+ */
+class QueryResult {
+public:
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+
+    QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
+                                       message(message) {}
+
+    // takes ownership of column_names, column_attributes and rows
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows,
+                std::string message) : column_names(column_names), column_attributes(column_attributes),
+                                       rows(rows), message(message) {}
+
+    virtual ~QueryResult();
+
+    QueryResult(const QueryResult &other) = delete;
+
+    QueryResult &operator=(const QueryResult &other) = delete;
+
+    ColumnNames *get_column_names() const { return column_names; }
+
+    ColumnAttributes *get_column_attributes() const { return column_attributes; }
+
+    ValueDicts *get_rows() const { return rows; }
+
+    const std::string &get_message() const { return message; }
+
+    friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
+
+protected:
+    ColumnNames *column_names;
+    ColumnAttributes *column_attributes;
+    ValueDicts *rows;
+    std::string message;
+};
+
+/**
+ * @class PlanNode - one operator of a query plan, and what EXPLAIN ANALYZE measured when it ran
+ */
+class PlanNode {
+public:
+    PlanNode(std::string name, std::string detail) : name(name), detail(detail), analyzed(false), seconds(0),
+                                                     rows_in(0), rows_out(0), pages_read(0), bytes_decoded(0),
+                                                     allocations(0) {}
+
+    virtual ~PlanNode();
+
+    PlanNode(const PlanNode &other) = delete;
+
+    PlanNode &operator=(const PlanNode &other) = delete;
+
+    // this operator and its inputs, one per line, inputs indented under the operator that consumes them
+    virtual std::string to_string(uint depth = 0) const;
+
+    std::string name;
+    std::string detail;
+    std::vector<PlanNode *> children;  // owned
+    bool analyzed;
+    double seconds;
+    u_int64_t rows_in;
+    u_int64_t rows_out;
+    u_int64_t pages_read;
+    u_int64_t bytes_decoded;
+    u_int64_t allocations;  // heap allocations while it ran
+};
+
+/**
+ * @class SQLExec - execution engine
+ *
+ *      All table metadata goes through one Tables instance, so after its first use a table's schema
+ *      comes from the schema cache rather than from a scan of _columns.
+ */
+class SQLExec {
+public:
+    /**
+     * Execute the given SQL statement.
+     * @param statement   the parsed SQL statement to execute
+     * @returns           the query result (freed by caller)
+     * @throws            SQLExecError (or DbRelationError from the storage engine)
+     */
+    static QueryResult *execute(const hsql::SQLStatement *statement);
+
+    // SHOW TABLES
+    static QueryResult *show_tables();
+
+    // SHOW COLUMNS FROM table_name
+    static QueryResult *show_columns(Identifier table_name);
+
+    // SHOW STATS: the engine's event counters since the last RESET STATS
+    static QueryResult *show_stats();
+
+    // SHOW STATS (second part): count and p50/p99/p99.9/max latency of each timed storage operation
+    static QueryResult *show_latencies();
+
+    /**
+     * EXPLAIN [ANALYZE] for a SELECT.
+     * @param statement  the SELECT
+     * @param analyze    run it too, and report time, rows in/out, pages read and bytes decoded per operator
+     * @returns          the operator tree as the result's message (freed by caller)
+     */
+    static QueryResult *explain(const hsql::SelectStatement *statement, bool analyze);
+
+    // ANALYZE [table_name] -- all user tables if table_name is empty
+    static QueryResult *analyze(Identifier table_name);
+
+    /**
+     * The planner's choice of how to read a table for a WHERE clause, from its statistics and indices.
+     * @param table  the table
+     * @param where  the WHERE clause (may be nullptr)
+     */
+    static AccessPath plan_access(HeapTable &table, const hsql::Expr *where);
+
+    // the catalog, opened (and created if necessary) on first use
+    static Tables &get_tables();
+
+    // the value of a number or string literal in an INSERT (needs no catalog, so any thread may call it);
+    // the table converts it to the column's type
+    static Value literal(const hsql::Expr *expr);
+
+    /**
+     * CREATE TABLE, with the options of its WITH clause (which the parser doesn't know)
+     * @param statement  the CREATE TABLE
+     * @param options    page_size: the size of the table's blocks in bytes (a power of two from 4096 to 65536)
+     * @param column_types  the types of the columns the parser was told are INT (BIGINT, BOOLEAN, DATE, ...)
+     * @returns          the query result (freed by caller)
+     * @throws           SQLExecError for an unknown or invalid option
+     */
+    static QueryResult *create(const hsql::CreateStatement *statement, const TableOptions &options = TableOptions(),
+                               const ColumnTypes &column_types = ColumnTypes());
+
+    /**
+     * Split CREATE TABLE ... WITH (name = value, ...) into the CREATE TABLE and its options, and give the parser
+     * INT for the column types it doesn't know (BIGINT, BOOLEAN, DATE, TIMESTAMP). Needs no catalog.
+     * @param statement     the statement's text
+     * @param create        set to the statement without its WITH clause, those types given as INT
+     * @param options       set to the options, by lower-case name
+     * @param column_types  set to the real types of the columns given as INT, by column name
+     * @returns             true if the statement was a CREATE TABLE with a WITH clause or such a type
+     */
+    static bool split_create(const std::string &statement, std::string &create, TableOptions &options,
+                             ColumnTypes &column_types);
+
+protected:
+    static Tables *tables;
+
+    // give the parser INT for the column types it doesn't know; true if any column was rewritten
+    static bool split_column_types(std::string &create, ColumnTypes &column_types);
+
+    static QueryResult *drop(const hsql::DropStatement *statement);
+
+    static QueryResult *insert(const hsql::InsertStatement *statement);
+
+    static QueryResult *select(const hsql::SelectStatement *statement, PlanNode **plan = nullptr,
+                               bool execute = true);
+};
@@ -0,0 +1,127 @@
+/**
+ * @file   sql_script.cpp
+ * @brief  the implementation file for SQLScriptReader
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "sql_script.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+using namespace std;
+
+
+/**
+ * Testing function for SQLScriptReader.
+ * Multi-line statements, quotes holding ';' and '--', comments, a missing final ';', and a block boundary.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_sql_script() {
+    string long_value(SQLScriptReader::BLOCK_SIZE, 'x');
+    stringstream script;
+    script << "-- a comment; not a statement\n"
+           << "create table t (a int,\n   b text);\n"
+           << "insert into t values (1, 'it''s; -- fine');;\n"
+           << "\n  select * from t -- trailing comment\n  where a = 1;\n"
+           << "insert into t values (2, '" << long_value << "');\n"
+           << "show tables";
+    vector<string> expected = {"create table t (a int,\n   b text)", "insert into t values (1, 'it''s; -- fine')",
+                               "select * from t -- trailing comment\n  where a = 1",
+                               "insert into t values (2, '" + long_value + "')", "show tables"};
+    vector<size_t> expected_lines = {2, 4, 6, 8, 9};
+    SQLScriptReader reader(script);
+    string statement;
+    size_t i = 0;
+    bool ok = true;
+    while (reader.next(statement)) {
+        if (i >= expected.size() || statement != expected[i] || reader.get_line() != expected_lines[i]) {
+            cout << "FAILED TEST: statement " << i << " on line " << reader.get_line() << ": "
+                 << statement.substr(0, 80) << endl;
+            ok = false;
+        }
+        i++;
+    }
+    if (i != expected.size()) {
+        cout << "FAILED TEST: " << i << " statements" << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+
+/*****************************************SQLScriptReader***********************************************************/
+
+size_t SQLScriptReader::statement_end(const string &text, size_t start) {
+    char quote = 0;
+    for (size_t i = start; i < text.length(); i++) {
+        char c = text[i];
+        if (quote != 0) {
+            if (c == quote)
+                quote = 0;  // a doubled quote just closes and reopens
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '-' && i + 1 < text.length() && text[i + 1] == '-') {
+            i = text.find('\n', i);
+            if (i == string::npos)
+                return text.length();
+        } else if (c == ';') {
+            return i;
+        }
+    }
+    return text.length();
+}
+
+bool SQLScriptReader::next(string &statement) {
+    while (true) {
+        // skip blank lines, comments and stray semicolons (more input is needed if the text ends inside them)
+        bool need_more = false;
+        while (this->pos < this->buffer.length()) {
+            char c = this->buffer[this->pos];
+            if (c == '\n') {
+                this->line++;
+                this->pos++;
+            } else if (c == ' ' || c == '\t' || c == '\r' || c == ';') {
+                this->pos++;
+            } else if (c == '-' && this->pos + 1 == this->buffer.length()) {
+                need_more = true;
+                break;
+            } else if (c == '-' && this->buffer[this->pos + 1] == '-') {
+                size_t newline = this->buffer.find('\n', this->pos);
+                if (newline == string::npos) {
+                    need_more = true;
+                    break;
+                }
+                this->pos = newline;
+            } else {
+                break;
+            }
+        }
+        if (this->pos >= this->buffer.length() || need_more) {
+            if (fill())
+                continue;
+            if (this->pos >= this->buffer.length() || this->buffer.compare(this->pos, 2, "--") == 0)
+                return false;  // the script ended, possibly in a comment
+        }
+        size_t end = statement_end(this->buffer, this->pos);
+        if (end == this->buffer.length() && fill())
+            continue;  // unfinished statement: rescan it with the next block
+        this->statement_line = this->line;
+        statement = this->buffer.substr(this->pos, end - this->pos);
+        this->line += count(statement.begin(), statement.end(), '\n');
+        statement.erase(statement.find_last_not_of(" \t\r\n") + 1);
+        this->pos = end < this->buffer.length() ? end + 1 : end;
+        return true;
+    }
+}
+
+bool SQLScriptReader::fill() {
+    if (!this->in)
+        return false;
+    // drop what has been returned already so the buffer holds about one block plus the current statement
+    this->buffer.erase(0, this->pos);
+    this->pos = 0;
+    size_t old_length = this->buffer.length();
+    this->buffer.resize(old_length + BLOCK_SIZE);
+    this->in.read(&this->buffer[old_length], BLOCK_SIZE);
+    this->buffer.resize(old_length + (size_t) this->in.gcount());
+    return this->buffer.length() > old_length;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file   sql_script.h
+ * @brief  Splitting SQL scripts into statements
+ *
+ * SQLScriptReader reads a script from a stream in large blocks and hands back one statement at a time.
+ * Statements end at a ';' outside quotes and may span lines; -- comments run to the end of the line.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <iostream>
+#include <string>
+
+/**
+ * @class SQLScriptReader - the statements of a script, in order
+ */
+class SQLScriptReader {
+public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    explicit SQLScriptReader(std::istream &in) : in(in), pos(0), line(1), statement_line(1) {}
+
+    virtual ~SQLScriptReader() {}
+
+    /**
+     * The next statement, trimmed and without its ';' (a final statement may lack the ';').
+     * Empty statements and comments are skipped.
+     * @param statement  receives the statement
+     * @return           false at the end of the script
+     */
+    virtual bool next(std::string &statement);
+
+    // line of the script the last statement returned by next() starts on
+    virtual size_t get_line() const { return statement_line; }
+
+    /**
+     * Where the statement starting at text[start] ends, honoring quotes and -- comments.
+     * @param text   the script text
+     * @param start  where the statement starts
+     * @return       the index of its ';', or text.length() if the text ends first
+     */
+    static size_t statement_end(const std::string &text, size_t start);
+
+protected:
+    std::istream &in;
+    std::string buffer;  // text read but not yet returned
+    size_t pos;          // start of the unreturned text in buffer
+    size_t line;         // line number at buffer[pos]
+    size_t statement_line;
+
+    // read another block onto the end of buffer; false at end of input
+    virtual bool fill();
+};
+
+bool test_sql_script();
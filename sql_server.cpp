@@ -0,0 +1,534 @@
+/**
+ * @file   sql_server.cpp
+ * @brief  the implementation file for SQLServer
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "sql_server.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <iostream>
+using namespace std;
+
+
+static const size_t READ_SIZE = 64 * 1024;
+static const size_t MAX_REQUEST = 1 << 20;  // longest request line we buffer before giving up on a client
+
+// connect to a Unix socket; -1 on failure
+static int connect_unix(const string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd >= 0 && connect(fd, (sockaddr *) &address, sizeof(address)) == 0)
+        return fd;
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+// read one dot-terminated response from a blocking socket; false if the connection closed first
+static bool read_response(int fd, string &buffer, string &response) {
+    response.clear();
+    while (true) {
+        size_t newline;
+        while ((newline = buffer.find('\n')) != string::npos) {
+            string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (line == ".")
+                return true;
+            response += (line[0] == '.' ? line.substr(1) : line) + "\n";
+        }
+        char chunk[4096];
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, (size_t) n);
+    }
+}
+
+/**
+ * Testing function for SQLServer.
+ * Several clients pipeline requests at a server with an echoing handler and check they get every
+ * response, in order, with dot-stuffing undone; then one sends many times MAX_PENDING requests and shuts
+ * down its side, and still gets them all. run() refuses to start unless SIGINT/SIGTERM are blocked, and a
+ * server process with a background thread (as the version collector is) stops cleanly on SIGTERM.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_sql_server() {
+    string path = "/tmp/sql5300_test_" + to_string(getpid()) + ".sock";
+    SQLServer server(path, 0, 3, [](const string &request) {
+        return "you said\n." + request + "\n";
+    });
+    // the server's thread inherits the mask (this thread gets its own back afterwards)
+    sigset_t old_signals;
+    pthread_sigmask(SIG_SETMASK, nullptr, &old_signals);
+    if (!sigismember(&old_signals, SIGTERM)) {
+        try {
+            server.run();
+            cout << "FAILED TEST: run() started without SIGINT/SIGTERM blocked" << endl;
+            return false;
+        } catch (SQLServerError &e) {
+        }
+    }
+    SQLServer::block_signals();
+    thread loop([&server]() { server.run(); });
+    pthread_sigmask(SIG_SETMASK, &old_signals, nullptr);
+    bool ok = true;
+    vector<thread> clients;
+    mutex lock;
+    for (int c = 0; c < 4; c++) {
+        clients.push_back(thread([&, c]() {
+            int fd = -1;
+            for (int attempt = 0; attempt < 100 && fd < 0; attempt++) {
+                fd = connect_unix(path);
+                if (fd < 0)
+                    usleep(10000);
+            }
+            if (fd < 0) {
+                lock_guard<mutex> guard(lock);
+                cout << "FAILED TEST: could not connect" << endl;
+                ok = false;
+                return;
+            }
+            string requests;
+            for (int i = 0; i < 50; i++)
+                requests += "client " + to_string(c) + " request " + to_string(i) + "\r\n";
+            bool sent = write(fd, requests.data(), requests.size()) == (ssize_t) requests.size();
+            string buffer, response;
+            for (int i = 0; i < 50; i++) {
+                string expected = "you said\n.client " + to_string(c) + " request " + to_string(i) + "\n";
+                if (!read_response(fd, buffer, response) || response != expected) {
+                    lock_guard<mutex> guard(lock);
+                    cout << "FAILED TEST: client " << c << " got " << response << endl;
+                    ok = false;
+                    break;
+                }
+            }
+            char eof;
+            if (!sent || write(fd, "quit\n", 5) != 5 || read(fd, &eof, 1) != 0) {
+                lock_guard<mutex> guard(lock);
+                cout << "FAILED TEST: client " << c << " was not disconnected after quit" << endl;
+                ok = false;
+            }
+            close(fd);
+        }));
+    }
+    for (auto &client: clients)
+        client.join();
+
+    // many more requests than a connection may have waiting, then a shutdown of the client's side right after
+    // the last (which has no newline): every one is answered before the server closes
+    int fd = connect_unix(path);
+    const int MANY = (int) SQLServer::MAX_PENDING * 16;
+    string requests;
+    for (int i = 0; i < MANY; i++)
+        requests += "pipelined " + to_string(i) + (i + 1 < MANY ? "\n" : "");
+    bool sent = fd >= 0 && write(fd, requests.data(), requests.size()) == (ssize_t) requests.size()
+                && shutdown(fd, SHUT_WR) == 0;
+    string buffer, response;
+    int answered = 0;
+    while (sent && answered < MANY && read_response(fd, buffer, response)
+           && response == "you said\n.pipelined " + to_string(answered) + "\n")
+        answered++;
+    char eof;
+    if (answered != MANY || read(fd, &eof, 1) != 0) {
+        cout << "FAILED TEST: " << answered << " of " << MANY << " pipelined requests answered before the close"
+             << endl;
+        ok = false;
+    }
+    if (fd >= 0)
+        close(fd);
+    server.stop();
+    loop.join();
+    if (SQLServer::frame("a\n.b") != "a\n..b\n.\n") {
+        cout << "FAILED TEST: frame" << endl;
+        ok = false;
+    }
+
+    // SIGTERM to a server process: run() returns and the socket is removed, even with another thread started
+    // (after the mask, as sql5300 starts the version collector) that would otherwise take the signal and die
+    string child_path = path + ".child";
+    pid_t child = fork();
+    if (child == 0) {
+        SQLServer::block_signals();
+        atomic<bool> serving(true);
+        thread background([&serving]() {
+            while (serving)
+                usleep(1000);
+        });
+        {
+            SQLServer child_server(child_path, 0, 1, [](const string &request) { return request; });
+            child_server.run();
+        }
+        serving = false;
+        background.join();
+        _exit(access(child_path.c_str(), F_OK) == 0 ? 2 : 0);
+    }
+    int child_fd = -1;
+    for (int attempt = 0; attempt < 500 && child_fd < 0; attempt++) {
+        child_fd = connect_unix(child_path);
+        if (child_fd < 0)
+            usleep(10000);
+    }
+    int status = -1;
+    if (child > 0) {
+        kill(child, SIGTERM);
+        waitpid(child, &status, 0);
+    }
+    if (child_fd < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        cout << "FAILED TEST: server process did not stop cleanly on SIGTERM (status " << status << ")" << endl;
+        ok = false;
+    }
+    if (child_fd >= 0)
+        close(child_fd);
+    return ok;
+}
+
+
+/*****************************************SQLServer*****************************************************************/
+
+SQLServer::SQLServer(string socket_path, uint tcp_port, uint num_workers, Handler handler)
+        : socket_path(socket_path), tcp_port(tcp_port), num_workers(num_workers ? num_workers : 1), handler(handler),
+          epoll_fd(-1), unix_fd(-1), tcp_fd(-1), wake_fd(-1), signal_fd(-1), stopping(false), next_id(1),
+          requests(MAX_CONNECTIONS) {  // a connection has at most one request queued, so push never waits
+    this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->wake_fd < 0)
+        throw SQLServerError(string("eventfd: ") + strerror(errno));
+}
+
+SQLServer::~SQLServer() {
+    for (auto const &entry: this->connections) {
+        close(entry.second->fd);
+        delete entry.second;
+    }
+    for (int fd: {this->epoll_fd, this->unix_fd, this->tcp_fd, this->wake_fd, this->signal_fd})
+        if (fd >= 0)
+            close(fd);
+    if (this->unix_fd >= 0)
+        unlink(this->socket_path.c_str());
+}
+
+string SQLServer::frame(const string &output) {
+    string framed;
+    size_t start = 0;
+    while (start < output.length()) {
+        size_t newline = output.find('\n', start);
+        size_t end = newline == string::npos ? output.length() : newline;
+        if (output[start] == '.')
+            framed += '.';
+        framed.append(output, start, end - start);
+        framed += '\n';
+        start = end + 1;
+    }
+    return framed + ".\n";
+}
+
+void SQLServer::listen_all() {
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0)
+        throw SQLServerError(string("epoll_create1: ") + strerror(errno));
+
+    this->unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_un unix_address;
+    memset(&unix_address, 0, sizeof(unix_address));
+    unix_address.sun_family = AF_UNIX;
+    if (this->socket_path.length() >= sizeof(unix_address.sun_path))
+        throw SQLServerError("socket path too long: " + this->socket_path);
+    strncpy(unix_address.sun_path, this->socket_path.c_str(), sizeof(unix_address.sun_path) - 1);
+    unlink(this->socket_path.c_str());
+    if (this->unix_fd < 0 || bind(this->unix_fd, (sockaddr *) &unix_address, sizeof(unix_address)) != 0
+        || listen(this->unix_fd, SOMAXCONN) != 0)
+        throw SQLServerError("cannot listen on " + this->socket_path + ": " + strerror(errno));
+
+    if (this->tcp_port != 0) {
+        this->tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int yes = 1;
+        setsockopt(this->tcp_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        sockaddr_in tcp_address;
+        memset(&tcp_address, 0, sizeof(tcp_address));
+        tcp_address.sin_family = AF_INET;
+        tcp_address.sin_port = htons((u_int16_t) this->tcp_port);
+        tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (this->tcp_fd < 0 || bind(this->tcp_fd, (sockaddr *) &tcp_address, sizeof(tcp_address)) != 0
+            || listen(this->tcp_fd, SOMAXCONN) != 0)
+            throw SQLServerError("cannot listen on 127.0.0.1:" + to_string(this->tcp_port) + ": " + strerror(errno));
+    }
+
+    for (int fd: {this->unix_fd, this->tcp_fd, this->wake_fd, this->signal_fd}) {
+        if (fd < 0)
+            continue;
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// the signals that stop the server
+static sigset_t stop_signals() {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    return signals;
+}
+
+void SQLServer::block_signals() {
+    sigset_t signals = stop_signals();
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+void SQLServer::run() {
+    // SIGINT/SIGTERM arrive through the loop; the mask has to be set before any thread was started, so here
+    // it is only checked (for this thread, the one that can be)
+    sigset_t signals = stop_signals(), current;
+    pthread_sigmask(SIG_BLOCK, nullptr, &current);
+    if (!sigismember(&current, SIGINT) || !sigismember(&current, SIGTERM))
+        throw SQLServerError("SIGINT/SIGTERM are not blocked (call SQLServer::block_signals at startup)");
+    this->signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    listen_all();
+    for (uint i = 0; i < this->num_workers; i++)
+        this->workers.push_back(thread([this]() { work(); }));
+
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    while (!this->stopping) {
+        int n = epoll_wait(this->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == this->unix_fd || fd == this->tcp_fd) {
+                accept_all(fd);
+            } else if (fd == this->signal_fd) {
+                signalfd_siginfo signal;  // consume it, or the next run() sees it at once
+                if (read(this->signal_fd, &signal, sizeof(signal)) < 0 && errno != EAGAIN)
+                    cerr << "sql5300 server: signalfd read: " << strerror(errno) << endl;
+                this->stopping = true;
+            } else if (fd == this->wake_fd) {
+                u_int64_t count;
+                if (read(this->wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                    cerr << "sql5300 server: eventfd read: " << strerror(errno) << endl;
+                vector<pair<u_int64_t, string> > finished;
+                {
+                    lock_guard<mutex> guard(this->done_mutex);
+                    finished.swap(this->done);
+                }
+                for (auto &response: finished) {
+                    auto found = this->connections.find(response.first);
+                    if (found == this->connections.end())
+                        continue;  // the client went away while its request ran
+                    Connection *connection = found->second;
+                    connection->output += response.second;
+                    connection->busy = false;
+                    dispatch(connection);
+                    write_to(connection);
+                }
+            } else {
+                auto found = this->fd_connections.find(fd);
+                if (found == this->fd_connections.end())
+                    continue;
+                Connection *connection = this->connections[found->second];
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    hang_up(connection);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                    read_from(connection);
+                else if (events[i].events & EPOLLOUT)
+                    write_to(connection);
+            }
+        }
+    }
+
+    this->requests.close();
+    for (auto &worker: this->workers)
+        worker.join();
+    this->workers.clear();
+}
+
+void SQLServer::stop() {
+    this->stopping = true;
+    u_int64_t one = 1;
+    if (write(this->wake_fd, &one, sizeof(one)) < 0)
+        cerr << "sql5300 server: eventfd write: " << strerror(errno) << endl;
+}
+
+void SQLServer::accept_all(int listen_fd) {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;  // EAGAIN: accepted everything pending
+        if (this->connections.size() >= MAX_CONNECTIONS) {
+            static const string refusal = frame("Error: too many connections");
+            if (send(fd, refusal.data(), refusal.length(), MSG_NOSIGNAL) < 0)
+                cerr << "sql5300 server: refusing a connection: " << strerror(errno) << endl;
+            close(fd);
+            continue;
+        }
+        Connection *connection = new Connection();
+        connection->id = this->next_id++;
+        connection->fd = fd;
+        connection->busy = connection->closing = connection->quit = connection->read_closed = false;
+        connection->gone = false;
+        connection->events = EPOLLIN;
+        this->connections[connection->id] = connection;
+        this->fd_connections[fd] = connection->id;
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Read until the socket is drained, the client has shut down its side, or the connection has as many requests
+// waiting as it may (the rest stays in the socket until they have run; a client that is gone is read to the end)
+void SQLServer::read_from(Connection *connection) {
+    char buffer[READ_SIZE];
+    while (!connection->read_closed && (connection->gone || connection->pending.size() < MAX_PENDING)) {
+        ssize_t n = read(connection->fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            connection->input.append(buffer, (size_t) n);
+            split_requests(connection);
+            if (connection->input.find('\n') == string::npos && connection->input.length() > MAX_REQUEST) {
+                close_connection(connection);
+                return;
+            }
+            continue;
+        }
+        if (n == 0) {
+            // answer everything it sent (a last line may lack its newline), then close
+            if (!connection->input.empty())
+                connection->input += '\n';
+            connection->read_closed = connection->closing = true;
+            split_requests(connection);
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        close_connection(connection);
+        return;
+    }
+    dispatch(connection);
+    write_to(connection);
+}
+
+void SQLServer::split_requests(Connection *connection) {
+    size_t start = 0, newline;
+    while ((connection->gone || connection->pending.size() < MAX_PENDING)
+           && (newline = connection->input.find('\n', start)) != string::npos) {
+        string line = connection->input.substr(start, newline - start);
+        start = newline + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || connection->quit)
+            continue;
+        if (line == "quit")
+            connection->quit = connection->closing = true;
+        else
+            connection->pending.push_back(line);
+    }
+    connection->input.erase(0, start);
+}
+
+void SQLServer::write_to(Connection *connection) {
+    if (connection->gone)
+        connection->output.clear();
+    while (!connection->output.empty()) {
+        ssize_t n = send(connection->fd, connection->output.data(), connection->output.length(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            close_connection(connection);
+            return;
+        }
+        connection->output.erase(0, (size_t) n);
+    }
+    dispatch(connection);  // the output may have gone under its limit
+    if (connection->output.empty() && connection->closing && !connection->busy && connection->pending.empty()) {
+        close_connection(connection);
+        return;
+    }
+    watch(connection);
+}
+
+void SQLServer::dispatch(Connection *connection) {
+    split_requests(connection);  // lines left in input while pending was full
+    if (connection->busy || connection->pending.empty() || connection->output.length() >= MAX_OUTPUT)
+        return;
+    connection->busy = true;
+    Request request;
+    request.connection_id = connection->id;
+    request.text = connection->pending.front();
+    connection->pending.pop_front();
+    this->requests.push(request);
+}
+
+void SQLServer::watch(Connection *connection) {
+    if (connection->gone)
+        return;  // no longer registered
+    u_int32_t events = 0;
+    if (!connection->read_closed && connection->pending.size() < MAX_PENDING
+        && connection->output.length() < MAX_OUTPUT)
+        events |= EPOLLIN;
+    if (!connection->output.empty())
+        events |= EPOLLOUT;
+    if (events == connection->events)
+        return;
+    epoll_event event;
+    event.events = events;
+    event.data.fd = connection->fd;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->events = events;
+}
+
+void SQLServer::hang_up(Connection *connection) {
+    // HUP and ERR are reported whatever the fd is registered for, so take it out of the loop altogether
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    connection->gone = connection->closing = true;
+    connection->events = 0;
+    read_from(connection);  // closes the connection on a read error, or once its requests are done
+}
+
+void SQLServer::close_connection(Connection *connection) {
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    close(connection->fd);
+    this->fd_connections.erase(connection->fd);
+    this->connections.erase(connection->id);
+    delete connection;
+}
+
+void SQLServer::work() {
+    Request request;
+    while (this->requests.pop(request)) {
+        string output;
+        try {
+            output = this->handler(request.text);
+        } catch (exception &e) {
+            output = string("Error: ") + e.what() + "\n";
+        }
+        {
+            lock_guard<mutex> guard(this->done_mutex);
+            this->done.push_back(make_pair(request.connection_id, frame(output)));
+        }
+        u_int64_t one = 1;
+        if (write(this->wake_fd, &one, sizeof(one)) < 0)
+            cerr << "sql5300 server: eventfd write: " << strerror(errno) << endl;
+    }
+}
@@ -0,0 +1,143 @@
+/**
+ * @file   sql_server.h
+ * @brief  Serving many clients from one sql5300 process over a Unix domain socket (and optionally TCP)
+ *
+ * Protocol: a client sends one statement per line. Each response is the output text line by line, ending
+ * with a line holding a single "."; response lines that begin with "." get another "." in front (as in
+ * SMTP). A line "quit" closes the connection after the responses already owed.
+ *
+ * One thread runs an epoll loop that accepts connections, reads and splits requests, and writes responses.
+ * A pool of workers runs the requests through the handler; a connection has at most one request with the
+ * workers at a time, so its responses come back in order.
+ *
+ * Memory is bounded per connection: once one has MAX_PENDING requests waiting, or MAX_OUTPUT bytes of responses
+ * its client hasn't read, the loop stops reading from it (and running its requests, for the output) until it
+ * catches up, so a fast client waits in its socket buffers. There are at most MAX_CONNECTIONS connections.
+ * A client that shuts down its side, or hangs up, still has every request it sent run.
+ *
+ * SIGINT/SIGTERM stop the server. They must be blocked in every thread of the process (see block_signals),
+ * since the kernel hands a process-directed signal to any thread that does not block it.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "bounded_queue.h"
+
+/**
+ * @class SQLServerError - the server could not start
+ */
+class SQLServerError : public std::runtime_error {
+public:
+    explicit SQLServerError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class SQLServer - the connection loop and worker pool
+ */
+class SQLServer {
+public:
+    static const size_t MAX_CONNECTIONS = 1024;
+    static const size_t MAX_PENDING = 64;        // requests a connection may have waiting
+    static const size_t MAX_OUTPUT = 1 << 20;    // response bytes a connection may have unsent
+
+    // runs one request and returns its output (called on a worker thread)
+    typedef std::function<std::string(const std::string &request)> Handler;
+
+    /**
+     * @param socket_path  Unix domain socket to listen on (replaced if it exists)
+     * @param tcp_port     also listen on 127.0.0.1 at this port (0 for no TCP)
+     * @param num_workers  worker threads
+     * @param handler      what to do with a request
+     */
+    SQLServer(std::string socket_path, uint tcp_port, uint num_workers, Handler handler);
+
+    virtual ~SQLServer();
+
+    SQLServer(const SQLServer &other) = delete;
+
+    SQLServer &operator=(const SQLServer &other) = delete;
+
+    // serve until stop() is called or the process gets SIGINT/SIGTERM
+    // throws SQLServerError if block_signals() was not called first
+    virtual void run();
+
+    // block SIGINT/SIGTERM so run() gets them through a signalfd: call at process start, before any thread is
+    // created, so that every thread inherits the mask (a thread without it would take the default action)
+    static void block_signals();
+
+    // make run() return (from any thread)
+    virtual void stop();
+
+    // the dot-terminated form of a response
+    static std::string frame(const std::string &output);
+
+protected:
+    struct Connection {
+        u_int64_t id;
+        int fd;
+        std::string input;                 // read but not yet split into requests
+        std::string output;
+        std::deque<std::string> pending;   // requests not yet handed to the workers
+        bool busy;                         // a request is with the workers
+        bool closing;                      // close once the requests are done and output is flushed
+        bool quit;                         // the client sent quit: what it sends after is ignored
+        bool read_closed;                  // the client shut down its side: nothing more to read
+        bool gone;                         // the client hung up: its requests still run, their output is dropped
+        u_int32_t events;                  // what the fd is registered for with epoll
+    };
+
+    struct Request {
+        u_int64_t connection_id;
+        std::string text;
+    };
+
+    std::string socket_path;
+    uint tcp_port;
+    uint num_workers;
+    Handler handler;
+    int epoll_fd, unix_fd, tcp_fd, wake_fd, signal_fd;
+    std::atomic<bool> stopping;
+    std::unordered_map<u_int64_t, Connection *> connections;
+    std::unordered_map<int, u_int64_t> fd_connections;
+    u_int64_t next_id;
+    BoundedQueue<Request> requests;
+    std::mutex done_mutex;
+    std::vector<std::pair<u_int64_t, std::string> > done;  // responses for the loop to send
+    std::vector<std::thread> workers;
+
+    virtual void listen_all();
+
+    virtual void accept_all(int listen_fd);
+
+    virtual void read_from(Connection *connection);
+
+    virtual void write_to(Connection *connection);
+
+    // move the complete lines of input to pending (as many as it has room for)
+    virtual void split_requests(Connection *connection);
+
+    virtual void dispatch(Connection *connection);
+
+    // register for EPOLLIN unless the connection is over its limits, and for EPOLLOUT while output waits
+    virtual void watch(Connection *connection);
+
+    // EPOLLHUP/EPOLLERR: read what the client sent before it went, and finish its requests without it
+    virtual void hang_up(Connection *connection);
+
+    virtual void close_connection(Connection *connection);
+
+    virtual void work();
+};
+
+bool test_sql_server();
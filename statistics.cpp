@@ -0,0 +1,579 @@
+/**
+ * @file   statistics.cpp
+ * @brief  the implementation file for HyperLogLog, Histogram, Statistics, Analyzer and CostModel
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "statistics.h"
+#include "column_codec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include "SQLParser.h"
+using namespace std;
+using namespace hsql;
+
+
+typedef u_int64_t u64;
+
+const Identifier Statistics::TABLE_NAME = "_statistics";
+
+// rows per block assumed for tables that haven't been analyzed
+static const double DEFAULT_ROWS_PER_BLOCK = 50;
+
+// longest TEXT histogram bound we keep (keeps a _statistics row well within one block)
+static const size_t MAX_BOUND_LENGTH = 32;
+
+// per-row CPU cost, in units of a sequential block read
+static const double CPU_ROW_COST = 0.01;
+
+/**
+ * Testing function for statistics and the cost model.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_statistics() {
+    bool ok = true;
+    HyperLogLog hll;
+    for (int i = 0; i < 20000; i++)
+        hll.add(Value(i % 5000));
+    if (fabs(hll.estimate() - 5000) > 500) {
+        cout << "FAILED TEST: HyperLogLog estimated " << hll.estimate() << " distinct values, expected ~5000" << endl;
+        ok = false;
+    }
+
+    vector<Value> values;
+    for (int i = 0; i < 1000; i++)
+        values.push_back(Value(999 - i));
+    Histogram histogram(values);
+    double half = histogram.fraction_below(Value(500), false);
+    if (fabs(half - 0.5) > 0.02 || histogram.fraction_below(Value(-1), true) != 0
+        || histogram.fraction_below(Value(5000), false) != 1) {
+        cout << "FAILED TEST: histogram fraction below 500 is " << half << endl;
+        ok = false;
+    }
+    vector<Value> words;
+    words.push_back(Value("a,b"));
+    words.push_back(Value("c\\d"));
+    Histogram round_trip = Histogram::deserialize(Histogram(words).serialize());
+    if (round_trip.bounds.size() != 3 || round_trip.bounds[0].s != "a,b" || round_trip.bounds[2].s != "c\\d") {
+        cout << "FAILED TEST: histogram serialization" << endl;
+        ok = false;
+    }
+
+    ColumnNames column_names;
+    column_names.push_back("id");
+    column_names.push_back("grp");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    HeapTable table("_test_statistics_cpp", column_names, column_attributes);
+    table.create();
+    const int num_rows = 4000;
+    for (int i = 0; i < num_rows; i++) {
+        ValueDict row;
+        row["id"] = Value(i);
+        row["grp"] = Value(i % 10);
+        table.insert(&row);
+    }
+    TableStatistics statistics = Analyzer::analyze(table, 8);
+    table.drop();
+    if (fabs(statistics.row_count - num_rows) > num_rows * 0.2 || statistics.columns["grp"].distinct < 8
+        || statistics.columns["grp"].distinct > 12 || statistics.columns["id"].distinct < num_rows * 0.8) {
+        cout << "FAILED TEST: analyze estimated " << statistics.row_count << " rows, "
+             << statistics.columns["id"].distinct << " ids, " << statistics.columns["grp"].distinct << " groups"
+             << endl;
+        ok = false;
+    }
+
+    SQLParserResult *parse = SQLParser::parseSQLString("SELECT * FROM t WHERE id = 17");
+    SQLParserResult *wide = SQLParser::parseSQLString("SELECT * FROM t WHERE id > 100");
+    map<Identifier, ColumnNames> indices;
+    indices["t_id"] = ColumnNames(1, "id");
+    AccessPath narrow_path = CostModel::choose_access_path(
+            ((SelectStatement *) parse->getStatement(0))->whereClause, statistics, indices);
+    AccessPath wide_path = CostModel::choose_access_path(
+            ((SelectStatement *) wide->getStatement(0))->whereClause, statistics, indices);
+    if (narrow_path.kind != AccessPath::INDEX_LOOKUP || wide_path.kind != AccessPath::TABLE_SCAN) {
+        cout << "FAILED TEST: access paths " << narrow_path.to_string("t") << " / " << wide_path.to_string("t")
+             << endl;
+        ok = false;
+    }
+    delete parse;
+    delete wide;
+    return ok;
+}
+
+
+/*****************************************HyperLogLog***************************************************************/
+
+// splitmix64 finalizer
+static u64 mix(u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+u64 HyperLogLog::hash(const Value &value) {
+    return mix(value.data_type == ColumnAttribute::TEXT ? value_bits(value) ^ 0x9e3779b97f4a7c15ULL
+                                                         : value_bits(value));
+}
+
+void HyperLogLog::add(const Value &value) {
+    add_hash(hash(value));
+}
+
+// The top PRECISION bits pick a register, which keeps the longest run of leading zeros seen in the rest
+void HyperLogLog::add_hash(u64 hash) {
+    uint index = (uint) (hash >> (64 - PRECISION));
+    u64 rest = hash << PRECISION;
+    u_int8_t rank = 1;
+    while (rank <= 64 - PRECISION && (rest & (1ULL << 63)) == 0) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > this->registers[index])
+        this->registers[index] = rank;
+}
+
+// Harmonic mean of the registers, with linear counting for small cardinalities
+double HyperLogLog::estimate() const {
+    const double m = NUM_REGISTERS;
+    double sum = 0;
+    uint zeros = 0;
+    for (auto r: this->registers) {
+        sum += ldexp(1.0, -r);
+        if (r == 0)
+            zeros++;
+    }
+    double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0)
+        e = m * log(m / zeros);
+    return e;
+}
+
+
+/*****************************************Histogram***************************************************************/
+
+static bool value_less(const Value &a, const Value &b) {
+    return a.data_type == ColumnAttribute::INT ? a.n < b.n : compare_values(a, b) < 0;
+}
+
+static bool value_equal(const Value &a, const Value &b) {
+    return a.data_type == ColumnAttribute::INT ? a.n == b.n : compare_values(a, b) == 0;
+}
+
+Histogram::Histogram(vector<Value> &values, uint num_buckets) {
+    if (values.empty())
+        return;
+    sort(values.begin(), values.end(), value_less);
+    size_t n = values.size();
+    if (num_buckets > n)
+        num_buckets = (uint) n;
+    this->bounds.push_back(values[0]);
+    for (uint b = 1; b <= num_buckets; b++)
+        this->bounds.push_back(values[b * n / num_buckets - 1]);
+    for (auto &bound: this->bounds)
+        if (bound.data_type == ColumnAttribute::TEXT && bound.s.length() > MAX_BOUND_LENGTH)
+            bound.s.resize(MAX_BOUND_LENGTH);
+}
+
+/**
+ * Estimated fraction of rows below a value: whole buckets below it, plus a linear interpolation
+ * within the bucket it falls in (halfway for TEXT)
+ * @param literal   the value (converted to the column's type, as the WHERE clause does)
+ * @param inclusive count rows equal to the value too
+ * @return fraction in [0, 1]
+ */
+double Histogram::fraction_below(const Value &literal, bool inclusive) const {
+    if (this->bounds.empty())
+        return CostModel::DEFAULT_SELECTIVITY;
+    Value bound;
+    try {
+        bound = convert_value(literal, this->bounds[0].data_type);
+    } catch (DbRelationError &e) {
+        return CostModel::DEFAULT_SELECTIVITY;
+    }
+    auto below = [&](const Value &v) { return value_less(v, bound) || (inclusive && value_equal(v, bound)); };
+    if (!below(this->bounds[0]))
+        return 0;
+    size_t num_buckets = this->bounds.size() - 1;
+    if (num_buckets == 0)
+        return 1;
+    double fraction = 0;
+    for (size_t i = 1; i <= num_buckets; i++) {
+        const Value &low = this->bounds[i - 1], &high = this->bounds[i];
+        if (below(high)) {
+            fraction += 1;
+            continue;
+        }
+        double x, x0, x1;
+        if (value_number(bound, x) && value_number(low, x0) && value_number(high, x1) && x1 > x0)
+            fraction += max(0.0, min(1.0, (x - x0) / (x1 - x0)));
+        else
+            fraction += 0.5;
+        break;
+    }
+    return fraction / num_buckets;
+}
+
+string Histogram::serialize() const {
+    string text;
+    for (auto const &bound: this->bounds) {
+        if (!text.empty())
+            text += ',';
+        if (bound.data_type == ColumnAttribute::INT) {
+            text += "i:" + to_string(bound.n);
+        } else if (bound.data_type != ColumnAttribute::TEXT) {
+            text += to_string((int) bound.data_type) + ":" + value_to_string(bound);  // DATE and such print no ','
+        } else {
+            text += "s:";
+            for (char c: bound.s) {
+                if (c == ',' || c == '\\')
+                    text += '\\';
+                text += c;
+            }
+        }
+    }
+    return text;
+}
+
+// A bound of a fixed-width type other than INT, as value_to_string printed it
+static Value fixed_bound(ColumnAttribute::DataType data_type, const string &field) {
+    switch (data_type) {
+        case ColumnAttribute::BIGINT:
+            return Value::bigint(strtoll(field.c_str(), nullptr, 10));
+        case ColumnAttribute::DOUBLE:
+            return Value::real(strtod(field.c_str(), nullptr));
+        default:
+            return convert_value(Value(field), data_type);  // BOOLEAN, DATE, TIMESTAMP parse from TEXT
+    }
+}
+
+Histogram Histogram::deserialize(const string &text) {
+    Histogram histogram;
+    size_t i = 0;
+    while (i + 1 < text.length()) {
+        char tag = text[i];
+        i += 2;
+        string field;
+        for (; i < text.length() && text[i] != ','; i++) {
+            if (text[i] == '\\' && i + 1 < text.length())
+                i++;
+            field += text[i];
+        }
+        i++;
+        if (tag == 'i')
+            histogram.bounds.push_back(Value((int32_t) atoi(field.c_str())));
+        else if (tag == 's')
+            histogram.bounds.push_back(Value(field));
+        else
+            histogram.bounds.push_back(fixed_bound((ColumnAttribute::DataType) (tag - '0'), field));
+    }
+    return histogram;
+}
+
+
+/*****************************************Statistics***************************************************************/
+
+ColumnNames &Statistics::COLUMN_NAMES() {
+    static ColumnNames column_names;
+    if (column_names.empty()) {
+        column_names.push_back("table_name");
+        column_names.push_back("column_name");
+        column_names.push_back("row_count");
+        column_names.push_back("block_count");
+        column_names.push_back("distinct_values");
+        column_names.push_back("histogram");
+    }
+    return column_names;
+}
+
+ColumnAttributes &Statistics::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes column_attributes;
+    if (column_attributes.empty()) {
+        ColumnAttribute text(ColumnAttribute::TEXT), integer(ColumnAttribute::INT);
+        column_attributes.push_back(text);
+        column_attributes.push_back(text);
+        column_attributes.push_back(integer);
+        column_attributes.push_back(integer);
+        column_attributes.push_back(integer);
+        column_attributes.push_back(text);
+    }
+    return column_attributes;
+}
+
+Statistics::Statistics() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+const TableStatistics &Statistics::get(HeapTable &table) {
+    Identifier table_name = table.get_table_name();
+    auto cached = this->cache.find(table_name);
+    if (cached != this->cache.end() && cached->second.analyzed)
+        return cached->second;
+
+    TableStatistics &statistics = this->cache[table_name];
+    statistics = TableStatistics();
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles) {
+        ValueDict *row = project(handle);
+        statistics.analyzed = true;
+        statistics.row_count = (*row)["row_count"].n;
+        statistics.block_count = (*row)["block_count"].n;
+        ColumnStatistics &column = statistics.columns[(*row)["column_name"].s];
+        column.distinct = (*row)["distinct_values"].n;
+        column.histogram = Histogram::deserialize((*row)["histogram"].s);
+        delete row;
+    }
+    delete handles;
+    if (!statistics.analyzed) {
+        // never analyzed: guess from the size of the file (re-checked on every lookup, since it grows)
+        BlockIDs *block_ids = table.block_ids();
+        statistics.block_count = (double) block_ids->size();
+        statistics.row_count = statistics.block_count * DEFAULT_ROWS_PER_BLOCK;
+        delete block_ids;
+    }
+    return statistics;
+}
+
+void Statistics::put(Identifier table_name, const TableStatistics &statistics) {
+    remove(table_name);
+    for (auto const &column: statistics.columns) {
+        ValueDict row;
+        row["table_name"] = Value(table_name);
+        row["column_name"] = Value(column.first);
+        row["row_count"] = Value((int32_t) min(statistics.row_count, (double) INT32_MAX));
+        row["block_count"] = Value((int32_t) statistics.block_count);
+        row["distinct_values"] = Value((int32_t) min(column.second.distinct, (double) INT32_MAX));
+        row["histogram"] = Value(column.second.histogram.serialize());
+        insert(&row);
+    }
+    this->cache[table_name] = statistics;
+    this->cache[table_name].analyzed = true;
+}
+
+void Statistics::remove(Identifier table_name) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles *handles = select(&where);
+    for (auto const &handle: *handles)
+        del(handle);
+    delete handles;
+    this->cache.erase(table_name);
+}
+
+
+/*****************************************Analyzer***************************************************************/
+
+/**
+ * Compute statistics from every block of a small table, or an evenly spread sample of a large one
+ * @param table         the table
+ * @param sample_blocks the most blocks to read
+ * @return the statistics (row count scaled up to the whole table if sampled)
+ */
+TableStatistics Analyzer::analyze(HeapTable &table, uint sample_blocks) {
+    BlockIDs *block_ids = table.block_ids();
+    BlockIDs sample;
+    if (sample_blocks == 0 || block_ids->size() <= sample_blocks) {
+        sample = *block_ids;
+    } else {
+        for (uint i = 0; i < sample_blocks; i++)
+            sample.push_back((*block_ids)[(size_t) i * block_ids->size() / sample_blocks]);
+    }
+
+    const ColumnNames &column_names = table.get_column_names();
+    vector<HyperLogLog> sketches(column_names.size());
+    vector<vector<Value> > values(column_names.size());
+    size_t sampled_rows = 0;
+    char *buffer = new char[table.get_page_size()];
+    for (auto const &block_id: sample) {
+        ValueDicts rows;
+        table.copy_block(block_id, buffer);
+        table.decode_block(buffer, rows);
+        for (auto row: rows) {
+            for (size_t c = 0; c < column_names.size(); c++) {
+                const Value &value = (*row)[column_names[c]];
+                sketches[c].add(value);
+                values[c].push_back(value);
+            }
+            delete row;
+        }
+        sampled_rows += rows.size();
+    }
+    delete[] buffer;
+
+    TableStatistics statistics;
+    statistics.analyzed = true;
+    statistics.block_count = (double) block_ids->size();
+    statistics.row_count = sample.empty() ? 0 : (double) sampled_rows * block_ids->size() / sample.size();
+    bool sampled = sample.size() < block_ids->size();
+    delete block_ids;
+    for (size_t c = 0; c < column_names.size(); c++) {
+        ColumnStatistics &column = statistics.columns[column_names[c]];
+        column.distinct = sketches[c].estimate();
+        // a column that looks unique in the sample is taken to be unique in the table
+        if (sampled && column.distinct >= 0.9 * sampled_rows)
+            column.distinct = statistics.row_count;
+        column.distinct = min(column.distinct, statistics.row_count);
+        column.histogram = Histogram(values[c]);
+    }
+    return statistics;
+}
+
+
+/*****************************************CostModel***************************************************************/
+
+string AccessPath::to_string(Identifier table_name) const {
+    char numbers[64];
+    snprintf(numbers, sizeof(numbers), "(cost=%.1f rows=%.0f)", this->cost, this->estimated_rows);
+    if (this->kind == INDEX_LOOKUP)
+        return "INDEX_LOOKUP " + table_name + " USING " + this->index_name + " " + numbers;
+    return "TABLE_SCAN " + table_name + " " + numbers;
+}
+
+// A comparison between a column and a literal, normalized so the column is on the left
+struct ColumnComparison {
+    const char *column;
+    Value literal;
+    int cmp;  // 0..5 = EQ, NE, LT, LE, GT, GE
+};
+
+static bool as_column_comparison(const Expr *expr, ColumnComparison &comparison) {
+    if (expr == nullptr || expr->type != kExprOperator || expr->expr == nullptr || expr->expr2 == nullptr)
+        return false;
+    if (expr->opType == Expr::NOT_EQUALS)
+        comparison.cmp = 1;
+    else if (expr->opType == Expr::LESS_EQ)
+        comparison.cmp = 3;
+    else if (expr->opType == Expr::GREATER_EQ)
+        comparison.cmp = 5;
+    else if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '=')
+        comparison.cmp = 0;
+    else if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '<')
+        comparison.cmp = 2;
+    else if (expr->opType == Expr::SIMPLE_OP && expr->opChar == '>')
+        comparison.cmp = 4;
+    else
+        return false;
+    const Expr *column = expr->expr, *literal = expr->expr2;
+    if (column->type != kExprColumnRef) {
+        static const int flipped[] = {0, 1, 4, 5, 2, 3};
+        swap(column, literal);
+        comparison.cmp = flipped[comparison.cmp];
+    }
+    if (column->type != kExprColumnRef)
+        return false;
+    comparison.column = column->name;
+    if (literal->type == kExprLiteralInt)
+        comparison.literal = literal->ival >= INT32_MIN && literal->ival <= INT32_MAX
+                             ? Value((int32_t) literal->ival) : Value::bigint(literal->ival);
+    else if (literal->type == kExprLiteralFloat)
+        comparison.literal = Value::real(literal->fval);
+    else if (literal->type == kExprLiteralString)
+        comparison.literal = Value(string(literal->name));
+    else
+        return false;
+    return true;
+}
+
+static double comparison_selectivity(const ColumnComparison &comparison, const TableStatistics &statistics) {
+    auto column = statistics.columns.find(comparison.column);
+    double equal = CostModel::DEFAULT_EQUALITY_SELECTIVITY;
+    if (column != statistics.columns.end() && column->second.distinct >= 1)
+        equal = 1.0 / column->second.distinct;
+    if (comparison.cmp == 0)
+        return equal;
+    if (comparison.cmp == 1)
+        return 1 - equal;
+    if (column == statistics.columns.end() || column->second.histogram.empty())
+        return CostModel::DEFAULT_SELECTIVITY;
+    const Histogram &histogram = column->second.histogram;
+    switch (comparison.cmp) {
+        case 2:
+            return histogram.fraction_below(comparison.literal, false);
+        case 3:
+            return histogram.fraction_below(comparison.literal, true);
+        case 4:
+            return 1 - histogram.fraction_below(comparison.literal, true);
+        default:
+            return 1 - histogram.fraction_below(comparison.literal, false);
+    }
+}
+
+double CostModel::selectivity(const Expr *where, const TableStatistics &statistics) {
+    if (where == nullptr)
+        return 1;
+    if (where->type == kExprOperator) {
+        switch (where->opType) {
+            case Expr::AND:
+                return selectivity(where->expr, statistics) * selectivity(where->expr2, statistics);
+            case Expr::OR: {
+                double a = selectivity(where->expr, statistics), b = selectivity(where->expr2, statistics);
+                return a + b - a * b;
+            }
+            case Expr::NOT:
+                return 1 - selectivity(where->expr, statistics);
+            default:
+                break;
+        }
+    }
+    ColumnComparison comparison;
+    if (as_column_comparison(where, comparison))
+        return comparison_selectivity(comparison, statistics);
+    return DEFAULT_SELECTIVITY;
+}
+
+// Collect the top-level AND-ed terms of a WHERE clause
+static void conjuncts(const Expr *where, vector<const Expr *> &terms) {
+    if (where == nullptr)
+        return;
+    if (where->type == kExprOperator && where->opType == Expr::AND) {
+        conjuncts(where->expr, terms);
+        conjuncts(where->expr2, terms);
+    } else {
+        terms.push_back(where);
+    }
+}
+
+/**
+ * Cost a full scan (every block, sequentially) against each usable index: an index is usable when
+ * a top-level AND term restricts its leading column, and costs a descent plus a random block read
+ * per matching row
+ */
+AccessPath CostModel::choose_access_path(const Expr *where, const TableStatistics &statistics,
+                                         const map<Identifier, ColumnNames> &index_columns) {
+    AccessPath best;
+    best.estimated_rows = statistics.row_count * selectivity(where, statistics);
+    best.cost = max(statistics.block_count, 1.0) + statistics.row_count * CPU_ROW_COST;
+
+    vector<const Expr *> terms;
+    conjuncts(where, terms);
+    for (auto const &index: index_columns) {
+        if (index.second.empty())
+            continue;
+        double index_selectivity = 1;
+        bool usable = false;
+        for (auto term: terms) {
+            ColumnComparison comparison;
+            if (as_column_comparison(term, comparison) && comparison.cmp != 1
+                && index.second[0] == comparison.column) {
+                index_selectivity *= comparison_selectivity(comparison, statistics);
+                usable = true;
+            }
+        }
+        if (!usable)
+            continue;
+        double matches = statistics.row_count * index_selectivity;
+        double cost = (INDEX_HEIGHT + matches) * RANDOM_BLOCK_COST + matches * CPU_ROW_COST;
+        if (cost < best.cost) {
+            best.kind = AccessPath::INDEX_LOOKUP;
+            best.index_name = index.first;
+            best.cost = cost;
+        }
+    }
+    return best;
+}
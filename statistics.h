@@ -0,0 +1,207 @@
+/**
+ * @file   statistics.h
+ * @brief  Table statistics gathered by ANALYZE, their catalog table, and the cost model that uses them
+ *
+ * HyperLogLog: distinct-value estimate in a fixed 1KB of registers
+ * Histogram: equi-depth histogram of a column's values (each bucket holds about the same number of rows)
+ * TableStatistics: row/block counts plus per-column distinct estimates and histograms
+ * Statistics: the _statistics catalog table, with an in-memory cache of what it holds
+ * Analyzer: computes TableStatistics from a sample of a HeapTable's blocks
+ * CostModel: selectivity estimates, scan-vs-index choice, and hash join build side choice
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <map>
+#include "heap_storage.h"
+
+namespace hsql {
+    struct Expr;
+}
+
+/**
+ * @class HyperLogLog - approximate distinct count (2^PRECISION one-byte registers, ~3% standard error)
+ */
+class HyperLogLog {
+public:
+    static const uint PRECISION = 10;
+    static const uint NUM_REGISTERS = 1 << PRECISION;
+
+    HyperLogLog() : registers(NUM_REGISTERS, 0) {}
+
+    virtual ~HyperLogLog() {}
+
+    virtual void add(const Value &value);
+
+    virtual void add_hash(u_int64_t hash);
+
+    // estimate of the number of distinct values added so far
+    virtual double estimate() const;
+
+    static u_int64_t hash(const Value &value);
+
+protected:
+    std::vector<u_int8_t> registers;
+};
+
+/**
+ * @class Histogram - equi-depth histogram: bucket i holds the values in (bounds[i-1], bounds[i]]
+ */
+class Histogram {
+public:
+    static const uint DEFAULT_BUCKETS = 16;
+
+    Histogram() {}
+
+    /**
+     * Build from a sample of a column's values.
+     * @param values       the sample (sorted in place)
+     * @param num_buckets  how many buckets to aim for
+     */
+    Histogram(std::vector<Value> &values, uint num_buckets = DEFAULT_BUCKETS);
+
+    virtual ~Histogram() {}
+
+    // estimated fraction of rows with value < bound (or <= bound if inclusive); bound is converted to the
+    // column's type as a WHERE clause's literal is
+    virtual double fraction_below(const Value &bound, bool inclusive) const;
+
+    virtual bool empty() const { return bounds.empty(); }
+
+    // text form for the catalog, e.g. "i:3,i:17,i:40" or "s:abc,s:x\,y" (other types: their DataType number,
+    // e.g. "5:2020-05-31" for a DATE)
+    virtual std::string serialize() const;
+
+    static Histogram deserialize(const std::string &text);
+
+    std::vector<Value> bounds;  // bounds[0] is the minimum, then each bucket's upper bound
+};
+
+/**
+ * @class ColumnStatistics - what ANALYZE knows about one column
+ */
+class ColumnStatistics {
+public:
+    ColumnStatistics() : distinct(0) {}
+
+    double distinct;
+    Histogram histogram;
+};
+
+/**
+ * @class TableStatistics - what ANALYZE knows about one table
+ */
+class TableStatistics {
+public:
+    TableStatistics() : row_count(0), block_count(0), analyzed(false) {}
+
+    double row_count;
+    double block_count;
+    bool analyzed;  // false means defaults are being used
+    std::map<Identifier, ColumnStatistics> columns;
+};
+
+/**
+ * @class Statistics - the _statistics catalog table: one row per analyzed column
+ *
+ *      Rows are (table_name, column_name, row_count, block_count, distinct, histogram) and are
+ *      read once per table into a cache. ANALYZE replaces a table's rows; DROP TABLE removes them.
+ */
+class Statistics : public HeapTable {
+public:
+    static const Identifier TABLE_NAME;
+
+    Statistics();
+
+    virtual ~Statistics() {}
+
+    /**
+     * Statistics for a table. A table that was never analyzed gets rough defaults derived
+     * from its block count, with analyzed set to false.
+     */
+    virtual const TableStatistics &get(HeapTable &table);
+
+    // replace the stored statistics of a table
+    virtual void put(Identifier table_name, const TableStatistics &statistics);
+
+    // forget a table's statistics (on DROP TABLE)
+    virtual void remove(Identifier table_name);
+
+protected:
+    std::map<Identifier, TableStatistics> cache;
+
+    static ColumnNames &COLUMN_NAMES();
+
+    static ColumnAttributes &COLUMN_ATTRIBUTES();
+};
+
+/**
+ * @class Analyzer - gathers TableStatistics for ANALYZE
+ *
+ *      Tables up to sample_blocks blocks are read in full; larger tables are sampled by reading
+ *      sample_blocks blocks spread evenly over the file and scaling the counts up.
+ */
+class Analyzer {
+public:
+    static const uint DEFAULT_SAMPLE_BLOCKS = 128;
+
+    static TableStatistics analyze(HeapTable &table, uint sample_blocks = DEFAULT_SAMPLE_BLOCKS);
+};
+
+/**
+ * @class AccessPath - how the planner decided to read a table
+ */
+class AccessPath {
+public:
+    enum Kind {
+        TABLE_SCAN, INDEX_LOOKUP
+    };
+
+    AccessPath() : kind(TABLE_SCAN), estimated_rows(0), cost(0) {}
+
+    virtual ~AccessPath() {}
+
+    // e.g. "TABLE_SCAN foo (cost=12.0 rows=480)"
+    virtual std::string to_string(Identifier table_name) const;
+
+    Kind kind;
+    Identifier index_name;
+    double estimated_rows;
+    double cost;
+};
+
+/**
+ * @class CostModel - estimates in units of sequential block reads
+ */
+class CostModel {
+public:
+    static constexpr double RANDOM_BLOCK_COST = 4.0;  // an index probe's random read vs a sequential one
+    static constexpr double INDEX_HEIGHT = 3.0;
+    static constexpr double DEFAULT_SELECTIVITY = 1.0 / 3;
+    static constexpr double DEFAULT_EQUALITY_SELECTIVITY = 0.005;
+
+    /**
+     * Estimated fraction of rows satisfying a WHERE clause.
+     * @param where       the clause (nullptr means every row)
+     * @param statistics  the table's statistics
+     */
+    static double selectivity(const hsql::Expr *where, const TableStatistics &statistics);
+
+    /**
+     * Choose between a full scan and a lookup through one of the table's indices.
+     * @param where          the WHERE clause
+     * @param statistics     the table's statistics
+     * @param index_columns  the key columns of each available index, by index name
+     */
+    static AccessPath choose_access_path(const hsql::Expr *where, const TableStatistics &statistics,
+                                         const std::map<Identifier, ColumnNames> &index_columns);
+
+    /**
+     * Which input of a hash join to build the hash table on: the one with fewer estimated rows.
+     * @returns  true to build on the left input
+     */
+    static bool build_left(double left_rows, double right_rows) { return left_rows <= right_rows; }
+};
+
+bool test_statistics();
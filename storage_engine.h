@@ -199,15 +199,16 @@ protected:
  */
 class ColumnAttribute {
 public:
+    // each type's codec is in column_codec.h (ColumnCodec<type>); TEXT is the only variable-width one
     enum DataType {
-        INT, TEXT
+        INT, TEXT, BIGINT, DOUBLE, BOOLEAN, DATE, TIMESTAMP
     };
 
     ColumnAttribute(DataType data_type) : data_type(data_type) {}
 
     virtual ~ColumnAttribute() {}
 
-    virtual DataType get_data_type() { return data_type; }
+    virtual DataType get_data_type() const { return data_type; }
 
     virtual void set_data_type(DataType data_type) { this->data_type = data_type; }
 
@@ -222,14 +223,40 @@ protected:
 class Value {
 public:
     ColumnAttribute::DataType data_type;
-    int32_t n;
-    std::string s;
+    int32_t n;          // INT, BOOLEAN (0 or 1), DATE (days since 1970-01-01)
+    union {
+        int64_t l;      // BIGINT, TIMESTAMP (microseconds since 1970-01-01 00:00:00)
+        double d;       // DOUBLE
+    };
+    std::string s;      // TEXT
+
+    Value() : n(0), l(0) { data_type = ColumnAttribute::INT; }
+
+    Value(int32_t n) : n(n), l(0) { data_type = ColumnAttribute::INT; }
+
+    Value(std::string s) : n(0), l(0), s(std::move(s)) { data_type = ColumnAttribute::TEXT; }
+
+    static Value bigint(int64_t l) { return typed(ColumnAttribute::BIGINT, 0, l); }
+
+    static Value real(double d) {
+        Value value = typed(ColumnAttribute::DOUBLE, 0, 0);
+        value.d = d;
+        return value;
+    }
+
+    static Value boolean(bool b) { return typed(ColumnAttribute::BOOLEAN, b ? 1 : 0, 0); }
 
-    Value() : n(0) { data_type = ColumnAttribute::INT; }
+    static Value date(int32_t days) { return typed(ColumnAttribute::DATE, days, 0); }
 
-    Value(int32_t n) : n(n) { data_type = ColumnAttribute::INT; }
+    static Value timestamp(int64_t micros) { return typed(ColumnAttribute::TIMESTAMP, 0, micros); }
 
-    Value(std::string s) : s(s) { data_type = ColumnAttribute::TEXT; }
+protected:
+    static Value typed(ColumnAttribute::DataType data_type, int32_t n, int64_t l) {
+        Value value(n);
+        value.data_type = data_type;
+        value.l = l;
+        return value;
+    }
 };
 
 // More type aliases
@@ -239,6 +266,8 @@ typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
 typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
 typedef std::map<Identifier, Value> ValueDict;
+typedef std::vector<ValueDict *> ValueDicts;
+typedef std::vector<Identifier> IndexNames;
 
 
 /**
@@ -319,8 +348,9 @@ public:
      * from an insert or select).
      * @param handle      the row to update
      * @param new_values  a dictionary keyd by column names for changing columns
+     * @returns           a handle to the updated row (which may have moved, leaving handle stale)
      */
-    virtual void update(const Handle handle, const ValueDict *new_values) = 0;
+    virtual Handle update(const Handle handle, const ValueDict *new_values) = 0;
 
     /**
      * Conceptually, execute: DELETE FROM <table_name> WHERE <handle>
@@ -359,6 +389,15 @@ public:
      */
     virtual ValueDict *project(Handle handle, const ColumnNames *column_names) = 0;
 
+    /**
+     * Accessors for the relation's schema.
+     */
+    virtual Identifier get_table_name() const { return table_name; }
+
+    virtual const ColumnNames &get_column_names() const { return column_names; }
+
+    virtual const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
 protected:
     Identifier table_name;
     ColumnNames column_names;
@@ -0,0 +1,164 @@
+/**
+ * @file   trace.cpp
+ * @brief  the implementation file for Tracer
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "trace.h"
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+atomic<bool> Tracer::on(false);
+const chrono::steady_clock::time_point Tracer::epoch = chrono::steady_clock::now();
+
+/**
+ * The ring buffer. Spans go in under the lock; recorded counts every span since start, so the
+ * slot for the next one is recorded % capacity and anything past capacity was overwritten.
+ */
+struct TraceBuffer {
+    mutex lock;
+    vector<TraceEvent> events;
+    u_int64_t recorded = 0;
+};
+
+// never destroyed, so threads still tracing during static destruction are safe
+static TraceBuffer &buffer() {
+    static TraceBuffer *buffer = new TraceBuffer();
+    return *buffer;
+}
+
+// JSON string body: quotes, backslashes and control characters escaped
+static string json_escape(const string &s) {
+    string escaped;
+    for (char c: s) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * Testing function for Tracer.
+ * Records spans from several threads into a small buffer, checks the wraparound and the JSON shape.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_trace() {
+    Tracer::start(8);
+    {
+        TraceSpan outer("outer", "test");
+        outer.set_detail("say \"hi\"\n");
+        vector<thread> threads;
+        for (int t = 0; t < 3; t++) {
+            threads.push_back(thread([]() {
+                for (int i = 0; i < 4; i++) {
+                    TraceSpan span("inner", "test");
+                }
+            }));
+        }
+        for (auto &t: threads)
+            t.join();
+    }
+    Tracer::stop();
+    {
+        TraceSpan ignored("ignored", "test");
+    }
+    bool ok = true;
+    if (Tracer::size() != 8 || Tracer::dropped() != 5) {
+        cout << "FAILED TEST: holding " << Tracer::size() << " spans, dropped " << Tracer::dropped() << endl;
+        ok = false;
+    }
+    stringstream out;
+    Tracer::dump(out);
+    string json = out.str();
+    if (json.find("{\"traceEvents\": [") != 0 || json.find("\"name\": \"outer\"") == string::npos
+        || json.find("say \\\"hi\\\"\\u000a") == string::npos || json.find("ignored") != string::npos
+        || json.find("\"ph\": \"X\"") == string::npos) {
+        cout << "FAILED TEST: dump " << json << endl;
+        ok = false;
+    }
+    Tracer::start(8);
+    Tracer::stop();
+    if (Tracer::size() != 0) {
+        cout << "FAILED TEST: start did not clear" << endl;
+        ok = false;
+    }
+    return ok;
+}
+
+
+/*****************************************Tracer********************************************************************/
+
+void Tracer::start(size_t capacity) {
+    TraceBuffer &b = buffer();
+    lock_guard<mutex> guard(b.lock);
+    b.events.assign(capacity ? capacity : 1, TraceEvent());
+    b.recorded = 0;
+    on.store(true, memory_order_relaxed);
+}
+
+void Tracer::stop() {
+    on.store(false, memory_order_relaxed);
+}
+
+void Tracer::record(TraceEvent &event) {
+    event.thread_id = thread_id();
+    TraceBuffer &b = buffer();
+    lock_guard<mutex> guard(b.lock);
+    if (b.events.empty())
+        return;
+    b.events[b.recorded % b.events.size()] = std::move(event);
+    b.recorded++;
+}
+
+size_t Tracer::size() {
+    TraceBuffer &b = buffer();
+    lock_guard<mutex> guard(b.lock);
+    return b.recorded < b.events.size() ? b.recorded : b.events.size();
+}
+
+u_int64_t Tracer::dropped() {
+    TraceBuffer &b = buffer();
+    lock_guard<mutex> guard(b.lock);
+    return b.recorded > b.events.size() ? b.recorded - b.events.size() : 0;
+}
+
+void Tracer::dump(ostream &out) {
+    TraceBuffer &b = buffer();
+    lock_guard<mutex> guard(b.lock);
+    size_t capacity = b.events.size();
+    u_int64_t first = b.recorded > capacity ? b.recorded - capacity : 0;
+    out << "{\"traceEvents\": [";
+    for (u_int64_t i = first; i < b.recorded; i++) {
+        const TraceEvent &event = b.events[i % capacity];
+        char times[96];
+        snprintf(times, sizeof(times), "\"ts\": %.3f, \"dur\": %.3f", event.start_ns / 1000.0,
+                 event.duration_ns / 1000.0);
+        out << (i == first ? "\n" : ",\n") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+            << "\", \"ph\": \"X\", " << times << ", \"pid\": 1, \"tid\": " << event.thread_id;
+        if (!event.detail.empty())
+            out << ", \"args\": {\"detail\": \"" << json_escape(event.detail) << "\"}";
+        out << "}";
+    }
+    out << "\n], \"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped\": "
+        << (b.recorded > capacity ? b.recorded - capacity : 0) << "}}" << endl;
+}
+
+uint Tracer::thread_id() {
+    static atomic<uint> next_id(1);
+    static thread_local uint id = 0;
+    if (id == 0)
+        id = next_id.fetch_add(1);
+    return id;
+}
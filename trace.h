@@ -0,0 +1,119 @@
+/**
+ * @file   trace.h
+ * @brief  Opt-in span tracing of query and storage phases, dumped as Chrome trace-event JSON
+ *
+ * While tracing is on, each TRACE_SPAN records its name, category, thread and start/duration into a
+ * fixed-size ring buffer (the oldest spans are overwritten). While it is off a span costs one relaxed
+ * atomic load. Load a dump in chrome://tracing or https://ui.perfetto.dev.
+ * Build with -DENGINE_STATS_DISABLED to compile the spans out along with the rest of the instrumentation.
+ *
+ * Tracer: on/off, the ring buffer, and the JSON dump
+ * TraceSpan: records the time from construction to destruction as one span
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/**
+ * @class TraceEvent - one completed span ("ph": "X" in the trace-event format)
+ */
+struct TraceEvent {
+    const char *name;      // string literal
+    const char *category;  // string literal: query, plan, operator, storage, bdb
+    std::string detail;    // optional, shown as args.detail (e.g. the SQL of a query span)
+    u_int64_t start_ns;    // since the tracer's epoch
+    u_int64_t duration_ns;
+    uint thread_id;        // small sequential id, in order of each thread's first span
+};
+
+/**
+ * @class Tracer - the trace buffer
+ */
+class Tracer {
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 16;
+
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    /**
+     * Start recording, discarding anything recorded before.
+     * @param capacity  how many spans the ring buffer keeps
+     */
+    static void start(size_t capacity = DEFAULT_CAPACITY);
+
+    // stop recording; what was recorded stays until the next start
+    static void stop();
+
+    static void record(TraceEvent &event);
+
+    // number of spans held (at most the capacity) and number overwritten since start
+    static size_t size();
+
+    static u_int64_t dropped();
+
+    // write the held spans, oldest first, as {"traceEvents": [...]}
+    static void dump(std::ostream &out);
+
+    static u_int64_t now_ns() {
+        return (u_int64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static uint thread_id();
+
+protected:
+    static std::atomic<bool> on;
+    static const std::chrono::steady_clock::time_point epoch;
+};
+
+/**
+ * @class TraceSpan - records the time from construction to destruction, if tracing was on at construction
+ */
+class TraceSpan {
+public:
+    TraceSpan(const char *name, const char *category) : active(Tracer::enabled()) {
+        if (active) {
+            event.name = name;
+            event.category = category;
+            event.start_ns = Tracer::now_ns();
+        }
+    }
+
+    ~TraceSpan() { finish(); }
+
+    // end the span now rather than at destruction
+    void finish() {
+        if (active) {
+            active = false;
+            event.duration_ns = Tracer::now_ns() - event.start_ns;
+            Tracer::record(event);
+        }
+    }
+
+    void set_detail(const std::string &detail) {
+        if (active)
+            event.detail = detail;
+    }
+
+    TraceSpan(const TraceSpan &other) = delete;
+
+    TraceSpan &operator=(const TraceSpan &other) = delete;
+
+protected:
+    bool active;
+    TraceEvent event;
+};
+
+#ifdef ENGINE_STATS_DISABLED
+#define TRACE_SPAN(name, category) ((void) 0)
+#else
+#define TRACE_SPAN(name, category) TraceSpan trace_span(name, category)
+#endif
+
+bool test_trace();
@@ -0,0 +1,119 @@
+/**
+ * @file   typed_table.cpp
+ * @brief  tests for TypedTable (the template itself is all in typed_table.h)
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "typed_table.h"
+#include <iostream>
+#include <vector>
+using namespace std;
+
+
+/**
+ * The schema the test uses: a TEXT column in the middle, so the columns after it have no fixed offset
+ */
+struct TypedTestSchema {
+    typedef TypedColumns<ColumnAttribute::INT, ColumnAttribute::BIGINT, ColumnAttribute::TEXT, ColumnAttribute::DOUBLE,
+                         ColumnAttribute::BOOLEAN> Columns;
+
+    static ColumnNames column_names() { return {"id", "big", "name", "price", "ok"}; }
+};
+
+static_assert(FieldOffset<TypedTestSchema::Columns, 2>::KNOWN
+              && FieldOffset<TypedTestSchema::Columns, 2>::VALUE == VersionHeader::SIZE + 12,
+              "the columns before the TEXT one have fixed offsets");
+static_assert(!FieldOffset<TypedTestSchema::Columns, 3>::KNOWN, "the columns after the TEXT one do not");
+static_assert(TypedTable<TypedTestSchema>::FIXED_SIZE == VersionHeader::SIZE + 21, "four fixed columns");
+
+// the i-th row of the test
+static TypedTestSchema::Columns::Row typed_test_row(int i) {
+    string name = i % 50 == 7 ? string(3000, (char) ('a' + i % 26)) : "name" + to_string(i);  // some out of line
+    return TypedTestSchema::Columns::Row(i, (int64_t) i * 3000000000LL, name, i / 4.0, (u_int8_t) (i % 2));
+}
+
+/**
+ * Fill a table through TypedTable and check what both it and the generic interface read back
+ * @param layout  the table's page layout
+ * @return true if testing succeeded, false otherwise
+ */
+static bool test_typed_layout(HeapTable::PageLayout layout) {
+    const int NUM_ROWS = 500;
+    typedef TypedTable<TypedTestSchema> Table;
+    bool ok = true;
+    Table table("_test_typed");
+    table.set_layout(layout);
+    table.create();
+    Handles handles;
+    for (int i = 0; i < NUM_ROWS; i++)
+        handles.push_back(table.insert(typed_test_row(i)));
+    // rows written the generic way read back typed, too
+    ValueDict values;
+    values["id"] = Value(NUM_ROWS);
+    values["big"] = Value(-1);
+    values["name"] = Value("generic");
+    values["price"] = Value::real(0.5);
+    values["ok"] = Value::boolean(true);
+    handles.push_back(table.insert(&values));
+
+    int expected = 0;
+    table.scan([&](Handle handle, const Table::Row &row) {
+        if (expected > NUM_ROWS) {
+            expected++;
+            return;
+        }
+        Table::Row want = expected < NUM_ROWS ? typed_test_row(expected)
+                                              : Table::Row(NUM_ROWS, -1, "generic", 0.5, (u_int8_t) 1);
+        if (row != want || handle != handles[expected]) {
+            cout << "FAILED TEST: typed scan row " << expected << " is " << get<0>(row) << ", " << get<2>(row) << endl;
+            ok = false;
+        }
+        expected++;
+    });
+    if (expected != NUM_ROWS + 1) {
+        cout << "FAILED TEST: typed scan visited " << expected << " rows" << endl;
+        ok = false;
+    }
+
+    for (int i: {0, 7, 123, NUM_ROWS - 1}) {
+        Table::Row row;
+        table.project(handles[i], row);
+        ValueDict *generic = table.project(handles[i]);
+        Table::Row want = typed_test_row(i);
+        if (row != want || table.project<0>(handles[i]) != i || table.project<2>(handles[i]) != get<2>(want)
+            || table.project<4>(handles[i]) != i % 2 || (*generic)["big"].l != get<1>(want)
+            || (*generic)["name"].s != get<2>(want) || (*generic)["price"].d != get<3>(want)) {
+            cout << "FAILED TEST: typed project of row " << i << endl;
+            ok = false;
+        }
+        delete generic;
+    }
+
+    // typed rows see deletes and updates made through HeapTable
+    table.del(handles[1]);
+    ValueDict rename;
+    rename["name"] = Value("renamed");
+    table.update(handles[2], &rename);
+    size_t renamed = 0;
+    size_t visited = table.scan([&](Handle, const Table::Row &row) {
+        if (get<0>(row) == 1)
+            ok = false;
+        if (get<0>(row) == 2 && get<2>(row) == "renamed")
+            renamed++;
+    });
+    if (visited != NUM_ROWS || renamed != 1) {
+        cout << "FAILED TEST: typed scan after delete and update (" << visited << " rows)" << endl;
+        ok = false;
+    }
+    table.drop();
+    return ok;
+}
+
+/**
+ * Testing function for TypedTable.
+ * Typed inserts (some with TEXT out of line), scan, project of rows and of single columns, in both layouts,
+ * checked against the generic HeapTable interface on the same table.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_typed_table() {
+    return test_typed_layout(HeapTable::ROW) && test_typed_layout(HeapTable::PAX);
+}
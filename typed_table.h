@@ -0,0 +1,388 @@
+/**
+ * @file   typed_table.h
+ * @brief  HeapTables whose schema is known at compile time: rows are tuples, marshaled without lookups
+ *
+ * A program that embeds the engine and knows a table's columns when it is compiled describes them once:
+ *
+ *     struct Events {
+ *         typedef TypedColumns<ColumnAttribute::INT, ColumnAttribute::TEXT, ColumnAttribute::TIMESTAMP> Columns;
+ *         static ColumnNames column_names() { return {"id", "note", "at"}; }
+ *     };
+ *     TypedTable<Events> events("events");
+ *     events.insert(Events::Columns::Row(1, "started", 1590932700000000));
+ *
+ * and gets insert, scan and project on std::tuple rows (each column as its codec's native type: int32_t, std::string,
+ * int64_t, double, u_int8_t for BOOLEAN, int32_t days for DATE, int64_t microseconds for TIMESTAMP). The record
+ * layout is HeapTable's marshal format, so the same table can be used through HeapTable and SQL as well; the
+ * difference is that each field's codec, and the offset of every column not after a TEXT one, is fixed when the
+ * template is instantiated: no ColumnNames lookups, no ValueDict, no checks of a value's type.
+ *
+ * TypedField: one column type's reads and writes
+ * TypedColumns: the column types of a schema, and its Row type
+ * TypedTable: a HeapTable with typed insert, scan and project
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <tuple>
+#include "arena.h"
+#include "column_codec.h"
+#include "engine_stats.h"
+#include "heap_storage.h"
+#include "mvcc.h"
+#include "trace.h"
+#include "wal.h"
+
+/**
+ * @class TypedField - a fixed-width column type in marshal format (a TEXT column is specialized below)
+ */
+template<ColumnAttribute::DataType TYPE>
+struct TypedField {
+    typedef typename ColumnCodec<TYPE>::NativeType Native;
+    static const bool FIXED = true;
+    static const uint SIZE = ColumnCodec<TYPE>::SIZE;  // in the record (0 for TEXT)
+
+    static uint size(const Native &) { return SIZE; }
+
+    static bool fits_inline(const Native &, uint) { return true; }
+
+    static void write(const Native &native, char *field) { ColumnCodec<TYPE>::write(native, field); }
+
+    // the field's bytes in the record
+    static uint skip(const char *) { return SIZE; }
+
+    // decode the field; returns its bytes in the record
+    static uint read(const char *field, Native &native, OverflowFile &) {
+        native = ColumnCodec<TYPE>::read(field);
+        return SIZE;
+    }
+
+    static Value value(const Native &native) { return ColumnCodec<TYPE>::make(native); }
+};
+
+/**
+ * @class TypedField<TEXT> - a u16 length and the bytes, or an OverflowPointer to a value stored out of line
+ */
+template<>
+struct TypedField<ColumnAttribute::TEXT> {
+    typedef std::string Native;
+    static const bool FIXED = false;
+    static const uint SIZE = 0;
+
+    static uint size(const Native &text) { return (uint) (sizeof(u_int16_t) + text.length()); }
+
+    // whether the value stays in the row (a longer one goes to the overflow file)
+    static bool fits_inline(const Native &text, uint limit) { return text.length() <= limit; }
+
+    static void write(const Native &text, char *field) {
+        u_int16_t length = (u_int16_t) text.length();
+        memcpy(field, &length, sizeof(length));
+        memcpy(field + sizeof(length), text.data(), text.length());
+    }
+
+    static uint skip(const char *field) {
+        if (OverflowPointer::is_pointer(field))
+            return OverflowPointer::SIZE;
+        u_int16_t length;
+        memcpy(&length, field, sizeof(length));
+        return sizeof(length) + length;
+    }
+
+    static uint read(const char *field, Native &text, OverflowFile &overflow) {
+        if (OverflowPointer::is_pointer(field)) {
+            text = overflow.read(OverflowPointer::read(field));
+            return OverflowPointer::SIZE;
+        }
+        u_int16_t length;
+        memcpy(&length, field, sizeof(length));
+        text.assign(field + sizeof(length), length);
+        return sizeof(length) + length;
+    }
+
+    static Value value(const Native &text) { return Value(text); }
+};
+
+// the type of column I
+template<size_t I, ColumnAttribute::DataType FIRST, ColumnAttribute::DataType... REST>
+struct ColumnTypeAt {
+    static const ColumnAttribute::DataType TYPE = ColumnTypeAt<I - 1, REST...>::TYPE;
+};
+
+template<ColumnAttribute::DataType FIRST, ColumnAttribute::DataType... REST>
+struct ColumnTypeAt<0, FIRST, REST...> {
+    static const ColumnAttribute::DataType TYPE = FIRST;
+};
+
+/**
+ * @class TypedColumns - a schema's column types, in order
+ */
+template<ColumnAttribute::DataType... TYPES>
+struct TypedColumns {
+    typedef std::tuple<typename TypedField<TYPES>::Native...> Row;
+    static const size_t COUNT = sizeof...(TYPES);
+
+    template<size_t I>
+    struct Column {
+        static const ColumnAttribute::DataType TYPE = ColumnTypeAt<I, TYPES...>::TYPE;
+        typedef TypedField<TYPE> Field;
+        typedef typename Field::Native Native;
+    };
+
+    static ColumnAttributes attributes() { return ColumnAttributes{ColumnAttribute(TYPES)...}; }
+};
+
+/**
+ * @class FieldOffset - where column I starts in a record (version header included). KNOWN unless a TEXT column comes
+ *      before it, in which case value is where it would start if every TEXT value before it were empty.
+ */
+template<typename Columns, size_t I>
+struct FieldOffset {
+    typedef typename Columns::template Column<I - 1>::Field Previous;
+    static const uint VALUE = FieldOffset<Columns, I - 1>::VALUE + Previous::SIZE;
+    static const bool KNOWN = FieldOffset<Columns, I - 1>::KNOWN && Previous::FIXED;
+
+    static uint of(const char *record) {
+        if (KNOWN)
+            return VALUE;
+        uint previous = FieldOffset<Columns, I - 1>::of(record);
+        return previous + Previous::skip(record + previous);
+    }
+};
+
+template<typename Columns>
+struct FieldOffset<Columns, 0> {
+    static const uint VALUE = VersionHeader::SIZE;
+    static const bool KNOWN = true;
+
+    static uint of(const char *) { return VALUE; }
+};
+
+/**
+ * @class RowCodec - a whole Row from column I on, one field after another (unrolled at compile time)
+ */
+template<typename Columns, size_t I = 0, bool END = (I == Columns::COUNT)>
+struct RowCodec {
+    typedef typename Columns::Row Row;
+    typedef typename Columns::template Column<I>::Field Field;
+    typedef RowCodec<Columns, I + 1> Next;
+
+    // the bytes of the row's TEXT fields (the fixed ones take FieldOffset<Columns, COUNT>::VALUE in all)
+    static uint variable_size(const Row &row) {
+        return (Field::FIXED ? 0 : Field::size(std::get<I>(row))) + Next::variable_size(row);
+    }
+
+    static bool fits_inline(const Row &row, uint limit) {
+        return Field::fits_inline(std::get<I>(row), limit) && Next::fits_inline(row, limit);
+    }
+
+    static void write(const Row &row, char *record, uint offset) {
+        Field::write(std::get<I>(row), record + offset);
+        Next::write(row, record, offset + Field::size(std::get<I>(row)));
+    }
+
+    // returns the offset just past the row
+    static uint read(const char *record, uint offset, Row &row, OverflowFile &overflow) {
+        offset += Field::read(record + offset, std::get<I>(row), overflow);
+        return Next::read(record, offset, row, overflow);
+    }
+
+    static void to_values(const Row &row, const ColumnNames &column_names, ValueDict &values) {
+        values[column_names[I]] = Field::value(std::get<I>(row));
+        Next::to_values(row, column_names, values);
+    }
+};
+
+template<typename Columns, size_t I>
+struct RowCodec<Columns, I, true> {
+    typedef typename Columns::Row Row;
+
+    static uint variable_size(const Row &) { return 0; }
+
+    static bool fits_inline(const Row &, uint) { return true; }
+
+    static void write(const Row &, char *, uint) {}
+
+    static uint read(const char *, uint offset, Row &, OverflowFile &) { return offset; }
+
+    static void to_values(const Row &, const ColumnNames &, ValueDict &) {}
+};
+
+/**
+ * @class TypedTable - a HeapTable of a schema known at compile time, with typed insert, scan and project
+ *
+ *      Schema has a Columns typedef (a TypedColumns) and a static column_names(). Rows are Schema::Columns::Row
+ *      tuples, marshaled and unmarshaled by RowCodec in HeapTable's format; a row with a TEXT value too long to
+ *      stay in it is inserted through HeapTable::insert, which puts the value out of line. The generic HeapTable
+ *      interface still works on the same table. Nothing checks that an existing table's file has this schema:
+ *      open it only with the one it was created with.
+ */
+template<typename Schema>
+class TypedTable : public HeapTable {
+public:
+    typedef typename Schema::Columns Columns;
+    typedef typename Columns::Row Row;
+    typedef RowCodec<Columns> Codec;
+
+    // a record's size without its TEXT values
+    static const uint FIXED_SIZE = FieldOffset<Columns, Columns::COUNT>::VALUE;
+
+    explicit TypedTable(Identifier table_name, uint page_size = DbBlock::BLOCK_SZ)
+            : HeapTable(table_name, Schema::column_names(), Columns::attributes(), page_size) {}
+
+    virtual ~TypedTable() {}
+
+    using HeapTable::insert;
+    using HeapTable::project;
+
+    // insert a row; its fields are written straight into the record
+    virtual Handle insert(const Row &row) {
+        this->open();
+        uint page_size = this->file.get_page_size();
+        uint size = FIXED_SIZE + Codec::variable_size(row);
+        if (!Codec::fits_inline(row, inline_text_limit(page_size)) || size > this->file.max_record_size()) {
+            // TEXT goes out of line: HeapTable::marshal decides which
+            ValueDict values;
+            Codec::to_values(row, this->column_names, values);
+            return HeapTable::insert(&values);
+        }
+        STATS_TIMER(INSERT_TIME);
+        TRACE_SPAN("TypedTable::insert", "storage");
+        ArenaScope row_scope;
+        VersionWrite write;
+        DurableWrite durable;
+        char *record = (char *) row_scope.get_arena().allocate(size);
+        VersionHeader header;
+        header.begin = write.get_stamp();
+        header.end = 0;
+        header.write(record);
+        Codec::write(row, record, VersionHeader::SIZE);
+        STATS_COUNT(MARSHAL_BYTES, size - VersionHeader::SIZE);
+        Dbt data(record, size);
+        Handle handle = this->append(&data);
+        STATS_COUNT(ROWS_INSERTED, 1);
+        return handle;
+    }
+
+    /**
+     * Call visit(handle, row) for every row this thread's snapshot sees, in block order.
+     * @param visit  called with a Handle and a const Row & (the same Row object, refilled for each row)
+     * @return       the number of rows visited
+     */
+    template<typename Visitor>
+    size_t scan(Visitor visit) {
+        STATS_TIMER(SELECT_TIME);
+        TRACE_SPAN("TypedTable::scan", "storage");
+        this->open();
+        Snapshot snapshot;
+        Row row;
+        size_t visited = 0;
+        BlockIDs *block_ids = this->file.block_ids();
+        try {
+            for (auto const &block_id: *block_ids) {
+                ArenaScope page_scope;
+                SlottedPage *block;
+                {
+                    PageLatch latch(this->file, block_id, false);
+                    block = this->file.get(block_id, page_scope.get_arena());
+                }
+                RecordIDs *record_ids = block->ids();
+                Dbt *data = nullptr;
+                try {
+                    for (auto const &record_id: *record_ids) {
+                        data = block->get(record_id);
+                        const char *record = (const char *) data->get_data();
+                        if (snapshot.visible(VersionHeader::read(record))) {
+                            Codec::read(record, VersionHeader::SIZE, row, this->overflow);
+                            visit(Handle(block_id, record_id), (const Row &) row);
+                            visited++;
+                        }
+                        delete data;
+                        data = nullptr;
+                    }
+                } catch (...) {
+                    delete data;
+                    delete record_ids;
+                    delete block;
+                    throw;
+                }
+                delete record_ids;
+                delete block;
+            }
+        } catch (...) {
+            delete block_ids;
+            throw;
+        }
+        delete block_ids;
+        STATS_COUNT(ROWS_SELECTED, visited);
+        return visited;
+    }
+
+    // the row at handle
+    virtual void project(Handle handle, Row &row) {
+        STATS_TIMER(PROJECT_TIME);
+        STATS_COUNT(ROWS_PROJECTED, 1);
+        TRACE_SPAN("TypedTable::project", "storage");
+        ArenaScope page_scope;
+        Dbt *data = nullptr;
+        SlottedPage *block = get_record(handle, page_scope.get_arena(), data);
+        try {
+            uint end = Codec::read((const char *) data->get_data(), VersionHeader::SIZE, row, this->overflow);
+            STATS_COUNT(UNMARSHAL_BYTES, end - VersionHeader::SIZE);
+            (void) end;  // unused when the counters are compiled out
+        } catch (...) {
+            delete data;
+            delete block;
+            throw;
+        }
+        delete data;
+        delete block;
+    }
+
+    // column I of the row at handle; the other fields are not decoded (nor even located, before a TEXT column)
+    template<size_t I>
+    typename Columns::template Column<I>::Native project(Handle handle) {
+        typedef typename Columns::template Column<I>::Field Field;
+        STATS_TIMER(PROJECT_TIME);
+        STATS_COUNT(ROWS_PROJECTED, 1);
+        TRACE_SPAN("TypedTable::project", "storage");
+        ArenaScope page_scope;
+        Dbt *data = nullptr;
+        SlottedPage *block = get_record(handle, page_scope.get_arena(), data);
+        typename Field::Native native;
+        try {
+            const char *record = (const char *) data->get_data();
+            uint size = Field::read(record + FieldOffset<Columns, I>::of(record), native, this->overflow);
+            STATS_COUNT(UNMARSHAL_BYTES, size);
+            (void) size;
+        } catch (...) {
+            delete data;
+            delete block;
+            throw;
+        }
+        delete data;
+        delete block;
+        return native;
+    }
+
+protected:
+    // the page holding handle's record (its bytes in arena) and, in data, the record (both freed by the caller)
+    SlottedPage *get_record(Handle handle, Arena &arena, Dbt *&data) {
+        this->open();
+        SlottedPage *block;
+        {
+            PageLatch latch(this->file, handle.first, false);
+            block = this->file.get(handle.first, arena);
+        }
+        data = block->get(handle.second);
+        if (data == nullptr) {
+            delete block;
+            throw DbRelationError("no such record");
+        }
+        return block;
+    }
+};
+
+bool test_typed_table();
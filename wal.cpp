@@ -0,0 +1,591 @@
+/**
+ * @file   wal.cpp
+ * @brief  the implementation file for WriteAheadLog and DurableWrite
+ * @authors Ethan Guttman, XingZheng
+ */
+#include "wal.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "fnv_hash.h"
+#include "heap_storage.h"
+using namespace std;
+
+
+/**
+ * The log. Records go into pending until a committer's leader writes them out; appended and flushed count
+ * bytes ever logged and ever on disk (they only grow, so they order records across checkpoints), while
+ * file_bytes is the size of the log file itself. imaged holds the pages whose image has been logged since
+ * the last checkpoint. The checkpoint lock is shared by writes in progress and exclusive for a checkpoint.
+ * Once a write or sync of the log fails, failure says why and every commit after it throws WalError (what
+ * reached disk is unknown) until the log is closed and opened again.
+ */
+struct LogState {
+    mutex lock;
+    condition_variable flushed_cv;
+    atomic<bool> enabled;
+    int fd = -1;
+    string path;
+    string pending;
+    u_int64_t appended = 0;
+    u_int64_t flushed = 0;
+    u_int64_t file_bytes = 0;
+    bool flushing = false;
+    string failure;
+    set<pair<string, BlockID>> imaged;
+    WalStats stats;
+    pthread_rwlock_t checkpoint_lock;
+    mutex files_lock;
+    set<HeapFile *> files;
+
+    LogState() : enabled(false) {
+        pthread_rwlockattr_t attributes;
+        pthread_rwlockattr_init(&attributes);
+        // a steady stream of writes must not hold a checkpoint off forever
+        pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+        pthread_rwlock_init(&checkpoint_lock, &attributes);
+        pthread_rwlockattr_destroy(&attributes);
+    }
+};
+
+// never destroyed, so tables written during static destruction are safe
+static LogState &log_state() {
+    static LogState *state = new LogState();
+    return *state;
+}
+
+// how far into the log this thread's last record goes, and how far it went at the thread's last commit
+static thread_local u_int64_t last_logged = 0;
+static thread_local u_int64_t last_committed = 0;
+
+// how many DurableWrites are in scope on this thread (only the outermost locks and commits)
+static thread_local uint durable_depth = 0;
+
+template<typename T>
+static void put_value(string &out, T value) {
+    out.append((const char *) &value, sizeof(value));
+}
+
+template<typename T>
+static bool get_value(const char *&in, const char *end, T &value) {
+    if (end - in < (ptrdiff_t) sizeof(value))
+        return false;
+    memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return true;
+}
+
+/**
+ * Append a record to the pending log. Each is [u32 body size][u32 checksum of body][body], with the body
+ * [u8 type][u16 name length][name][u32 block id][u16 record id][u32 payload size][payload].
+ */
+static void append_record(LogState &state, WriteAheadLog::RecordType type, const string &file, BlockID block_id,
+                          RecordID record_id, const void *payload, u_int32_t payload_size) {
+    string body;
+    body.reserve(1 + 2 + file.size() + 4 + 2 + 4 + payload_size);
+    put_value(body, (u_int8_t) type);
+    put_value(body, (u_int16_t) file.size());
+    body.append(file);
+    put_value(body, (u_int32_t) block_id);
+    put_value(body, (u_int16_t) record_id);
+    put_value(body, payload_size);
+    body.append((const char *) payload, payload_size);
+
+    lock_guard<mutex> guard(state.lock);
+    put_value(state.pending, (u_int32_t) body.size());
+    put_value(state.pending, fnv1a(body.data(), body.size()));  // finds a record torn by a crash
+    state.pending.append(body);
+    state.appended += 2 * sizeof(u_int32_t) + body.size();
+    state.stats.records++;
+    state.stats.bytes += 2 * sizeof(u_int32_t) + body.size();
+    last_logged = state.appended;
+}
+
+// whether this is the page's first change since the last checkpoint (so it must be logged whole)
+static bool first_change(LogState &state, const string &file, BlockID block_id) {
+    lock_guard<mutex> guard(state.lock);
+    return state.imaged.insert(make_pair(file, block_id)).second;
+}
+
+static void write_fully(int fd, const string &bytes) {
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = ::write(fd, bytes.data() + done, bytes.size() - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            throw WalError(string("write-ahead log write failed: ") + strerror(errno));
+        }
+        done += n;
+    }
+}
+
+/**
+ * Wait until the log is on disk through upto. One waiter at a time is the leader: it takes every record
+ * pending, writes and syncs them with the lock released (so more records and committers can gather for
+ * the next flush), then wakes everyone it covered. If the write or sync fails, the log is marked failed and
+ * the leader and everyone waiting throw.
+ * @param lock  holds state.lock
+ * @throws      WalError if the log has failed
+ */
+static void flush_locked(LogState &state, unique_lock<mutex> &lock, u_int64_t upto) {
+    while (state.flushed < upto) {
+        if (!state.failure.empty()) {
+            state.pending.clear();
+            throw WalError(state.failure);
+        }
+        if (state.flushing) {
+            state.flushed_cv.wait(lock);
+            continue;
+        }
+        state.flushing = true;
+        string batch;
+        batch.swap(state.pending);
+        u_int64_t target = state.appended;
+        int fd = state.fd;
+        lock.unlock();
+        try {
+            write_fully(fd, batch);
+            if (fdatasync(fd) != 0)
+                throw WalError(string("write-ahead log sync failed: ") + strerror(errno));
+        } catch (WalError &e) {
+            lock.lock();
+            state.failure = e.what();
+            state.pending.clear();  // never written now
+            state.flushing = false;
+            state.flushed_cv.notify_all();
+            throw;
+        }
+        lock.lock();
+        state.flushed = target;
+        state.file_bytes += batch.size();
+        state.flushing = false;
+        state.stats.flushes++;
+        state.flushed_cv.notify_all();
+    }
+}
+
+// checkpoint, unless the log has grown no bigger than limit
+static void checkpoint_over(u_int64_t limit) {
+    LogState &state = log_state();
+    pthread_rwlock_wrlock(&state.checkpoint_lock);
+    {
+        unique_lock<mutex> lock(state.lock);
+        if (state.fd < 0 || state.file_bytes + state.pending.size() <= limit) {
+            lock.unlock();
+            pthread_rwlock_unlock(&state.checkpoint_lock);
+            return;
+        }
+        // no write is in progress: everything logged is also in the tables, once they are synced
+        try {
+            flush_locked(state, lock, state.appended);
+        } catch (WalError &e) {
+            lock.unlock();
+            pthread_rwlock_unlock(&state.checkpoint_lock);
+            throw;
+        }
+    }
+    {
+        lock_guard<mutex> guard(state.files_lock);
+        for (auto file: state.files)
+            file->sync();
+    }
+    {
+        lock_guard<mutex> guard(state.lock);
+        if (ftruncate(state.fd, 0) != 0)
+            cerr << "write-ahead log truncate failed: " << strerror(errno) << endl;
+        state.file_bytes = 0;
+        state.imaged.clear();
+        state.stats.checkpoints++;
+    }
+    pthread_rwlock_unlock(&state.checkpoint_lock);
+}
+
+/**
+ * Testing function for the write-ahead log.
+ * A table's writes are replayed from the log after its file is lost, replay stops at a torn record, and
+ * concurrent committers share fsyncs, and a log that cannot be written fails its committers.
+ * @return true if testing succeeded, false otherwise
+ */
+bool test_wal() {
+    const string path = "_test_wal_cpp.wal";
+    remove(path.c_str());
+    ColumnNames column_names;
+    column_names.push_back("a");
+    column_names.push_back("b");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("_test_wal_cpp", column_names, column_attributes);
+    auto failed = [&](string message) {
+        cout << "FAILED TEST: " << message << endl;
+        if (WriteAheadLog::enabled())
+            WriteAheadLog::close(false);
+        table.drop();
+        remove(path.c_str());
+        return false;
+    };
+    // the table's rows as a -> b
+    auto contents = [&table]() {
+        map<int, string> rows;
+        Handles *handles = table.select();
+        for (auto const &handle: *handles) {
+            ValueDict *row = table.project(handle);
+            rows[(*row)["a"].n] = (*row)["b"].s;
+            delete row;
+        }
+        delete handles;
+        return rows;
+    };
+
+    WriteAheadLog::open(path);
+    table.create();
+    ValueDict row;
+    string padding(200, 'x');
+    for (int a = 1; a <= 50; a++) {  // enough to spill into a second block
+        row["a"] = Value(a);
+        row["b"] = Value(a % 2 ? padding : "even");
+        table.insert(&row);
+    }
+    Handles *handles = table.select();
+    ValueDict changes;
+    changes["b"] = Value("changed");
+    table.update((*handles)[0], &changes);
+    table.del((*handles)[1]);
+    delete handles;
+    map<int, string> expected = contents();
+    if (WriteAheadLog::stats().flushes == 0)
+        return failed("nothing was flushed to the log");
+
+    // crash: the log survives but the table's file does not
+    WriteAheadLog::close(false);
+    table.close();
+    {
+        Db db(_DB_ENV, 0);
+        db.remove("_test_wal_cpp.db", nullptr, 0);
+    }
+    {
+        ofstream torn(path, ios::app | ios::binary);
+        torn << "\x40\x00\x00\x00garbage";
+    }
+    size_t replayed = WriteAheadLog::recover(path);
+    if (replayed < 53)
+        return failed("only " + to_string(replayed) + " records replayed");
+    if (contents() != expected)
+        return failed("recovered table differs from the one logged");
+
+    // committers on several threads share fsyncs
+    WriteAheadLog::open(path);
+    u_int64_t flushes_before = WriteAheadLog::stats().flushes;
+    u_int64_t commits_before = WriteAheadLog::stats().commits;
+    vector<thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.push_back(thread([&table, t]() {
+            ValueDict values;
+            for (int i = 0; i < 25; i++) {
+                values["a"] = Value(1000 + t * 100 + i);
+                values["b"] = Value("concurrent");
+                table.insert(&values);
+            }
+        }));
+    for (auto &t: threads)
+        t.join();
+    WalStats stats = WriteAheadLog::stats();
+    if (stats.commits - commits_before != 200)
+        return failed(to_string(stats.commits - commits_before) + " commits, expected 200");
+    if (stats.flushes - flushes_before > 200)
+        return failed("more fsyncs than commits");
+    WriteAheadLog::checkpoint();
+    if (WriteAheadLog::stats().checkpoints == 0)
+        return failed("checkpoint did not run");
+    WriteAheadLog::close();
+    if (contents().size() != expected.size() + 200)
+        return failed("rows lost across a checkpoint");
+
+    // a log that cannot be written fails every commit (and close) instead of ending the process
+    WriteAheadLog::open("/dev/full");
+    int commit_errors = 0;
+    for (int a = 0; a < 2; a++) {
+        try {
+            row["a"] = Value(2000 + a);
+            table.insert(&row);
+        } catch (DbRelationError &e) {
+            commit_errors++;
+        }
+    }
+    try {
+        WriteAheadLog::close(false);
+    } catch (WalError &e) {
+        commit_errors++;
+    }
+    if (commit_errors != 3)
+        return failed(to_string(commit_errors) + " of 3 writes to a full log failed");
+    table.drop();
+    remove(path.c_str());
+    return true;
+}
+
+
+/*****************************************WriteAheadLog************************************************************/
+
+bool WriteAheadLog::enabled() {
+    return log_state().enabled;
+}
+
+void WriteAheadLog::open(const string &path) {
+    LogState &state = log_state();
+    lock_guard<mutex> guard(state.lock);
+    if (state.fd >= 0)
+        return;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        throw WalError("cannot open write-ahead log " + path + ": " + strerror(errno));
+    state.fd = fd;
+    state.path = path;
+    state.file_bytes = lseek(fd, 0, SEEK_END);
+    state.failure.clear();
+    state.imaged.clear();
+    state.stats = WalStats();
+    state.enabled = true;
+}
+
+void WriteAheadLog::close(bool checkpoint) {
+    LogState &state = log_state();
+    string failure;
+    if (checkpoint) {
+        try {
+            checkpoint_over(0);
+        } catch (WalError &e) {
+            failure = e.what();
+        }
+    }
+    pthread_rwlock_wrlock(&state.checkpoint_lock);
+    {
+        unique_lock<mutex> lock(state.lock);
+        if (state.fd >= 0) {
+            try {
+                flush_locked(state, lock, state.appended);
+            } catch (WalError &e) {
+                failure = e.what();
+            }
+            ::close(state.fd);
+            state.fd = -1;
+        }
+        state.enabled = false;
+    }
+    pthread_rwlock_unlock(&state.checkpoint_lock);
+    if (!failure.empty())
+        throw WalError(failure);
+}
+
+/**
+ * Redo. Records are replayed in order up to the first that is cut short or fails its checksum (the end of
+ * the last flush before the crash). Every record can be replayed more than once: a page image overwrites
+ * the block, an add is skipped if the block already has that record, and an end stamp is just rewritten.
+ */
+size_t WriteAheadLog::recover(const string &path) {
+    ifstream in(path, ios::binary);
+    if (!in)
+        return 0;
+    string log((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+
+    map<string, HeapFile *> files;
+    // a file missing altogether is created with the page size of the image that comes first for it
+    auto file_named = [&files](const string &name, uint page_size) {
+        HeapFile *&file = files[name];
+        if (file == nullptr) {
+            file = new HeapFile(name, page_size);
+            file->open_or_create();
+        }
+        return file;
+    };
+    size_t replayed = 0;
+    const char *in_log = log.data(), *log_end = log.data() + log.size();
+    while (true) {
+        u_int32_t size, sum;
+        if (!get_value(in_log, log_end, size) || !get_value(in_log, log_end, sum) || log_end - in_log < size
+            || fnv1a(in_log, size) != sum)
+            break;
+        const char *body = in_log, *body_end = in_log + size;
+        in_log += size;
+        u_int8_t type = 0;
+        u_int16_t name_size = 0, record_id = 0;
+        u_int32_t block_id = 0, payload_size = 0;
+        string name;
+        if (get_value(body, body_end, type) && get_value(body, body_end, name_size) && body_end - body >= name_size) {
+            name.assign(body, name_size);
+            body += name_size;
+        }
+        if (!get_value(body, body_end, block_id) || !get_value(body, body_end, record_id)
+            || !get_value(body, body_end, payload_size) || body_end - body != payload_size
+            || (type == PAGE_IMAGE && !HeapFile::valid_page_size(payload_size))
+            || (type == END && payload_size != sizeof(TxnStamp)))
+            break;
+        const char *payload = body;
+
+        if (type == DROP) {
+            HeapFile *file = file_named(name, DbBlock::BLOCK_SZ);
+            file->drop();
+            delete file;
+            files.erase(name);
+        } else if (type == PAGE_IMAGE) {
+            char *bytes = new char[payload_size];
+            memcpy(bytes, payload, payload_size);
+            Dbt data(bytes, payload_size);
+            SlottedPage *page = SlottedPage::make(data, block_id, false, true);
+            file_named(name, payload_size)->put(page);
+            delete page;
+        } else {
+            HeapFile *file = file_named(name, DbBlock::BLOCK_SZ);
+            SlottedPage *page = file->get(block_id);
+            if (type == ADD && record_id == page->get_num_records() + 1) {
+                Dbt record((void *) payload, payload_size);
+                page->add(&record);
+                file->put(page);
+            } else if (type == END) {
+                Dbt *record = page->get(record_id);
+                if (record != nullptr) {
+                    TxnStamp stamp;
+                    memcpy(&stamp, payload, sizeof(stamp));
+                    VersionHeader header = VersionHeader::read(record->get_data());
+                    header.end = stamp;
+                    header.write(record->get_data());
+                    page->put(record_id, *record);
+                    delete record;
+                    file->put(page);
+                }
+            }
+            delete page;
+        }
+        replayed++;
+    }
+    for (auto &file: files) {
+        file.second->close();
+        delete file.second;
+    }
+    if (truncate(path.c_str(), 0) != 0)
+        cerr << "write-ahead log truncate failed: " << strerror(errno) << endl;
+    return replayed;
+}
+
+void WriteAheadLog::log_add(const string &file, DbBlock *block, RecordID record_id, const Dbt *record) {
+    LogState &state = log_state();
+    if (!state.enabled)
+        return;
+    if (first_change(state, file, block->get_block_id()))
+        append_record(state, PAGE_IMAGE, file, block->get_block_id(), 0, block->get_data(),
+                  block->get_block()->get_size());
+    else
+        append_record(state, ADD, file, block->get_block_id(), record_id, record->get_data(), record->get_size());
+}
+
+void WriteAheadLog::log_end(const string &file, DbBlock *block, RecordID record_id, TxnStamp stamp) {
+    LogState &state = log_state();
+    if (!state.enabled)
+        return;
+    if (first_change(state, file, block->get_block_id()))
+        append_record(state, PAGE_IMAGE, file, block->get_block_id(), 0, block->get_data(),
+                  block->get_block()->get_size());
+    else
+        append_record(state, END, file, block->get_block_id(), record_id, &stamp, sizeof(stamp));
+}
+
+void WriteAheadLog::log_page(const string &file, DbBlock *block) {
+    LogState &state = log_state();
+    if (!state.enabled)
+        return;
+    first_change(state, file, block->get_block_id());
+    append_record(state, PAGE_IMAGE, file, block->get_block_id(), 0, block->get_data(),
+                  block->get_block()->get_size());
+}
+
+void WriteAheadLog::log_drop(const string &file) {
+    LogState &state = log_state();
+    if (!state.enabled)
+        return;
+    append_record(state, DROP, file, 0, 0, nullptr, 0);
+    lock_guard<mutex> guard(state.lock);
+    for (auto it = state.imaged.begin(); it != state.imaged.end();)
+        it = it->first == file ? state.imaged.erase(it) : ++it;
+}
+
+void WriteAheadLog::commit() {
+    LogState &state = log_state();
+    unique_lock<mutex> lock(state.lock);
+    if (state.fd < 0 || last_logged <= last_committed)
+        return;
+    last_committed = last_logged;
+    state.stats.commits++;
+    flush_locked(state, lock, last_logged);
+}
+
+void WriteAheadLog::checkpoint() {
+    checkpoint_over(0);
+}
+
+void WriteAheadLog::add_file(HeapFile *file) {
+    LogState &state = log_state();
+    lock_guard<mutex> guard(state.files_lock);
+    state.files.insert(file);
+}
+
+void WriteAheadLog::remove_file(HeapFile *file) {
+    LogState &state = log_state();
+    lock_guard<mutex> guard(state.files_lock);
+    state.files.erase(file);
+}
+
+WalStats WriteAheadLog::stats() {
+    LogState &state = log_state();
+    lock_guard<mutex> guard(state.lock);
+    return state.stats;
+}
+
+
+/*****************************************DurableWrite*************************************************************/
+
+DurableWrite::DurableWrite() : active(WriteAheadLog::enabled() && durable_depth == 0) {
+    durable_depth++;
+    if (this->active)
+        pthread_rwlock_rdlock(&log_state().checkpoint_lock);
+}
+
+// the write's records reach disk before it returns (and, with a VersionWrite in an outer scope, before
+// anyone else can see it)
+DurableWrite::~DurableWrite() noexcept(false) {
+    durable_depth--;
+    if (!this->active)
+        return;
+    pthread_rwlock_unlock(&log_state().checkpoint_lock);
+    if (uncaught_exception()) {
+        try {
+            WriteAheadLog::commit();
+        } catch (WalError &e) {
+        }  // the write's own exception is the one to report
+        return;
+    }
+    WriteAheadLog::commit();
+    u_int64_t size;
+    {
+        LogState &state = log_state();
+        lock_guard<mutex> guard(state.lock);
+        size = state.file_bytes;
+    }
+    if (size > WriteAheadLog::CHECKPOINT_BYTES)
+        checkpoint_over(WriteAheadLog::CHECKPOINT_BYTES);
+}
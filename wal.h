@@ -0,0 +1,126 @@
+/**
+ * @file   wal.h
+ * @brief  Write-ahead log for HeapTable changes, with group commit and redo recovery
+ *
+ * In durable mode every change to a page is logged before the write that made it returns. Most records
+ * are physiological: "record r was added to block b of table t" or "record r of block b was ended by
+ * stamp s". The first change to a page after a checkpoint logs the whole page instead, so redo always
+ * starts from an intact page even if a crash tore the page Berkeley DB was writing.
+ *
+ * Committing waits until the log is on disk through the committer's last record. Whoever finds no flush
+ * in progress becomes the leader: it writes out everything appended so far and fsyncs it once for every
+ * committer waiting, while new records keep going into the next batch (group commit).
+ *
+ * A checkpoint syncs every open table and empties the log; one runs when the log grows past
+ * CHECKPOINT_BYTES and on close. recover() replays a log left by a crash onto the tables.
+ *
+ * WriteAheadLog: the log
+ * DurableWrite: brackets one HeapTable write: holds off checkpoints during it and commits at its end
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#pragma once
+
+#include <sys/types.h>
+#include <stdexcept>
+#include <string>
+#include "mvcc.h"
+#include "storage_engine.h"
+
+class HeapFile;
+
+/**
+ * @class WalError - the log cannot be used (a DbRelationError, so a statement whose commit fails reports it)
+ */
+class WalError : public DbRelationError {
+public:
+    explicit WalError(std::string s) : DbRelationError(s) {}
+};
+
+/**
+ * @class WalStats - what the log has done since it was opened
+ */
+struct WalStats {
+    u_int64_t records = 0;
+    u_int64_t bytes = 0;
+    u_int64_t commits = 0;      // writes committed
+    u_int64_t flushes = 0;      // fsyncs of the log (commits / flushes is the mean group size)
+    u_int64_t checkpoints = 0;
+};
+
+/**
+ * @class WriteAheadLog - the log (one per process)
+ */
+class WriteAheadLog {
+public:
+    static const u_int64_t CHECKPOINT_BYTES = 64 << 20;
+
+    enum RecordType {
+        PAGE_IMAGE = 1,  // the whole block
+        ADD = 2,         // SlottedPage::add of the record, which got record_id
+        END = 3,         // the record's version was ended by the stamp in the payload
+        DROP = 4         // the table's file was removed
+    };
+
+    static bool enabled();
+
+    /**
+     * Start logging (durable mode).
+     * @param path  the log file, created if necessary (run recover() on it first)
+     */
+    static void open(const std::string &path);
+
+    // stop logging; with checkpoint, the tables are synced and the log emptied first
+    // (throws WalError, after closing, if the last flush failed)
+    static void close(bool checkpoint = true);
+
+    /**
+     * Replay a log onto the tables, sync them, and empty the log. Call before open(), with no tables open.
+     * @param path  the log file (nothing happens if it doesn't exist)
+     * @return      the number of records replayed
+     */
+    static size_t recover(const std::string &path);
+
+    // log a change to a block, made in memory while holding its exclusive latch but not yet put
+    static void log_add(const std::string &file, DbBlock *block, RecordID record_id, const Dbt *record);
+
+    static void log_end(const std::string &file, DbBlock *block, RecordID record_id, TxnStamp stamp);
+
+    static void log_page(const std::string &file, DbBlock *block);
+
+    static void log_drop(const std::string &file);
+
+    // wait until everything this thread has logged is on disk; throws WalError if the log failed
+    static void commit();
+
+    // sync every open table and empty the log (waits for writes in progress to finish); throws WalError as commit
+    static void checkpoint();
+
+    // the open files a checkpoint has to sync
+    static void add_file(HeapFile *file);
+
+    static void remove_file(HeapFile *file);
+
+    static WalStats stats();
+};
+
+/**
+ * @class DurableWrite - one HeapTable write in durable mode: no checkpoint can start while it is in scope,
+ *      and at the end of its scope it commits (waits for the log to reach disk). Does nothing outside durable mode.
+ *      If the commit fails, the destructor throws WalError, unless the write is already throwing.
+ */
+class DurableWrite {
+public:
+    DurableWrite();
+
+    virtual ~DurableWrite() noexcept(false);
+
+    DurableWrite(const DurableWrite &other) = delete;
+
+    DurableWrite &operator=(const DurableWrite &other) = delete;
+
+protected:
+    bool active;
+};
+
+bool test_wal();
@@ -0,0 +1,283 @@
+/**
+ * @file   workload.cpp
+ * @brief  YCSB-style workload driver for HeapTable: load N rows, then run a weighted mix of operations
+ *
+ * Usage: ./workload_driver [options] [envdir]
+ *      --rows N            rows to load (default 10000)
+ *      --seconds S         how long to run the mix (default 10)
+ *      --mix SPEC          operation weights, e.g. read=50,scan=5,insert=15,update=25,delete=5 (the default)
+ *      --distribution D    uniform or zipfian (default zipfian, theta 0.99)
+ *      --scan-length L     keys covered by one scan (default 100)
+ *      --seed N            random seed (default 42)
+ *      --json              JSON lines instead of TSV
+ *
+ * The table is usertable(ycsb_key INT, field0 TEXT). There is no index yet, so like YCSB's client the driver
+ * keeps each live key's Handle: reads, updates and deletes go straight to the row, while a scan runs
+ * SELECT * ... WHERE ycsb_key >= k AND ycsb_key < k + L (compiled, then a full table pass).
+ * envdir defaults to ./workload_data.
+ *
+ * @authors Ethan Guttman, XingZheng
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <iostream>
+#include <random>
+#include "db_cxx.h"
+#include "SQLParser.h"
+#include "heap_storage.h"
+#include "expr_compiler.h"
+#include "fnv_hash.h"
+#include "latency_recorder.h"
+using namespace std;
+
+DbEnv *_DB_ENV;
+
+typedef LatencyRecorder::Clock Clock;
+
+enum Operation {
+    READ, SCAN, INSERT, UPDATE, DELETE, NUM_OPERATIONS
+};
+static const char *OPERATION_NAMES[] = {"read", "scan", "insert", "update", "delete"};
+
+/**
+ * @class ZipfianGenerator - item numbers in [0, n) with P(i) proportional to 1 / (i+1)^theta
+ *
+ *      Gray et al., "Quickly Generating Billion-Record Synthetic Databases" (as used by YCSB).
+ *      The item count can grow as rows are inserted; zeta is extended incrementally.
+ */
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(u_int64_t n, double theta = 0.99) : theta(theta), zeta_n(0), n(0) {
+        zeta_2 = 1 + pow(0.5, theta);
+        alpha = 1 / (1 - theta);
+        resize(n);
+    }
+
+    void resize(u_int64_t new_n) {
+        for (u_int64_t i = n; i < new_n; i++)
+            zeta_n += 1 / pow((double) i + 1, theta);
+        n = new_n;
+        eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta_2 / zeta_n);
+    }
+
+    u_int64_t next(mt19937_64 &random) {
+        double u = uniform_real_distribution<double>(0, 1)(random);
+        double uz = u * zeta_n;
+        if (uz < 1)
+            return 0;
+        if (uz < zeta_2)
+            return 1;
+        u_int64_t item = (u_int64_t) (n * pow(eta * u - eta + 1, alpha));
+        return item < n ? item : n - 1;
+    }
+
+protected:
+    double theta, zeta_2, alpha, eta, zeta_n;
+    u_int64_t n;
+};
+
+// FNV-1a, so popular zipfian items are spread over the key space instead of clustering at the low keys
+static u_int64_t scramble(u_int64_t x) {
+    return fnv1a(&x, sizeof(x));
+}
+
+static ValueDict make_row(int32_t key, mt19937_64 &random) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+    string field(100, ' ');
+    for (auto &c: field)
+        c = letters[random() % 26];
+    ValueDict row;
+    row["ycsb_key"] = Value(key);
+    row["field0"] = Value(field);
+    return row;
+}
+
+/**
+ * Parse "read=50,scan=5,..." into cumulative weights
+ * @return false if the spec is malformed
+ */
+static bool parse_mix(const string &spec, vector<uint> &weights) {
+    weights.assign(NUM_OPERATIONS, 0);
+    size_t pos = 0;
+    while (pos < spec.length()) {
+        size_t comma = spec.find(',', pos);
+        string item = spec.substr(pos, comma == string::npos ? string::npos : comma - pos);
+        size_t equals = item.find('=');
+        if (equals == string::npos)
+            return false;
+        string name = item.substr(0, equals);
+        uint op = 0;
+        while (op < NUM_OPERATIONS && name != OPERATION_NAMES[op])
+            op++;
+        if (op == NUM_OPERATIONS)
+            return false;
+        weights[op] = (uint) atoi(item.c_str() + equals + 1);
+        pos = comma == string::npos ? spec.length() : comma + 1;
+    }
+    for (uint op = 1; op < NUM_OPERATIONS; op++)
+        weights[op] += weights[op - 1];
+    return weights[NUM_OPERATIONS - 1] > 0;
+}
+
+static int usage() {
+    cerr << "Usage: ./workload_driver [--rows N] [--seconds S] [--mix read=50,scan=5,insert=15,update=25,delete=5]"
+         << endl << "                         [--distribution uniform|zipfian] [--scan-length L] [--seed N] [--json]"
+         << " [envdir]" << endl;
+    return EXIT_FAILURE;
+}
+
+/**
+ * Main entry to the workload driver
+ */
+int main(int argc, char *argv[]) {
+    size_t num_rows = 10000, scan_length = 100;
+    double seconds = 10;
+    string mix = "read=50,scan=5,insert=15,update=25,delete=5", distribution = "zipfian", envdir = "workload_data";
+    u_int64_t seed = 42;
+    bool json = false;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--json")
+            json = true;
+        else if (arg == "--rows" && has_value)
+            num_rows = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seconds" && has_value)
+            seconds = atof(argv[++i]);
+        else if (arg == "--mix" && has_value)
+            mix = argv[++i];
+        else if (arg == "--distribution" && has_value)
+            distribution = argv[++i];
+        else if (arg == "--scan-length" && has_value)
+            scan_length = strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && has_value)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg[0] == '-')
+            return usage();
+        else
+            envdir = arg;
+    }
+    vector<uint> weights;
+    if (!parse_mix(mix, weights) || (distribution != "uniform" && distribution != "zipfian") || num_rows == 0)
+        return usage();
+
+    mkdir(envdir.c_str(), 0755);
+    DbEnv *env = new DbEnv(0U);
+    env->set_error_stream(&cerr);
+    try {
+        env->open(envdir.c_str(), DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+    } catch (DbException &e) {
+        cerr << "workload_driver: create db env error: " << e.what() << endl;
+        return EXIT_FAILURE;
+    }
+    _DB_ENV = env;
+
+    ColumnNames column_names;
+    column_names.push_back("ycsb_key");
+    column_names.push_back("field0");
+    ColumnAttributes column_attributes;
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::INT));
+    column_attributes.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    HeapTable table("usertable", column_names, column_attributes);
+    table.create();
+
+    // load phase: key i lives at handles[i]; deleted keys are marked with block 0
+    mt19937_64 random(seed);
+    vector<Handle> handles;
+    LatencyRecorder load;
+    for (size_t i = 0; i < num_rows; i++) {
+        ValueDict row = make_row((int32_t) i, random);
+        Clock::time_point start = Clock::now();
+        handles.push_back(table.insert(&row));
+        load.record(start);
+    }
+    BenchmarkReporter reporter(cout, json);
+    reporter.report("load", load);
+
+    // run phase
+    ZipfianGenerator zipfian(num_rows);
+    auto choose_key = [&]() -> size_t {
+        if (distribution == "uniform")
+            return uniform_int_distribution<size_t>(0, handles.size() - 1)(random);
+        return scramble(zipfian.next(random)) % handles.size();
+    };
+    vector<LatencyRecorder> latencies(NUM_OPERATIONS);
+    size_t missing = 0, conflicts = 0;
+    Clock::time_point begin = Clock::now();
+    Clock::time_point deadline = begin + chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+    while (Clock::now() < deadline) {
+        uint pick = (uint) (random() % weights[NUM_OPERATIONS - 1]);
+        uint op = 0;
+        while (pick >= weights[op])
+            op++;
+        size_t key = op == INSERT ? handles.size() : choose_key();
+        if ((op == READ || op == UPDATE || op == DELETE) && handles[key].first == 0) {
+            missing++;  // deleted earlier; YCSB counts these as NOT_FOUND
+            continue;
+        }
+        ValueDict row = op == INSERT || op == UPDATE ? make_row((int32_t) key, random) : ValueDict();
+        hsql::SQLParserResult *scan = nullptr;
+        if (op == SCAN) {
+            string sql = "SELECT * FROM usertable WHERE ycsb_key >= " + to_string(key) + " AND ycsb_key < "
+                         + to_string(key + scan_length);
+            scan = hsql::SQLParser::parseSQLString(sql);
+        }
+        Clock::time_point start = Clock::now();
+        switch (op) {
+            case READ:
+                delete table.project(handles[key]);
+                break;
+            case SCAN: {
+                CompiledPredicate *predicate = ExprCompiler::compile(
+                        ((const hsql::SelectStatement *) scan->getStatement(0))->whereClause,
+                        column_names, column_attributes);
+                Handles *matches = table.select(predicate);
+                for (auto const &handle: *matches)
+                    delete table.project(handle);
+                delete matches;
+                delete predicate;
+                break;
+            }
+            case INSERT:
+                handles.push_back(table.insert(&row));
+                zipfian.resize(handles.size());
+                break;
+            case UPDATE:
+                row.erase("ycsb_key");
+                try {
+                    handles[key] = table.update(handles[key], &row);  // the new version may be in another block
+                } catch (DbRelationError &e) {
+                    conflicts++;
+                }
+                break;
+            case DELETE:
+                table.del(handles[key]);
+                handles[key] = Handle(0, 0);
+                break;
+        }
+        latencies[op].record(start);
+        delete scan;
+    }
+    double elapsed = chrono::duration<double>(Clock::now() - begin).count();
+
+    LatencyRecorder total;
+    for (uint op = 0; op < NUM_OPERATIONS; op++) {
+        if (latencies[op].count() == 0)
+            continue;
+        reporter.report(OPERATION_NAMES[op], latencies[op], elapsed);
+        total.merge(latencies[op]);
+    }
+    reporter.report("total/" + distribution, total, elapsed);
+    if (missing)
+        cerr << "workload_driver: " << missing << " operations picked an already deleted key" << endl;
+    if (conflicts)
+        cerr << "workload_driver: " << conflicts << " updates conflicted" << endl;
+
+    table.drop();
+    env->close(0U);
+    delete env;
+    return EXIT_SUCCESS;
+}